@@ -149,23 +149,35 @@ HEADERS += $${VAULT_BASE}/source/files/vfilewriter.h
 SOURCES += $${VAULT_BASE}/source/files/vfilewriter.cpp
 HEADERS += $${VAULT_BASE}/source/files/vfsnode.h
 SOURCES += $${VAULT_BASE}/source/files/vfsnode.cpp
+HEADERS += $${VAULT_BASE}/source/server/vbroadcastmessage.h
+SOURCES += $${VAULT_BASE}/source/server/vbroadcastmessage.cpp
 HEADERS += $${VAULT_BASE}/source/server/vclientsession.h
 SOURCES += $${VAULT_BASE}/source/server/vclientsession.cpp
+HEADERS += $${VAULT_BASE}/source/server/vclientsessionstats.h
+SOURCES += $${VAULT_BASE}/source/server/vclientsessionstats.cpp
 HEADERS += $${VAULT_BASE}/source/server/vlistenersocket.h
 SOURCES += $${VAULT_BASE}/source/server/vlistenersocket.cpp
 HEADERS += $${VAULT_BASE}/source/server/vlistenerthread.h
 SOURCES += $${VAULT_BASE}/source/server/vlistenerthread.cpp
+HEADERS += $${VAULT_BASE}/source/server/vlockfreemessagequeue.h
+SOURCES += $${VAULT_BASE}/source/server/vlockfreemessagequeue.cpp
 HEADERS += $${VAULT_BASE}/source/server/vmanagementinterface.h
 HEADERS += $${VAULT_BASE}/source/server/vmessage.h
 SOURCES += $${VAULT_BASE}/source/server/vmessage.cpp
+HEADERS += $${VAULT_BASE}/source/server/vmessagedispatcher.h
+SOURCES += $${VAULT_BASE}/source/server/vmessagedispatcher.cpp
 HEADERS += $${VAULT_BASE}/source/server/vmessagehandler.h
 SOURCES += $${VAULT_BASE}/source/server/vmessagehandler.cpp
 HEADERS += $${VAULT_BASE}/source/server/vmessageinputthread.h
 SOURCES += $${VAULT_BASE}/source/server/vmessageinputthread.cpp
 HEADERS += $${VAULT_BASE}/source/server/vmessageoutputthread.h
 SOURCES += $${VAULT_BASE}/source/server/vmessageoutputthread.cpp
+HEADERS += $${VAULT_BASE}/source/server/vmessagepool.h
+SOURCES += $${VAULT_BASE}/source/server/vmessagepool.cpp
 HEADERS += $${VAULT_BASE}/source/server/vmessagequeue.h
 SOURCES += $${VAULT_BASE}/source/server/vmessagequeue.cpp
+HEADERS += $${VAULT_BASE}/source/server/vmessagereactor.h
+SOURCES += $${VAULT_BASE}/source/server/vmessagereactor.cpp
 HEADERS += $${VAULT_BASE}/source/server/vserver.h
 SOURCES += $${VAULT_BASE}/source/server/vserver.cpp
 HEADERS += $${VAULT_BASE}/source/sockets/vsocket.h
@@ -183,6 +195,8 @@ HEADERS += $${VAULT_BASE}/source/streams/viostream.h
 SOURCES += $${VAULT_BASE}/source/streams/viostream.cpp
 HEADERS += $${VAULT_BASE}/source/streams/vmemorystream.h
 SOURCES += $${VAULT_BASE}/source/streams/vmemorystream.cpp
+HEADERS += $${VAULT_BASE}/source/streams/vreadbufferedstream.h
+SOURCES += $${VAULT_BASE}/source/streams/vreadbufferedstream.cpp
 HEADERS += $${VAULT_BASE}/source/streams/vstream.h
 SOURCES += $${VAULT_BASE}/source/streams/vstream.cpp
 HEADERS += $${VAULT_BASE}/source/streams/vstreamcopier.h
@@ -191,18 +205,30 @@ HEADERS += $${VAULT_BASE}/source/streams/vtextiostream.h
 SOURCES += $${VAULT_BASE}/source/streams/vtextiostream.cpp
 HEADERS += $${VAULT_BASE}/source/streams/vwritebufferedstream.h
 SOURCES += $${VAULT_BASE}/source/streams/vwritebufferedstream.cpp
+HEADERS += $${VAULT_BASE}/source/threads/vconditionvariable.h
+SOURCES += $${VAULT_BASE}/source/threads/vconditionvariable.cpp
 HEADERS += $${VAULT_BASE}/source/threads/vmutex.h
 SOURCES += $${VAULT_BASE}/source/threads/vmutex.cpp
 HEADERS += $${VAULT_BASE}/source/threads/vmutexlocker.h
 SOURCES += $${VAULT_BASE}/source/threads/vmutexlocker.cpp
+HEADERS += $${VAULT_BASE}/source/threads/vreadwritelock.h
+SOURCES += $${VAULT_BASE}/source/threads/vreadwritelock.cpp
 HEADERS += $${VAULT_BASE}/source/threads/vsemaphore.h
 SOURCES += $${VAULT_BASE}/source/threads/vsemaphore.cpp
 HEADERS += $${VAULT_BASE}/source/threads/vthread.h
 SOURCES += $${VAULT_BASE}/source/threads/vthread.cpp
+HEADERS += $${VAULT_BASE}/source/threads/vthreadpool.h
+SOURCES += $${VAULT_BASE}/source/threads/vthreadpool.cpp
+HEADERS += $${VAULT_BASE}/source/threads/vtimerwheel.h
+SOURCES += $${VAULT_BASE}/source/threads/vtimerwheel.cpp
+HEADERS += $${VAULT_BASE}/source/toolbox/vasynclogappender.h
+SOURCES += $${VAULT_BASE}/source/toolbox/vasynclogappender.cpp
 HEADERS += $${VAULT_BASE}/source/toolbox/vassert.h
 SOURCES += $${VAULT_BASE}/source/toolbox/vassert.cpp
 HEADERS += $${VAULT_BASE}/source/toolbox/vclassregistry.h
 SOURCES += $${VAULT_BASE}/source/toolbox/vclassregistry.cpp
+HEADERS += $${VAULT_BASE}/source/toolbox/vdeferredlogmessage.h
+SOURCES += $${VAULT_BASE}/source/toolbox/vdeferredlogmessage.cpp
 HEADERS += $${VAULT_BASE}/source/toolbox/vhex.h
 SOURCES += $${VAULT_BASE}/source/toolbox/vhex.cpp
 HEADERS += $${VAULT_BASE}/source/toolbox/vlogger.h
@@ -46,6 +46,10 @@ clear by reading which ones you are not using.
 /* This flag enables VMutex checking and logging of lock delays. */
 #define VAULT_MUTEX_LOCK_DELAY_CHECK
 
+/* This flag strips VMutex lock/unlock down to the bare OS calls, with no diagnostics. */
+/* It disables VMutex::isLockedByCurrentThread() and lock delay checking. */
+//#define VAULT_MUTEX_BARE_LOCKS
+
 /* This flag enables the memory allocation tracking feature, useful for finding leaks. */
 #define VAULT_MEMORY_ALLOCATION_TRACKING_SUPPORT
 
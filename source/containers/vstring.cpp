@@ -15,6 +15,8 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vexception.h"
 #include "vlogger.h"
 
+#include <atomic>
+
 #ifndef V_EFFICIENT_SPRINTF
 #include "vmutex.h"
 #include "vmutexlocker.h"
@@ -190,7 +192,7 @@ VString::VString(const char* formatText, ...)
                 va_list args;
                 va_start(args, formatText);
 
-                this->vaFormat(formatText, args);
+                this->_vaFormat(formatText, args, true/*useScratchArena*/);
 
                 va_end(args);
             } else {
@@ -255,7 +257,7 @@ VString::VString(const VCodePoint& cp)
 
 VString::~VString() {
     if (!mU.mI.mUsingInternalBuffer) {
-        delete [] mU.mX.mHeapBufferPtr;
+        this->_releaseHeapBuffer();
     }
 }
 
@@ -955,6 +957,16 @@ void VString::truncateLength(int maxLength) {
     ASSERT_INVARIANT();
 }
 
+void VString::clearKeepingBuffer() {
+    ASSERT_INVARIANT();
+
+    _set()[0] = VCHAR_NULL_TERMINATOR;
+    mU.mI.mStringLength = 0;
+    mU.mI.mNumCodePoints = 0;
+
+    ASSERT_INVARIANT();
+}
+
 bool VString::isEmpty() const {
     ASSERT_INVARIANT();
 
@@ -1811,6 +1823,127 @@ Vu32 VString::getFourCharacterCode() const {
 
 static const int HEAP_BUFFER_EXPANSION_CHUNK_SIZE = 32;
 
+/*
+The scratch arena is a per-thread block that formatted strings can use instead of
+heap buffers while a VStringScratchScope is active; see vstring.h. gScratchStrings
+records the strings using it, in allocation order, so that the ones still alive
+when a scope ends can be moved to the heap. Entries for strings that have gone
+away are NULL. Outside any scope the arena is empty, and its space is still used
+to format into before copying, which saves sizing each result with a separate
+vsnprintf pass.
+
+The arena is allocated when the thread opens its first scope, so threads that never
+format inside one don't carry it; they format into a smaller stack buffer instead.
+VThread releases it when the thread ends (see VStringScratchScope::releaseThreadArena()).
+*/
+static const int SCRATCH_ARENA_SIZE = 8192;         ///< Bytes of scratch arena per thread.
+static const int SCRATCH_ARENA_MAX_STRINGS = 64;    ///< The most strings that can be using one thread's arena at once.
+static const int SCRATCH_ARENA_ALIGNMENT = 8;       ///< Arena buffer lengths are rounded up to this.
+static const int SCRATCH_FORMAT_STACK_SIZE = 256;   ///< Bytes of stack to format into on a thread with no arena.
+
+static V_THREAD_LOCAL char* gScratchArena = NULL;
+static V_THREAD_LOCAL int gScratchArenaUsed = 0;
+static V_THREAD_LOCAL int gScratchScopeDepth = 0;
+static V_THREAD_LOCAL VString* gScratchStrings[SCRATCH_ARENA_MAX_STRINGS];
+static V_THREAD_LOCAL int gNumScratchStrings = 0;
+static V_THREAD_LOCAL int gScratchScopeStringsMark = 0; ///< The innermost scope's mNumStringsMark; entries below it belong to outer scopes.
+
+#ifdef V_ASSERT_ACTIVE
+/*
+With assertions on, every thread's arena is registered here, so that a string whose
+text is in another thread's arena can be caught when it is released, rather than
+being deleted as if it were on the heap.
+*/
+static const int SCRATCH_ARENA_MAX_REGISTERED = 1024;   ///< The most arenas checked at once; any beyond are not checked.
+static std::atomic<char*> gRegisteredScratchArenas[SCRATCH_ARENA_MAX_REGISTERED];
+static std::atomic<int> gNumRegisteredScratchArenaSlots(0); ///< The slots ever used; freed slots below it are NULL.
+
+static void _registerScratchArena(char* arena) {
+    const int numSlots = gNumRegisteredScratchArenaSlots.load();
+    for (int i = 0; i < numSlots; ++i) {
+        char* expected = NULL;
+        if (gRegisteredScratchArenas[i].compare_exchange_strong(expected, arena)) {
+            return;
+        }
+    }
+
+    const int slot = gNumRegisteredScratchArenaSlots.fetch_add(1);
+    if (slot < SCRATCH_ARENA_MAX_REGISTERED) {
+        gRegisteredScratchArenas[slot].store(arena);
+    } else {
+        gNumRegisteredScratchArenaSlots.fetch_sub(1);
+    }
+}
+
+static void _deregisterScratchArena(char* arena) {
+    const int numSlots = V_MIN(gNumRegisteredScratchArenaSlots.load(), SCRATCH_ARENA_MAX_REGISTERED);
+    for (int i = 0; i < numSlots; ++i) {
+        char* expected = arena;
+        if (gRegisteredScratchArenas[i].compare_exchange_strong(expected, NULL)) {
+            return;
+        }
+    }
+}
+
+static bool _isInOtherThreadsScratchArena(const char* buffer) {
+    const int numSlots = V_MIN(gNumRegisteredScratchArenaSlots.load(), SCRATCH_ARENA_MAX_REGISTERED);
+    for (int i = 0; i < numSlots; ++i) {
+        const char* arena = gRegisteredScratchArenas[i].load(std::memory_order_relaxed);
+        if ((arena != NULL) && (arena != gScratchArena) && (buffer >= arena) && (buffer < arena + SCRATCH_ARENA_SIZE)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif /* V_ASSERT_ACTIVE */
+
+void VString::_releaseHeapBuffer() {
+    if (! this->_isScratchBuffer()) {
+        // A string using another thread's arena may only be released by that thread, within its scope.
+        VASSERT(! _isInOtherThreadsScratchArena(mU.mX.mHeapBufferPtr));
+        delete [] mU.mX.mHeapBufferPtr;
+        return;
+    }
+
+    // Our arena strings are moved to the heap when their scope ends, so we must be inside it.
+    VASSERT_GREATER_THAN(gScratchScopeDepth, 0);
+
+    // Strings come and go mostly in stack order, so search from the most recent.
+    bool found = false;
+    for (int i = gNumScratchStrings - 1; i >= 0; --i) {
+        if (gScratchStrings[i] == this) {
+            gScratchStrings[i] = NULL;
+            found = true;
+            break;
+        }
+    }
+
+    VASSERT(found);
+    (void) found; // unused if assertions are off
+
+    // Never trim below the innermost scope's mark, or that scope would miss strings registered after it.
+    while ((gNumScratchStrings > gScratchScopeStringsMark) && (gScratchStrings[gNumScratchStrings - 1] == NULL)) {
+        --gNumScratchStrings;
+    }
+}
+
+bool VString::_isScratchBuffer() const {
+    return !mU.mI.mUsingInternalBuffer && (gScratchArena != NULL) && (mU.mX.mHeapBufferPtr >= gScratchArena) && (mU.mX.mHeapBufferPtr < gScratchArena + SCRATCH_ARENA_SIZE);
+}
+
+void VString::_moveScratchBufferToHeap() {
+    int newBufferLength = mU.mI.mStringLength + 1;
+    newBufferLength += HEAP_BUFFER_EXPANSION_CHUNK_SIZE - (newBufferLength % HEAP_BUFFER_EXPANSION_CHUNK_SIZE);
+
+    char* newBuffer = new char[newBufferLength];
+    ::memcpy(newBuffer, _get(), static_cast<VSizeType>(mU.mI.mStringLength + 1));
+
+    this->_releaseHeapBuffer();
+    mU.mX.mHeapBufferPtr = newBuffer;
+    mU.mX.mHeapBufferLength = newBufferLength;
+}
+
 void VString::preflight(int stringLength) {
     ASSERT_INVARIANT();
 
@@ -1864,7 +1997,7 @@ void VString::preflight(int stringLength) {
         if (mU.mI.mUsingInternalBuffer) {
             mU.mI.mUsingInternalBuffer = false;
         } else {
-            delete [] mU.mX.mHeapBufferPtr;
+            this->_releaseHeapBuffer();
         }
 
         mU.mX.mHeapBufferPtr = newBuffer;
@@ -1933,6 +2066,11 @@ char* VString::orphanDataBuffer() {
         mU.mI.mNumCodePoints = 0;
 
     } else {
+        // the caller will delete[] the buffer, so it must not be in the scratch arena
+        if (this->_isScratchBuffer()) {
+            this->_moveScratchBufferToHeap();
+        }
+
         // hand back our heap buffer, and then switch to our internal buffer as empty
         orphanedBuffer = mU.mX.mHeapBufferPtr;
         mU.mX.mHeapBufferPtr = NULL;
@@ -1963,31 +2101,7 @@ void VString::postflight(int stringLength) {
 
 #ifdef VAULT_VARARG_STRING_FORMATTING_SUPPORT
 void VString::vaFormat(const char* formatText, va_list args) {
-    ASSERT_INVARIANT();
-
-    if (formatText == NULL) {
-        this->_setLength(0);
-    } else {
-        va_list argsCopy;
-        va_copy(argsCopy, args);
-        int newStringLength = VString::_determineSprintfLength(formatText, args);
-
-        if (newStringLength == -1) {
-            // We were unable to determine the buffer length needed. Log an error and make the preflight
-            // use as big a buffer as we dare: how about the size of the temporary formatting buffer.
-            const int kTruncatedStringLength = 32768;
-            VLOGGER_ERROR(VSTRING_FORMAT("VString: formatted string will be truncated to %d characaters.", kTruncatedStringLength));
-            newStringLength = kTruncatedStringLength;
-        }
-
-        this->preflight(newStringLength);
-
-        (void) vault::vsnprintf(_set(), static_cast<VSizeType>(this->_getBufferLength()), formatText, argsCopy);
-
-        this->_setLength(newStringLength); // could call postflight, but would do extra assertion check
-    }
-
-    ASSERT_INVARIANT();
+    this->_vaFormat(formatText, args, false/*useScratchArena*/);
 }
 #endif /* VAULT_VARARG_STRING_FORMATTING_SUPPORT */
 
@@ -2003,7 +2117,7 @@ void VString::_setLength(int stringLength) {
     if ((stringLength == 0) && !mU.mI.mUsingInternalBuffer && (mU.mX.mHeapBufferPtr != NULL)) {
         // String length is being set to zero and we had a heap buffer. Delete the buffer and switch to a zero length internal buffer.
         // Note: We could consider also switching to the internal buffer (with a copy and a heap buffer delete) if we are changing length from large to small.
-        delete [] mU.mX.mHeapBufferPtr;
+        this->_releaseHeapBuffer();
         mU.mX.mHeapBufferPtr = NULL;
         mU.mX.mHeapBufferLength = 0;
         mU.mI.mUsingInternalBuffer = true;
@@ -2151,6 +2265,80 @@ int VString::_determineSprintfLength(const char* formatText, va_list args) {
 
 #endif /* V_EFFICIENT_SPRINTF */
 
+void VString::_vaFormat(const char* formatText, va_list args, bool useScratchArena) {
+    ASSERT_INVARIANT();
+
+    if (formatText == NULL) {
+        this->_setLength(0);
+        ASSERT_INVARIANT();
+        return;
+    }
+
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+
+    // Format into the free end of the arena, or onto the stack if this thread has none. Nothing else can
+    // use the arena until we are done with it here, because vsnprintf does not call back into VString.
+    char stackScratch[SCRATCH_FORMAT_STACK_SIZE];
+    const bool haveArena = (gScratchArena != NULL);
+    char* scratch = haveArena ? (gScratchArena + gScratchArenaUsed) : stackScratch;
+    int scratchLength = haveArena ? (SCRATCH_ARENA_SIZE - gScratchArenaUsed) : SCRATCH_FORMAT_STACK_SIZE;
+    int newStringLength = vault::vsnprintf(scratch, static_cast<VSizeType>(scratchLength), formatText, args);
+
+    if ((newStringLength >= 0) && (newStringLength < scratchLength)) {
+        if (useScratchArena && haveArena && (gScratchScopeDepth > 0) && (newStringLength >= VSTRING_INTERNAL_BUFFER_SIZE) && (gNumScratchStrings < SCRATCH_ARENA_MAX_STRINGS)) {
+            // Keep the text where it is, and claim the space. The length must stay even,
+            // as preflight's chunked lengths are, because its low bit shares storage with
+            // mU.mI.mUsingInternalBuffer.
+            int bufferLength = ((newStringLength + 1 + SCRATCH_ARENA_ALIGNMENT - 1) / SCRATCH_ARENA_ALIGNMENT) * SCRATCH_ARENA_ALIGNMENT;
+            gScratchArenaUsed += bufferLength;
+            gScratchStrings[gNumScratchStrings++] = this;
+
+            if (mU.mI.mUsingInternalBuffer) {
+                mU.mI.mUsingInternalBuffer = false;
+            } else {
+                this->_releaseHeapBuffer();
+            }
+
+            mU.mX.mHeapBufferPtr = scratch;
+            mU.mX.mHeapBufferLength = bufferLength;
+            mU.mI.mStringLength = newStringLength;
+            mU.mI.mNumCodePoints = -1;
+        } else {
+            this->preflight(newStringLength);
+            ::memcpy(_set(), scratch, static_cast<VSizeType>(newStringLength + 1));
+            this->_setLength(newStringLength); // could call postflight, but would do extra assertion check
+        }
+
+    } else {
+        // Too long for the arena. Size it unless vsnprintf already told us, then format again into our own buffer.
+        if (newStringLength < 0) {
+            va_list argsSizing;
+            va_copy(argsSizing, argsCopy);
+            newStringLength = VString::_determineSprintfLength(formatText, argsSizing);
+            va_end(argsSizing);
+        }
+
+        if (newStringLength == -1) {
+            // We were unable to determine the buffer length needed. Log an error and make the preflight
+            // use as big a buffer as we dare: how about the size of the temporary formatting buffer.
+            const int kTruncatedStringLength = 32768;
+            VLOGGER_ERROR(VSTRING_FORMAT("VString: formatted string will be truncated to %d characaters.", kTruncatedStringLength));
+            newStringLength = kTruncatedStringLength;
+        }
+
+        this->preflight(newStringLength);
+
+        (void) vault::vsnprintf(_set(), static_cast<VSizeType>(this->_getBufferLength()), formatText, argsCopy);
+
+        this->_setLength(newStringLength); // could call postflight, but would do extra assertion check
+    }
+
+    va_end(argsCopy);
+
+    ASSERT_INVARIANT();
+}
+
 #endif /* VAULT_VARARG_STRING_FORMATTING_SUPPORT */
 
 void VString::_assignFromUTF16WideString(const std::wstring& utf16WideString) {
@@ -2230,3 +2418,70 @@ void VString::_determineNumCodePoints() const {
         mU.mI.mNumCodePoints = VCodePoint::countUTF8CodePoints(this->getDataBufferConst(), this->length());
     }
 }
+
+// VStringScratchScope --------------------------------------------------------
+
+VStringScratchScope::VStringScratchScope()
+    : mArenaMark(gScratchArenaUsed)
+    , mNumStringsMark(gNumScratchStrings)
+    , mOuterNumStringsMark(gScratchScopeStringsMark)
+    {
+
+    if (gScratchArena == NULL) {
+        gScratchArena = new char[SCRATCH_ARENA_SIZE];
+#ifdef V_ASSERT_ACTIVE
+        _registerScratchArena(gScratchArena);
+#endif
+    }
+
+    ++gScratchScopeDepth;
+    gScratchScopeStringsMark = mNumStringsMark;
+}
+
+VStringScratchScope::~VStringScratchScope() {
+    // Anything formatted in this scope that is still alive has escaped it.
+    for (int i = gNumScratchStrings - 1; i >= mNumStringsMark; --i) {
+        if (gScratchStrings[i] != NULL) {
+            try {
+                gScratchStrings[i]->_moveScratchBufferToHeap();
+            } catch (...) {
+                // Out of memory; the best we can do is leave the string empty rather than pointing at reused space.
+                gScratchStrings[i]->mU.mI.mUsingInternalBuffer = true;
+                gScratchStrings[i]->mU.mI.mInternalBuffer[0] = '\0';
+                gScratchStrings[i]->mU.mI.mStringLength = 0;
+                gScratchStrings[i]->mU.mI.mNumCodePoints = 0;
+                gScratchStrings[i] = NULL;
+            }
+        }
+    }
+
+    gNumScratchStrings = mNumStringsMark;
+    gScratchArenaUsed = mArenaMark;
+    gScratchScopeStringsMark = mOuterNumStringsMark;
+    --gScratchScopeDepth;
+}
+
+// static
+int VStringScratchScope::getNumBytesInUse() {
+    return gScratchArenaUsed;
+}
+
+// static
+bool VStringScratchScope::hasThreadArena() {
+    return gScratchArena != NULL;
+}
+
+// static
+void VStringScratchScope::releaseThreadArena() {
+    // Inside a scope, strings may still be using the arena.
+    VASSERT_ZERO(gScratchScopeDepth);
+    if ((gScratchArena == NULL) || (gScratchScopeDepth != 0)) {
+        return;
+    }
+
+#ifdef V_ASSERT_ACTIVE
+    _deregisterScratchArena(gScratchArena);
+#endif
+    delete [] gScratchArena;
+    gScratchArena = NULL;
+}
@@ -704,6 +704,12 @@ class VString {
         */
         void truncateLength(int maxLength);
         /**
+        Makes the string empty but keeps its buffer, so that a string that is refilled
+        over and over does not reallocate each time. (Assigning an empty string, or
+        truncating to zero length, releases a heap buffer.)
+        */
+        void clearKeepingBuffer();
+        /**
         Returns true if the string length is zero.
         @return true if the string length is zero
         */
@@ -1323,8 +1329,40 @@ class VString {
         @param  args        the argument list
         */
         static int _determineSprintfLength(const char* formatText, va_list args);
+        /**
+        Formats into the string. The text is formatted once, into free space in the
+        thread's scratch arena, and then copied to the string's buffer; only if it
+        does not fit there do we fall back to sizing it with _determineSprintfLength()
+        and formatting a second time. If useScratchArena is true and a
+        VStringScratchScope is active on this thread, a result too long for the
+        internal buffer is left in the arena and the string points at it rather
+        than copying it to the heap.
+        @param  formatText      the format text
+        @param  args            the argument list
+        @param  useScratchArena true if the string may keep its buffer in the scratch arena
+        */
+        void _vaFormat(const char* formatText, va_list args, bool useScratchArena);
 #endif
 
+        /**
+        Frees the external buffer: deletes it if it is on the heap, or just forgets
+        it if it is in this thread's scratch arena, whose space is reclaimed when
+        the scope ends. ASSUMES !mU.mI.mUsingInternalBuffer. The caller must then
+        install a new buffer or switch to the internal buffer.
+        */
+        void _releaseHeapBuffer();
+        /**
+        Returns true if the external buffer is in use and lies in this thread's
+        scratch arena.
+        */
+        bool _isScratchBuffer() const;
+        /**
+        Copies a scratch arena buffer to a new heap buffer and releases the arena
+        buffer, so that the string can outlive the scope it was formatted in.
+        ASSUMES _isScratchBuffer().
+        */
+        void _moveScratchBufferToHeap();
+
         /**
         This is where we do the conversion and assignment for all APIs that
         create a VString from a "wide" string, which is in UTF-16 form. We
@@ -1432,6 +1470,59 @@ class VString {
         } mU; ///< Union for overlaying mI internal and mX external views of string buffer storage. mI.mStringLength and mI.mUsingInternalBuffer are always valid and authoritative.
         
         friend class VStringUnit; ///< Let it examine our internals under test.
+        friend class VStringScratchScope; ///< Moves escaping strings out of the scratch arena.
+};
+
+// VStringScratchScope --------------------------------------------------------
+
+/**
+VStringScratchScope lets the strings formatted by VSTRING_FORMAT and VSTRING_ARGS
+on this thread, while it is in scope, keep their text in a per-thread scratch
+arena instead of allocating heap buffers. It is meant for code that formats a lot
+of short-lived strings, such as log output; the VLOGGER macros open one around
+every log call.
+
+The arena is a fixed block per thread, allocated when the thread opens its first
+scope, that is handed out by bumping an offset, and
+the offset goes back to where it was when the scope ends. A string that is still
+using the arena at that point has escaped the scope (it was a static, or a member,
+or was otherwise kept), so its text is moved to a heap buffer before the space is
+reused. Copies of a string never share its arena buffer; they are made on the heap
+as usual. When the arena is full, strings fall back to the heap.
+
+Scopes may be nested. The one restriction is that a string whose text is in the
+arena belongs to the thread until the scope ends: it must not be modified or
+destroyed by another thread before then. Copying it for another thread is fine.
+With assertions on, releasing such a string on another thread is caught.
+*/
+class VStringScratchScope {
+    public:
+
+        VStringScratchScope();
+        ~VStringScratchScope();
+
+        /**
+        Returns the number of arena bytes in use on this thread, for diagnostics and tests.
+        */
+        static int getNumBytesInUse();
+        /**
+        Returns true if this thread has allocated its arena, for diagnostics and tests.
+        */
+        static bool hasThreadArena();
+        /**
+        Frees this thread's arena, if it has one; the next scope allocates it again.
+        VThread calls this when the thread ends. It must not be called inside a scope.
+        */
+        static void releaseThreadArena();
+
+    private:
+
+        VStringScratchScope(const VStringScratchScope&); // not copyable
+        VStringScratchScope& operator=(const VStringScratchScope&); // not assignable
+
+        int mArenaMark;             ///< The arena offset when the scope began, restored when it ends.
+        int mNumStringsMark;        ///< The number of arena strings when the scope began.
+        int mOuterNumStringsMark;   ///< The enclosing scope's mNumStringsMark, restored when this scope ends.
 };
 
 inline bool operator==(const VString& lhs, const VString& rhs) { return ::strcmp(lhs, rhs) == 0; }      ///< Compares lhs and rhs for equality. @param    lhs    a string @param    rhs    a string @return true if lhs and rhs are equal according to strcmp()
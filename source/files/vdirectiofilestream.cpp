@@ -44,6 +44,16 @@ void VDirectIOFileStream::setFile(int fd, bool closeOnDestruct) {
     mCloseOnDestruct = closeOnDestruct;
 }
 
+bool VDirectIOFileStream::preallocate(Vs64 numBytes) {
+    return (VFileSystem::fallocate(mFile, static_cast<off_t>(numBytes)) == 0);
+}
+
+void VDirectIOFileStream::truncate(Vs64 length) {
+    if (VFileSystem::ftruncate(mFile, static_cast<off_t>(length)) != 0) {
+        throw VException(VSystemError(), VSTRING_FORMAT("VDirectIOFileStream::truncate failed to set the length of '%s' to " VSTRING_FORMATTER_S64 ".", mNode.getPath().chars(), length));
+    }
+}
+
 void VDirectIOFileStream::openReadOnly() {
     mFile = VFileSystem::open(mNode.getPath(), READ_ONLY_MODE);
 
@@ -99,7 +109,7 @@ Vs64 VDirectIOFileStream::read(Vu8* targetBuffer, Vs64 numBytesToRead) {
     // Also, we can set it to false if the actual size fits in 31 bits, as in VStream::copyMemory.
     do {
         if (needsSizeConversion) {
-            requestCount = static_cast<size_t>(V_MIN((CONST_S64(0x7FFFFFFF)), numBytesRemaining));
+            requestCount = static_cast<size_t>(V_MIN(((Vs64)(0x7FFFFFFF)), numBytesRemaining));
         } else {
             requestCount = static_cast<size_t>(numBytesRemaining);
         }
@@ -68,6 +68,21 @@ class VDirectIOFileStream : public VAbstractFileStream {
                                     responsibility
         */
         void setFile(int fd, bool closeOnDestruct);
+        /**
+        Reserves disk space for the file, from the start up to the specified length,
+        without changing the file length. Writes within that space then need not
+        allocate blocks as they extend the file. Only Linux supports this; elsewhere,
+        or if the file system cannot do it, nothing happens and false is returned.
+        @param    numBytes    the length up to which to reserve space
+        @return true if the space was reserved
+        */
+        bool preallocate(Vs64 numBytes);
+        /**
+        Sets the file length, discarding any data and reserved space beyond it.
+        Throws a VException if it fails.
+        @param    length    the new file length
+        */
+        void truncate(Vs64 length);
 
         // Implementation of VAbstractFileStream -----------------------------
 
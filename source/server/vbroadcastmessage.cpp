@@ -0,0 +1,41 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vbroadcastmessage.h"
+
+#include "vexception.h"
+#include "vlogger.h"
+
+// The wire header written by send() is protocol-specific; this just keeps the
+// capture buffer from having to grow for typical length+ID headers.
+static const Vs64 kWireHeaderAllowance = 64;
+
+// VBroadcastMessage ----------------------------------------------------------
+
+// static
+VMessagePtr VBroadcastMessage::create(VMessagePtr message) {
+    return VMessagePtr(new VBroadcastMessage(message));
+}
+
+VBroadcastMessage::VBroadcastMessage(VMessagePtr message)
+    : VMessage(message->getMessageID(), message->getMessageDataLength() + kWireHeaderAllowance)
+    {
+    // We are a VBinaryIOStream over mMessageDataBuffer, so the original writes its wire form straight into our buffer.
+    message->send("broadcast", *this);
+}
+
+void VBroadcastMessage::send(const VString& sessionLabel, VBinaryIOStream& out) {
+    // Write straight from the buffer rather than via streamCopy(), which would move our shared i/o offset.
+    VLOGGER_MESSAGE_LEVEL_FORMAT(VMessage::kMessageTrafficDetailsLevel, "[%s] VBroadcastMessage::send: Sending shared message ID=%d, %d bytes.", sessionLabel.chars(), (int) this->getMessageID(), (int) this->getMessageDataLength());
+    (void) out.write(this->getBuffer(), this->getMessageDataLength());
+}
+
+void VBroadcastMessage::receive(const VString& sessionLabel, VBinaryIOStream& /*in*/) {
+    throw VUnimplementedException(VSTRING_FORMAT("[%s] VBroadcastMessage::receive: A broadcast message cannot be received.", sessionLabel.chars()));
+}
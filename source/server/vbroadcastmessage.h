@@ -0,0 +1,80 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vbroadcastmessage_h
+#define vbroadcastmessage_h
+
+/** @file */
+
+#include "vmessage.h"
+
+/**
+    @ingroup vsocket
+*/
+
+/**
+VBroadcastMessage is an immutable, pre-serialized copy of a message, for
+posting the same payload to many sessions without giving each session its
+own copy of the message data.
+
+It is created from the original message by calling the original's send()
+once, capturing the complete wire form (header and data) in its own buffer.
+Its send() then writes those bytes as-is, and does not touch any stream
+position or other state; so a single VBroadcastMessage may be posted to any
+number of sessions' output queues (or standby queues) and sent concurrently
+by their output threads. For queue limit accounting, getMessageDataLength()
+returns the length of the wire form.
+
+You must not write to, seek, or recycle a VBroadcastMessage once it has been
+created, since every session that it was posted to shares its buffer.
+A VBroadcastMessage cannot be received.
+
+@see    VServer::postSharedBroadcastMessage()
+*/
+class VBroadcastMessage : public VMessage {
+    public:
+
+        /**
+        Creates a shareable broadcast message from the supplied message.
+        @param  message the message to broadcast; it is sent once to capture its
+                        wire form and is not referenced afterward
+        @return the broadcast message, suitable for posting to many sessions
+        */
+        static VMessagePtr create(VMessagePtr message);
+
+        /**
+        Virtual destructor.
+        */
+        virtual ~VBroadcastMessage() {}
+
+        /**
+        Writes the captured wire form of the original message to the output stream.
+        Safe to call on multiple threads at once.
+        @param    sessionLabel    a label to use in log output, to identify the session
+        @param    out                the stream to write to
+        */
+        virtual void send(const VString& sessionLabel, VBinaryIOStream& out);
+        /**
+        Throws a VUnimplementedException; a broadcast message is output-only.
+        */
+        virtual void receive(const VString& sessionLabel, VBinaryIOStream& in);
+
+    protected:
+
+        /**
+        Constructs the broadcast message by capturing the original's wire form.
+        @param  message the message to broadcast
+        */
+        VBroadcastMessage(VMessagePtr message);
+
+    private:
+
+        VBroadcastMessage(const VBroadcastMessage&); // not copyable
+        VBroadcastMessage& operator=(const VBroadcastMessage&); // not assignable
+};
+
+#endif /* vbroadcastmessage_h */
@@ -23,7 +23,7 @@ VClientSession::VClientSession(const VString& sessionBaseName, VServer* server,
     : VEnableSharedFromThis<VClientSession>()
     , mName(sessionBaseName)
     , mLoggerName(VSTRING_ARGS("vault.messages.VClientSession.%s.%s", sessionBaseName.chars(), VLogger::getCleansedLoggerName(socket->getHostIPAddress()).chars()))
-    , mMutex(VString::EMPTY()/*name will be set in body*/)
+    , mMutex(VString::EMPTY()/*name will be set in body*/, false, "VClientSession::mMutex")
     , mServer(server)
     , mClientType(clientType)
     , mClientIP(socket->getHostIPAddress())
@@ -36,6 +36,8 @@ VClientSession::VClientSession(const VString& sessionBaseName, VServer* server,
     , mStandbyStartTime(VInstant::NEVER_OCCURRED())
     , mStandbyTimeLimit(standbyTimeLimit)
     , mMaxClientQueueDataSize(maxQueueDataSize)
+    , mStats()
+    , mOutputSink(NULL)
     , mSocket(socket)
     , mSocketStream(socket, "VClientSession") // FIXME: find a way to get the IP address here or to set in ctor
     , mIOStream(mSocketStream)
@@ -75,7 +77,7 @@ void VClientSession::initIOThreads() {
 }
 
 void VClientSession::shutdown(VThread* callingThread) {
-    VMutexLocker locker(&mMutex, VSTRING_FORMAT("[%s]VClientSession::shutdown() %s", this->getName().chars(), (callingThread == NULL ? "" : callingThread->getName().chars())));
+    VMutexLocker locker(&mMutex, "VClientSession::shutdown()");
 
     mIsShuttingDown = true;
 
@@ -108,7 +110,7 @@ void VClientSession::shutdown(VThread* callingThread) {
 }
 
 void VClientSession::postOutputMessage(VMessagePtr message, bool isForBroadcast) {
-    VMutexLocker locker(&mMutex, VSTRING_FORMAT("[%s]VClientSession::postOutputMessage()", this->getName().chars())); // protect the mStartupStandbyQueue during queue operations
+    VMutexLocker locker(&mMutex, "VClientSession::postOutputMessage()"); // protect the mStartupStandbyQueue during queue operations
 
     // Don't post if client is doing a disconnect:
     if (mIsShuttingDown || this->isClientGoingOffline()) {
@@ -131,21 +133,33 @@ void VClientSession::postOutputMessage(VMessagePtr message, bool isForBroadcast)
         if ((mMaxClientQueueDataSize > 0) && (currentQueueDataSize >= mMaxClientQueueDataSize)) {
             // We have hit the queue size limit. Do not post. Initiate a shutdown of this session.
             VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VClientSession::postOutputMessage: Reached output queue limit of " VSTRING_FORMATTER_S64 " bytes. Not posting message ID=%d. Closing socket to force shutdown of session and its i/o threads.", this->getName().chars(), mMaxClientQueueDataSize, message->getMessageID()));
-            mSocket->close();
+            this->_closeSocketToForceShutdown();
         } else if ((mStandbyTimeLimit == VDuration::ZERO()) || (now <= mStandbyStartTime + mStandbyTimeLimit)) {
             VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VClientSession::postOutputMessage: Placing message ID=%d on standby queue for not-yet-started session.", this->getName().chars(), message->getMessageID()));
             mStartupStandbyQueue.postMessage(message);
         } else {
             // We have hit the standby time limit. Do not post. Initiate a shutdown of this session.
             VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VClientSession::postOutputMessage: Reached standby time limit of %s. Not posting message ID=%d. Closing socket to force shutdown of session and its i/o threads.", this->getName().chars(), mStandbyTimeLimit.getDurationString().chars(), message->getMessageID()));
-            mSocket->close();
+            this->_closeSocketToForceShutdown();
         }
     } else if (mOutputThread != NULL) {
         // This branch is entered only for posting to a session with an async output thread.
         // Typical for posting a message directly to 1 session or broadcasting to multiple sessions.
         // We need to post to the output thread.
         // Note that mOutputThread->postOutputMessage() stops its own thread if posting fails, triggering session end. We don't need to take action.
-        mOutputThread->postOutputMessage(message);
+        if (mOutputThread->postOutputMessage(message)) {
+            mStats.recordOutputQueueDepth(mOutputThread->getOutputQueueSize());
+        }
+    } else if (mOutputSink != NULL) {
+        // This branch is entered for a session serviced by an event loop such as VMessageReactor.
+        // The sink only queues the bytes; its own thread writes them when the socket can take them.
+        Vs64 queuedDataSize = mOutputSink->queueOutputMessage(message, this->getName());
+        mStats.recordMessageOut(message->getMessageDataLength());
+
+        if ((mMaxClientQueueDataSize > 0) && (queuedDataSize > mMaxClientQueueDataSize)) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VClientSession::postOutputMessage: Reached output queue limit of " VSTRING_FORMATTER_S64 " bytes after queuing message ID=%d. Closing socket to force shutdown of session.", this->getName().chars(), mMaxClientQueueDataSize, message->getMessageID()));
+            this->_closeSocketToForceShutdown();
+        }
     } else { // no output thread
         // Vault 4.0 TODO: This used to be for non-broadcast only, but I'm removing the distinction.
         // However, does this change how teardown works? Formerly the other branch (broadcast) treated
@@ -156,6 +170,7 @@ void VClientSession::postOutputMessage(VMessagePtr message, bool isForBroadcast)
         // This would only be for sessions that are synchronous and do not use a separate output thread.
         // Write the message directly to our output stream and release it.
         message->send(this->getName(), mIOStream);
+        mStats.recordMessageOut(message->getMessageDataLength());
     }
 
 }
@@ -167,9 +182,15 @@ void VClientSession::sendMessageToClient(VMessagePtr message, const VString& ses
     } else {
         VLOGGER_NAMED_LEVEL(mLoggerName, VMessage::kMessageQueueOpsLevel, VSTRING_FORMAT("[%s] VClientSession::sendMessageToClient: Sending message@0x%08X.", sessionLabel.chars(), message.get()));
         message->send(sessionLabel, out);
+        mStats.recordMessageOut(message->getMessageDataLength());
     }
 }
 
+void VClientSession::setOutputSink(VClientSessionOutputSink* outputSink) {
+    VMutexLocker locker(&mMutex, "VClientSession::setOutputSink()");
+    mOutputSink = outputSink;
+}
+
 VBentoNode* VClientSession::getSessionInfo() const {
     VBentoNode* result = new VBentoNode(mName);
 
@@ -188,6 +209,8 @@ VBentoNode* VClientSession::getSessionInfo() const {
         result->addInt("output-queue-size", mOutputThread->getOutputQueueSize());
     }
 
+    mStats.getSnapshot().addToBento(*result);
+
     return result;
 }
 
@@ -211,11 +234,26 @@ int VClientSession::_getOutputQueueSize() const {
 }
 
 void VClientSession::_postStandbyMessageToAsyncOutputQueue(VMessagePtr message) {
-    mOutputThread->postOutputMessage(message, false /* do not respect the queue limits, just move all messages onto the queue */);
+    // Do not respect the queue limits, just move all messages onto the queue.
+    if (mOutputThread != NULL) {
+        mOutputThread->postOutputMessage(message, false);
+    } else if (mOutputSink != NULL) {
+        (void) mOutputSink->queueOutputMessage(message, this->getName());
+        mStats.recordMessageOut(message->getMessageDataLength());
+    }
+}
+
+void VClientSession::_closeSocketToForceShutdown() {
+    // A sink's thread may be using the socket at this moment, so it must be the one to close it.
+    if (mOutputSink != NULL) {
+        mOutputSink->requestClose();
+    } else {
+        mSocket->close();
+    }
 }
 
 void VClientSession::_releaseQueuedClientMessages() {
-    VMutexLocker locker(&mMutex, VSTRING_FORMAT("[%s]VClientSession::_releaseQueuedClientMessages()", this->getName().chars())); // protect the mStartupStandbyQueue during queue operations
+    VMutexLocker locker(&mMutex, "VClientSession::_releaseQueuedClientMessages()"); // protect the mStartupStandbyQueue during queue operations
 
     // Order probably does not matter, but it makes sense to pop them in the order they would have been sent.
 
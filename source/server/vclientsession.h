@@ -14,6 +14,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vmutex.h"
 #include "vmutexlocker.h"
 #include "vmessagequeue.h"
+#include "vclientsessionstats.h"
 #include "vsocketstream.h"
 #include "vbinaryiostream.h"
 
@@ -34,6 +35,42 @@ class VBentoNode;
 
 typedef std::vector<const VMessageHandlerTask*> SessionTaskList;
 
+/**
+VClientSessionOutputSink is implemented by a component that writes a session's
+output on its behalf without a VMessageOutputThread, such as VMessageReactor.
+Once a session has an output sink, postOutputMessage() hands each message to
+the sink rather than writing it to the socket on the posting thread.
+*/
+class VClientSessionOutputSink {
+    public:
+
+        VClientSessionOutputSink() {}
+        virtual ~VClientSessionOutputSink() {}
+
+        /**
+        Queues the message's wire bytes to be written to the client. This must not
+        wait for the socket: it is called with the session's mutex locked, often by
+        a thread that is broadcasting to many sessions.
+        @param  message         the message to send; the caller still owns it afterward
+        @param  sessionLabel    a label to use in log output, to identify the session
+        @return the number of bytes waiting to be written, including this message
+        */
+        virtual Vs64 queueOutputMessage(VMessagePtr message, const VString& sessionLabel) = 0;
+        /**
+        Asks the sink to close the session's socket, because the session has hit its
+        output queue or standby limit. The sink's own thread may be using the socket
+        right now, so this must only record the request and wake that thread, which
+        then stops watching the socket and closes it. Like queueOutputMessage(), it
+        is called with the session's mutex locked.
+        */
+        virtual void requestClose() = 0;
+
+    private:
+
+        VClientSessionOutputSink(const VClientSessionOutputSink&); // not copyable
+        VClientSessionOutputSink& operator=(const VClientSessionOutputSink&); // not assignable
+};
+
 /**
 This base class provides the API and services general to the various
 types of client sessions that may keep a connection alive for a relatively
@@ -99,6 +136,13 @@ class VClientSession : public VEnableSharedFromThis<VClientSession> {
         */
         virtual bool isClientGoingOffline() const = 0;
         /**
+        Returns true once shutdown() has been called on this session. Used by
+        components such as VMessageReactor that service the session without
+        dedicated i/o threads, to notice that the session has ended.
+        @return obvious
+        */
+        bool isShuttingDown() const { return mIsShuttingDown; }
+        /**
         Triggers a tear-down of the client session, typically in response to
         an i/o thread ending its run() method.
         @param  callingThread   the thread invoking the shutdown (NULL if n/a)
@@ -107,9 +151,9 @@ class VClientSession : public VEnableSharedFromThis<VClientSession> {
         /**
         Posts a message to be sent to the client; if the session is using an
         output thread, the message is posted to the thread's output queue, where
-        it will be sent when the output thread wakes up; if the session is NOT
-        using an output thread, the message is written to the output stream
-        immediately. If the broadcast flag is specified and session is not "online"
+        it will be sent when the output thread wakes up; if the session has an
+        output sink, the message is queued there; otherwise the message is written
+        to the output stream immediately. If the broadcast flag is specified and session is not "online"
         then the message is queued and will be sent after the session goes online.
         @param  message         the message to be sent
         @param  isForBroadcast  true if the message is being broadcast; affects
@@ -137,6 +181,14 @@ class VClientSession : public VEnableSharedFromThis<VClientSession> {
         */
         void sendMessageToClient(VMessagePtr message, const VString& sessionLabel, VBinaryIOStream& out);
         /**
+        Sets or clears the sink that posted output is queued to when the session
+        has no output thread. The component that services the session sets it
+        when it takes the session on, and must clear it before the sink goes away;
+        once this returns, postOutputMessage() will not call the old sink again.
+        @param  outputSink  the sink, or NULL to write output synchronously again
+        */
+        void setOutputSink(VClientSessionOutputSink* outputSink);
+        /**
         Returns a string containing the client's address in address:port form.
         @return obvious
         */
@@ -149,6 +201,12 @@ class VClientSession : public VEnableSharedFromThis<VClientSession> {
         used to display diagnostic information.
         */
         virtual VBentoNode* getSessionInfo() const;
+        /**
+        Returns the session's traffic and handler statistics. The i/o threads and
+        message handling code record into it; anyone may read a snapshot at any time.
+        */
+        VClientSessionStats& getStats() { return mStats; }
+        const VClientSessionStats& getStats() const { return mStats; }
 
     protected:
 
@@ -175,7 +233,7 @@ class VClientSession : public VEnableSharedFromThis<VClientSession> {
         VString                 mClientAddress; ///< The user-visible string we use for logging, contains IP address + port of session.
         VMessageInputThread*    mInputThread;   ///< The thread that is reading inbound messages from the client.
         VMessageOutputThread*   mOutputThread;  ///< If using a separate output thread, this is it (may be NULL for sync i/o model).
-        bool                    mIsShuttingDown;///< True if we are in the process of tearing down the session.
+        std::atomic<bool>       mIsShuttingDown;///< True if we are in the process of tearing down the session.
 
     private:
 
@@ -183,11 +241,14 @@ class VClientSession : public VEnableSharedFromThis<VClientSession> {
         VClientSession& operator=(const VClientSession&); // not assignable
 
         void _releaseQueuedClientMessages();   ///< Releases all pending queued messages (called during shutdown).
+        void _closeSocketToForceShutdown();    ///< Closes the socket, or has the output sink close it on its own thread. Called with mMutex locked.
 
         VMessageQueue   mStartupStandbyQueue;   ///< A queue we use to hold outbound updates while this client session is starting up.
         VInstant        mStandbyStartTime;      ///< The time at which we started queueing standby messages; reset by _moveStandbyMessagesToAsyncOutputQueue().
         VDuration       mStandbyTimeLimit;      ///< Once we go to standby, a time limit applies after which posting standby causes session shutdown due to presumed failure.
         Vs64            mMaxClientQueueDataSize;///< If non-zero, if a message is posted when there are already this many bytes queued, we close the socket.
+        VClientSessionStats mStats;             ///< Traffic and handler statistics, readable without locking.
+        VClientSessionOutputSink* mOutputSink;  ///< If not NULL, where output is queued instead of being written synchronously. Guarded by mMutex.
 
         // We only access the socket i/o stream if postOutputMessage() is called
         // and we are not set up to use a separate output message thread. However, we are responsible
@@ -0,0 +1,163 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vclientsessionstats.h"
+
+#include "vthread.h"
+#include "vbento.h"
+
+#include <chrono>
+
+// A writer holds the sequence odd for only a handful of stores, so a waiting writer
+// or reader spins briefly before it starts yielding the CPU to whoever was preempted.
+static const int kSpinsBeforeYield = 100;
+
+// VClientSessionStats::Snapshot -----------------------------------------------
+
+void VClientSessionStats::Snapshot::add(const Snapshot& other) {
+    mNumMessagesIn += other.mNumMessagesIn;
+    mNumBytesIn += other.mNumBytesIn;
+    mNumMessagesOut += other.mNumMessagesOut;
+    mNumBytesOut += other.mNumBytesOut;
+    mOutputQueueHighWater = V_MAX(mOutputQueueHighWater, other.mOutputQueueHighWater);
+    mNumHandlerCalls += other.mNumHandlerCalls;
+    mHandlerMicroseconds += other.mHandlerMicroseconds;
+    mMaxHandlerMicroseconds = V_MAX(mMaxHandlerMicroseconds, other.mMaxHandlerMicroseconds);
+}
+
+void VClientSessionStats::Snapshot::addToBento(VBentoNode& bento) const {
+    bento.addS64("messages-in", mNumMessagesIn);
+    bento.addS64("bytes-in", mNumBytesIn);
+    bento.addS64("messages-out", mNumMessagesOut);
+    bento.addS64("bytes-out", mNumBytesOut);
+    bento.addS64("output-queue-high-water", mOutputQueueHighWater);
+    bento.addS64("handler-calls", mNumHandlerCalls);
+    bento.addS64("handler-microseconds", mHandlerMicroseconds);
+    bento.addS64("max-handler-microseconds", mMaxHandlerMicroseconds);
+}
+
+// VClientSessionStats ---------------------------------------------------------
+
+VClientSessionStats::VClientSessionStats()
+    : mSequence(0)
+    , mNumMessagesIn(0)
+    , mNumBytesIn(0)
+    , mNumMessagesOut(0)
+    , mNumBytesOut(0)
+    , mOutputQueueHighWater(0)
+    , mNumHandlerCalls(0)
+    , mHandlerMicroseconds(0)
+    , mMaxHandlerMicroseconds(0)
+    {
+}
+
+void VClientSessionStats::recordMessageIn(Vs64 numBytes) {
+    Vu32 sequence = this->_beginWrite();
+    _add(mNumMessagesIn, 1);
+    _add(mNumBytesIn, numBytes);
+    this->_endWrite(sequence);
+}
+
+void VClientSessionStats::recordMessageOut(Vs64 numBytes) {
+    Vu32 sequence = this->_beginWrite();
+    _add(mNumMessagesOut, 1);
+    _add(mNumBytesOut, numBytes);
+    this->_endWrite(sequence);
+}
+
+void VClientSessionStats::recordOutputQueueDepth(Vs64 numQueuedMessages) {
+    // Almost every post finds the queue no deeper than it has been before.
+    if (numQueuedMessages <= mOutputQueueHighWater.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    Vu32 sequence = this->_beginWrite();
+    if (numQueuedMessages > mOutputQueueHighWater.load(std::memory_order_relaxed)) {
+        mOutputQueueHighWater.store(numQueuedMessages, std::memory_order_relaxed);
+    }
+    this->_endWrite(sequence);
+}
+
+void VClientSessionStats::recordHandlerTime(Vs64 microseconds) {
+    Vu32 sequence = this->_beginWrite();
+    _add(mNumHandlerCalls, 1);
+    _add(mHandlerMicroseconds, microseconds);
+    if (microseconds > mMaxHandlerMicroseconds.load(std::memory_order_relaxed)) {
+        mMaxHandlerMicroseconds.store(microseconds, std::memory_order_relaxed);
+    }
+    this->_endWrite(sequence);
+}
+
+VClientSessionStats::Snapshot VClientSessionStats::getSnapshot() const {
+    Snapshot snapshot;
+    int numSpins = 0;
+
+    for (;;) {
+        Vu32 sequenceBefore = mSequence.load(std::memory_order_acquire);
+        if ((sequenceBefore & 1) == 0) {
+            snapshot.mNumMessagesIn = mNumMessagesIn.load(std::memory_order_relaxed);
+            snapshot.mNumBytesIn = mNumBytesIn.load(std::memory_order_relaxed);
+            snapshot.mNumMessagesOut = mNumMessagesOut.load(std::memory_order_relaxed);
+            snapshot.mNumBytesOut = mNumBytesOut.load(std::memory_order_relaxed);
+            snapshot.mOutputQueueHighWater = mOutputQueueHighWater.load(std::memory_order_relaxed);
+            snapshot.mNumHandlerCalls = mNumHandlerCalls.load(std::memory_order_relaxed);
+            snapshot.mHandlerMicroseconds = mHandlerMicroseconds.load(std::memory_order_relaxed);
+            snapshot.mMaxHandlerMicroseconds = mMaxHandlerMicroseconds.load(std::memory_order_relaxed);
+
+            // Keep the field loads above from drifting below the second sequence load.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSequence.load(std::memory_order_relaxed) == sequenceBefore) {
+                return snapshot;
+            }
+        }
+
+        if (++numSpins >= kSpinsBeforeYield) {
+            VThread::yield();
+        }
+    }
+}
+
+// static
+Vs64 VClientSessionStats::getTimestampMicroseconds() {
+    // VInstant only has millisecond resolution and follows the system clock, and most handlers take well under a millisecond.
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Vu32 VClientSessionStats::_beginWrite() {
+    int numSpins = 0;
+    Vu32 sequence = mSequence.load(std::memory_order_relaxed);
+
+    for (;;) {
+        if (((sequence & 1) == 0) && mSequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            break;
+        }
+
+        if ((sequence & 1) != 0) {
+            if (++numSpins >= kSpinsBeforeYield) {
+                VThread::yield();
+            }
+
+            sequence = mSequence.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Keep the field stores that follow from becoming visible before the odd sequence does.
+    std::atomic_thread_fence(std::memory_order_release);
+    return sequence + 1;
+}
+
+void VClientSessionStats::_endWrite(Vu32 sequence) {
+    mSequence.store(sequence + 1, std::memory_order_release);
+}
+
+// static
+void VClientSessionStats::_add(std::atomic<Vs64>& field, Vs64 amount) {
+    // Writers are serialized by the sequence, so this need not be an atomic read-modify-write.
+    field.store(field.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
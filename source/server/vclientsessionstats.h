@@ -0,0 +1,123 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vclientsessionstats_h
+#define vclientsessionstats_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include <atomic>
+
+class VBentoNode;
+
+/**
+    @ingroup vsocket
+*/
+
+/**
+VClientSessionStats counts the traffic and work of one client session: messages
+and bytes in each direction, the output queue high-water mark, and the time spent
+in message handlers. It is cheap enough to leave on in production. Recording a
+value costs one uncontended compare-and-swap and a few relaxed stores, and there
+is no mutex anywhere.
+
+Several threads record into the same block (the input thread, the output thread,
+dispatcher workers, and threads posting broadcasts), and a diagnostic reader
+wants figures that belong together, such as a message count and the matching
+byte count. So the block is guarded by a sequence lock. A writer makes the
+sequence number odd while it updates and even again when it is done. A reader
+copies the fields and retries if the sequence number was odd or changed while
+it was copying. Readers never block writers.
+*/
+class VClientSessionStats {
+    public:
+
+        /**
+        A consistent copy of the counters, which can also be summed over sessions.
+        */
+        struct Snapshot {
+            Snapshot() : mNumMessagesIn(0), mNumBytesIn(0), mNumMessagesOut(0), mNumBytesOut(0), mOutputQueueHighWater(0), mNumHandlerCalls(0), mHandlerMicroseconds(0), mMaxHandlerMicroseconds(0) {}
+
+            /**
+            Adds another snapshot into this one: counts and times are summed,
+            and high-water marks and maximums take the larger value.
+            */
+            void add(const Snapshot& other);
+            /**
+            Adds the values to a bento node as S64 attributes, for diagnostics.
+            */
+            void addToBento(VBentoNode& bento) const;
+
+            Vs64    mNumMessagesIn;             ///< Messages received from the client.
+            Vs64    mNumBytesIn;                ///< Message data bytes received from the client.
+            Vs64    mNumMessagesOut;            ///< Messages sent to the client.
+            Vs64    mNumBytesOut;               ///< Message data bytes sent to the client.
+            Vs64    mOutputQueueHighWater;      ///< The most messages seen waiting on the output queue at once.
+            Vs64    mNumHandlerCalls;           ///< Message handlers run for the session's messages.
+            Vs64    mHandlerMicroseconds;       ///< Total time spent in those handlers.
+            Vs64    mMaxHandlerMicroseconds;    ///< The longest single handler call.
+        };
+
+        VClientSessionStats();
+        ~VClientSessionStats() {}
+
+        /**
+        Records a message received from the client.
+        @param  numBytes    the message data length
+        */
+        void recordMessageIn(Vs64 numBytes);
+        /**
+        Records a message sent to the client.
+        @param  numBytes    the message data length
+        */
+        void recordMessageOut(Vs64 numBytes);
+        /**
+        Records the current depth of the output queue, raising the high-water mark
+        if it is a new maximum. Costs only a relaxed load when it is not.
+        @param  numQueuedMessages   the number of messages waiting
+        */
+        void recordOutputQueueDepth(Vs64 numQueuedMessages);
+        /**
+        Records the time taken by a message handler.
+        @param  microseconds    the elapsed time, as measured from getTimestampMicroseconds()
+        */
+        void recordHandlerTime(Vs64 microseconds);
+
+        /**
+        Returns a consistent copy of the counters.
+        */
+        Snapshot getSnapshot() const;
+
+        /**
+        Returns a monotonic timestamp in microseconds, for measuring the intervals
+        passed to recordHandlerTime().
+        */
+        static Vs64 getTimestampMicroseconds();
+
+    private:
+
+        VClientSessionStats(const VClientSessionStats&); // not copyable
+        VClientSessionStats& operator=(const VClientSessionStats&); // not assignable
+
+        Vu32 _beginWrite();                 ///< Waits for any other writer to finish, and makes the sequence odd. Returns the odd value.
+        void _endWrite(Vu32 sequence);      ///< Makes the sequence even again, publishing the writes.
+        static void _add(std::atomic<Vs64>& field, Vs64 amount); ///< Adds to a field. ASSUMES CALLER IS BETWEEN _beginWrite() AND _endWrite().
+
+        std::atomic<Vu32>   mSequence;                  ///< Odd while a writer is updating the fields below.
+        std::atomic<Vs64>   mNumMessagesIn;             ///< @see Snapshot
+        std::atomic<Vs64>   mNumBytesIn;                ///< @see Snapshot
+        std::atomic<Vs64>   mNumMessagesOut;            ///< @see Snapshot
+        std::atomic<Vs64>   mNumBytesOut;               ///< @see Snapshot
+        std::atomic<Vs64>   mOutputQueueHighWater;      ///< @see Snapshot
+        std::atomic<Vs64>   mNumHandlerCalls;           ///< @see Snapshot
+        std::atomic<Vs64>   mHandlerMicroseconds;       ///< @see Snapshot
+        std::atomic<Vs64>   mMaxHandlerMicroseconds;    ///< @see Snapshot
+};
+
+#endif /* vclientsessionstats_h */
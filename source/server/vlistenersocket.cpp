@@ -50,22 +50,14 @@ VSocket* VListenerSocket::accept() {
     bool                shouldAccept = true;
 
     if (mReadTimeOutActive) {
-        /* then we need to do a select call */
-        struct timeval  timeout = mReadTimeOut;
-        fd_set          readset;
-
-        FD_ZERO(&readset);
-        //lint -e573 Signed-unsigned mix with divide"
-        FD_SET(mSocketID, &readset);
-
-        int result = ::select(static_cast<int>(mSocketID + 1), &readset, NULL, NULL, &timeout);
+        /* then we need to wait for a pending connection */
+        int result = this->_platform_waitForIO(false, &mReadTimeOut);
 
         if (result == -1) {
-            throw VException(VSystemError::getSocketError(), VSTRING_FORMAT("VListenerSocket[%s:%d]::accept select() failed.", mBindAddress.chars(), mPortNumber));
+            throw VException(VSystemError::getSocketError(), VSTRING_FORMAT("VListenerSocket[%s:%d]::accept wait failed.", mBindAddress.chars(), mPortNumber));
         }
 
-        //lint -e573 Signed-unsigned mix with divide"
-        shouldAccept = ((result > 0) && FD_ISSET(mSocketID, &readset));
+        shouldAccept = (result > 0);
     }
 
     if (shouldAccept) {
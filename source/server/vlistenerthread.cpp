@@ -31,6 +31,8 @@ VListenerThread::VListenerThread(const VString& threadBaseName, bool deleteSelfA
     , mSessionFactory(sessionFactory)
     , mSocketThreads()
     , mSocketThreadsMutex(VSTRING_FORMAT("VListenerThread(%s)::mSocketThreadsMutex", threadBaseName.chars()))
+    , mIdleMutex(VSTRING_FORMAT("VListenerThread(%s)::mIdleMutex", threadBaseName.chars()))
+    , mIdleCondition()
     {
 }
 
@@ -38,7 +40,7 @@ VListenerThread::~VListenerThread() {
     VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("VListenerThread '%s' ended.", mName.chars()));
 
     // Make sure any of socket threads still alive no longer reference us.
-    VMutexLocker locker(&mSocketThreadsMutex, VSTRING_FORMAT("[%s]VListenerThread::socketThreadEnded()", this->getName().chars()));
+    VMutexLocker locker(&mSocketThreadsMutex, "VListenerThread::socketThreadEnded()");
     for (VSocketThreadPtrVector::const_iterator i = mSocketThreads.begin(); i != mSocketThreads.end(); ++i) {
         (*i)->mOwnerThread = NULL;
     }
@@ -49,6 +51,7 @@ void VListenerThread::stop() {
     this->stopAllSocketThreads();
 
     VThread::stop();
+    this->_wakeIdleWait();
 }
 
 void VListenerThread::run() {
@@ -56,13 +59,23 @@ void VListenerThread::run() {
         if (mShouldListen) {
             this->_runListening();
         } else {
-            VThread::sleep(5 * VDuration::SECOND()); // this value limits how quickly we can be shut down
+            // Wait for startListening() or stop() to wake us. The timeout only covers
+            // being stopped by other means, such as VThread::stopThread().
+            VMutexLocker locker(&mIdleMutex, "VListenerThread::run()");
+            if (! mShouldListen && this->isRunning()) {
+                (void) mIdleCondition.wait(&mIdleMutex, 5 * VDuration::SECOND());
+            }
         }
     }
 }
 
+void VListenerThread::startListening() {
+    mShouldListen = true;
+    this->_wakeIdleWait();
+}
+
 void VListenerThread::socketThreadEnded(VSocketThread* socketThread) {
-    VMutexLocker                        locker(&mSocketThreadsMutex, VSTRING_FORMAT("[%s]VListenerThread::socketThreadEnded()", this->getName().chars()));
+    VMutexLocker                        locker(&mSocketThreadsMutex, "VListenerThread::socketThreadEnded()");
     VSocketThreadPtrVector::iterator    position;
 
     position = std::find(mSocketThreads.begin(), mSocketThreads.end(), socketThread);
@@ -78,7 +91,7 @@ int VListenerThread::getPortNumber() const {
 
 VSocketInfoVector VListenerThread::enumerateActiveSockets() {
     VSocketInfoVector   info;
-    VMutexLocker        locker(&mSocketThreadsMutex, VSTRING_FORMAT("[%s]VListenerThread::enumerateActiveSockets()", this->getName().chars()));
+    VMutexLocker        locker(&mSocketThreadsMutex, "VListenerThread::enumerateActiveSockets()");
 
     for (VSizeType i = 0; i < mSocketThreads.size(); ++i) {
         VSocketInfo oneSocketInfo(*(mSocketThreads[i]->getSocket()));
@@ -91,7 +104,7 @@ VSocketInfoVector VListenerThread::enumerateActiveSockets() {
 
 void VListenerThread::stopSocketThread(VSocketID socketID, int localPortNumber) {
     bool            found = false;
-    VMutexLocker    locker(&mSocketThreadsMutex, VSTRING_FORMAT("[%s]VListenerThread::stopSocketThread()", this->getName().chars()));
+    VMutexLocker    locker(&mSocketThreadsMutex, "VListenerThread::stopSocketThread()");
 
     for (VSizeType i = 0; i < mSocketThreads.size(); ++i) {
         VSocketThread*  thread = mSocketThreads[i];
@@ -110,7 +123,7 @@ void VListenerThread::stopSocketThread(VSocketID socketID, int localPortNumber)
 }
 
 void VListenerThread::stopAllSocketThreads() {
-    VMutexLocker locker(&mSocketThreadsMutex, VSTRING_FORMAT("[%s]VListenerThread::stopAllSocketThreads()", this->getName().chars()));
+    VMutexLocker locker(&mSocketThreadsMutex, "VListenerThread::stopAllSocketThreads()");
 
     for (VSizeType i = 0; i < mSocketThreads.size(); ++i) {
         VSocketThread* thread = mSocketThreads[i];
@@ -140,7 +153,7 @@ void VListenerThread::_runListening() {
 
             if (theSocket != NULL) {
                 try {
-                    VMutexLocker locker(&mSocketThreadsMutex, VSTRING_FORMAT("[%s]VListenerThread::_runListening()", this->getName().chars()));
+                    VMutexLocker locker(&mSocketThreadsMutex, "VListenerThread::_runListening()");
 
                     if (mSessionFactory == NULL) {
                         VSocketThread* thread = mThreadFactory->createThread(theSocket, this);
@@ -196,3 +209,8 @@ void VListenerThread::_runListening() {
     }
 }
 
+void VListenerThread::_wakeIdleWait() {
+    // run() looks at mShouldListen and the running state while holding mIdleMutex.
+    VMutexLocker locker(&mIdleMutex, "VListenerThread::_wakeIdleWait()");
+    mIdleCondition.signal();
+}
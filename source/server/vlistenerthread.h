@@ -13,6 +13,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vsocketthread.h"
 #include "vsocket.h"
 #include "vmutex.h"
+#include "vconditionvariable.h"
 
 class VSocketFactory;
 class VSocketThreadFactory;
@@ -139,10 +140,10 @@ class VListenerThread : public VThread {
         void stopAllSocketThreads();
         /**
         Sets the thread to listen if it isn't already. If the thread is
-        currently listening, nothing changes. If it's sleeping in non-listening
-        mode, next time through the loop it will start listening again.
+        currently listening, nothing changes. If it's waiting in non-listening
+        mode, it is woken and starts listening again.
         */
-        void startListening() { mShouldListen = true; }
+        void startListening();
         /**
         Sets the thread to stop listening if it's currently listening. If the
         thread is not currently listening, nothing changes. If it's running in
@@ -170,6 +171,11 @@ class VListenerThread : public VThread {
         The run() method calls this when we are listening. So
         */
         void _runListening();
+        /**
+        Wakes the run() loop if it is waiting in non-listening mode, so that it
+        notices a change to mShouldListen or to the running state.
+        */
+        void _wakeIdleWait();
 
         int                     mPortNumber;            ///< The port number we are listening on.
         VString                 mBindAddress;           ///< The address to bind to (INADDR_ANY is used if the address is empty)
@@ -179,6 +185,8 @@ class VListenerThread : public VThread {
         VClientSessionFactory*  mSessionFactory;        ///< A factory for each incoming connection's VClientSession.
         VSocketThreadPtrVector  mSocketThreads;         ///< The VSocketThread objects we have created.
         VMutex                  mSocketThreadsMutex;    ///< Mutex to protect our VSocketThread vector.
+        VMutex                  mIdleMutex;             ///< The mutex held by run() while it waits on mIdleCondition in non-listening mode.
+        VConditionVariable      mIdleCondition;         ///< Signaled by startListening() and stop() to end a non-listening wait.
 
 };
 
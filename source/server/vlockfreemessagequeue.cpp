@@ -0,0 +1,262 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vlockfreemessagequeue.h"
+
+#include "vmessagequeue.h"
+#include "vmutexlocker.h"
+#include "vlogger.h"
+
+// VLockFreeMessageQueue ------------------------------------------------------
+
+VLockFreeMessageQueue::VLockFreeMessageQueue(int capacity, bool isBounded)
+    : mSlots(NULL)
+    , mMask(0)
+    , mIsBounded(isBounded)
+    , mEnqueuePosition(0)
+    , mDequeuePosition(0)
+    , mQueuedMessagesCount(0)
+    , mQueuedMessagesDataSize(0)
+    , mLastMessagePostTime(0)
+    , mConsumerBlocked(false)
+    , mWakeUpPending(false)
+    , mBlockingMutex("VLockFreeMessageQueue::mBlockingMutex")
+    , mBlockingCondition()
+    , mIsOverflowing(false)
+    , mOverflowMutex("VLockFreeMessageQueue::mOverflowMutex")
+    , mOverflowMessages()
+    {
+
+    VSizeType roundedCapacity = 2;
+    while (roundedCapacity < static_cast<VSizeType>(capacity)) {
+        roundedCapacity <<= 1;
+    }
+
+    mMask = roundedCapacity - 1;
+    mSlots = new Slot[roundedCapacity];
+
+    for (VSizeType i = 0; i < roundedCapacity; ++i) {
+        mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+        mSlots[i].mDataLength = 0;
+    }
+}
+
+VLockFreeMessageQueue::~VLockFreeMessageQueue() {
+    delete [] mSlots;
+}
+
+bool VLockFreeMessageQueue::postMessage(VMessagePtr message) {
+    bool posted = false;
+
+    // While the overflow holds messages, later ones must follow them there to stay in order.
+    if (!mIsBounded && mIsOverflowing.load(std::memory_order_seq_cst)) {
+        posted = this->_enqueueOverflow(message, false);
+    }
+
+    if (!posted) {
+        posted = this->_enqueue(message);
+    }
+
+    if (!posted && !mIsBounded) {
+        posted = this->_enqueueOverflow(message, true);
+    }
+
+    if (!posted) {
+        return false;
+    }
+
+    if (VMessageQueue::getQueueingLagLoggingThreshold() >= VDuration::ZERO()) {
+        mLastMessagePostTime.store(VInstant().getValue(), std::memory_order_relaxed);
+    }
+
+    if (mConsumerBlocked.load(std::memory_order_seq_cst)) {
+        this->_wakeConsumer();
+    }
+
+    return true;
+}
+
+bool VLockFreeMessageQueue::_enqueue(VMessagePtr message) {
+    VSizeType position = mEnqueuePosition.load(std::memory_order_relaxed);
+    Slot* slot = NULL;
+
+    for (;;) {
+        slot = &mSlots[position & mMask];
+        VSizeType sequence = slot->mSequence.load(std::memory_order_acquire);
+        Vs64 difference = static_cast<Vs64>(sequence) - static_cast<Vs64>(position);
+
+        if (difference == 0) {
+            if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break; // slot is ours
+            }
+        } else if (difference < 0) {
+            return false; // full: the consumer has not yet freed the slot from the previous lap
+        } else {
+            position = mEnqueuePosition.load(std::memory_order_relaxed); // another producer claimed it
+        }
+    }
+
+    Vs64 dataLength = (message == nullptr) ? 0 : message->getMessageDataLength();
+    slot->mMessage = message;
+    slot->mDataLength = dataLength;
+
+    // Count the message before it becomes visible, so the consumer can never uncount it first.
+    mQueuedMessagesDataSize.fetch_add(dataLength);
+    mQueuedMessagesCount.fetch_add(1);
+
+    slot->mSequence.store(position + 1, std::memory_order_seq_cst);
+
+    return true;
+}
+
+bool VLockFreeMessageQueue::_enqueueOverflow(VMessagePtr message, bool start) {
+    VMutexLocker locker(&mOverflowMutex, "VLockFreeMessageQueue::_enqueueOverflow()");
+
+    if (!start && !mIsOverflowing.load(std::memory_order_seq_cst)) {
+        return false; // the consumer drained it since we looked; the ring is next in line again
+    }
+
+    OverflowEntry entry;
+    entry.mMessage = message;
+    entry.mDataLength = (message == nullptr) ? 0 : message->getMessageDataLength();
+
+    mQueuedMessagesDataSize.fetch_add(entry.mDataLength);
+    mQueuedMessagesCount.fetch_add(1);
+
+    mOverflowMessages.push_back(entry);
+    mIsOverflowing.store(true, std::memory_order_seq_cst);
+
+    return true;
+}
+
+VMessagePtr VLockFreeMessageQueue::blockUntilNextMessage() {
+    // If there is a message on the queue, we can simply return it.
+    VMessagePtr message = this->getNextMessage();
+    if (message != nullptr) {
+        return message;
+    }
+
+    // A wakeUp() that arrived before we got here is not lost; it ends this call without waiting.
+    if (mWakeUpPending.exchange(false)) {
+        return VMessagePtr();
+    }
+
+    /* locker scope */ {
+        VMutexLocker locker(&mBlockingMutex, "VLockFreeMessageQueue::blockUntilNextMessage()");
+
+        // Announce that we're about to block, then look again: a producer that published before
+        // seeing the flag is caught by the second look; one that publishes after will signal us.
+        // wakeUp() raises its flag before taking the mutex to signal, so the same holds for it.
+        mConsumerBlocked.store(true, std::memory_order_seq_cst);
+        message = this->getNextMessage();
+
+        if ((message == nullptr) && !mWakeUpPending.exchange(false)) {
+            (void) mBlockingCondition.wait(&mBlockingMutex, 5 * VDuration::SECOND());
+            mWakeUpPending.store(false, std::memory_order_seq_cst);
+        }
+
+        mConsumerBlocked.store(false, std::memory_order_seq_cst);
+    }
+
+    if (message != nullptr) {
+        return message;
+    }
+
+    return this->getNextMessage();
+}
+
+VMessagePtr VLockFreeMessageQueue::getNextMessage() {
+    VMessagePtr message;
+
+    if (this->_dequeue(message) && (message != nullptr) && (VMessageQueue::getQueueingLagLoggingThreshold() >= VDuration::ZERO())) {
+        VInstant now;
+        VDuration delayInterval = now - VInstant::instantFromRawValue(mLastMessagePostTime.load(std::memory_order_relaxed));
+        if (delayInterval >= VMessageQueue::getQueueingLagLoggingThreshold()) {
+            VLOGGER_NAMED_LEVEL("vault.messages.VMessageQueue", VMessageQueue::getQueueingLagLoggingLevel(), VSTRING_FORMAT("VLockFreeMessageQueue saw a delay of %s when getting a message with ID %d.", delayInterval.getDurationString().chars(), message->getMessageID()));
+        }
+    }
+
+    return message;
+}
+
+void VLockFreeMessageQueue::wakeUp() {
+    mWakeUpPending.store(true, std::memory_order_seq_cst);
+    this->_wakeConsumer();
+}
+
+void VLockFreeMessageQueue::releaseAllMessages() {
+    VMessagePtr message;
+    while (this->_dequeue(message)) {
+        message.reset();
+    }
+}
+
+bool VLockFreeMessageQueue::_dequeue(VMessagePtr& message) {
+    // Whatever is in the ring was posted before the overflow began, or concurrently with it.
+    VSizeType position = mDequeuePosition.load(std::memory_order_relaxed);
+    Slot* slot = NULL;
+
+    for (;;) {
+        slot = &mSlots[position & mMask];
+        VSizeType sequence = slot->mSequence.load(std::memory_order_seq_cst);
+        Vs64 difference = static_cast<Vs64>(sequence) - static_cast<Vs64>(position + 1);
+
+        if (difference == 0) {
+            if (mDequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break; // slot is ours
+            }
+        } else if (difference < 0) {
+            return this->_dequeueOverflow(message); // ring empty (or the next post is claimed but not yet published)
+        } else {
+            position = mDequeuePosition.load(std::memory_order_relaxed); // another consumer took it
+        }
+    }
+
+    message = slot->mMessage;
+    slot->mMessage.reset();
+
+    // Uncount the message before freeing the slot, so a producer can never count its replacement first.
+    mQueuedMessagesDataSize.fetch_sub(slot->mDataLength);
+    mQueuedMessagesCount.fetch_sub(1);
+
+    slot->mSequence.store(position + mMask + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool VLockFreeMessageQueue::_dequeueOverflow(VMessagePtr& message) {
+    if (mIsBounded || !mIsOverflowing.load(std::memory_order_seq_cst)) {
+        return false;
+    }
+
+    VMutexLocker locker(&mOverflowMutex, "VLockFreeMessageQueue::_dequeueOverflow()");
+
+    if (mOverflowMessages.empty()) {
+        return false;
+    }
+
+    const OverflowEntry& entry = mOverflowMessages.front();
+    message = entry.mMessage;
+    mQueuedMessagesDataSize.fetch_sub(entry.mDataLength);
+    mQueuedMessagesCount.fetch_sub(1);
+    mOverflowMessages.pop_front();
+
+    if (mOverflowMessages.empty()) {
+        mIsOverflowing.store(false, std::memory_order_seq_cst);
+    }
+
+    return true;
+}
+
+void VLockFreeMessageQueue::_wakeConsumer() {
+    // The consumer holds mBlockingMutex from raising mConsumerBlocked until its wait releases it,
+    // so a signal sent with the mutex held cannot fall between its second look and its wait.
+    VMutexLocker locker(&mBlockingMutex, "VLockFreeMessageQueue::_wakeConsumer()");
+    mBlockingCondition.signal();
+}
@@ -0,0 +1,157 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vlockfreemessagequeue_h
+#define vlockfreemessagequeue_h
+
+/** @file */
+
+#include "vmessage.h"
+#include "vmutex.h"
+#include "vconditionvariable.h"
+#include "vcompactingdeque.h"
+
+#include <atomic>
+
+/**
+    @ingroup vsocket
+*/
+
+/**
+VLockFreeMessageQueue is an alternative to VMessageQueue for the case
+where many threads post to a queue that one thread drains, such as the
+output queue of a VMessageOutputThread receiving broadcasts from many
+message handler threads.
+
+Posting and removing messages never takes a lock: the queue is a fixed-size
+ring of slots, each with a sequence number that producers and consumers
+claim with a compare-and-swap. The consumer only touches a mutex and
+condition variable when the queue is empty and it has to block; producers
+only touch them when they find a consumer blocked.
+
+A bounded queue's postMessage() fails when the ring is full, and the caller
+decides what a full queue means. An unbounded queue instead moves on to a
+mutex-guarded overflow deque when the ring is full, so the ring can be sized
+for the normal backlog rather than the worst burst. Once a post has gone to
+the overflow, later posts follow it there until the consumer has drained it,
+so a producer's messages stay in order. getQueueSize() and getQueueDataSize()
+are exact: a message is counted before it becomes visible to the consumer and
+uncounted before its slot becomes available to producers.
+
+The queue is safe for multiple consumers as well, so that, for example,
+releaseAllMessages() may be called from a thread other than the one blocked
+in blockUntilNextMessage(); but it is intended for a single consumer.
+*/
+class VLockFreeMessageQueue {
+    public:
+
+        static const bool kBounded = true;      ///< Constructor flag: postMessage() fails when the ring is full.
+        static const bool kUnbounded = false;   ///< Constructor flag: messages that don't fit in the ring go to the overflow.
+
+        /**
+        Constructs the queue.
+        @param  capacity    the number of messages the ring can hold;
+                            rounded up to a power of two
+        @param  isBounded   kBounded if the ring's capacity is the limit; kUnbounded
+                            if messages beyond it go to the overflow
+        */
+        VLockFreeMessageQueue(int capacity, bool isBounded = kBounded);
+        /**
+        Virtual destructor.
+        */
+        virtual ~VLockFreeMessageQueue();
+
+        /**
+        Posts a message to the back of the queue. May be safely called from
+        any thread.
+        @param    message    the message object to be posted
+        @return true if the message was posted; false if the queue is bounded and full
+        */
+        bool postMessage(VMessagePtr message);
+        /**
+        Returns the message at the front of the queue, blocking if the queue
+        is empty. Returns NULL if the wait times out or is interrupted by
+        wakeUp(), so the caller can check whether it should keep running.
+        @return the message at the front of the queue, or NULL
+        */
+        VMessagePtr blockUntilNextMessage();
+        /**
+        Returns the message at the front of the queue, or NULL if the queue
+        is empty.
+        @return the message at the front of the queue, or NULL
+        */
+        VMessagePtr getNextMessage();
+        /**
+        Wakes up the consumer if it is blocked, even though there are no
+        messages. This is used during shutdown to let the blocked thread
+        notice that it has been asked to terminate. If the consumer is not
+        blocked yet, its next blocking call returns NULL without waiting.
+        */
+        void wakeUp();
+        /**
+        Returns the number of messages currently in the queue.
+        @return obvious
+        */
+        VSizeType getQueueSize() const { return mQueuedMessagesCount.load(); }
+        /**
+        Returns the number of message bytes currently in the queue.
+        @return obvious
+        */
+        Vs64 getQueueDataSize() const { return mQueuedMessagesDataSize.load(); }
+        /**
+        Returns the number of messages the ring can hold. An unbounded queue
+        holds any more in its overflow.
+        @return obvious
+        */
+        int getCapacity() const { return static_cast<int>(mMask + 1); }
+        /**
+        Releases all messages in the queue.
+        */
+        void releaseAllMessages();
+
+    private:
+
+        VLockFreeMessageQueue(const VLockFreeMessageQueue&); // not copyable
+        VLockFreeMessageQueue& operator=(const VLockFreeMessageQueue&); // not assignable
+
+        /** One slot in the ring. */
+        struct Slot {
+            std::atomic<VSizeType>  mSequence;      ///< Equals the claiming position when free for a producer, position + 1 when holding a message.
+            VMessagePtr             mMessage;       ///< The message held in the slot.
+            Vs64                    mDataLength;    ///< The message data length recorded when posted, so the accounting matches exactly on removal.
+        };
+
+        /** A message waiting in the overflow, with its data length recorded like a slot's. */
+        struct OverflowEntry {
+            VMessagePtr mMessage;       ///< The message.
+            Vs64        mDataLength;    ///< The message data length recorded when posted.
+        };
+
+        bool _enqueue(VMessagePtr message);                     ///< Posts the message to the ring; returns false if the ring is full.
+        bool _enqueueOverflow(VMessagePtr message, bool start); ///< Posts the message to the overflow; returns false if it has drained, unless start is true.
+        bool _dequeue(VMessagePtr& message);                    ///< Removes the front message into the parameter; returns false if the queue is empty.
+        bool _dequeueOverflow(VMessagePtr& message);            ///< Removes the front overflow message into the parameter; returns false if there is none.
+        void _wakeConsumer();                   ///< Signals the condition variable so that a blocked consumer wakes up.
+
+        Slot*                   mSlots;                     ///< The ring of slots.
+        VSizeType               mMask;                      ///< Capacity - 1; capacity is a power of two.
+        const bool              mIsBounded;                 ///< True if postMessage() fails when the ring is full.
+        std::atomic<VSizeType>  mEnqueuePosition;           ///< Next position producers will claim.
+        std::atomic<VSizeType>  mDequeuePosition;           ///< Next position consumers will claim.
+        std::atomic<VSizeType>  mQueuedMessagesCount;       ///< The number of messages in the queue.
+        std::atomic<Vs64>       mQueuedMessagesDataSize;    ///< The number of bytes in the queued messages.
+        std::atomic<Vs64>       mLastMessagePostTime;       ///< Raw VInstant value of the most recent post, if lag logging is on.
+        std::atomic<bool>       mConsumerBlocked;           ///< True while a consumer is in (or about to enter) its wait.
+        std::atomic<bool>       mWakeUpPending;             ///< Set by wakeUp(); the next blocking call consumes it instead of waiting.
+        VMutex                  mBlockingMutex;             ///< The mutex the consumer waits with.
+        VConditionVariable      mBlockingCondition;         ///< The condition variable used to block/awaken the consumer.
+        std::atomic<bool>       mIsOverflowing;             ///< True while the overflow holds messages; posts go there until it drains.
+        VMutex                  mOverflowMutex;             ///< Guards mOverflowMessages.
+        VCompactingDeque<OverflowEntry> mOverflowMessages;  ///< Messages posted while the ring was full, for an unbounded queue.
+};
+
+#endif /* vlockfreemessagequeue_h */
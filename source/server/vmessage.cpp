@@ -67,3 +67,11 @@ Vs64 VMessage::getBufferSize() const {
     return mMessageDataBuffer.getBufferSize();
 }
 
+// VMessageFactory ------------------------------------------------------------
+
+const Vs64 VMessageFactory::kFrameHeaderIncomplete = -1;
+const Vs64 VMessageFactory::kFrameLengthUnknown = -2;
+
+Vs64 VMessageFactory::getFrameLength(const Vu8* /*buffer*/, Vs64 /*numBytes*/) const {
+    return kFrameLengthUnknown;
+}
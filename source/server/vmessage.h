@@ -38,6 +38,20 @@ typedef int  VMessageID;        ///< Message identifier (verb) to distinguish it
 #define VLOGGER_MESSAGE_DEBUG(message) VLOGGER_NAMED_DEBUG(VMessage::kMessageLoggerName, message)
 /** Emits a message at kTrace level to the message logger. */
 #define VLOGGER_MESSAGE_TRACE(message) VLOGGER_NAMED_TRACE(VMessage::kMessageLoggerName, message)
+/** Emits a message at specified level to the message logger, formatting it only if an appender writes it; takes a format string and arguments as VSTRING_FORMAT() does. */
+#define VLOGGER_MESSAGE_LEVEL_FORMAT(level, ...) VLOGGER_NAMED_LEVEL_FORMAT(VMessage::kMessageLoggerName, level, __VA_ARGS__)
+/** Emits a formatted message at kFatal level to the message logger. */
+#define VLOGGER_MESSAGE_FATAL_FORMAT(...) VLOGGER_NAMED_FATAL_FORMAT(VMessage::kMessageLoggerName, __VA_ARGS__)
+/** Emits a formatted message at kError level to the message logger. */
+#define VLOGGER_MESSAGE_ERROR_FORMAT(...) VLOGGER_NAMED_ERROR_FORMAT(VMessage::kMessageLoggerName, __VA_ARGS__)
+/** Emits a formatted message at kWarn level to the message logger. */
+#define VLOGGER_MESSAGE_WARN_FORMAT(...) VLOGGER_NAMED_WARN_FORMAT(VMessage::kMessageLoggerName, __VA_ARGS__)
+/** Emits a formatted message at kInfo level to the message logger. */
+#define VLOGGER_MESSAGE_INFO_FORMAT(...) VLOGGER_NAMED_INFO_FORMAT(VMessage::kMessageLoggerName, __VA_ARGS__)
+/** Emits a formatted message at kDebug level to the message logger. */
+#define VLOGGER_MESSAGE_DEBUG_FORMAT(...) VLOGGER_NAMED_DEBUG_FORMAT(VMessage::kMessageLoggerName, __VA_ARGS__)
+/** Emits a formatted message at kTrace level to the message logger. */
+#define VLOGGER_MESSAGE_TRACE_FORMAT(...) VLOGGER_NAMED_TRACE_FORMAT(VMessage::kMessageLoggerName, __VA_ARGS__)
 /** Emits a hex dump at a specified level to the specified logger. */
 #define VLOGGER_MESSAGE_HEXDUMP(message, buffer, length) VLOGGER_NAMED_HEXDUMP(VMessage::kMessageLoggerName, VMessage::kMessageContentHexDumpLevel, message, buffer, length)
 /** Returns true if the message logger would emit at the specified level. */
@@ -220,6 +234,21 @@ class VMessageFactory {
         @return    pointer to a new message object
         */
         virtual VMessagePtr instantiateNewMessage(VMessageID messageID = 0) const = 0;
+        /**
+        May be implemented by subclass to tell a reader that accumulates input without
+        blocking (VMessageReactor) how long a message's wire frame is, from its first
+        bytes, so that receive() is called only once the whole frame has arrived. The
+        default returns kFrameLengthUnknown; the reader then calls receive() whenever
+        more bytes arrive and starts over if it runs out.
+        @param  buffer      the first bytes of the frame, as received so far
+        @param  numBytes    the number of bytes in buffer
+        @return the total frame length including its header; kFrameHeaderIncomplete if
+                    more bytes are needed to tell; or kFrameLengthUnknown
+        */
+        virtual Vs64 getFrameLength(const Vu8* buffer, Vs64 numBytes) const;
+
+        static const Vs64 kFrameHeaderIncomplete;   ///< Returned by getFrameLength() if the header has not fully arrived.
+        static const Vs64 kFrameLengthUnknown;      ///< Returned by getFrameLength() if the factory cannot tell frame lengths.
 };
 
 #endif /* vmessage_h */
@@ -0,0 +1,166 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vmessagedispatcher.h"
+
+#include "vmutexlocker.h"
+#include "vbento.h"
+#include "vlogger.h"
+
+// VMessageDispatchStrand -----------------------------------------------------
+
+VMessageDispatchStrand::VMessageDispatchStrand(VMessageDispatchTarget* target)
+    : mTarget(target)
+    , mMutex("VMessageDispatchStrand::mMutex")
+    , mPendingOrdered()
+    , mOrderedActive(false)
+    , mNumInFlight(0)
+    , mWaiterBlocked(false)
+    , mBlockingMutex("VMessageDispatchStrand::mBlockingMutex")
+    , mBlockingCondition()
+    {
+}
+
+void VMessageDispatchStrand::waitUntilInFlightBelow(int maxInFlight) {
+    while (mNumInFlight.load() >= maxInFlight) {
+        VMutexLocker locker(&mBlockingMutex, "VMessageDispatchStrand::waitUntilInFlightBelow()");
+
+        // Announce that we're about to block, then look again: a worker that finished before
+        // seeing the flag is caught by the second look; one that finishes after will signal us.
+        mWaiterBlocked.store(true);
+        if (mNumInFlight.load() >= maxInFlight) {
+            (void) mBlockingCondition.wait(&mBlockingMutex, VDuration::SECOND());
+        }
+
+        mWaiterBlocked.store(false);
+    }
+}
+
+void VMessageDispatchStrand::_finishedOne() {
+    --mNumInFlight;
+
+    if (mWaiterBlocked.load()) {
+        VMutexLocker locker(&mBlockingMutex, "VMessageDispatchStrand::_finishedOne()");
+        mBlockingCondition.signal();
+    }
+}
+
+// VMessageDispatcher ---------------------------------------------------------
+
+VMessageDispatcher::VMessageDispatcher(const VString& name, int numWorkerThreads, VManagementInterface* manager)
+    : mName(name)
+    , mLoggerName("vault.messages.VMessageDispatcher")
+    , mPool(name, numWorkerThreads, manager)
+    , mNumPosted(0)
+    , mNumUnordered(0)
+    , mNumCompleted(0)
+    {
+}
+
+VMessageDispatcher::~VMessageDispatcher() {
+    try {
+        this->stop();
+    } catch (...) {} // prevent exception from propagating
+}
+
+void VMessageDispatcher::start() {
+    mPool.start();
+}
+
+void VMessageDispatcher::stop() {
+    // The pool runs everything already queued. Once it is stopping, a task that readies its strand's
+    // next ordered message runs it itself (see _runMessage()), since the pool would run it inline anyway.
+    mPool.stop();
+}
+
+void VMessageDispatcher::postMessage(VMessageDispatchStrandPtr strand, VMessagePtr message, bool ordered) {
+    ++strand->mNumInFlight;
+    ++mNumPosted;
+
+    if (! ordered) {
+        ++mNumUnordered;
+    } else {
+        VMutexLocker locker(&strand->mMutex, "VMessageDispatcher::postMessage()");
+
+        if (strand->mOrderedActive) {
+            // Runs when the ordered message ahead of it finishes; see _runMessage().
+            strand->mPendingOrdered.push_back(std::move(message));
+            return;
+        }
+
+        strand->mOrderedActive = true;
+    }
+
+    this->_submit(strand, std::move(message), ordered);
+}
+
+void VMessageDispatcher::getDispatcherInfo(VBentoNode& bento) const {
+    bento.addString("name", mName);
+    bento.addInt("workers", mPool.getNumWorkerThreads());
+    bento.addInt("ready", mPool.getQueueSize());
+    bento.addS64("posted", mNumPosted.load());
+    bento.addS64("unordered", mNumUnordered.load());
+    bento.addS64("completed", mNumCompleted.load());
+
+    mPool.getPoolInfo(*bento.addNewChildNode("pool"));
+}
+
+void VMessageDispatcher::_submit(VMessageDispatchStrandPtr strand, VMessagePtr message, bool ordered) {
+    // The task holds the only reference to the message (the input thread moved its own in); see _runMessage().
+    (void) mPool.submit(std::bind(&VMessageDispatcher::_runMessage, this, strand, std::move(message), ordered));
+}
+
+void VMessageDispatcher::_runMessage(VMessageDispatchStrandPtr strand, VMessagePtr& message, bool ordered) {
+    for (;;) {
+        // The target catches whatever the handler throws; this is the last resort so that
+        // the message still counts as finished if the dispatch hooks themselves fail.
+        try {
+            strand->mTarget->dispatchPostedMessage(message);
+        } catch (const std::exception& ex) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageDispatcher: Caught exception for message ID %d: %s", mName.chars(), (int) message->getMessageID(), ex.what()));
+        } catch (...) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageDispatcher: Caught unknown exception for message ID %d.", mName.chars(), (int) message->getMessageID()));
+        }
+
+        // The message is the task's bound copy, so unless the handler kept a reference ours is the last
+        // one, and the target's pool can recycle it. This also resets our pointer; the task object
+        // itself lives on in the pool until we return. We must not touch the target after this.
+        strand->mTarget->releasePostedMessage(message);
+        ++mNumCompleted;
+
+        VMessagePtr nextMessage;
+        if (ordered) {
+            VMutexLocker locker(&strand->mMutex, "VMessageDispatcher::_runMessage()");
+
+            if (strand->mPendingOrdered.empty()) {
+                strand->mOrderedActive = false;
+            } else {
+                // The strand stays active while its next ordered message waits for a worker.
+                nextMessage = strand->mPendingOrdered.front();
+                strand->mPendingOrdered.pop_front();
+            }
+        }
+
+        // A stopping pool would run a submitted task right here, one level deeper per message in the
+        // strand; so then we run the strand's next message ourselves, in this loop.
+        const bool runNextHere = (nextMessage != nullptr) && mPool.isStopping();
+        if ((nextMessage != nullptr) && ! runNextHere) {
+            this->_submit(strand, std::move(nextMessage), true);
+        }
+
+        // The task's reference keeps the strand alive even if this lets its input thread end.
+        strand->_finishedOne();
+
+        if (! runNextHere) {
+            return;
+        }
+
+        message = std::move(nextMessage);
+    }
+}
@@ -0,0 +1,221 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vmessagedispatcher_h
+#define vmessagedispatcher_h
+
+/** @file */
+
+#include "vmessage.h"
+#include "vmutex.h"
+#include "vconditionvariable.h"
+#include "vthreadpool.h"
+
+#include <atomic>
+#include <deque>
+
+class VBentoNode;
+class VManagementInterface;
+class VMessageDispatcher;
+
+/**
+    @ingroup vsocket
+*/
+
+/**
+VMessageDispatchTarget is implemented by whatever received the messages posted
+on a VMessageDispatchStrand, and knows how to handle them: VMessageInputThread
+for its session, or VMessageReactorThread's per-session connection. Both methods
+are called on a dispatcher worker thread.
+*/
+class VMessageDispatchTarget {
+    public:
+
+        VMessageDispatchTarget() {}
+        virtual ~VMessageDispatchTarget() {}
+
+        /**
+        Handles the message, catching whatever its handler throws.
+        @param  message the message to handle
+        */
+        virtual void dispatchPostedMessage(VMessagePtr message) = 0;
+        /**
+        Called once the message has been handled, to recycle it. This is the last
+        time the dispatcher touches the target for this message; afterward the
+        target may be gone, unless it has further messages posted.
+        @param  message the message to release; the reference is reset
+        */
+        virtual void releasePostedMessage(VMessagePtr& message) = 0;
+
+    private:
+
+        VMessageDispatchTarget(const VMessageDispatchTarget&); // not copyable
+        VMessageDispatchTarget& operator=(const VMessageDispatchTarget&); // not assignable
+};
+
+/**
+VMessageDispatchStrand is the per-session state that a VMessageDispatcher keeps
+for one VMessageDispatchTarget. It carries the ordered messages that are waiting
+for the one ahead of them to finish, and the count of messages that have been
+posted but not yet finished, on which the input thread waits for backpressure
+and at shutdown.
+
+The strand is shared between the input thread and the tasks that reference it,
+so that a worker finishing the last task can still wake the input thread even if
+the input thread is on its way out. The ordered queue is guarded by the strand's
+own mutex, so sessions never contend with each other; the in-flight count can be
+read without it.
+*/
+class VMessageDispatchStrand {
+    public:
+
+        /**
+        Constructs the strand for a dispatch target.
+        @param  target  the input thread or connection whose messages are dispatched through this strand
+        */
+        VMessageDispatchStrand(VMessageDispatchTarget* target);
+        ~VMessageDispatchStrand() {}
+
+        /**
+        Returns the number of messages posted and not yet finished.
+        */
+        int getNumInFlight() const { return mNumInFlight.load(); }
+        /**
+        Blocks the caller until fewer than the specified number of messages are
+        in flight. Passing 1 waits until all posted messages have finished.
+        @param  maxInFlight the count that must not be reached before returning
+        */
+        void waitUntilInFlightBelow(int maxInFlight);
+
+    private:
+
+        VMessageDispatchStrand(const VMessageDispatchStrand&); // not copyable
+        VMessageDispatchStrand& operator=(const VMessageDispatchStrand&); // not assignable
+
+        void _finishedOne(); ///< Called by the dispatcher (without its mutex) when a posted message has finished.
+
+        friend class VMessageDispatcher;
+
+        VMessageDispatchTarget* mTarget;            ///< The input thread or connection that handles our messages.
+        VMutex                  mMutex;             ///< Guards mPendingOrdered and mOrderedActive.
+        std::deque<VMessagePtr> mPendingOrdered;    ///< Ordered messages waiting for the ordered one ahead of them to finish.
+        bool                    mOrderedActive;     ///< True while one of our ordered messages is submitted to or running on a worker.
+        std::atomic<int>        mNumInFlight;       ///< Messages posted and not yet finished, ordered or not.
+        std::atomic<bool>       mWaiterBlocked;     ///< True while the input thread is (about to be) waiting on mBlockingCondition.
+        VMutex                  mBlockingMutex;     ///< The mutex held by the input thread while it waits on mBlockingCondition.
+        VConditionVariable      mBlockingCondition; ///< Signaled when a message finishes while the input thread is blocked.
+};
+
+typedef VSharedPtr<VMessageDispatchStrand> VMessageDispatchStrandPtr;
+
+/**
+VMessageDispatcher runs message handlers on the worker threads of a VThreadPool
+it owns, rather than on the socket input thread that received the message. This
+lets a slow handler on one session proceed without stalling the reading of
+further messages, and lets a few workers serve many sessions. The pool does the
+scheduling (per-worker queues with work stealing); the dispatcher only adds the
+per-session ordering described below.
+
+An input thread is attached to a dispatcher with
+VMessageInputThread::setMessageDispatcher(). It then posts each message it
+receives here instead of calling _dispatchMessage() itself, and one of the
+workers calls the input thread's _dispatchMessage() for it. A VMessageReactor
+is attached with VMessageReactor::setMessageDispatcher(); each of its sessions
+gets its own strand, and the workers call the reactor thread's _dispatchMessage().
+The rules are:
+
+- Messages whose handler requires ordered dispatch (the default; see
+  VMessageHandlerFactory::requiresOrderedDispatch()) are processed one at a
+  time per session, in the order received, exactly as they would be inline.
+- Messages whose handler opts out may be processed by any worker as soon as one
+  is free, concurrently with other messages from the same session.
+- When a session has the configured number of messages in flight, its input
+  thread (or its reactor event loop, for that session only) stops reading from
+  the socket until one finishes, so a client that sends faster than its
+  handlers run is throttled by TCP rather than growing an unbounded backlog here.
+
+Because a handler may now run on a worker thread, handlers used in this mode must
+not assume that VThread::getCurrentThread() is the session's input thread. The
+handler's mThread is still the input thread.
+
+Each message is moved, not copied, from the input thread into the pool task, so
+that the worker that finishes it holds its last reference and returns it to the
+input thread's VMessagePool for reuse.
+
+The dispatcher must outlive the input threads attached to it. stop() lets the
+workers finish any posted messages, including ordered messages readied by the
+ones they finish, before they end.
+*/
+class VMessageDispatcher {
+    public:
+
+        static const int kDefaultNumWorkerThreads = 4;          ///< Default number of worker threads.
+        static const int kDefaultMaxInFlightPerSession = 32;    ///< Default limit on unfinished messages per session before its input pauses.
+
+        /**
+        Constructs the dispatcher. The workers are not started until start() is called.
+        @param  name                the name of the dispatcher, used to name the worker threads
+        @param  numWorkerThreads    the number of worker threads to run
+        @param  manager             the management interface to supply to the worker threads, or NULL
+        */
+        VMessageDispatcher(const VString& name, int numWorkerThreads = kDefaultNumWorkerThreads, VManagementInterface* manager = NULL);
+        /**
+        Destructor. Stops the workers if they are still running.
+        */
+        ~VMessageDispatcher();
+
+        /**
+        Starts the worker threads.
+        */
+        void start();
+        /**
+        Stops the worker threads after they have finished all posted messages,
+        and waits for them to end.
+        */
+        void stop();
+
+        /**
+        Posts a message to be processed on a worker thread. The caller is the input
+        thread that owns the strand; it should wait on the strand for backpressure.
+        @param  strand  the strand of the input thread that received the message
+        @param  message the message to process
+        @param  ordered true if the message must be processed after all ordered
+                        messages previously posted on the strand
+        */
+        void postMessage(VMessageDispatchStrandPtr strand, VMessagePtr message, bool ordered);
+
+        /**
+        Returns the number of worker threads.
+        */
+        int getNumWorkerThreads() const { return mPool.getNumWorkerThreads(); }
+        /**
+        Returns the number of messages ready to run but not yet picked up by a worker.
+        */
+        int getQueueSize() const { return mPool.getQueueSize(); }
+        /**
+        Adds the dispatcher's state and counters to a bento node, for diagnostics.
+        @param  bento   the node to add to
+        */
+        void getDispatcherInfo(VBentoNode& bento) const;
+
+    private:
+
+        VMessageDispatcher(const VMessageDispatcher&); // not copyable
+        VMessageDispatcher& operator=(const VMessageDispatcher&); // not assignable
+
+        void _submit(VMessageDispatchStrandPtr strand, VMessagePtr message, bool ordered); ///< Hands a ready message to the pool.
+        void _runMessage(VMessageDispatchStrandPtr strand, VMessagePtr& message, bool ordered); ///< The pool task: runs the message, has the target release it, then readies the strand's next ordered one.
+
+        VString                     mName;              ///< The dispatcher name, for log output.
+        VString                     mLoggerName;        ///< The logger name which we will use when emitting log output.
+        VThreadPool                 mPool;              ///< The worker threads that run the messages.
+        std::atomic<Vs64>           mNumPosted;         ///< Counter of messages posted.
+        std::atomic<Vs64>           mNumUnordered;      ///< Counter of posted messages that did not require ordering.
+        std::atomic<Vs64>           mNumCompleted;      ///< Counter of messages finished by the workers.
+};
+
+#endif /* vmessagedispatcher_h */
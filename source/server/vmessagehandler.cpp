@@ -10,14 +10,261 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vexception.h"
 #include "vsocketthread.h"
 #include "vclientsession.h"
+#include "vshutdownregistry.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+// VMessageHandlerTable -------------------------------------------------------
+
+static const Vu32 kHandlerTableSlotSeed = 0x68E31DA4;  // Distinguishes the slot hash from the bucket hash.
+static const int kHandlerTableMaxSeedAttempts = 8;     // Seeds to try before falling back to binary search.
+
+VMessageHandlerTable::VMessageHandlerTable(const VMessageHandlerFactoryMap& factories)
+    : mForm(kDense)
+    , mMinID(0)
+    , mSeed(0)
+    , mBucketShift(32)
+    , mSlotMask(0)
+    , mEntries()
+    , mSlots()
+    , mDisplacements()
+    {
+    // The map is in ID order, so the entries are too. Logger names are built once here
+    // so that handler construction never has to format them.
+    for (VMessageHandlerFactoryMap::const_iterator i = factories.begin(); i != factories.end(); ++i) {
+        if (i->second != NULL) {
+            Entry entry;
+            entry.mID = i->first;
+            entry.mFactory = i->second;
+            entry.mLoggerName.format("vault.messages.VMessageHandler.%d", i->first);
+            mEntries.push_back(entry);
+        }
+    }
+
+    if (mEntries.empty()) {
+        return; // dense and empty; every lookup misses
+    }
+
+    const int numEntries = static_cast<int>(mEntries.size());
+    mMinID = mEntries.front().mID;
+    const VMessageID maxID = mEntries.back().mID;
+
+    // Compare as 64-bit so that a span across the whole ID range cannot overflow.
+    if ((static_cast<Vs64>(maxID) - static_cast<Vs64>(mMinID)) < kMaxDenseRange) {
+        mSlots.assign(static_cast<VSizeType>(maxID - mMinID + 1), -1);
+        for (int i = 0; i < numEntries; ++i) {
+            mSlots[static_cast<VSizeType>(mEntries[i].mID - mMinID)] = i;
+        }
+
+        return;
+    }
+
+    // About two IDs per bucket, and twice as many slots as IDs.
+    int bucketBits = 1;
+    while ((1 << bucketBits) * 2 < numEntries) {
+        ++bucketBits;
+    }
+
+    int slotBits = 1;
+    while ((1 << slotBits) < 2 * numEntries) {
+        ++slotBits;
+    }
+
+    // Seeds come from a fixed sequence so that a given set of IDs always freezes into the same table.
+    Vu32 seed = 0x9E3779B9; // 2^32 / golden ratio
+    for (int attempt = 0; attempt < kHandlerTableMaxSeedAttempts; ++attempt) {
+        if (this->_buildHashed(bucketBits, slotBits, seed)) {
+            mForm = kHashed;
+            return;
+        }
+
+        seed = seed * 1664525 + 1013904223;
+    }
+
+    mForm = kSorted;
+    mSlots.clear();
+    mDisplacements.clear();
+}
+
+// static
+Vu32 VMessageHandlerTable::_hash(VMessageID messageID, Vu32 seed) {
+    Vu32 x = static_cast<Vu32>(messageID) ^ seed;
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x;
+}
+
+// static
+bool VMessageHandlerTable::_isEntryIDLess(const Entry& entry, VMessageID messageID) {
+    return entry.mID < messageID;
+}
+
+bool VMessageHandlerTable::_buildHashed(int bucketBits, int slotBits, Vu32 seed) {
+    const VSizeType numBuckets = static_cast<VSizeType>(1) << bucketBits;
+    const VSizeType numSlots = static_cast<VSizeType>(1) << slotBits;
+    const int bucketShift = 32 - bucketBits;
+    const Vu32 slotMask = static_cast<Vu32>(numSlots - 1);
+
+    std::vector<std::vector<int> > buckets(numBuckets);
+    for (int i = 0; i < static_cast<int>(mEntries.size()); ++i) {
+        buckets[static_cast<VSizeType>(_hash(mEntries[i].mID, seed) >> bucketShift)].push_back(i);
+    }
+
+    // Place the fullest buckets first, while the most slots are free.
+    std::vector<std::pair<VSizeType, VSizeType> > order(numBuckets); // (size, bucket index)
+    for (VSizeType b = 0; b < numBuckets; ++b) {
+        order[b] = std::make_pair(buckets[b].size(), b);
+    }
+
+    std::sort(order.rbegin(), order.rend());
+
+    mSlots.assign(numSlots, -1);
+    mDisplacements.assign(numBuckets, 0);
+    std::vector<Vu32> bucketSlots;
+
+    for (VSizeType b = 0; b < numBuckets; ++b) {
+        const std::vector<int>& bucket = buckets[order[b].second];
+        if (bucket.empty()) {
+            break; // sorted by size, so the rest are empty too
+        }
+
+        bool placed = false;
+        for (Vu32 displacement = 0; (displacement < numSlots) && ! placed; ++displacement) {
+            bucketSlots.clear();
+            placed = true;
+            for (std::vector<int>::const_iterator i = bucket.begin(); i != bucket.end(); ++i) {
+                Vu32 slot = (_hash(mEntries[static_cast<VSizeType>(*i)].mID, seed ^ kHandlerTableSlotSeed) ^ displacement) & slotMask;
+                if ((mSlots[slot] != -1) || (std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())) {
+                    placed = false;
+                    break;
+                }
+
+                bucketSlots.push_back(slot);
+            }
+
+            if (placed) {
+                mDisplacements[order[b].second] = displacement;
+                for (VSizeType j = 0; j < bucket.size(); ++j) {
+                    mSlots[bucketSlots[j]] = bucket[j];
+                }
+            }
+        }
+
+        if (! placed) {
+            return false; // two IDs in one bucket share a slot hash; the caller tries another seed
+        }
+    }
+
+    mSeed = seed;
+    mBucketShift = bucketShift;
+    mSlotMask = slotMask;
+    return true;
+}
+
+VMessageHandlerFactory* VMessageHandlerTable::find(VMessageID messageID) const {
+    const Entry* entry = this->_findEntry(messageID);
+    return (entry == NULL) ? NULL : entry->mFactory;
+}
+
+const VString* VMessageHandlerTable::findLoggerName(VMessageID messageID) const {
+    const Entry* entry = this->_findEntry(messageID);
+    return (entry == NULL) ? NULL : &entry->mLoggerName;
+}
+
+const VMessageHandlerTable::Entry* VMessageHandlerTable::_findEntry(VMessageID messageID) const {
+    int index = -1;
+
+    if (mForm == kDense) {
+        Vs64 offset = static_cast<Vs64>(messageID) - static_cast<Vs64>(mMinID);
+        if ((offset >= 0) && (offset < static_cast<Vs64>(mSlots.size()))) {
+            index = mSlots[static_cast<VSizeType>(offset)];
+        }
+    } else if (mForm == kHashed) {
+        Vu32 displacement = mDisplacements[static_cast<VSizeType>(_hash(messageID, mSeed) >> mBucketShift)];
+        index = mSlots[static_cast<VSizeType>((_hash(messageID, mSeed ^ kHandlerTableSlotSeed) ^ displacement) & mSlotMask)];
+    } else {
+        std::vector<Entry>::const_iterator position = std::lower_bound(mEntries.begin(), mEntries.end(), messageID, VMessageHandlerTable::_isEntryIDLess);
+        if (position != mEntries.end()) {
+            index = static_cast<int>(position - mEntries.begin());
+        }
+    }
+
+    if ((index < 0) || (mEntries[static_cast<VSizeType>(index)].mID != messageID)) {
+        return NULL;
+    }
+
+    return &mEntries[static_cast<VSizeType>(index)];
+}
+
+// VMessageHandlerStorage -----------------------------------------------------
+
+VMessageHandlerStorage::VMessageHandlerStorage(int capacity)
+    : mBuffer(::malloc(static_cast<size_t>(V_MAX(1, capacity))))
+    , mCapacity(V_MAX(1, capacity))
+    , mInUse(false)
+    {
+    if (mBuffer.load() == NULL) {
+        throw std::bad_alloc();
+    }
+}
+
+VMessageHandlerStorage::~VMessageHandlerStorage() {
+    ::free(mBuffer.load());
+    mBuffer.store(NULL);
+}
+
+void* VMessageHandlerStorage::acquire(int size) {
+    if (mInUse.exchange(true)) {
+        return NULL;
+    }
+
+    if (size > mCapacity.load()) {
+        // Only the holder of mInUse touches the block, so we can safely replace it.
+        void* largerBuffer = ::malloc(static_cast<size_t>(size));
+        if (largerBuffer == NULL) {
+            mInUse.store(false);
+            return NULL; // the caller falls back to the heap, which will report the failure
+        }
+
+        // Publish the new block before freeing the old one, so that no heap handler can
+        // be allocated in the old block while contains() might still see it.
+        void* oldBuffer = mBuffer.load();
+        mBuffer.store(largerBuffer);
+        mCapacity.store(size);
+        ::free(oldBuffer);
+    }
+
+    return mBuffer.load();
+}
+
+bool VMessageHandlerStorage::contains(const void* p) const {
+    if (p == NULL) {
+        return false;
+    }
+
+    // Read the capacity first: if it is the grown one, the grown block is already visible.
+    int capacity = mCapacity.load();
+    const Vu8* buffer = static_cast<const Vu8*>(mBuffer.load());
+    const Vu8* pointer = static_cast<const Vu8*>(p);
+    return (pointer >= buffer) && (pointer < buffer + capacity);
+}
+
+void VMessageHandlerStorage::release() {
+    mInUse.store(false);
+}
 
 // VMessageHandler ------------------------------------------------------------
 
 VMessageHandlerFactoryMap* VMessageHandler::gFactoryMap = NULL;
+std::atomic<const VMessageHandlerTable*> VMessageHandler::gHandlerTable(NULL);
 
 // static
 VMessageHandler* VMessageHandler::get(VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread) {
-    VMessageHandlerFactory* factory = (*(VMessageHandler::mapInstance()))[m->getMessageID()];
+    VMessageHandlerFactory* factory = VMessageHandler::_getHandlerTable()->find(m->getMessageID());
 
     if (factory == NULL)
         return NULL;
@@ -25,9 +272,83 @@ VMessageHandler* VMessageHandler::get(VMessagePtr m, VServer* server, VClientSes
         return factory->createHandler(m, server, session, thread);
 }
 
+// static
+VMessageHandler* VMessageHandler::get(VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, VMessageHandlerStorage& storage) {
+    VMessageHandlerFactory* factory = VMessageHandler::_getHandlerTable()->find(m->getMessageID());
+
+    if (factory == NULL)
+        return NULL;
+    else
+        return factory->createHandlerInStorage(storage, m, server, session, thread);
+}
+
+// static
+void VMessageHandler::destroy(VMessageHandler* handler, VMessageHandlerStorage* storage) {
+    if ((storage != NULL) && storage->contains(handler)) {
+        handler->~VMessageHandler();
+        storage->release();
+    } else {
+        delete handler;
+    }
+}
+
 // static
 void VMessageHandler::registerHandlerFactory(VMessageID messageID, VMessageHandlerFactory* factory) {
+    VMutexLocker locker(VMessageHandler::_getRegistrationMutex(), "VMessageHandler::registerHandlerFactory()");
     (*(VMessageHandler::mapInstance()))[messageID] = factory;
+
+    // Late registration: replace the frozen table so lookups see the new factory.
+    if (gHandlerTable.load(std::memory_order_acquire) != NULL) {
+        (void) VMessageHandler::_publishHandlerTable();
+    }
+}
+
+// static
+void VMessageHandler::freezeHandlerFactories() {
+    (void) VMessageHandler::_getHandlerTable();
+}
+
+// static
+bool VMessageHandler::requiresOrderedDispatch(VMessageID messageID) {
+    VMessageHandlerFactory* factory = VMessageHandler::_getHandlerTable()->find(messageID);
+
+    if (factory == NULL)
+        return true;
+    else
+        return factory->requiresOrderedDispatch();
+}
+
+// static
+const VString& VMessageHandler::_getLoggerName(VMessageID messageID) {
+    const VString* loggerName = VMessageHandler::_getHandlerTable()->findLoggerName(messageID);
+    if (loggerName != NULL) {
+        return *loggerName;
+    }
+
+    // A handler constructed directly rather than via a registered factory; rare enough
+    // that interning its name under a lock is fine. Map nodes never move, so the
+    // reference stays valid.
+    static VMutex gUnregisteredLoggerNamesMutex("VMessageHandler::gUnregisteredLoggerNamesMutex");
+    static std::map<VMessageID, VString> gUnregisteredLoggerNames;
+
+    VMutexLocker locker(&gUnregisteredLoggerNamesMutex, "VMessageHandler::_getLoggerName()");
+    std::map<VMessageID, VString>::iterator position = gUnregisteredLoggerNames.find(messageID);
+    if (position == gUnregisteredLoggerNames.end()) {
+        position = gUnregisteredLoggerNames.insert(std::make_pair(messageID, VSTRING_FORMAT("vault.messages.VMessageHandler.%d", messageID))).first;
+    }
+
+    return position->second;
+}
+
+// static
+const VString& VMessageHandler::_getSessionName(VClientSessionPtr session, VSocketThread* thread) {
+    if (session != nullptr) { // A message handler doesn't need to be related to a session object.
+        return session->getName();
+    } else if (thread != NULL) { // Thread may be null for test case or other purposes.
+        return thread->getName();
+    } else {
+        return VString::EMPTY();
+    }
 }
 
 // static
@@ -41,26 +362,81 @@ VMessageHandlerFactoryMap* VMessageHandler::mapInstance() {
     return gFactoryMap;
 }
 
-VMessageHandler::VMessageHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, const VMessageFactory* messageFactory, VMutex* mutex)
-    : mName(name)
-    , mLoggerName(VSTRING_ARGS("vault.messages.VMessageHandler.%d", m->getMessageID()))
+// static
+const VMessageHandlerTable* VMessageHandler::_getHandlerTable() {
+    const VMessageHandlerTable* table = gHandlerTable.load(std::memory_order_acquire);
+
+    if (table == NULL) {
+        // Several input threads may race to freeze on their first message; only the first builds it.
+        VMutexLocker locker(VMessageHandler::_getRegistrationMutex(), "VMessageHandler::_getHandlerTable()");
+        table = gHandlerTable.load(std::memory_order_acquire);
+        if (table == NULL) {
+            table = VMessageHandler::_publishHandlerTable();
+            locker.unlock(); // the shutdown registry calls _deleteHandlerTables() with its own mutex locked
+            VShutdownRegistry::instance()->registerFunction(VMessageHandler::_deleteHandlerTables);
+        }
+    }
+
+    return table;
+}
+
+// static
+const VMessageHandlerTable* VMessageHandler::_publishHandlerTable() {
+    // Called with the registration mutex locked, so the map is stable and no other table is being published.
+    const VMessageHandlerTable* table = new VMessageHandlerTable(*(VMessageHandler::mapInstance()));
+    const VMessageHandlerTable* replacedTable = gHandlerTable.exchange(table, std::memory_order_acq_rel);
+
+    if (replacedTable != NULL) {
+        // A lock-free reader may still be using the replaced table, so it is kept until shutdown.
+        // This only happens for registrations after the first lookup.
+        VMessageHandler::_getRetiredHandlerTables().push_back(replacedTable);
+    }
+
+    return table;
+}
+
+// static
+void VMessageHandler::_deleteHandlerTables() {
+    // Shutdown runs after the threads that look up handlers have ended.
+    VMutexLocker locker(VMessageHandler::_getRegistrationMutex(), "VMessageHandler::_deleteHandlerTables()");
+    delete gHandlerTable.exchange(NULL, std::memory_order_acq_rel);
+
+    std::vector<const VMessageHandlerTable*>& retiredTables = VMessageHandler::_getRetiredHandlerTables();
+    for (std::vector<const VMessageHandlerTable*>::const_iterator i = retiredTables.begin(); i != retiredTables.end(); ++i) {
+        delete (*i);
+    }
+
+    retiredTables.clear();
+}
+
+// static
+VMutex* VMessageHandler::_getRegistrationMutex() {
+    // Function-local so that it exists for registrations made during static initialization.
+    static VMutex gRegistrationMutex("VMessageHandler::gRegistrationMutex", true /*suppress logging*/);
+    return &gRegistrationMutex;
+}
+
+// static
+std::vector<const VMessageHandlerTable*>& VMessageHandler::_getRetiredHandlerTables() {
+    static std::vector<const VMessageHandlerTable*> gRetiredHandlerTables;
+    return gRetiredHandlerTables;
+}
+
+VMessageHandler::VMessageHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, const VMessageFactory* messageFactory, VMutex* mutex, bool copyName)
+    : mOwnedName(copyName ? name : VString::EMPTY())
+    , mName(copyName ? mOwnedName : name)
+    , mLoggerName(VMessageHandler::_getLoggerName(m->getMessageID()))
     , mMessage(m)
     , mServer(server)
     , mSession(session)
     , mThread(thread)
     , mMessageFactory(messageFactory)
     , mStartTime(/*now*/)
-    , mLocker(mutex, VSTRING_FORMAT("VMessageHandler(%s)", name.chars()))
+    , mLocker(mutex, "VMessageHandler")
     , mUnblockTime(/*now*/) // Note that if we block locking the mutex, mUnblockTime - mStartTime will indicate how long we were blocked here.
-    , mSessionName() // initialized below if session or thread was supplied
+    , mSessionName(VMessageHandler::_getSessionName(session, thread))
     {
 
-    if (session != nullptr) { // A message handler doesn't need to be related to a session object.
-        mSessionName = session->getName();
-    } else if (mThread != NULL) { // Thread may be null for test case or other purposes.
-        mSessionName = mThread->getName();
-    }
-
     VLOGGER_NAMED_LEVEL(mLoggerName, VMessage::kMessageHandlerLifecycleLevel, VSTRING_FORMAT("[%s] %s@0x%08X for message ID=%d constructed.", mSessionName.chars(), mName.chars(), this, (int) m->getMessageID()));
 }
 
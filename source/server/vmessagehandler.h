@@ -15,6 +15,10 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vmessage.h"
 #include "vclientsession.h"
 
+#include <atomic>
+#include <new>
+#include <vector>
+
 /** @file */
 
 /**
@@ -24,9 +28,161 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 class VServer;
 class VSocketThread;
 
+class VMessageHandler;
 class VMessageHandlerFactory;
 typedef std::map<VMessageID, VMessageHandlerFactory*> VMessageHandlerFactoryMap;
 
+/**
+VMessageHandlerTable is the frozen, read-only form of the registered message
+handler factories, which VMessageHandler uses to find the factory for each
+inbound message. Registration goes into a VMessageHandlerFactoryMap; freezing
+builds one of these from it, and from then on every lookup takes no lock and
+never modifies anything, so any number of input threads can look up
+concurrently and unknown IDs leave no trace.
+
+The table keeps one entry per registered handler, in ID order, holding its
+factory and its logger name. If the registered IDs span a small range (at most
+kMaxDenseRange), a direct array indexed by ID locates the entry. Otherwise a
+two-level perfect hash does: the ID's first hash picks a bucket, whose
+displacement (chosen at freeze time so that no two IDs collide) is mixed into a
+second hash to pick a slot in an array about twice the number of IDs. In the
+unlikely case that no displacements can be found, the entries are binary
+searched instead.
+*/
+class VMessageHandlerTable {
+    public:
+
+        static const int kMaxDenseRange = 4096; ///< The largest ID span we will index directly.
+
+        /** How the table locates an entry. */
+        enum Form {
+            kDense,     ///< Direct array indexed by (ID - lowest ID).
+            kHashed,    ///< Two-level perfect hash.
+            kSorted     ///< Binary search of the entries; the fallback if no perfect hash was found.
+        };
+
+        /**
+        Builds the table from the registered factories. Entries with NULL factories are ignored.
+        @param  factories   the registered factories
+        */
+        VMessageHandlerTable(const VMessageHandlerFactoryMap& factories);
+        ~VMessageHandlerTable() {}
+
+        /**
+        Returns the factory registered for the message ID, or NULL if there is none.
+        @param  messageID   the message ID to look up
+        @return the factory, or NULL
+        */
+        VMessageHandlerFactory* find(VMessageID messageID) const;
+        /**
+        Returns the logger name used by handlers for the message ID, built once
+        when the table was frozen, or NULL if the ID is not registered.
+        @param  messageID   the message ID to look up
+        @return the logger name, or NULL
+        */
+        const VString* findLoggerName(VMessageID messageID) const;
+
+        Form getForm() const { return mForm; }                          ///< Returns how the table locates entries.
+        bool isDense() const { return mForm == kDense; }                ///< Returns true if the table is a direct array.
+        int getNumFactories() const { return static_cast<int>(mEntries.size()); } ///< Returns the number of registered factories.
+        int getNumSlots() const { return static_cast<int>(mSlots.size()); } ///< Returns the size of the slot array (zero in sorted form).
+
+    private:
+
+        VMessageHandlerTable(const VMessageHandlerTable&); // not copyable
+        VMessageHandlerTable& operator=(const VMessageHandlerTable&); // not assignable
+
+        /** One registered handler. */
+        struct Entry {
+            VMessageID              mID;            ///< The message ID.
+            VMessageHandlerFactory* mFactory;       ///< The factory registered for it.
+            VString                 mLoggerName;    ///< The logger name its handlers use.
+        };
+
+        static Vu32 _hash(VMessageID messageID, Vu32 seed); ///< Mixes the ID and seed into a well-distributed 32-bit value.
+        static bool _isEntryIDLess(const Entry& entry, VMessageID messageID); ///< Orders entries by ID for binary search.
+        bool _buildHashed(int bucketBits, int slotBits, Vu32 seed); ///< Searches for bucket displacements that place every entry in its own slot.
+        const Entry* _findEntry(VMessageID messageID) const; ///< Returns the entry for the ID, or NULL.
+
+        Form                    mForm;          ///< How _findEntry() locates entries.
+        VMessageID              mMinID;         ///< The lowest registered ID (dense form).
+        Vu32                    mSeed;          ///< The hash seed (hashed form).
+        int                     mBucketShift;   ///< 32 minus log2 of the bucket count (hashed form).
+        Vu32                    mSlotMask;      ///< The slot count minus one (hashed form).
+        std::vector<Entry>      mEntries;       ///< One entry per registered factory, in ID order.
+        std::vector<int>        mSlots;         ///< The index into mEntries for each slot, or -1 (dense and hashed forms).
+        std::vector<Vu32>       mDisplacements; ///< The displacement for each bucket (hashed form).
+};
+
+/**
+VMessageHandlerStorage is a reusable block of memory in which a message handler
+can be constructed instead of on the heap. Each message otherwise costs a heap
+allocation and free for its handler; a thread that dispatches messages keeps one
+of these and passes it to VMessageHandler::get(), so that in the steady state
+each handler is constructed in the same memory as the previous one.
+
+The storage holds one handler at a time. If it is already in use (for example,
+by a handler from the same session running concurrently on another dispatcher
+worker), or the handler is too big and the storage cannot grow because it is in
+use, the handler is simply allocated on the heap as before.
+VMessageHandler::destroy() knows which is which. Acquiring and releasing the
+storage is safe from any thread.
+*/
+class VMessageHandlerStorage {
+    public:
+
+        static const int kDefaultCapacity = 512; ///< Default initial size; enough for most handler subclasses.
+
+        /**
+        Constructs the storage.
+        @param  capacity    the initial size of the block; it grows to fit larger handlers
+        */
+        VMessageHandlerStorage(int capacity = kDefaultCapacity);
+        /**
+        Destructor. The storage must not be in use.
+        */
+        ~VMessageHandlerStorage();
+
+        /**
+        Reserves the block for an object of the specified size.
+        @param  size    the size of the object to be constructed
+        @return the block, or NULL if it is in use
+        */
+        void* acquire(int size);
+        /**
+        Makes the block available again, after the object in it has been destroyed.
+        */
+        void release();
+        /**
+        Returns true if the pointer lies within this storage's block. A handler
+        pointer need not be the start of the block, because its VMessageHandler
+        base may not be at offset zero of the concrete handler type.
+        @param  p   the pointer to test
+        */
+        bool contains(const void* p) const;
+
+        /**
+        Constructs a handler of the specified type in the storage if it is
+        available, and otherwise on the heap. This is what the handler factory
+        macros use; the handler must be destroyed with VMessageHandler::destroy().
+        Arguments are those of the handler constructor the macros call.
+        */
+        template <class HANDLER_TYPE>
+        static VMessageHandler* construct(VMessageHandlerStorage& storage, const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread);
+
+    private:
+
+        VMessageHandlerStorage(const VMessageHandlerStorage&); // not copyable
+        VMessageHandlerStorage& operator=(const VMessageHandlerStorage&); // not assignable
+
+        template <class HANDLER_TYPE>
+        static VMessageHandler* _constructInPlace(void* p, const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread);
+
+        std::atomic<void*>  mBuffer;    ///< The block (malloc'd so that it is suitably aligned for any handler); atomic because contains() may run while another thread's acquire() replaces it.
+        std::atomic<int>    mCapacity;  ///< The size of mBuffer; stored after mBuffer when the block grows.
+        std::atomic<bool>   mInUse;     ///< True while a handler occupies mBuffer.
+};
+
 /**
 VMessageHandler is the abstract base class for objects that process inbound
 messages from various client connections. A VMessageHandler is constructed with
@@ -65,16 +221,59 @@ class VMessageHandler {
         */
         static VMessageHandler* get(VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread);
         /**
+        Returns a message handler suitable for handling the specified
+        message, constructed in the supplied storage if it is available
+        (see VMessageHandlerStorage). The caller must dispose of the
+        handler with destroy() rather than delete.
+        @param    m        the message to supply to the handler
+        @param    server    the server to supply to the handler
+        @param    session    the session for the client that sent this message, or NULL if n/a
+        @param    thread    the thread processing the message
+        @param    storage   the storage in which to construct the handler if possible
+        */
+        static VMessageHandler* get(VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, VMessageHandlerStorage& storage);
+        /**
+        Destroys a handler obtained from get(), whether it was constructed in
+        the storage or on the heap.
+        @param    handler   the handler to destroy (may be NULL)
+        @param    storage   the storage that was passed to get(), or NULL if none was
+        */
+        static void destroy(VMessageHandler* handler, VMessageHandlerStorage* storage);
+        /**
         Registers a message handler factory for a particular
         message ID. When a call is made to get(), the appropriate
         factory function is called to create a handler for the message
-        ID.
+        ID. Registration normally happens during static initialization
+        (see DEFINE_MESSAGE_HANDLER_FACTORY). Registrations are serialized;
+        one made after the factories have been frozen builds and publishes a
+        new table, which lookups see from then on.
         */
         static void registerHandlerFactory(VMessageID messageID, VMessageHandlerFactory* factory);
+        /**
+        Freezes the registered factories into the read-only VMessageHandlerTable
+        that get() uses. This happens automatically on the first lookup; a server
+        may call it explicitly once all handlers are registered, before it starts
+        accepting connections, so the table is built ahead of the first message.
+        */
+        static void freezeHandlerFactories();
+        /**
+        Returns true if messages with the specified ID must be handled in the order
+        received relative to the session's other ordered messages, when a
+        VMessageDispatcher is running handlers on worker threads. This is decided
+        by the message's handler factory (see
+        VMessageHandlerFactory::requiresOrderedDispatch()), because the handler
+        itself is not constructed until a worker runs it. Unknown IDs are ordered.
+        @param  messageID   the message ID
+        @return true if the message must be dispatched in order
+        */
+        static bool requiresOrderedDispatch(VMessageID messageID);
 
         /**
         Constructs a message handler with a message to handle and the
-        server in which it is running.
+        server in which it is running. Unless copyName is true, the handler refers to
+        its name rather than copying it, so the name must outlive the handler; the
+        factory macros pass the factory's own name. The logger and session names
+        likewise refer to strings owned by the handler table and the session (or thread).
         @param    name      the handler's name for logger output
         @param    m        the message to process
         @param    server    the server we're running in
@@ -86,8 +285,10 @@ class VMessageHandler {
                             if not, messages can be instantiated explicitly); the caller owns the factory.
         @param  mutex   if not null, a mutex that will be initially locked by the constructor
                         and unlocked by the destructor
+        @param  copyName    true if the handler must keep its own copy of the name, for a
+                            subclass whose name is built at run time or is otherwise temporary
         */
-        VMessageHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, const VMessageFactory* messageFactory, VMutex* mutex);
+        VMessageHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, const VMessageFactory* messageFactory, VMutex* mutex, bool copyName = false);
         /**
         Virtual destructor. VMessageHandler will delete the owned message (setting mMessage to NULL
         will obviously circumvent this).
@@ -191,8 +392,9 @@ class VMessageHandler {
         */
         void _logMessageContentHexDump(const VString& info, const Vu8* buffer, Vs64 length) const;
 
-        VString                 mName;          ///< The name to identify this handler type in log output.
-        VString                 mLoggerName;    ///< The logger name which we will use when emitting log output.
+        VString                 mOwnedName;     ///< Our copy of the name if the constructor was asked for one, else empty. MUST BE DECLARED BEFORE mName.
+        const VString&          mName;          ///< The name to identify this handler type in log output; refers to mOwnedName or the caller's string.
+        const VString&          mLoggerName;    ///< The logger name which we will use when emitting log output; interned in the handler table.
         VMessagePtr             mMessage;       ///< The message this handler is to process.
         VServer*                mServer;        ///< The server in which we are running.
         VClientSessionPtr       mSession;       ///< The session reference for which we are running, which holds NULL if n/a.
@@ -201,7 +403,7 @@ class VMessageHandler {
         VInstant                mStartTime;     ///< The time at which this handler was instantiated (message receipt). MUST BE DECLARED BEFORE mLocker.
         VMutexLocker            mLocker;        ///< The mutex locker for the mutex we were given.
         VInstant                mUnblockTime;   ///< The time at which this handler obtained the mLocker lock. MUST BE DECLARED AFTER mLocker.
-        VString                 mSessionName;   ///< The name to identify this handler's session in log output.
+        const VString&          mSessionName;   ///< The name to identify this handler's session in log output; owned by mSession or mThread.
 
     private:
 
@@ -209,8 +411,16 @@ class VMessageHandler {
         VMessageHandler& operator=(const VMessageHandler&); // not assignable
 
         static VMessageHandlerFactoryMap* mapInstance();
+        static const VMessageHandlerTable* _getHandlerTable(); ///< Returns the frozen table, freezing it first if necessary.
+        static const VString& _getLoggerName(VMessageID messageID); ///< Returns the interned logger name for handlers of the message ID, for the handler to refer to.
+        static const VString& _getSessionName(VClientSessionPtr session, VSocketThread* thread); ///< Returns the name to use for mSessionName.
+        static const VMessageHandlerTable* _publishHandlerTable(); ///< Builds a table from the map and installs it; the caller holds the registration mutex.
+        static void _deleteHandlerTables(); ///< Shutdown function that deletes the current and replaced tables.
+        static VMutex* _getRegistrationMutex(); ///< Returns the mutex that serializes registration and table publication.
+        static std::vector<const VMessageHandlerTable*>& _getRetiredHandlerTables(); ///< Returns the tables replaced by late registrations.
 
         static VMessageHandlerFactoryMap* gFactoryMap;    ///< The factories that create handlers for each ID.
+        static std::atomic<const VMessageHandlerTable*> gHandlerTable; ///< The frozen lookup table built from gFactoryMap, or NULL until frozen.
 };
 
 /**
@@ -235,10 +445,30 @@ class VMessageHandlerFactory {
         @param    thread    the thread to be passed thru to the handler constructor
         */
         virtual VMessageHandler* createHandler(VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread) = 0;
+        /**
+        Instantiates a new message handler for the specified message's ID,
+        constructing it in the supplied storage if the factory supports that.
+        The default implementation ignores the storage and calls createHandler();
+        the factory macros override it using VMessageHandlerStorage::construct().
+        Parameters are as for createHandler().
+        */
+        virtual VMessageHandler* createHandlerInStorage(VMessageHandlerStorage& /*storage*/, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread)
+            { return this->createHandler(m, server, session, thread); }
+        /**
+        Returns true if the handlers this factory creates must run one at a time, in
+        the order their messages were received, with the session's other ordered
+        messages, when a VMessageDispatcher is in use. This is the default, and
+        matches what happens without a dispatcher. A factory may return false for
+        handlers that don't depend on the effects of earlier messages, so that they
+        may run concurrently with the session's other messages; the
+        DEFINE_UNORDERED_MESSAGE_HANDLER_FACTORY macro does this.
+        */
+        virtual bool requiresOrderedDispatch() const { return true; }
 };
 
-// This macro goes in the handler's .h file to define the handler's factory.
-#define DEFINE_MESSAGE_HANDLER_FACTORY(messageid, factoryclassname, handlerclassname, descriptivename) \
+// This macro is the common body of the two factory macros below; extramembers is
+// inserted among the factory's public members.
+#define _DEFINE_MESSAGE_HANDLER_FACTORY_CLASS(messageid, factoryclassname, handlerclassname, descriptivename, extramembers) \
 class factoryclassname : public VMessageHandlerFactory { \
     public: \
     \
@@ -247,6 +477,9 @@ class factoryclassname : public VMessageHandlerFactory { \
         \
         virtual VMessageHandler* createHandler(VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread) \
             { return new handlerclassname(mName, m, server, session, thread); } \
+        virtual VMessageHandler* createHandlerInStorage(VMessageHandlerStorage& storage, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread) \
+            { return VMessageHandlerStorage::construct<handlerclassname>(storage, mName, m, server, session, thread); } \
+        extramembers \
     \
     private: \
     \
@@ -255,6 +488,16 @@ class factoryclassname : public VMessageHandlerFactory { \
     \
 }
 
+// This macro goes in the handler's .h file to define the handler's factory.
+// The handlers it creates refer to the factory's name rather than copying it.
+#define DEFINE_MESSAGE_HANDLER_FACTORY(messageid, factoryclassname, handlerclassname, descriptivename) \
+_DEFINE_MESSAGE_HANDLER_FACTORY_CLASS(messageid, factoryclassname, handlerclassname, descriptivename, /*no extra members*/)
+
+// This macro is the same as DEFINE_MESSAGE_HANDLER_FACTORY, but the factory opts its
+// handler out of ordered dispatch (see VMessageHandlerFactory::requiresOrderedDispatch()).
+#define DEFINE_UNORDERED_MESSAGE_HANDLER_FACTORY(messageid, factoryclassname, handlerclassname, descriptivename) \
+_DEFINE_MESSAGE_HANDLER_FACTORY_CLASS(messageid, factoryclassname, handlerclassname, descriptivename, virtual bool requiresOrderedDispatch() const { return false; })
+
 // This macro goes in the handler's .cpp file to declare the handler's factory.
 #define DECLARE_MESSAGE_HANDLER_FACTORY(factoryclassname) \
 factoryclassname factoryclassname::gFactory
@@ -264,6 +507,40 @@ factoryclassname factoryclassname::gFactory
 #define FORCE_LINK_MESSAGE_HANDLER_FACTORY(factoryclassname) \
 if (false) { factoryclassname dummy; }
 
+// VMessageHandlerStorage inline template implementation ----------------------
+
+// static
+template <class HANDLER_TYPE>
+VMessageHandler* VMessageHandlerStorage::construct(VMessageHandlerStorage& storage, const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread) {
+    void* p = storage.acquire(static_cast<int>(sizeof(HANDLER_TYPE)));
+    if (p == NULL) {
+        return new HANDLER_TYPE(name, m, server, session, thread);
+    }
+
+    try {
+        return VMessageHandlerStorage::_constructInPlace<HANDLER_TYPE>(p, name, m, server, session, thread);
+    } catch (...) {
+        storage.release();
+        throw;
+    }
+}
+
+// Placement new cannot be written while "new" is redefined for memory tracking (see vtypes.h).
+#ifdef VAULT_MEMORY_ALLOCATION_TRACKING_SUPPORT
+#pragma push_macro("new")
+#undef new
+#endif
+
+// static
+template <class HANDLER_TYPE>
+VMessageHandler* VMessageHandlerStorage::_constructInPlace(void* p, const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread) {
+    return new (p) HANDLER_TYPE(name, m, server, session, thread);
+}
+
+#ifdef VAULT_MEMORY_ALLOCATION_TRACKING_SUPPORT
+#pragma pop_macro("new")
+#endif
+
 /**
 This interface defines a background task object that can be attached to
 a VClientSession, such that the session will not destruct until all attached
@@ -13,18 +13,33 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vmessage.h"
 #include "vclientsession.h"
 #include "vbento.h"
+#include "vmutexlocker.h"
+#include "vtimerwheel.h"
 
 // VMessageInputThread --------------------------------------------------------
 
+// Called on the shared timer wheel if an input thread waits a long time for its output thread to end.
+static void _warnStillWaitingForOutputThread(const VString& loggerName, const VString& threadName) {
+    VLOGGER_NAMED_WARN(loggerName, VSTRING_FORMAT("[%s] VMessageInputThread: Still waiting for output thread to end after 15 seconds. Will warn again when output thread ends.", threadName.chars()));
+}
+
 VMessageInputThread::VMessageInputThread(const VString& threadBaseName, VSocket* socket, VListenerThread* ownerThread, VServer* server, const VMessageFactory* messageFactory)
     : VSocketThread(threadBaseName, socket, ownerThread)
     , mSocketStream(socket, "VMessageInputThread")
-    , mInputStream(mSocketStream)
+    , mBufferedStream(mSocketStream)
+    , mInputStream(mBufferedStream)
     , mConnected(false)
     , mSession()
     , mServer(server)
     , mMessageFactory(messageFactory)
+    , mMessagePool(messageFactory)
+    , mHandlerStorage()
     , mHasOutputThread(false)
+    , mOutputThreadMutex(VSTRING_FORMAT("VMessageInputThread(%s)::mOutputThreadMutex", threadBaseName.chars()), false, "VMessageInputThread::mOutputThreadMutex")
+    , mOutputThreadCondition()
+    , mMessageDispatcher(NULL)
+    , mDispatchStrand()
+    , mMaxInFlightMessages(VMessageDispatcher::kDefaultMaxInFlightPerSession)
     {
 }
 
@@ -38,6 +53,7 @@ VMessageInputThread::~VMessageInputThread() {
 
     mServer = NULL;
     mMessageFactory = NULL;
+    mMessageDispatcher = NULL;
 }
 
 void VMessageInputThread::run() {
@@ -76,30 +92,44 @@ void VMessageInputThread::run() {
         }
     }
 
+    // Handlers still running on the dispatcher's workers refer to us and our session.
+    if (mDispatchStrand != nullptr) {
+        mDispatchStrand->waitUntilInFlightBelow(1);
+    }
+
     if (mSession != nullptr) {
         mSession->shutdown(this);
     }
 
-    // If we are dependent on an output thread, we must spin here until it clears the flag.
-    const VDuration warnLimit = 15 * VDuration::SECOND();
-    const VInstant startTime;
-    bool warned = false;
-    while (mHasOutputThread) {
-        VThread::sleep(50 * VDuration::MILLISECOND());
-        if (!warned) {
+    // If we are dependent on an output thread, we must wait here until it clears the flag.
+    // If that takes a while, a timer logs a warning; if the timer has fired by the time
+    // we can cancel it, we log again when the wait is over.
+    if (mHasOutputThread) {
+        const VInstant startTime;
+        const VTimerID warningTimer = VTimerWheel::getSharedInstance()->schedule(15 * VDuration::SECOND(), std::bind(_warnStillWaitingForOutputThread, mLoggerName, mName));
+
+        /* locker scope */ {
+            VMutexLocker locker(&mOutputThreadMutex, "VMessageInputThread::run()");
+            while (mHasOutputThread) {
+                (void) mOutputThreadCondition.wait(&mOutputThreadMutex, VDuration::SECOND());
+            }
+        }
+
+        if (! VTimerWheel::getSharedInstance()->cancel(warningTimer)) {
             const VInstant now;
             const VDuration duration = now - startTime;
-            if (duration > warnLimit) {
-                warned = true;
-                VLOGGER_NAMED_WARN(mLoggerName, VSTRING_FORMAT("[%s] VMessageInputThread: Still waiting for output thread to end after %s. Will warn again when output thread ends.", mName.chars(), duration.getDurationString().chars()));
-            }
+            VLOGGER_NAMED_WARN(mLoggerName, VSTRING_FORMAT("[%s] VMessageInputThread: Finally saw output thread end after %s.", mName.chars(), duration.getDurationString().chars()));
         }
     }
+}
 
-    if (warned) {
-        const VInstant now;
-        const VDuration duration = now - startTime;
-        VLOGGER_NAMED_WARN(mLoggerName, VSTRING_FORMAT("[%s] VMessageInputThread: Finally saw output thread end after %s.", mName.chars(), duration.getDurationString().chars()));
+void VMessageInputThread::setHasOutputThread(bool hasOutputThread) {
+    // Change the flag while holding the mutex run() waits with, so that by the time run()
+    // can see it clear, we are done with our members and the thread may safely end.
+    VMutexLocker locker(&mOutputThreadMutex, "VMessageInputThread::setHasOutputThread()");
+    mHasOutputThread = hasOutputThread;
+    if (! hasOutputThread) {
+        mOutputThreadCondition.signal();
     }
 }
 
@@ -107,9 +137,20 @@ void VMessageInputThread::attachSession(VClientSessionPtr session) {
     mSession = session;
 }
 
+void VMessageInputThread::setMessageDispatcher(VMessageDispatcher* dispatcher, int maxInFlightMessages) {
+    mMessageDispatcher = dispatcher;
+    mMaxInFlightMessages = V_MAX(1, maxInFlightMessages);
+
+    if (dispatcher == NULL) {
+        mDispatchStrand.reset();
+    } else {
+        mDispatchStrand.reset(new VMessageDispatchStrand(this));
+    }
+}
+
 //lint -e429 "Custodial pointer 'message' has not been freed or returned" [OK: try or catch branches guarantee message is released.]
 void VMessageInputThread::_processNextRequest() {
-    VMessagePtr message = mMessageFactory->instantiateNewMessage();
+    VMessagePtr message = mMessagePool.get();
 
     /*
     RULES FOR EXCEPTION HANDLING IN REQUEST PROCESSING FUNCTIONS.
@@ -127,19 +168,38 @@ void VMessageInputThread::_processNextRequest() {
     3. Vault 4.0 uses VMessagePtr smart pointers, so we no longer need to
         catch here in order to release the message we instantiated above
         before re-throwing. So there is no longer a try/catch here at all.
+    4. With a message dispatcher, the same rules apply to _dispatchMessage()
+        on the worker thread; the dispatcher logs whatever escapes it.
     */
     message->receive(mName, mInputStream);
-    this->_dispatchMessage(message);
+
+    if (mSession != nullptr) {
+        mSession->getStats().recordMessageIn(message->getMessageDataLength());
+    }
+
+    if (mMessageDispatcher == NULL) {
+        this->_dispatchMessage(message);
+    } else {
+        // The worker that finishes the message returns it to mMessagePool, so we must not keep a reference.
+        const bool ordered = VMessageHandler::requiresOrderedDispatch(message->getMessageID());
+        mMessageDispatcher->postMessage(mDispatchStrand, std::move(message), ordered);
+        // Backpressure: don't read more from the socket until the session is under its limit.
+        mDispatchStrand->waitUntilInFlightBelow(mMaxInFlightMessages);
+    }
+
+    mMessagePool.release(message); // reused next time unless the handler kept a reference (no-op if the dispatcher took it)
 }
 
 void VMessageInputThread::_dispatchMessage(VMessagePtr message) {
-    VMessageHandler* handler = VMessageHandler::get(message, mServer, mSession, this);
+    // With a dispatcher, unordered handlers for this session may be running on several workers at
+    // once; only one can use mHandlerStorage, and the others are allocated on the heap.
+    VMessageHandler* handler = VMessageHandler::get(message, mServer, mSession, this, mHandlerStorage);
 
     if (handler == NULL) {
         VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageInputThread::_dispatchMessage: No message hander defined for message %d.", mName.chars(), (int) message->getMessageID()));
         this->_handleNoMessageHandler(message);
     } else {
-        VInstant messageHandlerStart;
+        const Vs64 handlerStartMicroseconds = VClientSessionStats::getTimestampMicroseconds();
 
         /*
         PLEASE SEE COMMENTS IN VMessageInputThread::_processNextRequest() FOR THE
@@ -157,7 +217,11 @@ void VMessageInputThread::_dispatchMessage(VMessagePtr message) {
             VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageInputThread::_dispatchMessage: Caught unknown exception for message ID %d.", mName.chars(), (int) message->getMessageID()));
         }
 
-        delete handler;
+        if (mSession != nullptr) {
+            mSession->getStats().recordHandlerTime(VClientSessionStats::getTimestampMicroseconds() - handlerStartMicroseconds);
+        }
+
+        VMessageHandler::destroy(handler, &mHandlerStorage);
     }
 }
 
@@ -169,8 +233,10 @@ void VMessageInputThread::_callProcessMessage(VMessageHandler* handler) {
 
 // VBentoMessageInputThread ---------------------------------------------------
 
-VBentoMessageInputThread::VBentoMessageInputThread(const VString& threadBaseName, VSocket* socket, VListenerThread* ownerThread, VServer* server, const VMessageFactory* messageFactory) :
-    VMessageInputThread(threadBaseName, socket, ownerThread, server, messageFactory) {
+VBentoMessageInputThread::VBentoMessageInputThread(const VString& threadBaseName, VSocket* socket, VListenerThread* ownerThread, VServer* server, const VMessageFactory* messageFactory)
+    : VMessageInputThread(threadBaseName, socket, ownerThread, server, messageFactory)
+    , mReplyMutex("VBentoMessageInputThread::mReplyMutex")
+    {
 }
 
 void VBentoMessageInputThread::_handleNoMessageHandler(VMessagePtr message) {
@@ -178,14 +244,7 @@ void VBentoMessageInputThread::_handleNoMessageHandler(VMessagePtr message) {
     responseData.addInt("result", -1);
     responseData.addString("error-message", VSTRING_FORMAT("Invalid message ID %d. No handler defined.", (int) message->getMessageID()));
 
-    VString bentoText;
-    responseData.writeToBentoTextString(bentoText);
-    VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] Error Reply: %s", mName.chars(), bentoText.chars()));
-
-    VMessagePtr response = mMessageFactory->instantiateNewMessage();
-    responseData.writeToStream(*response);
-    VBinaryIOStream io(mSocketStream);
-    response->send(mName, io);
+    this->_sendErrorReply(responseData);
 }
 
 void VBentoMessageInputThread::_callProcessMessage(VMessageHandler* handler) {
@@ -196,14 +255,19 @@ void VBentoMessageInputThread::_callProcessMessage(VMessageHandler* handler) {
         responseData.addInt("result", -1);
         responseData.addString("error-message", VSTRING_FORMAT("An error occurred processing the message: %s", ex.what()));
 
-        VString bentoText;
-        responseData.writeToBentoTextString(bentoText);
-        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] Error Reply: %s", mName.chars(), bentoText.chars()));
-
-        VMessagePtr response = mMessageFactory->instantiateNewMessage();
-        responseData.writeToStream(*response);
-        VBinaryIOStream io(mSocketStream);
-        response->send(mName, io);
+        this->_sendErrorReply(responseData);
     }
 }
 
+void VBentoMessageInputThread::_sendErrorReply(const VBentoNode& responseData) {
+    VString bentoText;
+    responseData.writeToBentoTextString(bentoText);
+    VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] Error Reply: %s", mName.chars(), bentoText.chars()));
+
+    VMessagePtr response = mMessageFactory->instantiateNewMessage();
+    responseData.writeToStream(*response);
+
+    VMutexLocker locker(&mReplyMutex, "VBentoMessageInputThread::_sendErrorReply()");
+    VBinaryIOStream io(mSocketStream);
+    response->send(mName, io);
+}
@@ -12,10 +12,16 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vsocketthread.h"
 #include "vsocketstream.h"
+#include "vreadbufferedstream.h"
 #include "vserver.h"
 #include "vbinaryiostream.h"
 #include "vmessage.h"
+#include "vmessagepool.h"
+#include "vmessagedispatcher.h"
+#include "vmessagehandler.h"
+#include "vconditionvariable.h"
 
+class VBentoNode;
 class VMessageHandler;
 
 /**
@@ -27,8 +33,9 @@ VMessageInputThread understands how to perform blocking input reads
 of VMessage objects (finding and calling a VMessageHandler) from its
 i/o stream. You can also write to its i/o stream, but if you are
 doing asynchronous i/o you'll instead post messages to a VMessageOutputThread.
+With a VMessageDispatcher, it is the dispatch target of its session's strand.
 */
-class VMessageInputThread : public VSocketThread {
+class VMessageInputThread : public VSocketThread, public VMessageDispatchTarget {
     public:
 
         /**
@@ -67,9 +74,27 @@ class VMessageInputThread : public VSocketThread {
         Sets or clears the mHasOutputThread that controls whether this input thread must
         wait before returning from run(). This is used when separate in/out threads are
         handling i/o and the destruction sequence requires the input thread to wait for the
-        output thread to die before dying itself.
+        output thread to die before dying itself. Clearing the flag wakes the waiting
+        input thread; the caller must not touch this object afterwards, since it may
+        then end and be deleted.
         */
-        void setHasOutputThread(bool hasOutputThread) { mHasOutputThread = hasOutputThread; }
+        void setHasOutputThread(bool hasOutputThread);
+        /**
+        Switches the thread to posting each received message to a dispatcher, which
+        runs the message handlers on its worker threads, instead of running them here
+        before reading the next message. Must be called before the thread is started.
+        See VMessageDispatcher for the ordering and backpressure rules.
+        @param  dispatcher          the dispatcher to post to, or NULL to run handlers
+                                    on this thread (the default); the caller owns it,
+                                    and it must outlive this thread
+        @param  maxInFlightMessages the number of this session's messages that may be
+                                    posted and unfinished before we stop reading more
+        */
+        void setMessageDispatcher(VMessageDispatcher* dispatcher, int maxInFlightMessages = VMessageDispatcher::kDefaultMaxInFlightPerSession);
+
+        // VMessageDispatchTarget implementation, called on the dispatcher's worker threads.
+        virtual void dispatchPostedMessage(VMessagePtr message) { this->_dispatchMessage(message); }
+        virtual void releasePostedMessage(VMessagePtr& message) { mMessagePool.release(message); }
 
     protected:
 
@@ -113,12 +138,20 @@ class VMessageInputThread : public VSocketThread {
         virtual void _afterProcessMessage(VMessageHandler* /*handler*/) {}
 
         VSocketStream           mSocketStream;      ///< The underlying raw stream from which data is read.
+        VReadBufferedStream     mBufferedStream;    ///< Buffers mSocketStream so that decoding small fields does not cost a recv() each.
         VBinaryIOStream         mInputStream;       ///< The formatted stream from which data is directly read.
         bool                    mConnected;         ///< True if the client has completed the connection sequence.
         VClientSessionPtr       mSession;           ///< The session object we are associated with.
         VServer*                mServer;            ///< The server object that owns us.
         const VMessageFactory*  mMessageFactory;    ///< Factory for instantiating new messages to read from input stream.
+        VMessagePool            mMessagePool;       ///< Recycles received messages (via mMessageFactory) so the receive path does not allocate per message.
+        VMessageHandlerStorage  mHandlerStorage;    ///< Reused memory in which each message's handler is constructed.
         volatile bool           mHasOutputThread;   ///< True if we are dependent on an output thread completion before returning from run(). (see run() code)
+        VMutex                  mOutputThreadMutex; ///< The mutex held by run() while it waits on mOutputThreadCondition.
+        VConditionVariable      mOutputThreadCondition; ///< Signaled when mHasOutputThread is cleared.
+        VMessageDispatcher*     mMessageDispatcher; ///< If not NULL, the dispatcher that runs our message handlers on its workers.
+        VMessageDispatchStrandPtr mDispatchStrand;  ///< Our ordering and in-flight state in mMessageDispatcher.
+        int                     mMaxInFlightMessages; ///< The in-flight count at which we pause reading when using mMessageDispatcher.
 
     private:
 
@@ -142,6 +175,11 @@ class VBentoMessageInputThread : public VMessageInputThread {
         virtual void _handleNoMessageHandler(VMessagePtr message);
         virtual void _callProcessMessage(VMessageHandler* handler);
 
+    private:
+
+        void _sendErrorReply(const VBentoNode& responseData); ///< Logs the error reply and writes it to mSocketStream under mReplyMutex.
+
+        VMutex  mReplyMutex; ///< Serializes error replies; with a dispatcher, handlers for this session may fail on several workers at once.
 };
 
 #endif /* vmessageinputthread_h */
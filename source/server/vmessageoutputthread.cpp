@@ -17,9 +17,10 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 VMessageOutputThread::VMessageOutputThread(const VString& threadBaseName, VSocket* socket, VListenerThread* ownerThread, VServer* server, VClientSessionPtr session, VMessageInputThread* dependentInputThread, int maxQueueSize, Vs64 maxQueueDataSize, const VDuration& maxQueueGracePeriod)
     : VSocketThread(threadBaseName, socket, ownerThread)
-    , mOutputQueue()
+    , mOutputQueue(((maxQueueSize > 0) && (maxQueueSize < kOutputQueueRingCapacity)) ? maxQueueSize : kOutputQueueRingCapacity, VLockFreeMessageQueue::kUnbounded)
     , mSocketStream(socket, "VMessageOutputThread")
-    , mOutputStream(mSocketStream)
+    , mBatchStream(mSocketStream, kMaxBatchDataSize, VMemoryStream::kIncrement2x, true)
+    , mOutputStream(mBatchStream)
     , mServer(server)
     , mSession(session)
     , mDependentInputThread(dependentInputThread)
@@ -57,7 +58,7 @@ void VMessageOutputThread::run() {
             this->_processNextOutboundMessage();
         }
     } catch (const VSocketClosedException& /*ex*/) {
-        VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread: Socket has closed, thread will end.", mName.chars()));
+        VLOGGER_NAMED_DEBUG_FORMAT(mLoggerName, "[%s] VMessageOutputThread: Socket has closed, thread will end.", mName.chars());
     } catch (const VException& ex) {
         /*
         Unlike the input threads, we shouldn't normally get an EOF exception to indicate that the
@@ -67,17 +68,17 @@ void VMessageOutputThread::run() {
         being closed programmatically are to be expected, so we check that before logging an error.
         */
         if (this->isRunning()) {
-            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread::run: Exiting due to top level exception #%d '%s'.", mName.chars(), ex.getError(), ex.what()));
+            VLOGGER_NAMED_ERROR_FORMAT(mLoggerName, "[%s] VMessageOutputThread::run: Exiting due to top level exception #%d '%s'.", mName.chars(), ex.getError(), ex.what());
         } else {
-            VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread: Socket has closed, thread will end.", mName.chars()));
+            VLOGGER_NAMED_DEBUG_FORMAT(mLoggerName, "[%s] VMessageOutputThread: Socket has closed, thread will end.", mName.chars());
         }
     } catch (const std::exception& ex) {
         if (this->isRunning()) {
-            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread: Exiting due to top level exception '%s'.", mName.chars(), ex.what()));
+            VLOGGER_NAMED_ERROR_FORMAT(mLoggerName, "[%s] VMessageOutputThread: Exiting due to top level exception '%s'.", mName.chars(), ex.what());
         }
     } catch (...) {
         if (this->isRunning()) {
-            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread: Exiting due to top level unknown exception.", mName.chars()));
+            VLOGGER_NAMED_ERROR_FORMAT(mLoggerName, "[%s] VMessageOutputThread: Exiting due to top level unknown exception.", mName.chars());
         }
     }
 
@@ -126,8 +127,8 @@ bool VMessageOutputThread::postOutputMessage(VMessagePtr message, bool respectQu
 
             if (gracePeriodExceeded) {
                 if (this->isRunning()) { // Only stop() once; we may land here repeatedly under fast queueing, before stop completes.
-                    VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread::postOutputMessage: Closing socket to shut down session because output queue size of %d messages and " VSTRING_FORMATTER_S64 " bytes is over limit.",
-                                                 mName.chars(), currentQueueSize, currentQueueDataSize));
+                    VLOGGER_NAMED_ERROR_FORMAT(mLoggerName, "[%s] VMessageOutputThread::postOutputMessage: Closing socket to shut down session because output queue size of %d messages and " VSTRING_FORMATTER_S64 " bytes is over limit.",
+                                                 mName.chars(), currentQueueSize, currentQueueDataSize);
 
                     this->stop();
                 }
@@ -137,8 +138,8 @@ bool VMessageOutputThread::postOutputMessage(VMessagePtr message, bool respectQu
                 if (now - mWhenMaxQueueSizeWarned > VDuration::MINUTE()) { // Throttle the rate of ongoing warnings.
                     mWhenMaxQueueSizeWarned = now;
                     VDuration gracePeriodRemaining = (mWhenWentOverLimit + mMaxQueueGracePeriod) - now;
-                    VLOGGER_NAMED_WARN(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread::postOutputMessage: Posting to queue with excess size of %d messages and " VSTRING_FORMATTER_S64 " bytes. Remaining grace period %d seconds.",
-                                                mName.chars(), currentQueueSize, currentQueueDataSize, gracePeriodRemaining.getDurationSeconds()));
+                    VLOGGER_NAMED_WARN_FORMAT(mLoggerName, "[%s] VMessageOutputThread::postOutputMessage: Posting to queue with excess size of %d messages and " VSTRING_FORMATTER_S64 " bytes. Remaining grace period %d seconds.",
+                                                mName.chars(), currentQueueSize, currentQueueDataSize, gracePeriodRemaining.getDurationSeconds());
                 }
             }
         }
@@ -146,10 +147,9 @@ bool VMessageOutputThread::postOutputMessage(VMessagePtr message, bool respectQu
 
     bool posted = false;
     try {
-        mOutputQueue.postMessage(message); // can throw bad_alloc if out of memory and queue cannot push_back
-        posted = true;
+        posted = mOutputQueue.postMessage(message); // unbounded, so only fails by throwing bad_alloc if the overflow cannot push_back
     } catch (...) {
-        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageOutputThread::postOutputMessage: Closing socket to shut down session because ran out memory.", mName.chars()));
+        VLOGGER_NAMED_ERROR_FORMAT(mLoggerName, "[%s] VMessageOutputThread::postOutputMessage: Closing socket to shut down session because ran out memory.", mName.chars());
         this->stop();
     }
 
@@ -177,14 +177,54 @@ void VMessageOutputThread::_processNextOutboundMessage() {
 
     if (message == nullptr) {
         // OK -- means we were awakened from block but w/o a message actually available
-    } else {
-        if (mSession != nullptr) {
-            mSession->sendMessageToClient(message, mName, mOutputStream);
-        } else {
-            // We are just a client. No "session". Just send.
-            VLOGGER_NAMED_LEVEL(mLoggerName, VMessage::kMessageQueueOpsLevel, VSTRING_FORMAT("[%s] VMessageOutputThread::_processNextOutboundMessage: Sending message@0x%08X.", mName.chars(), message.get()));
-            message->send(mName, mOutputStream);
+        return;
+    }
+
+    // Drain whatever is already queued behind this message into as few socket writes as possible.
+    int     numMessagesBatched = 0;
+    bool    corked = false;
+
+    try {
+        while (message != nullptr) {
+            this->_sendOutboundMessage(message);
+            ++numMessagesBatched;
+
+            if ((numMessagesBatched >= kMaxBatchMessages) || (mBatchStream.getEOFOffset() >= kMaxBatchDataSize)) {
+                if (!corked && (mOutputQueue.getQueueSize() != 0)) {
+                    mSocket->setCork(true);
+                    corked = true;
+                }
+
+                mOutputStream.flush();
+                numMessagesBatched = 0;
+            }
+
+            if (! this->isRunning()) {
+                break;
+            }
+
+            message = mOutputQueue.getNextMessage();
         }
+
+        mOutputStream.flush();
+    } catch (...) {
+        // Discard the unsent remainder of the batch; the caller is going to end the thread.
+        mBatchStream.seek0();
+        mBatchStream.setEOF(0);
+        throw;
+    }
+
+    if (corked) {
+        mSocket->setCork(false);
     }
 }
 
+void VMessageOutputThread::_sendOutboundMessage(VMessagePtr message) {
+    if (mSession != nullptr) {
+        mSession->sendMessageToClient(message, mName, mOutputStream);
+    } else {
+        // We are just a client. No "session". Just send.
+        VLOGGER_NAMED_LEVEL_FORMAT(mLoggerName, VMessage::kMessageQueueOpsLevel, "[%s] VMessageOutputThread::_sendOutboundMessage: Sending message@0x%08X.", mName.chars(), message.get());
+        message->send(mName, mOutputStream);
+    }
+}
@@ -12,9 +12,10 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vsocketthread.h"
 #include "vsocketstream.h"
+#include "vwritebufferedstream.h"
 #include "vbinaryiostream.h"
 #include "vmessage.h"
-#include "vmessagequeue.h"
+#include "vlockfreemessagequeue.h"
 #include "vclientsession.h"
 
 class VServer;
@@ -27,6 +28,15 @@ class VServer;
 VMessageOutputThread understands how to maintain and monitor a message
 output queue, waking up when a new message has been posted to the queue,
 and writing it to the output stream.
+
+Each time it wakes up, it drains every message already queued (up to
+kMaxBatchMessages messages or kMaxBatchDataSize bytes at a time) into a
+write buffer and sends the batch with a single socket write, rather than
+one or more writes per message. If the queue holds more than one batch,
+the socket is corked until the queue is empty so the batches go out in
+full-sized segments. A message whose data is at least kMaxBatchDataSize
+bytes is not copied into the batch; it is written straight to the socket
+after the batch so far.
 */
 class VMessageOutputThread : public VSocketThread {
     public:
@@ -113,18 +123,29 @@ class VMessageOutputThread : public VSocketThread {
         */
         bool isOutputQueueOverLimit(int& currentQueueSize, Vs64& currentQueueDataSize) const;
 
+        static const int kOutputQueueRingCapacity = 1024; ///< Most messages the output queue's lock-free ring holds (fewer if maxQueueSize is smaller); a backlog beyond it overflows.
+        static const int kMaxBatchMessages = 256;       ///< Max number of queued messages coalesced into one socket write.
+        static const int kMaxBatchDataSize = 65536;     ///< Max number of buffered bytes before a batch is written to the socket.
+
     private:
 
         VMessageOutputThread(const VMessageOutputThread&); // not copyable
         VMessageOutputThread& operator=(const VMessageOutputThread&); // not assignable
 
         /**
-        Processes the next queued message, blocking if there is nothing queued.
+        Processes the next queued message, blocking if there is nothing queued,
+        along with any other messages already queued behind it.
         */
         void _processNextOutboundMessage();
+        /**
+        Writes one message to the batch buffer (through the session, if any).
+        @param  message the message to send
+        */
+        void _sendOutboundMessage(VMessagePtr message);
 
-        VMessageQueue           mOutputQueue;       ///< The output queue that this thread pulls messages from.
+        VLockFreeMessageQueue   mOutputQueue;       ///< The output queue that this thread pulls messages from.
         VSocketStream           mSocketStream;      ///< The underlying raw stream the message data is written to.
+        VWriteBufferedStream    mBatchStream;       ///< Accumulates a batch of messages for a single write to mSocketStream.
         VBinaryIOStream         mOutputStream;      ///< The formatted stream the message data is written to.
         VServer*                mServer;            ///< The server object.
         VClientSessionPtr       mSession;           ///< The session object.
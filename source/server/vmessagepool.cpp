@@ -0,0 +1,113 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vmessagepool.h"
+
+#include "vbento.h"
+#include "vmutexlocker.h"
+
+// VMessagePool ---------------------------------------------------------------
+
+VMessagePool::VMessagePool(const VMessageFactory* messageFactory, int maxPooledMessages, Vs64 maxPooledBufferSize)
+    : mMutex("VMessagePool::mMutex")
+    , mMessageFactory(messageFactory)
+    , mMaxPooledMessages(maxPooledMessages)
+    , mMaxPooledBufferSize(maxPooledBufferSize)
+    , mPooledMessages()
+    , mNumCreated(0)
+    , mNumReused(0)
+    , mNumDiscarded(0)
+    , mNumTrimmed(0)
+    , mNumReleasesSinceTrim(0)
+    , mMinPooledSinceTrim(0)
+    {
+    mPooledMessages.reserve(static_cast<VSizeType>(maxPooledMessages));
+}
+
+VMessagePtr VMessagePool::get(VMessageID messageID) {
+    VMessagePtr message;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mMutex, "VMessagePool::get()");
+
+        if (mPooledMessages.empty()) {
+            ++mNumCreated;
+        } else {
+            message = mPooledMessages.back();
+            mPooledMessages.pop_back();
+            ++mNumReused;
+            mMinPooledSinceTrim = V_MIN(mMinPooledSinceTrim, static_cast<int>(mPooledMessages.size()));
+        }
+    }
+
+    if (message == nullptr) {
+        return mMessageFactory->instantiateNewMessage(messageID);
+    }
+
+    message->setMessageID(messageID);
+    return message;
+}
+
+void VMessagePool::release(VMessagePtr& message) {
+    if (message == nullptr) {
+        return;
+    }
+
+    VMutexLocker locker(&mMutex, "VMessagePool::release()");
+
+    // Only our reference left means nobody else can observe the message being recycled.
+    if ((message.use_count() == 1) &&
+        (static_cast<int>(mPooledMessages.size()) < mMaxPooledMessages) &&
+        (message->getBufferSize() <= mMaxPooledBufferSize)) {
+        message->recycleForReceive();
+        mPooledMessages.push_back(message);
+    } else {
+        ++mNumDiscarded;
+    }
+
+    message.reset();
+
+    // Messages that sat in the pool through a whole interval were not needed; free them.
+    if (++mNumReleasesSinceTrim >= kTrimInterval) {
+        this->_trim(static_cast<int>(mPooledMessages.size()) - mMinPooledSinceTrim);
+        mNumReleasesSinceTrim = 0;
+        mMinPooledSinceTrim = static_cast<int>(mPooledMessages.size());
+    }
+}
+
+void VMessagePool::trim(int maxPooledMessages) {
+    VMutexLocker locker(&mMutex, "VMessagePool::trim()");
+    this->_trim(maxPooledMessages);
+}
+
+int VMessagePool::getNumPooledMessages() const {
+    VMutexLocker locker(&mMutex, "VMessagePool::getNumPooledMessages()");
+    return static_cast<int>(mPooledMessages.size());
+}
+
+void VMessagePool::_trim(int maxPooledMessages) {
+    // The back is the top of the LIFO stack and holds the most recently used (cache-warm) messages;
+    // the coldest ones are at the front, so those are the ones to free.
+    const int numExcess = static_cast<int>(mPooledMessages.size()) - V_MAX(0, maxPooledMessages);
+    if (numExcess > 0) {
+        mPooledMessages.erase(mPooledMessages.begin(), mPooledMessages.begin() + numExcess);
+        mNumTrimmed += numExcess;
+    }
+
+    mMinPooledSinceTrim = V_MIN(mMinPooledSinceTrim, static_cast<int>(mPooledMessages.size()));
+}
+
+void VMessagePool::getPoolInfo(VBentoNode& bento) const {
+    VMutexLocker locker(&mMutex, "VMessagePool::getPoolInfo()");
+    bento.addInt("pooled", static_cast<int>(mPooledMessages.size()));
+    bento.addS64("created", mNumCreated);
+    bento.addS64("reused", mNumReused);
+    bento.addS64("discarded", mNumDiscarded);
+    bento.addS64("trimmed", mNumTrimmed);
+}
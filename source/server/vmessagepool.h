@@ -0,0 +1,115 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vmessagepool_h
+#define vmessagepool_h
+
+/** @file */
+
+#include "vmessage.h"
+#include "vmutex.h"
+
+class VBentoNode;
+
+/**
+    @ingroup vsocket
+*/
+
+/**
+VMessagePool keeps a free list of messages for reuse on a thread's receive
+path, so that steady-state message input does not allocate and free a
+message object and its data buffer for every message received.
+
+A message obtained with get() is either a recycled one, readied with
+recycleForReceive() so its data buffer keeps whatever capacity it grew to,
+or (if the pool is empty) a new one from the message factory. When the
+caller is done with it, it hands the message back with release(). A message
+is only reused if the caller's reference is the last one; if a handler kept
+the message (for example to post it to an output queue), release() simply
+lets go of it and the pool allocates a replacement later.
+
+To keep memory bounded, the pool holds at most maxPooledMessages, and does not
+keep messages whose buffers have grown beyond maxPooledBufferSize; those are
+freed on release as usual. The pool also gives back memory after a burst:
+every kTrimInterval releases, it frees the messages that stayed idle in the
+pool the whole time, since the thread's current load does not need them.
+trim() discards pooled messages down to a count directly.
+
+Each input thread owns its own pool, but the pool is guarded by a mutex: when
+the input thread hands its messages to a VMessageDispatcher, it is the worker
+that finishes a message (and so holds the last reference to it) that releases
+it back to the input thread's pool, while the input thread keeps calling get().
+*/
+class VMessagePool {
+    public:
+
+        static const int kDefaultMaxPooledMessages = 16;            ///< Default cap on the number of idle messages kept.
+        static const Vs64 kDefaultMaxPooledBufferSize = 65536;      ///< Default cap on the buffer size of a message that is kept.
+        static const int kTrimInterval = 256;                       ///< Number of releases between automatic trims of idle messages.
+
+        /**
+        Constructs the pool.
+        @param  messageFactory      the factory used to create messages when the pool is empty (the caller owns it)
+        @param  maxPooledMessages   the maximum number of idle messages to keep
+        @param  maxPooledBufferSize messages whose buffer has grown larger than this are not kept
+        */
+        VMessagePool(const VMessageFactory* messageFactory, int maxPooledMessages = kDefaultMaxPooledMessages, Vs64 maxPooledBufferSize = kDefaultMaxPooledBufferSize);
+        /**
+        Destructor. Pooled messages are released.
+        */
+        ~VMessagePool() {}
+
+        /**
+        Returns a message ready for receive(): a recycled one if available,
+        otherwise a new one from the factory.
+        @param  messageID   the message ID to give the message
+        @return a message
+        */
+        VMessagePtr get(VMessageID messageID = 0);
+        /**
+        Returns a message to the pool, if the caller holds the only reference
+        to it and it is within the pool's limits; otherwise it is just released.
+        In either case the caller's pointer is reset.
+        @param  message the message to return
+        */
+        void release(VMessagePtr& message);
+        /**
+        Discards pooled messages until at most the specified number remain.
+        @param  maxPooledMessages   the number of messages to leave in the pool
+        */
+        void trim(int maxPooledMessages = 0);
+
+        /**
+        Returns the number of idle messages currently in the pool.
+        */
+        int getNumPooledMessages() const;
+        /**
+        For diagnostic purposes, adds the pool's counters to the supplied Bento node.
+        */
+        void getPoolInfo(VBentoNode& bento) const;
+
+    private:
+
+        VMessagePool(const VMessagePool&); // not copyable
+        VMessagePool& operator=(const VMessagePool&); // not assignable
+
+        void _trim(int maxPooledMessages); ///< Implements trim(); the caller holds mMutex.
+
+        mutable VMutex              mMutex;                 ///< Guards the pool, which a dispatcher worker may release to concurrently with the owner's get().
+        const VMessageFactory*      mMessageFactory;        ///< Factory for messages when the pool is empty.
+        int                         mMaxPooledMessages;     ///< Cap on mPooledMessages.size().
+        Vs64                        mMaxPooledBufferSize;   ///< Messages with bigger buffers are not kept.
+        std::vector<VMessagePtr>    mPooledMessages;        ///< The idle messages (used as a LIFO stack, so the most recently used buffer is reused first).
+        Vs64                        mNumCreated;            ///< Number of messages obtained from the factory.
+        Vs64                        mNumReused;             ///< Number of get() calls satisfied from the pool.
+        Vs64                        mNumDiscarded;          ///< Number of released messages not kept (shared, oversized, or pool full).
+        Vs64                        mNumTrimmed;            ///< Number of idle messages freed by trimming.
+        int                         mNumReleasesSinceTrim;  ///< Releases since the last automatic trim.
+        int                         mMinPooledSinceTrim;    ///< Fewest idle messages since the last automatic trim; that many went unused.
+};
+
+#endif /* vmessagepool_h */
@@ -18,9 +18,11 @@ int VMessageQueue::gVMessageQueueLagLoggingLevel(VLoggerLevel::DEBUG);
 
 VMessageQueue::VMessageQueue()
     : mQueuedMessages()
+    , mQueuedMessagesCount(0)
     , mQueuedMessagesDataSize(0)
     , mMessageQueueMutex("VMessageQueue::mMessageQueueMutex")
-    , mMessageQueueSemaphore()
+    , mMessageQueueCondition()
+    , mWakeUpPending(false)
     , mLastMessagePostTime()
     {
 }
@@ -33,38 +35,54 @@ void VMessageQueue::postMessage(VMessagePtr message) {
     VMutexLocker locker(&mMessageQueueMutex, "VMessageQueue::postMessage()");
 
     mQueuedMessages.push_back(message);
+    mQueuedMessagesCount.store(mQueuedMessages.size());
     mLastMessagePostTime.setNow();
 
     if (message != nullptr) {
         mQueuedMessagesDataSize += message->getMessageDataLength();
     }
 
-    locker.unlock();    // otherwise signal() will deadlock
-    mMessageQueueSemaphore.signal();
+    locker.unlock();    // the waiter would only block on the mutex if we signaled while holding it
+    mMessageQueueCondition.signal();
 }
 
 VMessagePtr VMessageQueue::blockUntilNextMessage() {
-    // If there is a message on the queue, we can simply return it.
-    VMessagePtr message = this->getNextMessage();
-    if (message != nullptr) {
-        return message;
-    }
+    VMutexLocker locker(&mMessageQueueMutex, "VMessageQueue::blockUntilNextMessage()");
 
-    // There is nothing on the queue, so wait until someone posts a message.
-    VMutex dummy("VMessageQueue::blockUntilNextMessage() dummy");
-    mMessageQueueSemaphore.wait(&dummy, 5 * VDuration::SECOND());
+    // Because the queue and the wakeup flag are examined under the same mutex
+    // that postMessage() and wakeUp() change them under, a post or wakeup cannot
+    // slip in between our look and our wait. The timeout is only a backstop.
+    (void) mMessageQueueCondition.waitFor(&mMessageQueueMutex, std::bind(&VMessageQueue::_hasMessageOrWakeUp, this), 5 * VDuration::SECOND());
+    mWakeUpPending = false;
 
-    return this->getNextMessage();
+    return this->_popNextMessage();
 }
 
 VMessagePtr VMessageQueue::getNextMessage() {
-    VMessagePtr message;
-
     VMutexLocker locker(&mMessageQueueMutex, "VMessageQueue::getNextMessage()");
+    return this->_popNextMessage();
+}
+
+void VMessageQueue::wakeUp() {
+    /* locker scope */ {
+        VMutexLocker locker(&mMessageQueueMutex, "VMessageQueue::wakeUp()");
+        mWakeUpPending = true;
+    }
+
+    mMessageQueueCondition.signal();
+}
+
+bool VMessageQueue::_hasMessageOrWakeUp() const {
+    return mWakeUpPending || (mQueuedMessages.size() > 0);
+}
+
+VMessagePtr VMessageQueue::_popNextMessage() {
+    VMessagePtr message;
 
     if (mQueuedMessages.size() > 0) {
         message = mQueuedMessages.front();
         mQueuedMessages.pop_front();
+        mQueuedMessagesCount.store(mQueuedMessages.size());
 
         if (message != nullptr) {
             mQueuedMessagesDataSize -= message->getMessageDataLength();
@@ -76,25 +94,21 @@ VMessagePtr VMessageQueue::getNextMessage() {
         VInstant now;
         VDuration delayInterval = now - mLastMessagePostTime;
         if (delayInterval >= gVMessageQueueLagLoggingThreshold) {
-            VLOGGER_NAMED_LEVEL("vault.messages.VMessageQueue", gVMessageQueueLagLoggingLevel, VSTRING_FORMAT("VMessageQueue saw a delay of %s when getting a message with ID %d.", delayInterval.getDurationString().chars(), message->getMessageID()));
+            VLOGGER_NAMED_LEVEL_FORMAT("vault.messages.VMessageQueue", gVMessageQueueLagLoggingLevel, "VMessageQueue saw a delay of %s when getting a message with ID %d.", delayInterval.getDurationString(), message->getMessageID());
         }
     }
 
     return message;
 }
 
-void VMessageQueue::wakeUp() {
-    mMessageQueueSemaphore.signal();
-}
-
 VSizeType VMessageQueue::getQueueSize() const {
-    // No need to lock here, nothing bad can happen underneath us.
-    return mQueuedMessages.size();
+    // No need to lock here: the count is an atomic copy of the deque size, so we never look at the deque while it is changing.
+    return mQueuedMessagesCount.load();
 }
 
 Vs64 VMessageQueue::getQueueDataSize() const {
-    // No need to lock here, nothing bad can happen underneath us.
-    return mQueuedMessagesDataSize;
+    // No need to lock here, for the same reason.
+    return mQueuedMessagesDataSize.load();
 }
 
 void VMessageQueue::releaseAllMessages() {
@@ -103,6 +117,7 @@ void VMessageQueue::releaseAllMessages() {
     while (mQueuedMessages.size() > 0) {
         VMessagePtr message = mQueuedMessages.front();
         mQueuedMessages.pop_front();
+        mQueuedMessagesCount.store(mQueuedMessages.size());
 
         if (message != nullptr) {
             mQueuedMessagesDataSize -= message->getMessageDataLength();
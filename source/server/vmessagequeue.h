@@ -10,10 +10,12 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vtypes.h"
 #include "vmutex.h"
-#include "vsemaphore.h"
+#include "vconditionvariable.h"
 #include "vcompactingdeque.h"
 #include "vmessage.h"
 
+#include <atomic>
+
 /** @file */
 
 /**
@@ -54,8 +56,11 @@ class VMessageQueue {
         virtual void postMessage(VMessagePtr message);
         /**
         Returns the message at the front of the queue, blocking if the queue
-        is empty. May be safely called from any thread.
-        @return the message at the front of the queue; the caller becomes
+        is empty. May be safely called from any thread. Returns NULL if
+        wakeUp() is called while the queue is empty, or if nothing is posted
+        within a few seconds, so that the caller gets a chance to check whether
+        it should keep going.
+        @return the message at the front of the queue, or NULL; the caller becomes
                         owner of the object
         */
         VMessagePtr blockUntilNextMessage();
@@ -103,11 +108,16 @@ class VMessageQueue {
     private:
 
         VCompactingDeque<VMessagePtr> mQueuedMessages;///< The actual queue of messages.
-        Vs64            mQueuedMessagesDataSize;    ///< The number of bytes in the queued messages.
+        std::atomic<VSizeType> mQueuedMessagesCount; ///< The number of queued messages; changed with mMessageQueueMutex held, but readable without it.
+        std::atomic<Vs64> mQueuedMessagesDataSize;  ///< The number of bytes in the queued messages; likewise.
         VMutex          mMessageQueueMutex;         ///< The mutex used to synchronize.
-        VSemaphore      mMessageQueueSemaphore;     ///< The semaphore used to block/awaken.
+        VConditionVariable mMessageQueueCondition;  ///< Signaled (with mMessageQueueMutex) when a message is posted or wakeUp() is called.
+        bool            mWakeUpPending;             ///< Set by wakeUp() and consumed by blockUntilNextMessage(), so a wakeup is not lost if nobody is waiting yet.
         VInstant        mLastMessagePostTime;       ///< Time most recent message was posted.
 
+        bool _hasMessageOrWakeUp() const;          ///< The blockUntilNextMessage() wait predicate. ASSUMES CALLER HOLDS mMessageQueueMutex.
+        VMessagePtr _popNextMessage();              ///< Removes and returns the front message, or NULL. ASSUMES CALLER HOLDS mMessageQueueMutex.
+
         static VDuration gVMessageQueueLagLoggingThreshold; ///< If >=0, queuing lags are logged.
         static int gVMessageQueueLagLoggingLevel;           ///< Log level at which queuing lags are logged.
 };
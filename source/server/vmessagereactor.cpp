@@ -0,0 +1,954 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vmessagereactor.h"
+#include "vtypes_internal.h"
+
+#include "vexception.h"
+#include "vmessagehandler.h"
+#include "vmutexlocker.h"
+#include "vlogger.h"
+#include "vsocket.h"
+#include "vmemorystream.h"
+#include "vbento.h"
+
+#ifdef __linux__
+    #define VMESSAGEREACTOR_EPOLL_SUPPORTED
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+#endif
+
+static const int kReactorReadBufferSize = 65536;        // Size of each thread's scratch buffer for non-blocking reads.
+static const int kReactorMaxEventsPerWait = 256;        // Max events harvested per epoll_wait call.
+static const int kReactorSweepIntervalMS = 1000;        // How often idle event loops look for connections closed elsewhere.
+static const Vs64 kReactorInitialInputBufferSize = 1024;// Initial size of each connection's input accumulation buffer.
+static const Vs64 kReactorInitialOutputBufferSize = 1024;// Initial size of each connection's output queue buffer.
+static const Vs64 kReactorMaxIdleBufferSize = 65536;    // A connection's buffer that grew beyond this is given back once empty.
+static const Vs64 kReactorMaxFrameSize = 16 * 1024 * 1024; // A connection sending a larger message frame is closed.
+static const int kReactorMaxMessagesPerWakeUp = 64;     // Messages dispatched per connection before the loop services the others.
+static const int kReactorMaxWriteSize = 1024 * 1024;    // Most bytes handed to one non-blocking write.
+
+// VMessageReactorFrameStream -------------------------------------------------
+
+/**
+VMessageReactorFrameStream is a read-only view of the bytes accumulated so far
+for a connection. Unlike VReadOnlyMemoryStream, any read that cannot be fully
+satisfied throws VEOFException, including the buffer-to-buffer path used by
+streamCopy(). When the message factory cannot tell us frame lengths, that lets
+us run an unmodified VMessage::receive() against a partial frame and find out
+that more bytes are needed, without the reactor knowing the wire protocol.
+*/
+class VMessageReactorFrameStream : public VReadOnlyMemoryStream {
+    public:
+
+        VMessageReactorFrameStream(Vu8* buffer, Vs64 numBytes) : VReadOnlyMemoryStream(buffer, numBytes) {}
+        virtual ~VMessageReactorFrameStream() {}
+
+        virtual Vs64 read(Vu8* targetBuffer, Vs64 numBytesToRead) {
+            this->_requireAvailable(numBytesToRead);
+            return VReadOnlyMemoryStream::read(targetBuffer, numBytesToRead);
+        }
+
+        virtual bool skip(Vs64 numBytesToSkip) {
+            this->_requireAvailable(numBytesToSkip);
+            return VReadOnlyMemoryStream::skip(numBytesToSkip);
+        }
+
+    protected:
+
+        virtual Vs64 _prepareToRead(Vs64 numBytesToRead) const {
+            this->_requireAvailable(numBytesToRead);
+            return VReadOnlyMemoryStream::_prepareToRead(numBytesToRead);
+        }
+
+    private:
+
+        void _requireAvailable(Vs64 numBytesNeeded) const {
+            if (numBytesNeeded > this->available()) {
+                throw VEOFException("VMessageReactorFrameStream: incomplete message frame.");
+            }
+        }
+};
+
+// VMessageReactorConnection --------------------------------------------------
+
+/**
+The per-session state kept by a reactor thread: the session and its socket,
+the bytes received so far that do not yet form a complete message, and the
+bytes posted to the session that have not yet been written. The connection is
+the session's output sink; posting threads only append to the output buffer,
+and the reactor thread writes it out when the socket is writable. With a message
+dispatcher, it is also the dispatch target of the session's strand, and counts
+the messages it has in flight; it is not deleted until they have all finished.
+*/
+class VMessageReactorConnection : public VClientSessionOutputSink, public VMessageDispatchTarget {
+    public:
+
+        VMessageReactorConnection(VClientSessionPtr session, VSocket* socket, VMessageReactorThread* thread)
+            : VClientSessionOutputSink()
+            , VMessageDispatchTarget()
+            , mSession(session)
+            , mSocket(socket)
+            , mThread(thread)
+            , mInputBuffer(kReactorInitialInputBufferSize)
+            , mNumBytesConsumed(0)
+            , mExpectedFrameLength(VMessageFactory::kFrameLengthUnknown)
+            , mRegisteredID(VSocket::kNoSocketID)
+            , mIsWatchingOutput(false)
+            , mIsBacklogged(false)
+            , mStrand()
+            , mNumInFlight(0)
+            , mIsInputPaused(false)
+            , mIsClosed(false)
+            , mOutputMutex("VMessageReactorConnection::mOutputMutex")
+            , mOutputBuffer(kReactorInitialOutputBufferSize)
+            , mNumBytesWritten(0)
+            , mIsOutputRequested(false)
+            , mIsCloseRequested(false)
+            {
+        }
+
+        virtual ~VMessageReactorConnection() {}
+
+        // VClientSessionOutputSink implementation. Called by posting threads with the session's mutex locked.
+        virtual Vs64 queueOutputMessage(VMessagePtr message, const VString& sessionLabel) {
+            bool requestOutput = false;
+            Vs64 numBytesQueued = 0;
+
+            /* locker scope */ {
+                VMutexLocker locker(&mOutputMutex, "VMessageReactorConnection::queueOutputMessage");
+                VBinaryIOStream out(mOutputBuffer);
+                (void) mOutputBuffer.seek(0, SEEK_END);
+                message->send(sessionLabel, out);
+
+                numBytesQueued = mOutputBuffer.getEOFOffset() - mNumBytesWritten;
+                requestOutput = ! mIsOutputRequested;
+                mIsOutputRequested = true;
+            }
+
+            if (requestOutput) {
+                mThread->_requestOutput(this);
+            }
+
+            return numBytesQueued;
+        }
+
+        // VClientSessionOutputSink implementation. Called by posting threads with the session's mutex locked.
+        virtual void requestClose() {
+            mIsCloseRequested = true;
+            // Always ask: a pending output request may never be serviced if the peer has stopped reading.
+            mThread->_requestOutput(this);
+        }
+
+        /** Returns true if the session asked us to close the socket; the reactor thread does so when it sees this. */
+        bool isCloseRequested() const { return mIsCloseRequested; }
+
+        // VMessageDispatchTarget implementation. Called on the dispatcher's worker threads.
+        virtual void dispatchPostedMessage(VMessagePtr message) {
+            mThread->_dispatchMessage(mSession, message);
+        }
+
+        virtual void releasePostedMessage(VMessagePtr& message) {
+            mThread->mMessagePool.release(message);
+            mThread->_postedMessageFinished(this); // After this the reactor thread may delete us.
+        }
+
+        /** Appends freshly read bytes after any unconsumed ones. */
+        void append(const Vu8* buffer, int numBytes) {
+            (void) mInputBuffer.seek(0, SEEK_END);
+            (void) mInputBuffer.write(buffer, numBytes);
+        }
+
+        /** Returns the number of received bytes not yet consumed by a complete message. */
+        Vs64 getNumUnconsumedBytes() const { return mInputBuffer.getEOFOffset() - mNumBytesConsumed; }
+        /** Returns a pointer to the first unconsumed byte. */
+        Vu8* getUnconsumedBytes() const { return mInputBuffer.getBuffer() + mNumBytesConsumed; }
+        /** Marks bytes as consumed by a complete message. */
+        void consume(Vs64 numBytes) { mNumBytesConsumed += numBytes; mExpectedFrameLength = VMessageFactory::kFrameLengthUnknown; }
+
+        /** Slides any unconsumed bytes down to the start of the buffer so it does not grow without bound. */
+        void compact() {
+            Vs64 numRemaining = this->getNumUnconsumedBytes();
+            if ((numRemaining == 0) && (mInputBuffer.getBufferSize() > kReactorMaxIdleBufferSize)) {
+                mInputBuffer.adoptBuffer(new Vu8[kReactorInitialInputBufferSize], VMemoryStream::kAllocatedByOperatorNew, true, kReactorInitialInputBufferSize, 0);
+            } else if ((mNumBytesConsumed != 0) && (numRemaining != 0)) {
+                ::memmove(mInputBuffer.getBuffer(), this->getUnconsumedBytes(), static_cast<size_t>(numRemaining));
+            }
+
+            mInputBuffer.setEOF(numRemaining);
+            mNumBytesConsumed = 0;
+        }
+
+        /**
+        Writes as much queued output as the socket will take without blocking.
+        Returns true if the queue is now empty; the next posted message will request output again.
+        */
+        bool flushOutput() {
+            VMutexLocker locker(&mOutputMutex, "VMessageReactorConnection::flushOutput");
+
+            while (mNumBytesWritten < mOutputBuffer.getEOFOffset()) {
+                int numBytesToWrite = static_cast<int>(V_MIN(static_cast<Vs64>(kReactorMaxWriteSize), mOutputBuffer.getEOFOffset() - mNumBytesWritten));
+                int numBytesWritten = mSocket->writeNonBlocking(mOutputBuffer.getBuffer() + mNumBytesWritten, numBytesToWrite);
+                if (numBytesWritten == 0) {
+                    return false; // The socket's send buffer is full; we'll be told when it is writable.
+                }
+
+                mNumBytesWritten += numBytesWritten;
+            }
+
+            if (mOutputBuffer.getBufferSize() > kReactorMaxIdleBufferSize) {
+                mOutputBuffer.adoptBuffer(new Vu8[kReactorInitialOutputBufferSize], VMemoryStream::kAllocatedByOperatorNew, true, kReactorInitialOutputBufferSize, 0);
+            }
+
+            mOutputBuffer.setEOF(0);
+            mNumBytesWritten = 0;
+            mIsOutputRequested = false;
+            return true;
+        }
+
+        /** Returns true if the socket was closed or the session began shutting down on another thread. */
+        bool isDefunct() const { return (mSocket->getSockID() == VSocket::kNoSocketID) || mSession->isShuttingDown(); }
+
+        VClientSessionPtr       mSession;               ///< The session; keeps it alive while we service it.
+        VSocket*                mSocket;                ///< The session's socket (owned by the session).
+        VMessageReactorThread*  mThread;                ///< The thread servicing this connection.
+        VMemoryStream           mInputBuffer;           ///< Received bytes; [mNumBytesConsumed, EOF) are not yet part of a dispatched message.
+        Vs64                    mNumBytesConsumed;      ///< Offset of the first unconsumed byte in mInputBuffer.
+        Vs64                    mExpectedFrameLength;   ///< The length of the frame at mNumBytesConsumed, once its header has been decoded.
+        VSocketID               mRegisteredID;          ///< The descriptor that was added to the epoll set.
+        bool                    mIsWatchingOutput;      ///< True if the epoll registration includes EPOLLOUT.
+        bool                    mIsBacklogged;          ///< True if buffered messages are waiting for the next turn of the loop.
+        VMessageDispatchStrandPtr mStrand;              ///< Our ordering state in the thread's message dispatcher, if it has one.
+        int                     mNumInFlight;           ///< Messages posted to the dispatcher whose finish the reactor thread has not yet seen.
+        bool                    mIsInputPaused;         ///< True while mNumInFlight is at the limit; we neither read nor dispatch.
+        bool                    mIsClosed;              ///< True once _closeConnection() has run; we are deleted when mNumInFlight reaches zero.
+
+    private:
+
+        VMessageReactorConnection(const VMessageReactorConnection&); // not copyable
+        VMessageReactorConnection& operator=(const VMessageReactorConnection&); // not assignable
+
+        VMutex                  mOutputMutex;           ///< Protects the output members below.
+        VMemoryStream           mOutputBuffer;          ///< Posted output; [mNumBytesWritten, EOF) is not yet written.
+        Vs64                    mNumBytesWritten;       ///< Offset of the first unwritten byte in mOutputBuffer.
+        bool                    mIsOutputRequested;     ///< True from the first queued message until the queue is drained.
+        std::atomic<bool>       mIsCloseRequested;      ///< Set by requestClose() on a posting thread; acted on by the reactor thread.
+};
+
+// VMessageReactorThread ------------------------------------------------------
+
+VMessageReactorThread::VMessageReactorThread(const VString& threadName, int reactorIndex, VServer* server, const VMessageFactory* messageFactory, VManagementInterface* manager)
+    : VSocketThread(threadName, VSTRING_FORMAT("vault.messages.VMessageReactorThread.%d", reactorIndex), kDontDeleteSelfAtEnd, kCreateThreadJoinable, manager)
+    , mServer(server)
+    , mMessageFactory(messageFactory)
+    , mReactor(NULL)
+    , mIsDead(false)
+    , mReactorIndex(reactorIndex)
+    , mPollID(-1)
+    , mWakeUpID(-1)
+    , mConnections()
+    , mBackloggedConnections()
+    , mPendingMutex(VSTRING_FORMAT("VMessageReactorThread(%s)::mPendingMutex", threadName.chars()), false, "VMessageReactorThread::mPendingMutex")
+    , mPendingConnections()
+    , mOutputRequests()
+    , mFinishedMessages()
+    , mClosingConnections()
+    , mMessageDispatcher(NULL)
+    , mMaxInFlightMessages(VMessageDispatcher::kDefaultMaxInFlightPerSession)
+    , mNumSessions(0)
+    , mReadBuffer(NULL)
+    , mMessagePool(messageFactory)
+    , mHandlerStorage()
+    {
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+    mPollID = ::epoll_create1(EPOLL_CLOEXEC);
+    if (mPollID < 0) {
+        throw VStackTraceException(VSystemError(), VSTRING_FORMAT("[%s] VMessageReactorThread: epoll_create1 failed.", mName.chars()));
+    }
+
+    mWakeUpID = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mWakeUpID < 0) {
+        VSystemError e;
+        (void) ::close(mPollID);
+        throw VStackTraceException(e, VSTRING_FORMAT("[%s] VMessageReactorThread: eventfd failed.", mName.chars()));
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // NULL identifies the wake-up descriptor
+    if (::epoll_ctl(mPollID, EPOLL_CTL_ADD, mWakeUpID, &event) != 0) {
+        VSystemError e;
+        (void) ::close(mWakeUpID);
+        (void) ::close(mPollID);
+        throw VStackTraceException(e, VSTRING_FORMAT("[%s] VMessageReactorThread: Unable to watch the wake-up descriptor.", mName.chars()));
+    }
+#else
+    throw VUnimplementedException(VSTRING_FORMAT("[%s] VMessageReactorThread: epoll is not available on this platform.", mName.chars()));
+#endif
+
+    mReadBuffer = new Vu8[kReactorReadBufferSize];
+}
+
+VMessageReactorThread::~VMessageReactorThread() {
+    // Normally run() has already closed everything; this covers a thread that never ran.
+    for (VMessageReactorConnectionList::const_iterator i = mPendingConnections.begin(); i != mPendingConnections.end(); ++i) {
+        try {
+            (*i)->mSession->setOutputSink(NULL);
+            (*i)->mSession->shutdown(NULL);
+        } catch (...) {}
+
+        delete (*i);
+    }
+
+    for (VMessageReactorConnectionList::const_iterator i = mConnections.begin(); i != mConnections.end(); ++i) {
+        try {
+            (*i)->mSession->setOutputSink(NULL);
+        } catch (...) {}
+
+        delete (*i);
+    }
+
+    if (mWakeUpID >= 0) {
+        (void) ::close(mWakeUpID);
+    }
+
+    if (mPollID >= 0) {
+        (void) ::close(mPollID);
+    }
+
+    delete [] mReadBuffer;
+
+    mServer = NULL;
+    mMessageFactory = NULL;
+    mMessageDispatcher = NULL;
+}
+
+void VMessageReactorThread::run() {
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+    struct epoll_event events[kReactorMaxEventsPerWait];
+    VInstant lastSweepTime;
+
+    while (this->isRunning()) {
+        // Don't sleep while connections still have buffered messages to dispatch.
+        int timeoutMS = mBackloggedConnections.empty() ? kReactorSweepIntervalMS : 0;
+        int numEvents = ::epoll_wait(mPollID, events, kReactorMaxEventsPerWait, timeoutMS);
+
+        if (numEvents < 0) {
+            VSystemError e;
+            if (e.isLikePosixError(EINTR)) {
+                continue;
+            }
+
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: epoll_wait failed: %s", mName.chars(), e.getErrorMessage().chars()));
+
+            // Once marked, we are handed no more sessions; those already handed over are shut down below.
+            if (mReactor != NULL) {
+                mReactor->_markThreadDead(this);
+            }
+
+            break;
+        }
+
+        for (int i = 0; i < numEvents; ++i) {
+            VMessageReactorConnection* connection = static_cast<VMessageReactorConnection*>(events[i].data.ptr);
+            if (connection == NULL) {
+                Vu64 counter;
+                (void) ::read(mWakeUpID, &counter, sizeof(counter));
+                continue;
+            }
+
+            if (((events[i].events & EPOLLOUT) != 0) && ! this->_processWritable(connection)) {
+                continue; // The connection was closed.
+            }
+
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0) {
+                this->_processInput(connection, true); // Closes the connection on EOF or error.
+            }
+        }
+
+        this->_processFinishedMessages();
+        this->_processBacklog();
+        this->_addPendingConnections();
+        this->_processOutputRequests();
+
+        VInstant now;
+        if ((numEvents == 0) || ((now - lastSweepTime) > VDuration::MILLISECOND() * kReactorSweepIntervalMS)) {
+            lastSweepTime = now;
+            this->_sweepConnections();
+        }
+    }
+#endif /* VMESSAGEREACTOR_EPOLL_SUPPORTED */
+
+    // We are stopping. Shut down all sessions we still service.
+    this->_addPendingConnections();
+    while (!mConnections.empty()) {
+        this->_closeConnection(mConnections.back());
+    }
+
+    // Handlers still running on the dispatcher refer to their connections and to us.
+    this->_waitForFinishedMessages();
+}
+
+void VMessageReactorThread::stop() {
+    VSocketThread::stop();
+    this->_wakeUp();
+}
+
+void VMessageReactorThread::attachSession(VClientSessionPtr session, VSocket* socket) {
+    VMessageReactorConnection* connection = new VMessageReactorConnection(session, socket, this);
+    if (mMessageDispatcher != NULL) {
+        connection->mStrand.reset(new VMessageDispatchStrand(connection));
+    }
+
+    /* locker scope */ {
+        VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::attachSession");
+        mPendingConnections.push_back(connection);
+        ++mNumSessions;
+    }
+
+    // Output posted from now on is queued; it is written once the event loop picks up the connection.
+    session->setOutputSink(connection);
+
+    this->_wakeUp();
+}
+
+void VMessageReactorThread::setMessageDispatcher(VMessageDispatcher* dispatcher, int maxInFlightMessages) {
+    mMessageDispatcher = dispatcher;
+    mMaxInFlightMessages = V_MAX(1, maxInFlightMessages);
+}
+
+void VMessageReactorThread::_dispatchMessage(VClientSessionPtr session, VMessagePtr message) {
+    // With a dispatcher, several workers may be here at once; only one can use mHandlerStorage,
+    // and the others' handlers are allocated on the heap.
+    VMessageHandler* handler = VMessageHandler::get(message, mServer, session, this, mHandlerStorage);
+
+    if (handler == NULL) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread::_dispatchMessage: No message hander defined for message %d.", session->getName().chars(), (int) message->getMessageID()));
+        this->_handleNoMessageHandler(session, message);
+    } else {
+        /*
+        The exception handling rules are the same as in VMessageInputThread::_processNextRequest(),
+        except that a serious error closes only this session, not the whole event loop.
+        */
+        const Vs64 handlerStartMicroseconds = VClientSessionStats::getTimestampMicroseconds();
+        try {
+            this->_beforeProcessMessage(handler, message);
+            this->_callProcessMessage(handler);
+            this->_afterProcessMessage(handler);
+        } catch (const VException& ex) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread::_dispatchMessage: Caught exception for message %d: #%d %s", session->getName().chars(), (int) message->getMessageID(), ex.getError(), ex.what()));
+        } catch (const std::exception& e) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread::_dispatchMessage: Caught exception for message ID %d: %s", session->getName().chars(), (int) message->getMessageID(), e.what()));
+        } catch (...) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread::_dispatchMessage: Caught unknown exception for message ID %d.", session->getName().chars(), (int) message->getMessageID()));
+        }
+
+        session->getStats().recordHandlerTime(VClientSessionStats::getTimestampMicroseconds() - handlerStartMicroseconds);
+
+        VMessageHandler::destroy(handler, &mHandlerStorage);
+    }
+}
+
+void VMessageReactorThread::_callProcessMessage(VMessageHandler* handler) {
+    handler->logProcessMessageStart();
+    handler->processMessage();
+    handler->logProcessMessageEnd();
+}
+
+void VMessageReactorThread::_addPendingConnections() {
+    VMessageReactorConnectionList newConnections;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::_addPendingConnections");
+        newConnections.swap(mPendingConnections);
+    }
+
+    for (VMessageReactorConnectionList::const_iterator i = newConnections.begin(); i != newConnections.end(); ++i) {
+        VMessageReactorConnection* connection = *i;
+        mConnections.push_back(connection);
+        connection->mRegisteredID = connection->mSocket->getSockID();
+
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+        // We watch for writability at first, so that any output posted before now is written by the first wait.
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+        event.data.ptr = connection;
+        if (::epoll_ctl(mPollID, EPOLL_CTL_ADD, connection->mRegisteredID, &event) != 0) {
+            VSystemError e;
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Unable to watch session [%s]: %s", mName.chars(), connection->mSession->getName().chars(), e.getErrorMessage().chars()));
+            this->_closeConnection(connection);
+            continue;
+        }
+
+        connection->mIsWatchingOutput = true;
+#endif
+
+        // A close requested before we picked the connection up was skipped by _processOutputRequests().
+        if (connection->isCloseRequested()) {
+            this->_closeConnection(connection);
+            continue;
+        }
+
+        // Any data that arrived before we started watching is reported by the next (level-triggered) wait.
+        VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Now servicing session [%s].", mName.chars(), connection->mSession->getName().chars()));
+    }
+}
+
+void VMessageReactorThread::_processInput(VMessageReactorConnection* connection, bool isReadable) {
+    try {
+        // Stop reading once a frame's worth is buffered; the kernel holds the rest, pushing back on the peer.
+        while (isReadable && (connection->getNumUnconsumedBytes() < kReactorMaxFrameSize)) {
+            int numBytesRead = connection->mSocket->readNonBlocking(mReadBuffer, kReactorReadBufferSize);
+            if (numBytesRead == 0) {
+                break;
+            }
+
+            connection->append(mReadBuffer, numBytesRead);
+
+            if (numBytesRead < kReactorReadBufferSize) {
+                break; // Drained what the kernel had; level-triggered epoll will tell us if more arrives.
+            }
+        }
+
+        int numMessagesDispatched = 0;
+        while (this->isRunning() && ! connection->mIsInputPaused && (connection->getNumUnconsumedBytes() > 0) && this->_receiveAndDispatch(connection)) {
+            if (++numMessagesDispatched == kReactorMaxMessagesPerWakeUp) {
+                // Give the other connections a turn; the rest is dispatched on the next turn of the loop.
+                if ((connection->getNumUnconsumedBytes() > 0) && ! connection->mIsBacklogged) {
+                    connection->mIsBacklogged = true;
+                    mBackloggedConnections.push_back(connection);
+                }
+
+                break;
+            }
+        }
+
+        connection->compact();
+        return;
+
+    } catch (const VEOFException& /*ex*/) {
+        VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Session [%s] socket has closed (EOF).", mName.chars(), connection->mSession->getName().chars()));
+    } catch (const VSocketClosedException& /*ex*/) {
+        VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Session [%s] socket has closed.", mName.chars(), connection->mSession->getName().chars()));
+    } catch (const VException& ex) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] due to exception #%d '%s'.", mName.chars(), connection->mSession->getName().chars(), ex.getError(), ex.what()));
+    } catch (const std::exception& ex) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] due to exception '%s'.", mName.chars(), connection->mSession->getName().chars(), ex.what()));
+    } catch (...) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] due to unknown exception.", mName.chars(), connection->mSession->getName().chars()));
+    }
+
+    this->_closeConnection(connection);
+}
+
+bool VMessageReactorThread::_receiveAndDispatch(VMessageReactorConnection* connection) {
+    const Vs64 numBytesAvailable = connection->getNumUnconsumedBytes();
+
+    // Decode the frame header once; after that, just wait until the whole frame is here.
+    if (connection->mExpectedFrameLength == VMessageFactory::kFrameLengthUnknown) {
+        Vs64 frameLength = mMessageFactory->getFrameLength(connection->getUnconsumedBytes(), numBytesAvailable);
+        if (frameLength == VMessageFactory::kFrameHeaderIncomplete) {
+            return false;
+        }
+
+        if (frameLength > kReactorMaxFrameSize) {
+            throw VRangeException(VSTRING_FORMAT("[%s] VMessageReactorThread: Message frame of " VSTRING_FORMATTER_S64 " bytes exceeds the limit of " VSTRING_FORMATTER_S64 ".", connection->mSession->getName().chars(), frameLength, kReactorMaxFrameSize));
+        }
+
+        connection->mExpectedFrameLength = frameLength;
+    }
+
+    if (numBytesAvailable < connection->mExpectedFrameLength) {
+        return false;
+    }
+
+    // With a known frame length, receive() sees exactly the frame, so it cannot read into the next one.
+    const bool                  isFrameLengthKnown = (connection->mExpectedFrameLength >= 0);
+    VMessageReactorFrameStream  frameStream(connection->getUnconsumedBytes(), isFrameLengthKnown ? connection->mExpectedFrameLength : numBytesAvailable);
+    VBinaryIOStream             frameIO(frameStream);
+    VMessagePtr                 message = mMessagePool.get();
+
+    try {
+        message->receive(connection->mSession->getName(), frameIO);
+    } catch (const VEOFException& /*ex*/) {
+        mMessagePool.release(message);
+
+        if (isFrameLengthKnown) {
+            throw VException(VSTRING_FORMAT("[%s] VMessageReactorThread: Message was longer than its " VSTRING_FORMATTER_S64 "-byte frame.", connection->mSession->getName().chars(), connection->mExpectedFrameLength));
+        }
+
+        if (numBytesAvailable >= kReactorMaxFrameSize) {
+            throw VRangeException(VSTRING_FORMAT("[%s] VMessageReactorThread: Message frame exceeds the limit of " VSTRING_FORMATTER_S64 " bytes.", connection->mSession->getName().chars(), kReactorMaxFrameSize));
+        }
+
+        return false; // Partial frame; wait for more bytes. The VEOFException from a real peer close comes from the socket, not from here.
+    }
+
+    connection->consume(isFrameLengthKnown ? connection->mExpectedFrameLength : frameStream.getIOOffset());
+    connection->mSession->getStats().recordMessageIn(message->getMessageDataLength());
+
+    if (mMessageDispatcher == NULL) {
+        this->_dispatchMessage(connection->mSession, message);
+        mMessagePool.release(message);
+        return true;
+    }
+
+    // The worker that finishes the message returns it to mMessagePool, and tells us so through _postedMessageFinished().
+    const bool ordered = VMessageHandler::requiresOrderedDispatch(message->getMessageID());
+    ++connection->mNumInFlight;
+    mMessageDispatcher->postMessage(connection->mStrand, std::move(message), ordered);
+
+    // Backpressure: leave the rest in the socket until the session is under its limit.
+    if (connection->mNumInFlight >= mMaxInFlightMessages) {
+        this->_pauseInput(connection, true);
+    }
+
+    return true;
+}
+
+void VMessageReactorThread::_processBacklog() {
+    VMessageReactorConnectionList backloggedConnections;
+    backloggedConnections.swap(mBackloggedConnections);
+
+    for (VMessageReactorConnectionList::const_iterator i = backloggedConnections.begin(); i != backloggedConnections.end(); ++i) {
+        (*i)->mIsBacklogged = false;
+        this->_processInput(*i, false);
+    }
+}
+
+bool VMessageReactorThread::_processWritable(VMessageReactorConnection* connection) {
+    try {
+        bool isDrained = connection->flushOutput();
+        this->_watchOutput(connection, ! isDrained);
+        return true;
+
+    } catch (const VSocketClosedException& /*ex*/) {
+        VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Session [%s] socket has closed.", mName.chars(), connection->mSession->getName().chars()));
+    } catch (const VException& ex) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] due to output exception #%d '%s'.", mName.chars(), connection->mSession->getName().chars(), ex.getError(), ex.what()));
+    } catch (const std::exception& ex) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] due to output exception '%s'.", mName.chars(), connection->mSession->getName().chars(), ex.what()));
+    }
+
+    this->_closeConnection(connection);
+    return false;
+}
+
+void VMessageReactorThread::_processOutputRequests() {
+    VMessageReactorConnectionList requests;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::_processOutputRequests");
+        requests.swap(mOutputRequests);
+    }
+
+    // A connection that drained and was posted to again can be listed twice; service it once.
+    std::sort(requests.begin(), requests.end());
+    requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+
+    for (VMessageReactorConnectionList::const_iterator i = requests.begin(); i != requests.end(); ++i) {
+        // Usually the socket takes it all right away; if not, we watch for writability.
+        // A connection still pending in mPendingConnections is written once it is picked up.
+        if ((*i)->mRegisteredID == VSocket::kNoSocketID) {
+            continue;
+        }
+
+        if ((*i)->isCloseRequested()) {
+            VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] at its request.", mName.chars(), (*i)->mSession->getName().chars()));
+            this->_closeConnection(*i);
+        } else {
+            (void) this->_processWritable(*i);
+        }
+    }
+}
+
+void VMessageReactorThread::_requestOutput(VMessageReactorConnection* connection) {
+    /* locker scope */ {
+        VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::_requestOutput");
+        mOutputRequests.push_back(connection);
+    }
+
+    this->_wakeUp();
+}
+
+void VMessageReactorThread::_watchOutput(VMessageReactorConnection* connection, bool watch) {
+    if (connection->mIsWatchingOutput == watch) {
+        return;
+    }
+
+    connection->mIsWatchingOutput = watch;
+    this->_updateWatchedEvents(connection);
+}
+
+void VMessageReactorThread::_pauseInput(VMessageReactorConnection* connection, bool pause) {
+    if (connection->mIsInputPaused == pause) {
+        return;
+    }
+
+    connection->mIsInputPaused = pause;
+    this->_updateWatchedEvents(connection);
+}
+
+void VMessageReactorThread::_updateWatchedEvents(VMessageReactorConnection* connection) {
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+    // While input is paused we don't even watch for the peer's close, which level-triggered epoll would keep reporting.
+    struct epoll_event event;
+    event.events = (connection->mIsInputPaused ? 0 : (EPOLLIN | EPOLLRDHUP)) | (connection->mIsWatchingOutput ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    if (::epoll_ctl(mPollID, EPOLL_CTL_MOD, connection->mRegisteredID, &event) != 0) {
+        throw VException(VSystemError(), VSTRING_FORMAT("[%s] VMessageReactorThread: Unable to change the events watched for session [%s].", mName.chars(), connection->mSession->getName().chars()));
+    }
+#endif
+}
+
+void VMessageReactorThread::_postedMessageFinished(VMessageReactorConnection* connection) {
+    // We wake the loop before releasing the lock, so that it cannot see the last finish, end, and be deleted
+    // while we are still writing to mWakeUpID.
+    VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::_postedMessageFinished");
+    mFinishedMessages.push_back(connection);
+    this->_wakeUp();
+}
+
+void VMessageReactorThread::_processFinishedMessages() {
+    VMessageReactorConnectionList finished;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::_processFinishedMessages");
+        finished.swap(mFinishedMessages);
+    }
+
+    // A connection is listed once per finished message, so it cannot be deleted while it is still listed.
+    for (VMessageReactorConnectionList::const_iterator i = finished.begin(); i != finished.end(); ++i) {
+        VMessageReactorConnection* connection = *i;
+        --connection->mNumInFlight;
+
+        if (connection->mIsClosed) {
+            if (connection->mNumInFlight == 0) {
+                mClosingConnections.erase(std::remove(mClosingConnections.begin(), mClosingConnections.end(), connection), mClosingConnections.end());
+                delete connection;
+            }
+        } else if (connection->mIsInputPaused && (connection->mNumInFlight < mMaxInFlightMessages)) {
+            try {
+                this->_pauseInput(connection, false);
+            } catch (const VException& ex) {
+                VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Closing session [%s] due to exception #%d '%s'.", mName.chars(), connection->mSession->getName().chars(), ex.getError(), ex.what()));
+                this->_closeConnection(connection);
+                continue;
+            }
+
+            this->_processInput(connection, false); // Dispatches what was buffered when we paused.
+        }
+    }
+}
+
+void VMessageReactorThread::_waitForFinishedMessages() {
+    while (! mClosingConnections.empty()) {
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+        // Only the wake-up descriptor is left in the set. If the set itself has failed, we just poll.
+        struct epoll_event event;
+        if (::epoll_wait(mPollID, &event, 1, kReactorSweepIntervalMS) > 0) {
+            Vu64 counter;
+            (void) ::read(mWakeUpID, &counter, sizeof(counter));
+        } else {
+            VThread::sleep(VDuration::MILLISECOND() * 10);
+        }
+#endif
+
+        this->_processFinishedMessages();
+    }
+}
+
+void VMessageReactorThread::_closeConnection(VMessageReactorConnection* connection) {
+    // Once this returns, no posting thread is inside the connection or will enter it again.
+    connection->mSession->setOutputSink(NULL);
+
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+    // If the socket was already closed elsewhere, the kernel removed it from the set, and the
+    // descriptor number may since have been reused by a newer connection; so only remove it if still ours.
+    if ((connection->mRegisteredID != VSocket::kNoSocketID) && (connection->mSocket->getSockID() == connection->mRegisteredID)) {
+        struct epoll_event event;
+        (void) ::epoll_ctl(mPollID, EPOLL_CTL_DEL, connection->mRegisteredID, &event);
+    }
+#endif
+
+    // We close the descriptor here, where it is used, so that no other thread closes it while we may be in a read or write.
+    connection->mSocket->close();
+
+    VMessageReactorConnectionList::iterator position = std::find(mConnections.begin(), mConnections.end(), connection);
+    if (position != mConnections.end()) {
+        mConnections.erase(position);
+    }
+
+    position = std::find(mBackloggedConnections.begin(), mBackloggedConnections.end(), connection);
+    if (position != mBackloggedConnections.end()) {
+        mBackloggedConnections.erase(position);
+    }
+
+    /* locker scope */ {
+        VMutexLocker locker(&mPendingMutex, "VMessageReactorThread::_closeConnection");
+        mOutputRequests.erase(std::remove(mOutputRequests.begin(), mOutputRequests.end(), connection), mOutputRequests.end());
+        --mNumSessions;
+    }
+
+    try {
+        connection->mSession->shutdown(this);
+    } catch (const std::exception& ex) {
+        VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VMessageReactorThread: Exception shutting down session [%s]: '%s'.", mName.chars(), connection->mSession->getName().chars(), ex.what()));
+    }
+
+    // Deleting releases our session reference; the session deletes the socket when the last reference goes.
+    // Handlers still running on the dispatcher use the connection, so then it waits for them to finish.
+    connection->mIsClosed = true;
+    if (connection->mNumInFlight == 0) {
+        delete connection;
+    } else {
+        mClosingConnections.push_back(connection);
+    }
+}
+
+void VMessageReactorThread::_sweepConnections() {
+    VMessageReactorConnectionList defunctConnections;
+    for (VMessageReactorConnectionList::const_iterator i = mConnections.begin(); i != mConnections.end(); ++i) {
+        if ((*i)->isDefunct()) {
+            defunctConnections.push_back(*i);
+        }
+    }
+
+    for (VMessageReactorConnectionList::const_iterator i = defunctConnections.begin(); i != defunctConnections.end(); ++i) {
+        this->_closeConnection(*i);
+    }
+}
+
+void VMessageReactorThread::_wakeUp() {
+#ifdef VMESSAGEREACTOR_EPOLL_SUPPORTED
+    if (mWakeUpID >= 0) {
+        Vu64 increment = 1;
+        (void) ::write(mWakeUpID, &increment, sizeof(increment));
+    }
+#endif
+}
+
+// VMessageReactor ------------------------------------------------------------
+
+VMessageReactor::VMessageReactor(const VString& reactorBaseName, int numThreads, VServer* server, const VMessageFactory* messageFactory, VManagementInterface* manager)
+    : mName(reactorBaseName)
+    , mNumThreads(V_MAX(1, numThreads))
+    , mServer(server)
+    , mMessageFactory(messageFactory)
+    , mManager(manager)
+    , mMessageDispatcher(NULL)
+    , mMaxInFlightMessages(VMessageDispatcher::kDefaultMaxInFlightPerSession)
+    , mThreadsMutex(VSTRING_FORMAT("VMessageReactor(%s)::mThreadsMutex", reactorBaseName.chars()))
+    , mThreads()
+    {
+}
+
+VMessageReactor::~VMessageReactor() {
+    try {
+        this->stop();
+    } catch (...) {}
+
+    mServer = NULL;
+    mMessageFactory = NULL;
+    mManager = NULL;
+    mMessageDispatcher = NULL;
+}
+
+void VMessageReactor::start() {
+    VMutexLocker locker(&mThreadsMutex, "VMessageReactor::start");
+
+    if (!mThreads.empty()) {
+        return;
+    }
+
+    for (int i = 0; i < mNumThreads; ++i) {
+        VMessageReactorThread* thread = this->_createReactorThread(VSTRING_FORMAT("%s.%d", mName.chars(), i), i);
+        thread->mReactor = this;
+        thread->setMessageDispatcher(mMessageDispatcher, mMaxInFlightMessages);
+        mThreads.push_back(thread);
+        thread->start();
+    }
+}
+
+void VMessageReactor::stop() {
+    std::vector<VMessageReactorThread*> threads;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mThreadsMutex, "VMessageReactor::stop");
+        threads.swap(mThreads);
+    }
+
+    // Joined without the lock, which a thread whose event loop fails takes to mark itself dead.
+    for (std::vector<VMessageReactorThread*>::const_iterator i = threads.begin(); i != threads.end(); ++i) {
+        (*i)->stop();
+    }
+
+    for (std::vector<VMessageReactorThread*>::const_iterator i = threads.begin(); i != threads.end(); ++i) {
+        (void) VThread::threadJoin((*i)->threadID(), NULL); // join() returns at once for a stopped thread
+        delete (*i);
+    }
+}
+
+void VMessageReactor::setMessageDispatcher(VMessageDispatcher* dispatcher, int maxInFlightMessages) {
+    mMessageDispatcher = dispatcher;
+    mMaxInFlightMessages = maxInFlightMessages;
+}
+
+void VMessageReactor::attachSession(VClientSessionPtr session, VSocket* socket) {
+    VMutexLocker locker(&mThreadsMutex, "VMessageReactor::attachSession");
+
+    if (mThreads.empty()) {
+        throw VStackTraceException(VSTRING_FORMAT("VMessageReactor(%s)::attachSession: Reactor is not running.", mName.chars()));
+    }
+
+    VMessageReactorThread* leastLoaded = NULL;
+    for (std::vector<VMessageReactorThread*>::const_iterator i = mThreads.begin(); i != mThreads.end(); ++i) {
+        if (! (*i)->mIsDead && ((leastLoaded == NULL) || ((*i)->getNumSessions() < leastLoaded->getNumSessions()))) {
+            leastLoaded = *i;
+        }
+    }
+
+    if (leastLoaded == NULL) {
+        throw VStackTraceException(VSTRING_FORMAT("VMessageReactor(%s)::attachSession: All event loops have failed.", mName.chars()));
+    }
+
+    leastLoaded->attachSession(session, socket);
+}
+
+int VMessageReactor::getNumSessions() const {
+    VMutexLocker locker(&mThreadsMutex, "VMessageReactor::getNumSessions");
+
+    int numSessions = 0;
+    for (std::vector<VMessageReactorThread*>::const_iterator i = mThreads.begin(); i != mThreads.end(); ++i) {
+        numSessions += (*i)->getNumSessions();
+    }
+
+    return numSessions;
+}
+
+void VMessageReactor::getReactorInfo(VBentoNode& bento) const {
+    VMutexLocker locker(&mThreadsMutex, "VMessageReactor::getReactorInfo");
+
+    bento.addString("name", mName);
+    for (std::vector<VMessageReactorThread*>::const_iterator i = mThreads.begin(); i != mThreads.end(); ++i) {
+        VBentoNode* threadNode = bento.addNewChildNode("reactor-thread");
+        threadNode->addString("name", (*i)->getName());
+        threadNode->addInt("sessions", (*i)->getNumSessions());
+        threadNode->addBool("dead", (*i)->mIsDead);
+    }
+}
+
+void VMessageReactor::_markThreadDead(VMessageReactorThread* thread) {
+    VMutexLocker locker(&mThreadsMutex, "VMessageReactor::_markThreadDead");
+    thread->mIsDead = true;
+}
+
+VMessageReactorThread* VMessageReactor::_createReactorThread(const VString& threadName, int reactorIndex) {
+    return new VMessageReactorThread(threadName, reactorIndex, mServer, mMessageFactory, mManager);
+}
@@ -0,0 +1,308 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vmessagereactor_h
+#define vmessagereactor_h
+
+/** @file */
+
+#include "vsocketthread.h"
+#include "vclientsession.h"
+#include "vmessage.h"
+#include "vmessagepool.h"
+#include "vmessagehandler.h"
+#include "vmessagedispatcher.h"
+#include "vmutex.h"
+
+class VServer;
+class VMessageHandler;
+class VMessageReactorConnection;
+class VMessageReactor;
+class VManagementInterface;
+class VBentoNode;
+
+/**
+    @ingroup vsocket
+*/
+
+/**
+VMessageReactorThread is one event loop of a VMessageReactor. It waits on a
+single epoll set for readability on all of the sessions assigned to it, reads
+whatever bytes are available without blocking, and whenever a complete message
+has accumulated it receives and dispatches it exactly as VMessageInputThread
+would (same VMessageHandler lookup, same before/call/after hooks). If the
+message factory implements VMessageFactory::getFrameLength(), each frame's
+header is decoded once and receive() is called only when the whole frame is
+buffered. A frame larger than 16 MB closes the session, and at most 64
+messages are dispatched for one session before the others get a turn.
+
+By default the message handlers run inline on the event loop thread, so they
+must not block: a handler that waits on I/O, a lock, or another service stalls
+every session on the loop until it returns. Handlers that may block need a
+VMessageDispatcher (see setMessageDispatcher()); the loop then posts each
+message to the dispatcher's workers, on the session's own strand, and goes on
+servicing the other sessions. A session with too many messages in flight is
+not read from until its handlers catch up.
+
+Output posted to its sessions is queued per session by the posting thread
+and written by the event loop, without blocking, as the socket accepts it.
+A session that goes over its output queue limit only asks its event loop to
+close it; the socket is removed from the epoll set and closed by the event
+loop itself, never by a posting thread.
+
+It derives from VSocketThread so that message handlers are handed a real
+thread object, but it has no socket of its own; getSocket() returns NULL.
+Reactor threads are joinable and do not delete themselves: whoever created
+one (normally its VMessageReactor) stops, joins, and deletes it. If the event
+loop fails, the thread shuts down its sessions and ends, and tells its reactor
+so that no more sessions are assigned to it.
+*/
+class VMessageReactorThread : public VSocketThread {
+    public:
+
+        /**
+        Constructs the reactor thread.
+        @param  threadName      the thread name
+        @param  reactorIndex    the index of this thread within its reactor (used for logging)
+        @param  server          the server we're running for
+        @param  messageFactory  a factory that instantiates messages suitable for input
+                                (The caller owns the factory.)
+        @param  manager         the management interface to notify of thread start/end, or NULL
+        */
+        VMessageReactorThread(const VString& threadName, int reactorIndex, VServer* server, const VMessageFactory* messageFactory, VManagementInterface* manager);
+        /**
+        Virtual destructor. Any sessions still attached are shut down.
+        */
+        virtual ~VMessageReactorThread();
+
+        /**
+        Runs the event loop until the thread is stopped.
+        */
+        virtual void run();
+        /**
+        Stops the thread; wakes up the event loop so that it notices promptly.
+        */
+        virtual void stop();
+
+        /**
+        Hands a session over to this thread. May be called from any thread; the
+        session is added to the epoll set the next time the event loop wakes up.
+        The session must have been created without input or output threads, and
+        must be the owner of the supplied socket.
+        @param  session the session to service
+        @param  socket  the session's connected socket
+        */
+        void attachSession(VClientSessionPtr session, VSocket* socket);
+
+        /**
+        Switches the thread from running message handlers inline to posting them to
+        a dispatcher. Must be called before the thread is started. See
+        VMessageDispatcher for the ordering and backpressure rules.
+        @param  dispatcher          the dispatcher to post to, or NULL to run handlers
+                                    inline on this thread (the default), where they must
+                                    not block; the caller owns it, and it must outlive
+                                    this thread
+        @param  maxInFlightMessages the number of a session's messages that may be posted
+                                    and unfinished before we stop reading from it
+        */
+        void setMessageDispatcher(VMessageDispatcher* dispatcher, int maxInFlightMessages = VMessageDispatcher::kDefaultMaxInFlightPerSession);
+
+        /**
+        Returns the number of sessions currently assigned to this thread (including
+        ones handed over but not yet picked up by the event loop).
+        */
+        int getNumSessions() const { return mNumSessions; }
+
+    protected:
+
+        /**
+        Handles the message by finding or creating a handler and calling it
+        to process the message. Equivalent to VMessageInputThread::_dispatchMessage().
+        With a message dispatcher, this is called on its worker threads.
+        @param  session the session that the message arrived on
+        @param  message the message to handle
+        */
+        virtual void _dispatchMessage(VClientSessionPtr session, VMessagePtr message);
+        /**
+        Called by _dispatchMessage if it cannot find the handler for the message.
+        @see VMessageInputThread::_handleNoMessageHandler()
+        */
+        virtual void _handleNoMessageHandler(VClientSessionPtr /*session*/, VMessagePtr /*message*/) {}
+        /**
+        @see VMessageInputThread::_beforeProcessMessage()
+        */
+        virtual void _beforeProcessMessage(VMessageHandler* /*handler*/, VMessagePtr /*message*/) {}
+        /**
+        Calls the message handler to process the message it was constructed with.
+        @see VMessageInputThread::_callProcessMessage()
+        */
+        virtual void _callProcessMessage(VMessageHandler* handler);
+        /**
+        @see VMessageInputThread::_afterProcessMessage()
+        */
+        virtual void _afterProcessMessage(VMessageHandler* /*handler*/) {}
+
+        VServer*                mServer;            ///< The server object that owns the sessions.
+        const VMessageFactory*  mMessageFactory;    ///< Factory for instantiating new messages to read from input.
+
+    private:
+
+        VMessageReactorThread(const VMessageReactorThread&); // not copyable
+        VMessageReactorThread& operator=(const VMessageReactorThread&); // not assignable
+
+        typedef std::vector<VMessageReactorConnection*> VMessageReactorConnectionList;
+
+        friend class VMessageReactorConnection; // calls _requestOutput(), _dispatchMessage(), and _postedMessageFinished()
+        friend class VMessageReactor; // sets mReactor and reads mIsDead
+        friend class VMessageUnit; // unit tests directly examine our state
+
+        void _addPendingConnections();                                              ///< Moves handed-over sessions into the epoll set.
+        void _processInput(VMessageReactorConnection* connection, bool isReadable); ///< Reads the socket if readable, and dispatches complete messages up to the per-wakeup budget.
+        bool _receiveAndDispatch(VMessageReactorConnection* connection);            ///< Receives and dispatches one message if complete; returns false if more bytes are needed.
+        void _processBacklog();                                                     ///< Gives connections that used up their budget their next turn.
+        bool _processWritable(VMessageReactorConnection* connection);               ///< Writes queued output; returns false if the connection was closed.
+        void _processOutputRequests();                                              ///< Writes output newly posted by other threads; closes connections whose session asked for it.
+        void _requestOutput(VMessageReactorConnection* connection);                 ///< Called by a connection on the posting thread when it has new output.
+        void _watchOutput(VMessageReactorConnection* connection, bool watch);       ///< Adds or removes EPOLLOUT from the connection's registration.
+        void _pauseInput(VMessageReactorConnection* connection, bool pause);         ///< Stops or resumes reading and dispatching the connection's messages.
+        void _updateWatchedEvents(VMessageReactorConnection* connection);           ///< Changes the connection's epoll registration to match its output and pause state.
+        void _postedMessageFinished(VMessageReactorConnection* connection);         ///< Called on a dispatcher worker when one of the connection's messages is finished.
+        void _processFinishedMessages();                                            ///< Accounts for finished posted messages; resumes or deletes their connections.
+        void _waitForFinishedMessages();                                            ///< When stopping, waits until no closed connection has a message in flight.
+        void _closeConnection(VMessageReactorConnection* connection);               ///< Removes the connection from the epoll set, closes its socket, and shuts down its session.
+        void _sweepConnections();                                                   ///< Closes connections whose socket or session was shut down elsewhere.
+        void _wakeUp();                                                             ///< Interrupts a blocked epoll wait.
+
+        VMessageReactor*                mReactor;               ///< The reactor that owns us, if any; told when our event loop fails.
+        bool                            mIsDead;                ///< True once our event loop has failed. Guarded by mReactor's mThreadsMutex.
+        int                             mReactorIndex;          ///< Index of this thread within its reactor.
+        int                             mPollID;                ///< The epoll descriptor.
+        int                             mWakeUpID;              ///< An eventfd registered in the epoll set, signaled by _wakeUp().
+        VMessageReactorConnectionList   mConnections;           ///< The connections serviced by this thread. Only touched on this thread.
+        VMessageReactorConnectionList   mBackloggedConnections; ///< Connections with buffered messages left over after their budget. Only touched on this thread.
+        VMutex                          mPendingMutex;          ///< Protects mPendingConnections, mOutputRequests, and mFinishedMessages.
+        VMessageReactorConnectionList   mPendingConnections;    ///< Connections handed over by attachSession(), not yet in the epoll set.
+        VMessageReactorConnectionList   mOutputRequests;        ///< Connections that have had output posted since the last turn of the loop.
+        VMessageReactorConnectionList   mFinishedMessages;      ///< One entry per posted message finished by a dispatcher worker. Protected by mPendingMutex.
+        VMessageReactorConnectionList   mClosingConnections;    ///< Closed connections that still have messages in flight. Only touched on this thread.
+        VMessageDispatcher*             mMessageDispatcher;     ///< If not NULL, the dispatcher that runs our message handlers on its workers.
+        int                             mMaxInFlightMessages;   ///< The in-flight count at which we pause a connection's input when using mMessageDispatcher.
+        volatile int                    mNumSessions;           ///< Number of connections assigned, for diagnostics and load balancing.
+        Vu8*                            mReadBuffer;            ///< Scratch buffer for non-blocking reads, shared by all connections on this thread.
+        VMessagePool                    mMessagePool;           ///< Recycles received messages across all connections on this thread.
+        VMessageHandlerStorage          mHandlerStorage;        ///< Reused memory in which each message's handler is constructed.
+};
+
+/**
+VMessageReactor is an alternative to the thread-per-socket session model
+(one VMessageInputThread plus one VMessageOutputThread per connection). It
+owns a small fixed pool of VMessageReactorThread event loops; each accepted
+session is assigned to the least loaded loop, which then performs all of its
+input and handler dispatch. An idle session therefore costs a socket and a
+small buffer, not two OS threads and their stacks.
+
+To use it, create the reactor and start() it, and have your
+VClientSessionFactory::createSession() construct the session with NULL input
+and output threads (exactly as for the synchronous session model), then call
+attachSession(). Output posted with VClientSession::postOutputMessage() is
+queued on the session's event loop and written when the socket is writable,
+so neither the posting thread nor the loop waits on a slow client; the
+session's maxQueueDataSize limits how much output may be queued.
+
+Message handlers run on the event loops unless setMessageDispatcher() is used,
+and in that case must not block; see VMessageReactorThread.
+
+The event loops use epoll and are only available on Linux; on other
+platforms start() throws a VUnimplementedException.
+*/
+class VMessageReactor {
+    public:
+
+        /**
+        Constructs the reactor. The threads are not created until start().
+        @param  reactorBaseName a distinguishing base name used to name the threads
+        @param  numThreads      the number of event loop threads; must be at least 1
+        @param  server          the server we're running for
+        @param  messageFactory  a factory that instantiates messages suitable for input
+                                (The caller owns the factory.)
+        @param  manager         the management interface to notify of thread start/end, or NULL
+        */
+        VMessageReactor(const VString& reactorBaseName, int numThreads, VServer* server, const VMessageFactory* messageFactory, VManagementInterface* manager);
+        /**
+        Virtual destructor. Stops the threads if still running.
+        */
+        virtual ~VMessageReactor();
+
+        /**
+        Creates and starts the event loop threads.
+        */
+        void start();
+        /**
+        Stops the event loop threads and waits for them to end, then deletes
+        them. Sessions still attached are shut down by their threads as they end.
+        */
+        void stop();
+
+        /**
+        Has the event loop threads post messages to a dispatcher rather than run the
+        handlers themselves. Must be called before start().
+        @see VMessageReactorThread::setMessageDispatcher()
+        */
+        void setMessageDispatcher(VMessageDispatcher* dispatcher, int maxInFlightMessages = VMessageDispatcher::kDefaultMaxInFlightPerSession);
+
+        /**
+        Assigns a newly created session to the least loaded event loop whose
+        event loop has not failed. Throws if there is none.
+        @param  session the session to service; must have no input or output thread
+        @param  socket  the session's connected socket
+        */
+        void attachSession(VClientSessionPtr session, VSocket* socket);
+
+        /**
+        Returns the total number of sessions assigned across all threads.
+        */
+        int getNumSessions() const;
+
+        /**
+        For diagnostic purposes, adds the reactor's thread and session counts to
+        the supplied Bento node.
+        */
+        void getReactorInfo(VBentoNode& bento) const;
+
+    protected:
+
+        /**
+        Instantiates one event loop thread. A subclass may override this to
+        supply a VMessageReactorThread subclass with custom dispatch hooks.
+        @param  threadName      the name for the thread
+        @param  reactorIndex    the index of the thread within this reactor
+        */
+        virtual VMessageReactorThread* _createReactorThread(const VString& threadName, int reactorIndex);
+
+        VString                 mName;              ///< The reactor base name.
+        int                     mNumThreads;        ///< Number of event loop threads.
+        VServer*                mServer;            ///< The server supplied to each thread.
+        const VMessageFactory*  mMessageFactory;    ///< The message factory supplied to each thread.
+        VManagementInterface*   mManager;           ///< The management interface supplied to each thread.
+        VMessageDispatcher*     mMessageDispatcher; ///< The dispatcher supplied to each thread, or NULL to dispatch inline.
+        int                     mMaxInFlightMessages; ///< The per-session in-flight limit supplied to each thread.
+
+    private:
+
+        VMessageReactor(const VMessageReactor&); // not copyable
+        VMessageReactor& operator=(const VMessageReactor&); // not assignable
+
+        void _markThreadDead(VMessageReactorThread* thread); ///< Called by a thread whose event loop failed, so attachSession() skips it.
+
+        friend class VMessageReactorThread; // calls _markThreadDead()
+        friend class VMessageUnit; // unit tests directly examine our state
+
+        mutable VMutex                      mThreadsMutex;  ///< Protects mThreads and each thread's mIsDead.
+        std::vector<VMessageReactorThread*> mThreads;       ///< The event loops, which we own; stop() joins and deletes them.
+};
+
+#endif /* vmessagereactor_h */
@@ -7,25 +7,74 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vserver.h"
 
+#include "vbroadcastmessage.h"
 #include "vmutexlocker.h"
+#include "vbento.h"
 
 VServer::VServer()
     : mSessions()
     , mSessionsMutex("VServer::mSessionsMutex")
+    , mSessionsLock("VServer::mSessionsLock", VReadWriteLock::kPreferWriters)
+    , mEndedSessionsStats()
+    , mNumEndedSessions(0)
     {
 }
 
 void VServer::addClientSession(VClientSessionPtr session) {
-    VMutexLocker locker(&mSessionsMutex, "VServer::addClientSession()");
+    VMutexLocker mutexLocker(&mSessionsMutex, "VServer::addClientSession()");
+    VWriteLocker locker(&mSessionsLock, "VServer::addClientSession()");
     mSessions.push_back(session);
 }
 
 void VServer::removeClientSession(VClientSessionPtr session) {
-    VMutexLocker locker(&mSessionsMutex, "VServer::removeClientSession()");
+    VMutexLocker mutexLocker(&mSessionsMutex, "VServer::removeClientSession()");
+    VWriteLocker locker(&mSessionsLock, "VServer::removeClientSession()");
     for (VClientSessionList::iterator i = mSessions.begin(); i != mSessions.end(); i++) {
         if ((*i) == session) {
+            mEndedSessionsStats.add(session->getStats().getSnapshot());
+            ++mNumEndedSessions;
             (void) mSessions.erase(i);
             break;
         }
     }
 }
+
+void VServer::postSharedBroadcastMessage(const VString& clientType, VMessagePtr message, VClientSessionConstPtr omitSession) {
+    VMessagePtr sharedMessage = VBroadcastMessage::create(message);
+
+    VReadLocker locker(&mSessionsLock, "VServer::postSharedBroadcastMessage()");
+    for (VClientSessionList::const_iterator i = mSessions.begin(); i != mSessions.end(); ++i) {
+        if ((omitSession != nullptr) && ((*i) == omitSession)) {
+            continue;
+        }
+
+        if (clientType.isNotEmpty() && ((*i)->getClientType() != clientType)) {
+            continue;
+        }
+
+        (*i)->postBroadcastOutputMessage(sharedMessage);
+    }
+}
+
+VClientSessionStats::Snapshot VServer::getSessionStats() const {
+    VReadLocker locker(&mSessionsLock, "VServer::getSessionStats()");
+
+    VClientSessionStats::Snapshot totals = mEndedSessionsStats;
+    for (VClientSessionList::const_iterator i = mSessions.begin(); i != mSessions.end(); ++i) {
+        totals.add((*i)->getStats().getSnapshot());
+    }
+
+    return totals;
+}
+
+void VServer::getSessionStatsInfo(VBentoNode& bento) const {
+    VClientSessionStats::Snapshot totals = this->getSessionStats();
+
+    /* locker scope */ {
+        VReadLocker locker(&mSessionsLock, "VServer::getSessionStatsInfo()");
+        bento.addInt("active-sessions", static_cast<int>(mSessions.size()));
+        bento.addS64("ended-sessions", mNumEndedSessions);
+    }
+
+    totals.addToBento(bento);
+}
@@ -12,6 +12,8 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vmessage.h"
 #include "vclientsession.h"
+#include "vmutex.h"
+#include "vreadwritelock.h"
 
 /**
     @ingroup vsocket
@@ -19,6 +21,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 class VSocket;
 class VListenerThread;
+class VBentoNode;
 
 /**
 This abstract base class defines the interface that must be provided by a concrete
@@ -55,11 +58,47 @@ class VServer {
                                 be posted to
         */
         virtual void postBroadcastMessage(const VString& clientType, VMessagePtr message, VClientSessionConstPtr omitSession) = 0;
+        /**
+        A ready-made implementation for postBroadcastMessage(): wraps the message
+        in a single VBroadcastMessage and posts that same object to every matching
+        session, so the message data is copied once rather than once per session.
+        @param  clientType  if not empty, only sessions of this client type receive the message
+        @param  message     the message to be broadcast; it is sent once to capture
+                                its wire form and is not referenced afterward
+        @param  omitSession if not NULL, specifies a session the message will NOT
+                                be posted to
+        */
+        void postSharedBroadcastMessage(const VString& clientType, VMessagePtr message, VClientSessionConstPtr omitSession);
+
+        /**
+        Returns the statistics of all sessions the server has had, added together:
+        the active sessions' current figures plus the final figures of every session
+        that has been removed. Each session's contribution is a consistent snapshot.
+        @return the server-wide totals
+        */
+        VClientSessionStats::Snapshot getSessionStats() const;
+        /**
+        Adds the server-wide session statistics to a bento node, along with the
+        number of active and ended sessions, for diagnostics.
+        @param  bento   the node to add to
+        */
+        void getSessionStatsInfo(VBentoNode& bento) const;
 
     protected:
 
+        /*
+        mSessions is guarded by two locks. mSessionsMutex is the lock subclasses have always
+        used: hold it to iterate mSessions, and it excludes addClientSession() and
+        removeClientSession(). Those also take mSessionsLock for writing, after mSessionsMutex,
+        so that the base class's own readers (shared broadcasts and statistics) can take just
+        mSessionsLock for reading and proceed concurrently. A subclass that modifies mSessions
+        itself must likewise hold both.
+        */
         VClientSessionList mSessions; ///< Active sessions.
-        mutable VMutex mSessionsMutex;///< Mutex to protect operations on mSessions.
+        mutable VMutex mSessionsMutex;///< Mutex to protect operations on mSessions; excludes writers, but not concurrent readers under mSessionsLock.
+        mutable VReadWriteLock mSessionsLock; ///< Lock to protect operations on mSessions; broadcasts only read, so they proceed concurrently.
+        VClientSessionStats::Snapshot mEndedSessionsStats; ///< The totals of sessions that have been removed. Guarded by mSessionsLock.
+        Vs64 mNumEndedSessions; ///< The number of sessions that have been removed. Guarded by mSessionsLock.
 };
 
 #endif /* vserver_h */
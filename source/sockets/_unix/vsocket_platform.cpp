@@ -19,6 +19,8 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include <sys/ioctl.h>
 #include <ifaddrs.h>
+#include <poll.h>
+#include <limits.h>
 
 // static
 bool VSocket::_platform_staticInit() {
@@ -94,8 +96,33 @@ VString VSocket::_platform_addrinfoToIPAddressString(const VString& hostName, co
 bool VSocket::_platform_isSocketIDValid(VSocketID socketID) {
     // On Unix:
     // -1 is typical error return value from ::socket()
-    // Also, FD_SETSIZE is max num open sockets, sockid over that is sign of a big problem, and would cause FD_SET() during read() to fail.
-    return (socketID >= 0) && (socketID <= FD_SETSIZE);
+    // IDs at or above FD_SETSIZE are fine: we wait with poll(), which has no fd_set size limit.
+    return (socketID >= 0);
+}
+
+int VSocket::_platform_waitForIO(bool forWrite, const struct timeval* timeout) {
+    struct pollfd pollInfo;
+    pollInfo.fd = mSocketID;
+    pollInfo.events = forWrite ? POLLOUT : POLLIN;
+    pollInfo.revents = 0;
+
+    int timeoutMilliseconds = -1; // infinite
+    if (timeout != NULL) {
+        // Round up so that a sub-millisecond timeout does not turn into a non-blocking poll.
+        Vs64 milliseconds = (static_cast<Vs64>(timeout->tv_sec) * 1000) + ((static_cast<Vs64>(timeout->tv_usec) + 999) / 1000);
+        timeoutMilliseconds = static_cast<int>(V_MIN(milliseconds, static_cast<Vs64>(INT_MAX)));
+    }
+
+    int result = ::poll(&pollInfo, 1, timeoutMilliseconds);
+
+    if ((result > 0) && ((pollInfo.revents & POLLNVAL) != 0)) {
+        // Socket ID is not open (closed out from under us); report it the way select() would.
+        errno = EBADF;
+        return -1;
+    }
+
+    // POLLERR and POLLHUP are reported as ready; the subsequent recv()/send() surfaces the actual error or EOF.
+    return result;
 }
 
 int VSocket::_platform_available() {
@@ -34,6 +34,11 @@ License: MIT. See LICENSE.md in the Vault top level directory.
     #define VSOCKET_DEFAULT_RECV_FLAGS 0
 #endif
 
+// Flags for a recv() that must return immediately rather than wait for data (see VSocket::readNonBlocking()).
+#define VSOCKET_NONBLOCKING_RECV_FLAGS (VSOCKET_DEFAULT_RECV_FLAGS | MSG_DONTWAIT)
+// Likewise for a send() that must not wait for buffer space (see VSocket::writeNonBlocking()).
+#define VSOCKET_NONBLOCKING_SEND_FLAGS (VSOCKET_DEFAULT_SEND_FLAGS | MSG_DONTWAIT)
+
 /*
 There are a couple of Unix APIs we call that take a socklen_t parameter.
 Well, on HP-UX the parameter is defined as an int. The cleanest way of dealing
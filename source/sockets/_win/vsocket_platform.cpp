@@ -76,6 +76,16 @@ bool VSocket::_platform_isSocketIDValid(VSocketID socketID) {
     return socketID != INVALID_SOCKET;
 }
 
+int VSocket::_platform_waitForIO(bool forWrite, const struct timeval* timeout) {
+    // A Winsock fd_set is an array of socket handles, so FD_SETSIZE limits how many
+    // sockets one call can wait on, not the handle values; select() is fine here.
+    fd_set socketSet;
+    FD_ZERO(&socketSet);
+    FD_SET(mSocketID, &socketSet);
+
+    return ::select(SelectSockIDTypeCast (mSocketID + 1), (forWrite ? NULL : &socketSet), (forWrite ? &socketSet : NULL), NULL, timeout);
+}
+
 int VSocket::_platform_available() {
     u_long numBytesAvailable = 0;
 
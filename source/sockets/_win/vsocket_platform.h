@@ -26,6 +26,10 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 // For other Unix platforms, we specify it in the flags of each send()/recv() call via this parameter.
 #define VSOCKET_DEFAULT_SEND_FLAGS 0
 #define VSOCKET_DEFAULT_RECV_FLAGS 0
+// Winsock has no MSG_DONTWAIT; VSocket::readNonBlocking() checks available() before calling recv().
+#define VSOCKET_NONBLOCKING_RECV_FLAGS 0
+// Nor for send(); VSocket::writeNonBlocking() only returns early if the socket itself is in non-blocking mode.
+#define VSOCKET_NONBLOCKING_SEND_FLAGS 0
 
 /*
 There are a couple of Unix APIs we call that take a socklen_t parameter.
@@ -225,6 +225,7 @@ VSocket::VSocket()
     , mReadTimeOut()
     , mWriteTimeOutActive(false)
     , mWriteTimeOut()
+    , mWaitWhenNoTimeOut(true)
     , mRequireReadAll(true)
     , mNumBytesRead(0)
     , mNumBytesWritten(0)
@@ -241,6 +242,7 @@ VSocket::VSocket(VSocketID id)
     , mReadTimeOut()
     , mWriteTimeOutActive(false)
     , mWriteTimeOut()
+    , mWaitWhenNoTimeOut(true)
     , mRequireReadAll(true)
     , mNumBytesRead(0)
     , mNumBytesWritten(0)
@@ -296,6 +298,16 @@ void VSocket::setIntSockOpt(int level, int name, int value) {
     this->setSockOpt(level, name, static_cast<void*>(&intValue), sizeof(intValue));
 }
 
+void VSocket::setCork(bool corked) {
+#if defined(TCP_CORK)
+    this->setIntSockOpt(IPPROTO_TCP, TCP_CORK, corked ? 1 : 0);
+#elif defined(TCP_NOPUSH)
+    this->setIntSockOpt(IPPROTO_TCP, TCP_NOPUSH, corked ? 1 : 0);
+#else
+    (void) corked; // No equivalent option; segments are coalesced only as the no-delay setting allows.
+#endif
+}
+
 void VSocket::setLinger(int val) {
     struct linger lingerParam;
 
@@ -372,32 +384,27 @@ int VSocket::read(Vu8* buffer, int numBytesToRead) {
 
     int     bytesRemainingToRead = numBytesToRead;
     Vu8*    nextBufferPositionPtr = buffer;
-    fd_set  readset;
 
     while (bytesRemainingToRead > 0) {
 
-        FD_ZERO(&readset);
-        FD_SET(mSocketID, &readset);
-        int result = ::select(SelectSockIDTypeCast (mSocketID + 1), &readset, NULL, NULL, (mReadTimeOutActive ? &mReadTimeOut : NULL));
+        if (mReadTimeOutActive || mWaitWhenNoTimeOut) {
+            int result = this->_platform_waitForIO(false, (mReadTimeOutActive ? &mReadTimeOut : NULL));
 
-        if (result < 0) {
-            VSystemError e = VSystemError::getSocketError();
-            if (e.isLikePosixError(EINTR)) {
-                // Debug message: read was interrupted but we will cycle around and try again...
-                continue;
-            }
+            if (result < 0) {
+                VSystemError e = VSystemError::getSocketError();
+                if (e.isLikePosixError(EINTR)) {
+                    // Debug message: read was interrupted but we will cycle around and try again...
+                    continue;
+                }
 
-            if (e.isLikePosixError(EBADF)) {
-                throw VSocketClosedException(e, VSTRING_FORMAT("VSocket[%s] read: Socket has closed (EBADF).", mSocketName.chars()));
-            } else {
-                throw VException(e, VSTRING_FORMAT("VSocket[%s] read: Select failed. Result=%d.", mSocketName.chars(), result));
+                if (e.isLikePosixError(EBADF)) {
+                    throw VSocketClosedException(e, VSTRING_FORMAT("VSocket[%s] read: Socket has closed (EBADF).", mSocketName.chars()));
+                } else {
+                    throw VException(e, VSTRING_FORMAT("VSocket[%s] read: Wait failed. Result=%d.", mSocketName.chars(), result));
+                }
+            } else if (result == 0) {
+                throw VException(VSTRING_FORMAT("VSocket[%s] read: Wait timed out.", mSocketName.chars()));
             }
-        } else if (result == 0) {
-            throw VException(VSTRING_FORMAT("VSocket[%s] read: Select timed out.", mSocketName.chars()));
-        }
-
-        if (!FD_ISSET(mSocketID, &readset)) {
-            throw VException(VSystemError::getSocketError(), VSTRING_FORMAT("VSocket[%s] read: Select got FD_ISSET false.", mSocketName.chars()));
         }
 
         int theNumBytesRead = SendRecvResultTypeCast ::recv(mSocketID, RecvBufferPtrTypeCast nextBufferPositionPtr, SendRecvByteCountTypeCast bytesRemainingToRead, VSOCKET_DEFAULT_RECV_FLAGS);
@@ -428,6 +435,51 @@ int VSocket::read(Vu8* buffer, int numBytesToRead) {
     return (numBytesToRead - bytesRemainingToRead);
 }
 
+int VSocket::readNonBlocking(Vu8* buffer, int maxNumBytesToRead) {
+    if (! VSocket::_platform_isSocketIDValid(mSocketID)) {
+        throw VStackTraceException(VSTRING_FORMAT("VSocket[%s] readNonBlocking: Invalid socket ID %d.", mSocketName.chars(), mSocketID));
+    }
+
+#ifdef VPLATFORM_WIN
+    // No per-call non-blocking flag on Winsock; only ask recv() for what is already buffered.
+    int numBytesAvailable = this->available();
+    if (numBytesAvailable == 0) {
+        return 0;
+    }
+
+    maxNumBytesToRead = V_MIN(maxNumBytesToRead, numBytesAvailable);
+#endif
+
+    int theNumBytesRead;
+    for (;;) {
+        theNumBytesRead = SendRecvResultTypeCast ::recv(mSocketID, RecvBufferPtrTypeCast buffer, SendRecvByteCountTypeCast maxNumBytesToRead, VSOCKET_NONBLOCKING_RECV_FLAGS);
+
+        if (theNumBytesRead >= 0) {
+            break;
+        }
+
+        VSystemError e = VSystemError::getSocketError();
+        if (e.isLikePosixError(EINTR)) {
+            continue;
+        } else if (e.isLikePosixError(EAGAIN) || e.isLikePosixError(EWOULDBLOCK)) {
+            return 0;
+        } else if (e.isLikePosixError(EPIPE) || e.isLikePosixError(EBADF)) {
+            throw VSocketClosedException(e, VSTRING_FORMAT("VSocket[%s] readNonBlocking: Socket has closed.", mSocketName.chars()));
+        } else {
+            throw VException(e, VSTRING_FORMAT("VSocket[%s] readNonBlocking: recv failed. Result=%d.", mSocketName.chars(), theNumBytesRead));
+        }
+    }
+
+    if (theNumBytesRead == 0) {
+        throw VEOFException(VSTRING_FORMAT("VSocket[%s] readNonBlocking: Peer has closed the connection.", mSocketName.chars()));
+    }
+
+    mNumBytesRead += theNumBytesRead;
+    mLastEventTime.setNow();
+
+    return theNumBytesRead;
+}
+
 int VSocket::write(const Vu8* buffer, int numBytesToWrite) {
     if (! VSocket::_platform_isSocketIDValid(mSocketID)) {
         throw VStackTraceException(VSTRING_FORMAT("VSocket[%s] write: Invalid socket ID %d.", mSocketName.chars(), mSocketID));
@@ -435,28 +487,27 @@ int VSocket::write(const Vu8* buffer, int numBytesToWrite) {
 
     const Vu8*  nextBufferPositionPtr = buffer;
     int         bytesRemainingToWrite = numBytesToWrite;
-    fd_set      writeset;
 
     while (bytesRemainingToWrite > 0) {
 
-        FD_ZERO(&writeset);
-        FD_SET(mSocketID, &writeset);
-        int result = ::select(SelectSockIDTypeCast (mSocketID + 1), NULL, &writeset, NULL, (mWriteTimeOutActive ? &mWriteTimeOut : NULL));
+        if (mWriteTimeOutActive || mWaitWhenNoTimeOut) {
+            int result = this->_platform_waitForIO(true, (mWriteTimeOutActive ? &mWriteTimeOut : NULL));
 
-        if (result < 0) {
-            VSystemError e = VSystemError::getSocketError();
-            if (e.isLikePosixError(EINTR)) {
-                // Debug message: write was interrupted but we will cycle around and try again...
-                continue;
-            }
+            if (result < 0) {
+                VSystemError e = VSystemError::getSocketError();
+                if (e.isLikePosixError(EINTR)) {
+                    // Debug message: write was interrupted but we will cycle around and try again...
+                    continue;
+                }
 
-            if (e.isLikePosixError(EBADF)) {
-                throw VSocketClosedException(e, VSTRING_FORMAT("VSocket[%s] write: Socket has closed (EBADF).", mSocketName.chars()));
-            } else {
-                throw VException(e, VSTRING_FORMAT("VSocket[%s] write: select() failed. Result=%d.", mSocketName.chars(), result));
+                if (e.isLikePosixError(EBADF)) {
+                    throw VSocketClosedException(e, VSTRING_FORMAT("VSocket[%s] write: Socket has closed (EBADF).", mSocketName.chars()));
+                } else {
+                    throw VException(e, VSTRING_FORMAT("VSocket[%s] write: Wait failed. Result=%d.", mSocketName.chars(), result));
+                }
+            } else if (result == 0) {
+                throw VException(VSTRING_FORMAT("VSocket[%s] write: Wait timed out.", mSocketName.chars()));
             }
-        } else if (result == 0) {
-            throw VException(VSTRING_FORMAT("VSocket[%s] write: Select timed out.", mSocketName.chars()));
         }
 
         int theNumBytesWritten = SendRecvResultTypeCast ::send(mSocketID, SendBufferPtrTypeCast nextBufferPositionPtr, SendRecvByteCountTypeCast bytesRemainingToWrite, VSOCKET_DEFAULT_SEND_FLAGS);
@@ -483,6 +534,37 @@ int VSocket::write(const Vu8* buffer, int numBytesToWrite) {
     return (numBytesToWrite - bytesRemainingToWrite);
 }
 
+int VSocket::writeNonBlocking(const Vu8* buffer, int maxNumBytesToWrite) {
+    if (! VSocket::_platform_isSocketIDValid(mSocketID)) {
+        throw VStackTraceException(VSTRING_FORMAT("VSocket[%s] writeNonBlocking: Invalid socket ID %d.", mSocketName.chars(), mSocketID));
+    }
+
+    int theNumBytesWritten;
+    for (;;) {
+        theNumBytesWritten = SendRecvResultTypeCast ::send(mSocketID, SendBufferPtrTypeCast buffer, SendRecvByteCountTypeCast maxNumBytesToWrite, VSOCKET_NONBLOCKING_SEND_FLAGS);
+
+        if (theNumBytesWritten >= 0) {
+            break;
+        }
+
+        VSystemError e = VSystemError::getSocketError();
+        if (e.isLikePosixError(EINTR)) {
+            continue;
+        } else if (e.isLikePosixError(EAGAIN) || e.isLikePosixError(EWOULDBLOCK)) {
+            return 0;
+        } else if (e.isLikePosixError(EPIPE) || e.isLikePosixError(EBADF)) {
+            throw VSocketClosedException(e, VSTRING_FORMAT("VSocket[%s] writeNonBlocking: Socket has closed.", mSocketName.chars()));
+        } else {
+            throw VException(e, VSTRING_FORMAT("VSocket[%s] writeNonBlocking: send failed. Result=%d.", mSocketName.chars(), theNumBytesWritten));
+        }
+    }
+
+    mNumBytesWritten += theNumBytesWritten;
+    mLastEventTime.setNow();
+
+    return theNumBytesWritten;
+}
+
 void VSocket::discoverHostAndPort() {
     struct sockaddr_in  info;
     VSocklenT           infoLength = sizeof(info);
@@ -917,7 +999,7 @@ void VSocketConnectionStrategyThreadedRunner::_lockedStartWorker(const VString&
 }
 
 void VSocketConnectionStrategyThreadedRunner::_workerSucceeded(VSocketConnectionStrategyThreadedWorker* worker, VSocket& openedSocket) {
-    VMutexLocker locker(&mMutex, VSTRING_FORMAT("_workerSucceeded(%s)", worker->getName().chars()));
+    VMutexLocker locker(&mMutex, "VSocketConnectionStrategyThreadedRunner::_workerSucceeded()");
     if (mConnectionCompleted) {
         VLOGGER_TRACE(VSTRING_FORMAT("VSocketConnectionStrategyThreadedRunner %s:%d _workerSucceeded(sockid %d) ignored because another worker has already won.", openedSocket.getHostIPAddress().chars(), mPortNumberToConnect, (int) openedSocket.getSockID()));
     } else {
@@ -934,7 +1016,7 @@ void VSocketConnectionStrategyThreadedRunner::_workerSucceeded(VSocketConnection
 }
 
 void VSocketConnectionStrategyThreadedRunner::_workerFailed(VSocketConnectionStrategyThreadedWorker* worker, const VException& ex) {
-    VMutexLocker locker(&mMutex, VSTRING_FORMAT("_workerFailed(%s)", worker->getName().chars()));
+    VMutexLocker locker(&mMutex, "VSocketConnectionStrategyThreadedRunner::_workerFailed()");
     this->_lockedForgetOneWorker(worker);
 
     VLOGGER_ERROR(VSTRING_FORMAT("VSocketConnectionStrategyThreadedRunner::_workerFailed: %s", ex.what()));
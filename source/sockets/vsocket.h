@@ -367,6 +367,16 @@ class VSocket {
         */
         void setWriteTimeOut(const struct timeval& timeout);
         /**
+        Specifies whether read() and write() should first wait for the socket to
+        become ready even when no timeout is set for that direction. Without a
+        timeout the wait cannot fail in any way that the subsequent blocking
+        recv() or send() would not also report, so turning it off saves one
+        system call per read or write. The default is true (always wait).
+        When a timeout is set, the wait is always performed so that it can be honored.
+        @param    waitWhenNoTimeOut    false to call recv()/send() directly when no timeout is set
+        */
+        void setWaitWhenNoTimeOut(bool waitWhenNoTimeOut) { mWaitWhenNoTimeOut = waitWhenNoTimeOut; }
+        /**
         Sets the socket options to their default values.
         */
         void setDefaultSockOpt();
@@ -408,6 +418,18 @@ class VSocket {
         */
         virtual int read(Vu8* buffer, int numBytesToRead);
         /**
+        Reads whatever data is immediately available on the socket, up to the
+        specified maximum, without waiting for more to arrive. This is intended
+        for readiness-driven callers (see VMessageReactor) that have already been
+        told the socket is readable, and must never block the calling thread.
+        Throws VEOFException if the peer has closed the connection.
+
+        @param    buffer                the buffer to read into
+        @param    maxNumBytesToRead     the maximum number of bytes to read
+        @return    the number of bytes read; 0 means no data is available right now
+        */
+        virtual int readNonBlocking(Vu8* buffer, int maxNumBytesToRead);
+        /**
         Writes data to the socket.
 
         If you don't have a write timeout set up for this socket, then
@@ -419,6 +441,17 @@ class VSocket {
         */
         virtual int write(const Vu8* buffer, int numBytesToWrite);
         /**
+        Writes as much of the data as the socket will take right now, without
+        waiting for buffer space. This is the output counterpart of readNonBlocking(),
+        for readiness-driven callers (see VMessageReactor) that keep the unwritten
+        remainder and try again when the socket becomes writable.
+
+        @param    buffer                the buffer to read out of
+        @param    maxNumBytesToWrite    the maximum number of bytes to write
+        @return    the number of bytes written; 0 means the socket cannot take any right now
+        */
+        virtual int writeNonBlocking(const Vu8* buffer, int maxNumBytesToWrite);
+        /**
         Flushes any unwritten bytes to the socket.
         */
         virtual void flush();
@@ -450,6 +483,15 @@ class VSocket {
         @param  value   the option value
         */
         void setIntSockOpt(int level, int name, int value);
+        /**
+        Corks or uncorks the socket: while corked, the TCP stack holds back
+        partial segments so that a run of writes goes out in full-sized
+        packets; uncorking sends whatever is pending immediately. Uses TCP_CORK
+        where available (Linux) or TCP_NOPUSH (BSD, Mac OS X); on other platforms
+        this does nothing.
+        @param  corked  true to cork, false to uncork
+        */
+        void setCork(bool corked);
 
         static const VSocketID kNoSocketID = V_NO_SOCKET_ID_CONSTANT; ///< The sock id for a socket that is not connected.
         static const int kDefaultBufferSize = 65535;    ///< The default buffer size.
@@ -479,6 +521,7 @@ class VSocket {
         struct timeval  mReadTimeOut;           ///< The read timeout value, if used.
         bool            mWriteTimeOutActive;    ///< True if writes should time out.
         struct timeval  mWriteTimeOut;          ///< The write timeout value, if used.
+        bool            mWaitWhenNoTimeOut;     ///< True if read/write wait for readiness even when no timeout is active.
         bool            mRequireReadAll;        ///< True if we throw when read returns less than # bytes asked for.
         Vs64            mNumBytesRead;          ///< Number of bytes read from this socket.
         Vs64            mNumBytesWritten;       ///< Number of bytes written to this socket.
@@ -518,6 +561,18 @@ class VSocket {
         */
         static bool _platform_isSocketIDValid(VSocketID socketID);
         /**
+        Waits until the socket is ready for reading or writing, or until the
+        timeout elapses. Unlike select(), the wait is not limited to socket IDs
+        below FD_SETSIZE. The return value and error reporting follow select():
+        the caller examines VSystemError::getSocketError() on a negative result.
+        @param  forWrite    true to wait for writability, false to wait for readability
+        @param  timeout     the maximum time to wait, or NULL to wait indefinitely
+        @return > 0 if the socket is ready (or has an error or hangup that the next
+                recv()/send() will report), 0 if the timeout elapsed, < 0 on error
+                (a socket ID that is no longer open is reported as EBADF)
+        */
+        int _platform_waitForIO(bool forWrite, const struct timeval* timeout);
+        /**
         Returns the number of bytes that are available to be read on this
         socket. If you do a read() on that number of bytes, you know that
         it will not block.
@@ -21,6 +21,13 @@ VSocketThread::VSocketThread(const VString& threadBaseName, VSocket* socket, VLi
     {
 }
 
+VSocketThread::VSocketThread(const VString& name, const VString& loggerName, bool deleteSelfAtEnd, bool createDetached, VManagementInterface* manager)
+    : VThread(name, loggerName, deleteSelfAtEnd, createDetached, manager)
+    , mSocket(NULL)
+    , mOwnerThread(NULL)
+    {
+}
+
 VSocketThread::~VSocketThread() {
     if (mOwnerThread != NULL) {
         // Prevent all exceptions from escaping destructor.
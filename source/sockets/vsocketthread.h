@@ -53,6 +53,17 @@ class VSocketThread : public VThread {
         */
         VSocketThread(const VString& threadBaseName, VSocket* socket, VListenerThread* ownerThread);
         /**
+        Constructs a socket thread that has no socket or owner thread of its own,
+        such as an event loop that services many sockets, leaving its name and
+        lifetime to the caller.
+        @param  name            the thread name
+        @param  loggerName      the logger name which we will use when emitting log output
+        @param  deleteSelfAtEnd kDeleteSelfAtEnd or kDontDeleteSelfAtEnd (see VThread)
+        @param  createDetached  kCreateThreadDetached or kCreateThreadJoinable (see VThread)
+        @param  manager         the object that receives notifications for this thread, or NULL
+        */
+        VSocketThread(const VString& name, const VString& loggerName, bool deleteSelfAtEnd, bool createDetached, VManagementInterface* manager);
+        /**
         Virtual destructor.
         */
         virtual ~VSocketThread();
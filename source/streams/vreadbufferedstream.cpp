@@ -0,0 +1,170 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vreadbufferedstream.h"
+
+#include "vexception.h"
+
+VReadBufferedStream::VReadBufferedStream(VStream& rawStream, int bufferSize)
+    : VStream(rawStream.getName())
+    , mRawStream(rawStream)
+    , mBuffer(VStream::newNewBuffer(bufferSize))
+    , mBufferSize(bufferSize)
+    , mStartOffset(0)
+    , mEndOffset(0)
+    {
+}
+
+VReadBufferedStream::~VReadBufferedStream() {
+    delete [] mBuffer;
+}
+
+Vs64 VReadBufferedStream::read(Vu8* targetBuffer, Vs64 numBytesToRead) {
+    Vs64 numBytesRead = 0;
+
+    while (numBytesRead < numBytesToRead) {
+        int numBytesBuffered = mEndOffset - mStartOffset;
+
+        if (numBytesBuffered > 0) {
+            int numBytesToCopy = static_cast<int>(V_MIN(static_cast<Vs64>(numBytesBuffered), numBytesToRead - numBytesRead));
+            VStream::copyMemory(targetBuffer + numBytesRead, mBuffer + mStartOffset, numBytesToCopy);
+            mStartOffset += numBytesToCopy;
+            numBytesRead += numBytesToCopy;
+            continue;
+        }
+
+        Vs64 numBytesRemaining = numBytesToRead - numBytesRead;
+
+        if (numBytesRemaining >= mBufferSize) {
+            // Buffer is empty and the read is big enough that buffering would only add a copy.
+            numBytesRead += mRawStream.read(targetBuffer + numBytesRead, numBytesRemaining);
+            break;
+        }
+
+        (void) this->_fillBuffer(static_cast<int>(numBytesRemaining));
+
+        if (mEndOffset == mStartOffset) {
+            break; // raw stream has ended; caller sees a short read
+        }
+    }
+
+    return numBytesRead;
+}
+
+Vs64 VReadBufferedStream::write(const Vu8* buffer, Vs64 numBytesToWrite) {
+    return mRawStream.write(buffer, numBytesToWrite);
+}
+
+void VReadBufferedStream::flush() {
+    mRawStream.flush();
+}
+
+bool VReadBufferedStream::skip(Vs64 numBytesToSkip) {
+    Vs64 numBytesRemaining = numBytesToSkip;
+
+    while (numBytesRemaining > 0) {
+        if (mEndOffset == mStartOffset) {
+            int numBytesWanted = static_cast<int>(V_MIN(numBytesRemaining, static_cast<Vs64>(mBufferSize)));
+            (void) this->_fillBuffer(numBytesWanted);
+
+            if (mEndOffset == mStartOffset) {
+                return false;
+            }
+        }
+
+        int numBytesToDiscard = static_cast<int>(V_MIN(static_cast<Vs64>(mEndOffset - mStartOffset), numBytesRemaining));
+        mStartOffset += numBytesToDiscard;
+        numBytesRemaining -= numBytesToDiscard;
+    }
+
+    return true;
+}
+
+bool VReadBufferedStream::seek(Vs64 offset, int whence) {
+    if ((whence != SEEK_CUR) || (offset < 0)) {
+        throw VStackTraceException("VReadBufferedStream::seek received unsupported seek type.");
+    }
+
+    return this->skip(offset);
+}
+
+Vs64 VReadBufferedStream::getIOOffset() const {
+    return mRawStream.getIOOffset() - (mEndOffset - mStartOffset);
+}
+
+Vs64 VReadBufferedStream::available() const {
+    return (mEndOffset - mStartOffset) + mRawStream.available();
+}
+
+Vu8* VReadBufferedStream::peek(int numBytes) {
+    if (! this->_fillBuffer(numBytes)) {
+        throw VEOFException(VSTRING_FORMAT("VReadBufferedStream[%s]::peek encountered end of stream. Buffered %d of %d bytes.", mName.chars(), (mEndOffset - mStartOffset), numBytes));
+    }
+
+    return mBuffer + mStartOffset;
+}
+
+void VReadBufferedStream::consume(int numBytes) {
+    if ((numBytes < 0) || (numBytes > (mEndOffset - mStartOffset))) {
+        throw VRangeException(VSTRING_FORMAT("VReadBufferedStream[%s]::consume of %d bytes with only %d buffered.", mName.chars(), numBytes, (mEndOffset - mStartOffset)));
+    }
+
+    mStartOffset += numBytes;
+}
+
+bool VReadBufferedStream::_fillBuffer(int numBytesNeeded) {
+    int numBytesBuffered = mEndOffset - mStartOffset;
+
+    if (numBytesBuffered >= numBytesNeeded) {
+        return true;
+    }
+
+    if (numBytesBuffered == 0) {
+        mStartOffset = 0;
+        mEndOffset = 0;
+    }
+
+    // Make room for numBytesNeeded contiguous bytes starting at mStartOffset.
+    if (numBytesNeeded > mBufferSize) {
+        Vu8* newBuffer = VStream::newNewBuffer(numBytesNeeded);
+        VStream::copyMemory(newBuffer, mBuffer + mStartOffset, numBytesBuffered);
+        delete [] mBuffer;
+        mBuffer = newBuffer;
+        mBufferSize = numBytesNeeded;
+        mStartOffset = 0;
+        mEndOffset = numBytesBuffered;
+    } else if (mStartOffset + numBytesNeeded > mBufferSize) {
+        ::memmove(mBuffer, mBuffer + mStartOffset, static_cast<size_t>(numBytesBuffered));
+        mStartOffset = 0;
+        mEndOffset = numBytesBuffered;
+    }
+
+    while ((mEndOffset - mStartOffset) < numBytesNeeded) {
+        int numBytesMissing = numBytesNeeded - (mEndOffset - mStartOffset);
+        int spaceRemaining = mBufferSize - mEndOffset;
+        int numBytesToRead = numBytesMissing;
+
+        // Opportunistically take whatever else has already arrived, so the next few reads are free.
+        if (numBytesMissing < spaceRemaining) {
+            Vs64 numBytesAvailable = mRawStream.available();
+            if (numBytesAvailable > numBytesMissing) {
+                numBytesToRead = static_cast<int>(V_MIN(numBytesAvailable, static_cast<Vs64>(spaceRemaining)));
+            }
+        }
+
+        Vs64 numBytesRead = mRawStream.read(mBuffer + mEndOffset, numBytesToRead);
+        if (numBytesRead <= 0) {
+            return false;
+        }
+
+        mEndOffset += static_cast<int>(numBytesRead);
+    }
+
+    return true;
+}
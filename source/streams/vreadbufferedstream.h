@@ -0,0 +1,151 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vreadbufferedstream_h
+#define vreadbufferedstream_h
+
+/** @file */
+
+#include "vstream.h"
+
+/**
+    @ingroup vstream_derived
+*/
+
+/**
+VReadBufferedStream is the read-side counterpart of VWriteBufferedStream. It
+sits on top of a raw stream such as a VSocketStream that doesn't buffer data
+on its own, refills an internal buffer with as few large reads as possible,
+and serves small reads (such as the individual fields decoded by a
+VBinaryIOStream) from memory. Writes and flushes are passed straight through
+to the raw stream, so a single VIOStream constructed on a VReadBufferedStream
+can still be used for both directions.
+
+When refilling, it reads at least the number of bytes the caller needs, plus
+whatever the raw stream reports as available() without blocking, up to the
+buffer capacity. Reads at least as large as the buffer bypass it.
+
+In addition to the normal VStream API, peek() and consume() let a caller work
+on whole message frames in place: peek() guarantees that a number of bytes
+are buffered contiguously and returns a pointer to them, and consume()
+discards them once they have been decoded.
+
+Once data has been buffered, you must not read from the raw stream directly,
+or you will skip past the buffered bytes.
+
+@see    VWriteBufferedStream
+@see    VSocketStream
+@see    VBinaryIOStream
+*/
+class VReadBufferedStream : public VStream {
+    public:
+
+        static const int kDefaultBufferSize = 65536;    ///< The default initial buffer capacity.
+
+        /**
+        Constructor.
+        @param  rawStream   the stream to read from (and to pass writes through to)
+        @param  bufferSize  the initial buffer capacity; it grows if peek() needs more
+        */
+        VReadBufferedStream(VStream& rawStream, int bufferSize = kDefaultBufferSize);
+        /**
+        Destructor.
+        */
+        virtual ~VReadBufferedStream();
+
+        // Required VStream method overrides:
+
+        /**
+        Reads bytes, from the buffer where possible.
+        @param    targetBuffer    the buffer to read into
+        @param    numBytesToRead    the number of bytes to read
+        @return    the actual number of bytes that could be read
+        */
+        virtual Vs64 read(Vu8* targetBuffer, Vs64 numBytesToRead);
+        /**
+        Writes directly to the raw stream; writes are not buffered.
+        @param    buffer            the buffer containing the data
+        @param    numBytesToWrite    the number of bytes to write to the stream
+        @return the actual number of bytes written
+        */
+        virtual Vs64 write(const Vu8* buffer, Vs64 numBytesToWrite);
+        /**
+        Flushes the raw stream.
+        */
+        virtual void flush();
+        /**
+        Skips over bytes in the input, discarding buffered bytes first.
+        @param    numBytesToSkip    the number of bytes to skip
+        @return true if all the bytes could be skipped
+        */
+        virtual bool skip(Vs64 numBytesToSkip);
+        /**
+        Seeks in the stream. Like VSocketStream, only seeking forward
+        (offset >= 0, whence = SEEK_CUR) is supported; other requests throw
+        a VException.
+        @param  offset  the offset (meaning depends on whence param)
+        @param  whence  SEEK_SET, SEEK_CUR, or SEEK_END
+        @return true if the seek was successful
+        */
+        virtual bool seek(Vs64 offset, int whence);
+        /**
+        Returns the raw stream's offset, less the bytes buffered but not yet read.
+        @return the current offset
+        */
+        virtual Vs64 getIOOffset() const;
+        /**
+        Returns the number of bytes buffered plus the number available on the raw stream.
+        @return the number of bytes currently available for reading
+        */
+        virtual Vs64 available() const;
+
+        /**
+        Ensures that at least the specified number of bytes are buffered
+        contiguously, reading from the raw stream as needed, and returns a
+        pointer to them without consuming them. The pointer is valid until the
+        next call to any read, skip, peek, or consume function.
+        Throws VEOFException if the raw stream ends first.
+        @param  numBytes    the number of bytes required
+        @return a pointer to the next unread byte
+        */
+        Vu8* peek(int numBytes);
+        /**
+        Discards the specified number of buffered bytes, typically after
+        decoding a frame obtained with peek(). Throws VRangeException if
+        fewer bytes are buffered.
+        @param  numBytes    the number of bytes to discard
+        */
+        void consume(int numBytes);
+        /**
+        Returns the number of bytes currently buffered and not yet read.
+        @return the buffered byte count
+        */
+        int getNumBufferedBytes() const { return mEndOffset - mStartOffset; }
+
+    private:
+
+        // Prevent copy construction and assignment since there is no provision for sharing the raw stream.
+        VReadBufferedStream(const VReadBufferedStream& other);
+        VReadBufferedStream& operator=(const VReadBufferedStream& other);
+
+        /**
+        Reads from the raw stream into the buffer until at least numBytesNeeded
+        are buffered, or the raw stream ends. Makes room first by compacting or
+        growing the buffer if necessary.
+        @param  numBytesNeeded  the number of buffered bytes wanted, including those already buffered
+        @return true if the requested number of bytes are now buffered
+        */
+        bool _fillBuffer(int numBytesNeeded);
+
+        VStream&    mRawStream;     ///< The raw stream we read from and write through to.
+        Vu8*        mBuffer;        ///< The buffer holding data read from the raw stream.
+        int         mBufferSize;    ///< The capacity of mBuffer.
+        int         mStartOffset;   ///< Offset in mBuffer of the next unread byte.
+        int         mEndOffset;     ///< Offset in mBuffer just past the last buffered byte.
+};
+
+#endif /* vreadbufferedstream_h */
@@ -15,17 +15,16 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 class VTailRunnerTextInputStream : public VTextIOStream {
     public:
-        VTailRunnerTextInputStream(VTextTailRunner* runner, VStream& rawStream, VDuration sleepDuration, int lineEndingsWriteKind = kUseNativeLineEndings);
+        VTailRunnerTextInputStream(VTextTailRunner* runner, VStream& rawStream, int lineEndingsWriteKind = kUseNativeLineEndings);
         virtual ~VTailRunnerTextInputStream();
     
-        // We just override the two ways of reading bytes; if desired bytes are not yet available, we sleep.
+        // We just override the two ways of reading bytes; if desired bytes are not yet available, we wait.
         virtual void readGuaranteed(Vu8* targetBuffer, Vs64 numBytesToRead);
         virtual Vu8 readGuaranteedByte();
 
     private:
     
         VTextTailRunner*    mRunner;
-        VDuration           mSleepDuration;
 };
 
 // VTextTailRunnerThread ------------------------------
@@ -33,27 +32,27 @@ class VTailRunnerTextInputStream : public VTextIOStream {
 class VTailRunnerThread : public VThread {
     public:
     
-        VTailRunnerThread(VTailRunnerTextInputStreamPtr inputStream, VTailHandler& handler, bool processByLine, VDuration sleepDuration);
+        VTailRunnerThread(VTextTailRunner* runner, VTailRunnerTextInputStreamPtr inputStream, VTailHandler& handler, bool processByLine);
         virtual ~VTailRunnerThread() {}
     
         virtual void run();
 
     private:
     
+        VTextTailRunner*                mRunner;
         VTailRunnerTextInputStreamPtr   mInputStream;
         VTailHandler&                   mHandler;
         bool                            mProcessByLine;
-        VDuration                       mSleepDuration;
 };
 
 // VTextTailRunnerThread ------------------------------
 
-VTailRunnerThread::VTailRunnerThread(VTailRunnerTextInputStreamPtr inputStream, VTailHandler& handler, bool processByLine, VDuration sleepDuration)
+VTailRunnerThread::VTailRunnerThread(VTextTailRunner* runner, VTailRunnerTextInputStreamPtr inputStream, VTailHandler& handler, bool processByLine)
     : VThread("VTailRunnerThread", VString::EMPTY(), kDeleteSelfAtEnd, kCreateThreadJoinable, nullptr)
+    , mRunner(runner)
     , mInputStream(inputStream)
     , mHandler(handler)
     , mProcessByLine(processByLine)
-    , mSleepDuration(sleepDuration)
     {
 }
 
@@ -69,17 +68,18 @@ void VTailRunnerThread::run() {
                 mHandler.processCodePoint(c);
             }
         } catch (const VEOFException&) { // just keep trying
-            VThread::sleep(mSleepDuration);
+            mRunner->_waitForData();
         }
     }
+
+    mRunner->_tailThreadEnded(); // the runner may be destructed once this returns
 }
 
 // VTailRunnerTextInputStream ------------------------------
 
-VTailRunnerTextInputStream::VTailRunnerTextInputStream(VTextTailRunner* runner, VStream& rawStream, VDuration sleepDuration, int lineEndingsWriteKind)
+VTailRunnerTextInputStream::VTailRunnerTextInputStream(VTextTailRunner* runner, VStream& rawStream, int lineEndingsWriteKind)
     : VTextIOStream(rawStream, lineEndingsWriteKind)
     , mRunner(runner)
-    , mSleepDuration(sleepDuration)
     {
 }
 
@@ -92,7 +92,7 @@ void VTailRunnerTextInputStream::readGuaranteed(Vu8* targetBuffer, Vs64 numBytes
         if (this->available() >= numBytesToRead) {
             return VTextIOStream::readGuaranteed(targetBuffer, numBytesToRead);
         } else {
-            VThread::sleep(mSleepDuration);
+            mRunner->_waitForData();
         }
     }
 
@@ -104,7 +104,7 @@ Vu8 VTailRunnerTextInputStream::readGuaranteedByte() {
         if (this->available() > 0) {
             return VTextIOStream::readGuaranteedByte();
         } else {
-            VThread::sleep(mSleepDuration);
+            mRunner->_waitForData();
         }
     }
 
@@ -116,13 +116,18 @@ Vu8 VTailRunnerTextInputStream::readGuaranteedByte() {
 
 VTextTailRunner::VTextTailRunner(VStream& inputStream, VTailHandler& handler, bool processByLine, VDuration sleepDuration, const VString& loggerName)
     : mInputFileStream()
-    , mInputStream(new VTailRunnerTextInputStream(this, inputStream, sleepDuration))
+    , mInputStream(new VTailRunnerTextInputStream(this, inputStream))
     , mHandler(handler)
     , mProcessByLine(processByLine)
     , mSleepDuration(sleepDuration)
     , mLoggerName(loggerName)
     , mMutex("VTextTailRunner")
     , mTailThread(nullptr)
+    , mIdleMutex("VTextTailRunner::mIdleMutex")
+    , mIdleCondition()
+    , mEndedMutex("VTextTailRunner::mEndedMutex")
+    , mEndedCondition()
+    , mTailThreadActive(false)
     {
 }
 
@@ -135,32 +140,66 @@ VTextTailRunner::VTextTailRunner(const VFSNode& inputFile, VTailHandler& handler
     , mLoggerName(loggerName)
     , mMutex("VTextTailRunner")
     , mTailThread(nullptr)
+    , mIdleMutex("VTextTailRunner::mIdleMutex")
+    , mIdleCondition()
+    , mEndedMutex("VTextTailRunner::mEndedMutex")
+    , mEndedCondition()
+    , mTailThreadActive(false)
     {
     mInputFileStream.openReadOnly();
     mInputFileStream.seek0();
     
-    mInputStream = VTailRunnerTextInputStreamPtr(new VTailRunnerTextInputStream(this, mInputFileStream, sleepDuration));
+    mInputStream = VTailRunnerTextInputStreamPtr(new VTailRunnerTextInputStream(this, mInputFileStream));
 }
 
 VTextTailRunner::~VTextTailRunner() {
     this->stop();
-    VThread::sleep(mSleepDuration + (250 * VDuration::MILLISECOND())); // Allow mTailThread to wake and wind down before we destruct our raw mInputFileStream.
+
+    // Wait for mTailThread to wind down before we destruct our raw mInputFileStream.
+    VMutexLocker locker(&mEndedMutex, "VTextTailRunner::~VTextTailRunner");
+    while (mTailThreadActive) {
+        (void) mEndedCondition.wait(&mEndedMutex, VDuration::SECOND());
+    }
 }
 
 void VTextTailRunner::start() {
-    mTailThread = new VTailRunnerThread(mInputStream, mHandler, mProcessByLine, mSleepDuration);
+    mTailThreadActive = true;
+    mTailThread = new VTailRunnerThread(this, mInputStream, mHandler, mProcessByLine);
     mTailThread->start();
 }
 
 void VTextTailRunner::stop() {
-    VMutexLocker locker(&mMutex, "VTextTailRunner::stop");
-    if (mTailThread != nullptr) {
+    /* locker scope */ {
+        VMutexLocker locker(&mMutex, "VTextTailRunner::stop");
+        if (mTailThread == nullptr) {
+            return;
+        }
+
         mTailThread->stop();
         mTailThread = nullptr;
     }
+
+    // _waitForData() looks at isRunning() while holding mIdleMutex.
+    VMutexLocker locker(&mIdleMutex, "VTextTailRunner::stop");
+    mIdleCondition.signal();
 }
 
 bool VTextTailRunner::isRunning() const {
     VMutexLocker locker(&mMutex, "VTextTailRunner::isRunning");
     return (mTailThread != nullptr) && mTailThread->isRunning();
 }
+
+void VTextTailRunner::_waitForData() {
+    VMutexLocker locker(&mIdleMutex, "VTextTailRunner::_waitForData");
+    if (this->isRunning()) {
+        (void) mIdleCondition.wait(&mIdleMutex, V_MAX(VDuration::MILLISECOND(), mSleepDuration)); // the timeout must be positive
+    }
+}
+
+void VTextTailRunner::_tailThreadEnded() {
+    // Clear the flag while holding the mutex the destructor waits with, so that by the time
+    // the destructor can see it clear, we are done with our members.
+    VMutexLocker locker(&mEndedMutex, "VTextTailRunner::_tailThreadEnded");
+    mTailThreadActive = false;
+    mEndedCondition.signal();
+}
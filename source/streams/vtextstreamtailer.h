@@ -13,6 +13,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vtextiostream.h"
 #include "vthread.h"
 #include "vmutexlocker.h"
+#include "vconditionvariable.h"
 
 /**
     @ingroup viostream_derived
@@ -68,7 +69,7 @@ class VTextTailRunner {
         @param  inputStream     the stream to tail
         @param  handler         the handler to call with tailed lines or code points
         @param  processByLine   true if lines are to be handled; false if individual code points are to be handled
-        @param  sleepDuration   the interval to sleep when there is no data available to read
+        @param  sleepDuration   the interval to wait before looking again when there is no data available to read
         @param  loggerName      the logger name to be used when emitting log output
         */
         VTextTailRunner(VStream& inputStream, VTailHandler& handler, bool processByLine=true, VDuration sleepDuration=VDuration::SECOND(), const VString& loggerName=VString::EMPTY());
@@ -77,10 +78,13 @@ class VTextTailRunner {
         @param  inputFile       the file to tail
         @param  handler         the handler to call with tailed lines or code points
         @param  processByLine   true if lines are to be handled; false if individual code points are to be handled
-        @param  sleepDuration   the interval to sleep when there is no data available to read
+        @param  sleepDuration   the interval to wait before looking again when there is no data available to read
         @param  loggerName      the logger name to be used when emitting log output
         */
         VTextTailRunner(const VFSNode& inputFile, VTailHandler& handler, bool processByLine=true, VDuration sleepDuration=VDuration::SECOND(), const VString& loggerName=VString::EMPTY());
+        /**
+        Destructor. Stops the tailing thread, and waits for it to end.
+        */
         virtual ~VTextTailRunner();
 
         /**
@@ -88,7 +92,8 @@ class VTextTailRunner {
         */
         void start();
         /**
-        Stops the tailing thread, which will subsequently destruct.
+        Stops the tailing thread, which will subsequently destruct. If the thread is
+        waiting for more data, it is woken rather than left to finish its wait.
         */
         void stop();
         /**
@@ -97,7 +102,23 @@ class VTextTailRunner {
         bool isRunning() const;
 
     private:
-    
+
+        VTextTailRunner(const VTextTailRunner&); // not copyable
+        VTextTailRunner& operator=(const VTextTailRunner&); // not assignable
+
+        friend class VTailRunnerThread;
+        friend class VTailRunnerTextInputStream;
+
+        /**
+        Called on the tailing thread when there is no data to read; waits for
+        mSleepDuration, or until stop() is called.
+        */
+        void _waitForData();
+        /**
+        Called on the tailing thread as it ends, to release the destructor.
+        */
+        void _tailThreadEnded();
+
         VBufferedFileStream             mInputFileStream;   ///< The file stream, if VFSNode constructor form was used.
         VTailRunnerTextInputStreamPtr   mInputStream;       ///< The input stream, either as supplied or for the file.
         VTailHandler&                   mHandler;           ///< The handler to be called with each line or code point tailed.
@@ -107,6 +128,12 @@ class VTextTailRunner {
     
         mutable VMutex                  mMutex;             ///< Synchronizes access to mTailThread.
         VThread*                        mTailThread;        ///< The thread that does the actual tailing.
+
+        VMutex                          mIdleMutex;         ///< The mutex held by the tailing thread while it waits on mIdleCondition.
+        VConditionVariable              mIdleCondition;     ///< Signaled by stop() to cut short a wait for data.
+        VMutex                          mEndedMutex;        ///< The mutex held by the destructor while it waits on mEndedCondition.
+        VConditionVariable              mEndedCondition;    ///< Signaled when the tailing thread ends.
+        volatile bool                   mTailThreadActive;  ///< True from start() until the tailing thread ends.
     
 };
 
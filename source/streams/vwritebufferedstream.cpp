@@ -11,9 +11,11 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vexception.h"
 
-VWriteBufferedStream::VWriteBufferedStream(VStream& rawStream, Vs64 initialBufferSize, Vs64 resizeIncrement)
+VWriteBufferedStream::VWriteBufferedStream(VStream& rawStream, Vs64 initialBufferSize, Vs64 resizeIncrement, bool writeLargeWritesDirectly)
     : VMemoryStream(initialBufferSize, resizeIncrement)
     , mRawStream(rawStream)
+    , mDirectWriteSize(writeLargeWritesDirectly ? initialBufferSize : 0)
+    , mDirectWritePending(false)
     {
 }
 
@@ -21,10 +23,24 @@ Vs64 VWriteBufferedStream::read(Vu8* /*targetBuffer*/, Vs64 /*numBytesToRead*/)
     throw VUnimplementedException("VWriteBufferedStream::read: Read is not permitted on buffered write stream.");
 }
 
+Vs64 VWriteBufferedStream::write(const Vu8* buffer, Vs64 numBytesToWrite) {
+    mDirectWritePending = false;
+
+    if (! this->_isLargeWrite(numBytesToWrite)) {
+        return VMemoryStream::write(buffer, numBytesToWrite);
+    }
+
+    // Keep the order of the data: what is buffered goes first, then the large write.
+    this->flush();
+    return mRawStream.write(buffer, numBytesToWrite);
+}
+
 void VWriteBufferedStream::flush() {
-    // Flush the complete contents of our buffer to the raw stream.
+    // Flush the complete contents of our buffer to the raw stream; there's no need for an empty write.
     this->seek(SEEK_SET, 0);    // set our i/o offset back to 0
-    (void) VStream::streamCopy(*this, mRawStream, this->getEOFOffset());
+    if (this->getEOFOffset() != 0) {
+        (void) VStream::streamCopy(*this, mRawStream, this->getEOFOffset());
+    }
 
     // Reset ourself to be "empty" and at i/o offset 0.
     this->seek(SEEK_SET, 0);
@@ -35,3 +51,14 @@ bool VWriteBufferedStream::skip(Vs64 /*numBytesToSkip*/) {
     throw VUnimplementedException("VWriteBufferedStream::skip: Skip is not permitted on buffered write stream.");
 }
 
+Vu8* VWriteBufferedStream::_getWriteIOPtr() const {
+    return mDirectWritePending ? NULL : VMemoryStream::_getWriteIOPtr();
+}
+
+void VWriteBufferedStream::_prepareToWrite(Vs64 numBytesToWrite) {
+    if (this->_isLargeWrite(numBytesToWrite)) {
+        mDirectWritePending = true; // streamCopy() will find no buffer pointer, and call write() instead
+    } else {
+        VMemoryStream::_prepareToWrite(numBytesToWrite);
+    }
+}
@@ -24,6 +24,12 @@ of the stream is reset to empty, so you can't seek in it. The idea is that
 you may do a series of writes and seeks, followed by a flush, which appends
 all pending data to the underlying raw stream.
 
+If constructed with writeLargeWritesDirectly, a single write (or streamCopy())
+of at least initialBufferSize bytes is not buffered: the pending data is flushed
+and the large write goes straight to the raw stream, so large payloads are not
+copied an extra time and the buffer does not grow to hold them. You cannot seek
+back into data that has been written this way.
+
 Thus you must instantiate a raw stream and supply it to the VWriteBufferedStream
 so it has an actual stream to do i/o on. You will then typically instantiate
 a VIOStream-derived object for i/o, and construct it with the VWriteBufferedStream.
@@ -41,8 +47,13 @@ class VWriteBufferedStream : public VMemoryStream {
 
         /**
         Constructor.
+        @param  rawStream                   the stream that buffered data is flushed to
+        @param  initialBufferSize           the initial size of the buffer
+        @param  resizeIncrement             how the buffer grows (see VMemoryStream)
+        @param  writeLargeWritesDirectly    true to send writes of initialBufferSize bytes or more
+                                                straight to the raw stream, after flushing
         */
-        VWriteBufferedStream(VStream& rawStream, Vs64 initialBufferSize = VMemoryStream::kDefaultBufferSize, Vs64 resizeIncrement = VMemoryStream::kIncrement2x);
+        VWriteBufferedStream(VStream& rawStream, Vs64 initialBufferSize = VMemoryStream::kDefaultBufferSize, Vs64 resizeIncrement = VMemoryStream::kIncrement2x, bool writeLargeWritesDirectly = false);
         /**
         Destructor.
         */
@@ -55,6 +66,14 @@ class VWriteBufferedStream : public VMemoryStream {
         @return    the actual number of bytes that could be read
         */
         virtual Vs64 read(Vu8* targetBuffer, Vs64 numBytesToRead);
+        /**
+        Overrides VMemoryStream::write in order to send a large write directly to
+        the raw stream, if so constructed.
+        @param    buffer            the buffer to write from
+        @param    numBytesToWrite   the number of bytes to write
+        @return    the number of bytes written
+        */
+        virtual Vs64 write(const Vu8* buffer, Vs64 numBytesToWrite);
 
         /**
         Overrides VMemoryStream::flush in order to copy the buffered data
@@ -73,13 +92,30 @@ class VWriteBufferedStream : public VMemoryStream {
         // call through to the raw stream, though I'm not sure it should
         // really be like that.
 
+    protected:
+
+        /**
+        Overrides VMemoryStream::_getWriteIOPtr so that streamCopy() does not copy
+        into the buffer once _prepareToWrite() has decided on a direct write.
+        */
+        virtual Vu8* _getWriteIOPtr() const;
+        /**
+        Overrides VMemoryStream::_prepareToWrite so that a large streamCopy() is
+        sent to write(), and from there to the raw stream, rather than grow the buffer.
+        */
+        virtual void _prepareToWrite(Vs64 numBytesToWrite);
+
     private:
 
         // Prevent copy construction and assignment since there is no provision for sharing the raw stream.
         VWriteBufferedStream(const VWriteBufferedStream& other);
         VWriteBufferedStream& operator=(const VWriteBufferedStream& other);
 
-        VStream& mRawStream; ///< The raw stream we eventually flush to.
+        bool _isLargeWrite(Vs64 numBytesToWrite) const { return (mDirectWriteSize > 0) && (numBytesToWrite >= mDirectWriteSize); }
+
+        VStream&    mRawStream;         ///< The raw stream we eventually flush to.
+        Vs64        mDirectWriteSize;   ///< Writes of this many bytes or more bypass the buffer; zero means none do.
+        bool        mDirectWritePending;///< True between _prepareToWrite() deciding on a direct write and the write() itself.
 };
 
 #endif /* vwritebufferedstream_h */
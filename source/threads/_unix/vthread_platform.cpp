@@ -11,13 +11,23 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vtypes_internal_platform.h"
 
 #include "vmutex.h"
+#include "vreadwritelock.h"
+#include "vconditionvariable.h"
 #include "vsemaphore.h"
 #include "vlogger.h"
 #include "vinstant.h"
 #include "vexception.h"
 
 #include <sys/time.h>
+#include <time.h>
 #include <sys/resource.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+    #include <sched.h>
+    #include <sys/syscall.h>
+#endif
 
 // VThread platform-specific functions ---------------------------------------
 
@@ -50,16 +60,21 @@ void VThread::threadCreate(VThreadID_Type* threadID, bool createDetached, thread
 }
 
 // static
-#ifdef VTHREAD_PTHREAD_SETNAME_SUPPORTED
 void VThread::_threadStarting(const VThread* thread) {
-    // This API lets us associate our thread name with the native thread resource, so that debugger/crashdump/instruments etc. can see our thread name.
-    (void)/*int result =*/ ::pthread_setname_np(thread->getName()); // "np" indicates API is non-POSIX
-}
+    // This API lets us associate our thread name with the native thread resource, so that debugger/crashdump/instruments/top etc. can see our thread name.
+    const VString& osName = thread->getPlacement().mOSName.isEmpty() ? thread->getName() : thread->getPlacement().mOSName;
+#if defined(VTHREAD_PTHREAD_SETNAME_SUPPORTED)
+    (void)/*int result =*/ ::pthread_setname_np(osName); // "np" indicates API is non-POSIX
+#elif defined(__linux__)
+    // Linux takes at most 15 characters plus the terminator, and fails rather than truncating.
+    char truncatedName[16];
+    osName.copyToBuffer(truncatedName, static_cast<int>(sizeof(truncatedName)));
+    (void)/*int result =*/ ::pthread_setname_np(::pthread_self(), truncatedName);
 #else
-void VThread::_threadStarting(const VThread* /*thread*/) {
     // Nothing to do if pthread_setname_np() is not available.
-}
+    (void) osName;
 #endif
+}
 
 // static
 void VThread::_threadEnded(const VThread* /*thread*/) {
@@ -91,6 +106,84 @@ bool VThread::setPriority(int nice) {
     return (::setpriority(PRIO_PROCESS, 0, nice) == 0);
 }
 
+// static
+#ifdef __linux__
+bool VThread::setAffinity(const VThreadCPUList& cpus) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (VThreadCPUList::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+        if ((*i < 0) || (*i >= CPU_SETSIZE)) {
+            return false;
+        }
+
+        CPU_SET(*i, &cpuSet);
+    }
+
+    return (::pthread_setaffinity_np(::pthread_self(), sizeof(cpuSet), &cpuSet) == 0);
+}
+#else
+bool VThread::setAffinity(const VThreadCPUList& /*cpus*/) {
+    // Other Unix platforms (notably Mac OS X) offer affinity hints at most, not binding.
+    return false;
+}
+#endif
+
+// static
+#ifdef __linux__
+bool VThread::setPreferredNUMANode(int numaNode) {
+    // We make the system call directly because its wrapper and constants come with libnuma, which we don't require.
+    static const int kMPOL_PREFERRED = 1;
+    unsigned long nodeMask = 0;
+    const int kMaxNodes = static_cast<int>(8 * sizeof(nodeMask));
+    if ((numaNode < 0) || (numaNode >= kMaxNodes)) {
+        return false;
+    }
+
+    nodeMask = 1UL << numaNode;
+    return (::syscall(SYS_set_mempolicy, kMPOL_PREFERRED, &nodeMask, static_cast<unsigned long>(kMaxNodes + 1)) == 0);
+}
+#else
+bool VThread::setPreferredNUMANode(int /*numaNode*/) {
+    return false;
+}
+#endif
+
+// static
+#ifdef __linux__
+bool VThread::getNUMANodeCPUs(int numaNode, VThreadCPUList& cpus) {
+    VString path(VSTRING_FORMAT("/sys/devices/system/node/node%d/cpulist", numaNode));
+    FILE* f = ::fopen(path.chars(), "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    char buffer[1024];
+    char* line = ::fgets(buffer, static_cast<int>(sizeof(buffer)), f);
+    (void) ::fclose(f);
+    if (line == NULL) {
+        return false;
+    }
+
+    try {
+        cpus = VThreadPlacement::parseCPUList(VString(line));
+    } catch (const VException&) {
+        return false;
+    }
+
+    return ! cpus.empty();
+}
+#else
+bool VThread::getNUMANodeCPUs(int /*numaNode*/, VThreadCPUList& /*cpus*/) {
+    return false;
+}
+#endif
+
+// static
+int VThread::getNumProcessors() {
+    long numProcessors = ::sysconf(_SC_NPROCESSORS_ONLN);
+    return (numProcessors < 1) ? 1 : static_cast<int>(numProcessors);
+}
+
 // static
 void VThread::sleep(const VDuration& interval) {
     int milliseconds = static_cast<int>(interval.getDurationMilliseconds());
@@ -129,11 +222,152 @@ bool VMutex::mutexLock(VMutex_Type* mutex) {
     return (::pthread_mutex_lock(mutex) == 0);
 }
 
+// static
+bool VMutex::mutexTryLock(VMutex_Type* mutex) {
+    return (::pthread_mutex_trylock(mutex) == 0);
+}
+
 // static
 bool VMutex::mutexUnlock(VMutex_Type* mutex) {
     return (::pthread_mutex_unlock(mutex) == 0);
 }
 
+// VReadWriteLock platform-specific functions --------------------------------
+
+// static
+bool VReadWriteLock::rwlockInit(VReadWriteLock_Type* rwlock, bool preferWriters) {
+    pthread_rwlockattr_t attributes;
+    if (::pthread_rwlockattr_init(&attributes) != 0) {
+        return false;
+    }
+
+#ifdef __GLIBC__
+    // glibc lets new readers in ahead of a waiting writer unless told otherwise. (Darwin already prefers writers.)
+    if (preferWriters) {
+        (void) ::pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    }
+#else
+    (void) preferWriters;
+#endif
+
+    int result = ::pthread_rwlock_init(rwlock, &attributes);
+    (void) ::pthread_rwlockattr_destroy(&attributes);
+    return (result == 0);
+}
+
+// static
+void VReadWriteLock::rwlockDestroy(VReadWriteLock_Type* rwlock) {
+    (void) ::pthread_rwlock_destroy(rwlock);
+}
+
+// static
+bool VReadWriteLock::rwlockReadLock(VReadWriteLock_Type* rwlock) {
+    return (::pthread_rwlock_rdlock(rwlock) == 0);
+}
+
+// static
+bool VReadWriteLock::rwlockReadUnlock(VReadWriteLock_Type* rwlock) {
+    return (::pthread_rwlock_unlock(rwlock) == 0);
+}
+
+// static
+bool VReadWriteLock::rwlockWriteLock(VReadWriteLock_Type* rwlock) {
+    return (::pthread_rwlock_wrlock(rwlock) == 0);
+}
+
+// static
+bool VReadWriteLock::rwlockWriteUnlock(VReadWriteLock_Type* rwlock) {
+    return (::pthread_rwlock_unlock(rwlock) == 0);
+}
+
+// VConditionVariable platform-specific functions ----------------------------
+
+// static
+bool VConditionVariable::conditionInit(VConditionVariable_Type* condition) {
+#ifdef VPLATFORM_MAC
+    // Darwin has no pthread_condattr_setclock(); conditionWait() uses a relative timeout instead.
+    return (::pthread_cond_init(condition, NULL) == 0);
+#else
+    pthread_condattr_t attributes;
+    if (::pthread_condattr_init(&attributes) != 0) {
+        return false;
+    }
+
+    // Measure timed waits on the monotonic clock, so that setting the system clock does not disturb them.
+    (void) ::pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+    int result = ::pthread_cond_init(condition, &attributes);
+    (void) ::pthread_condattr_destroy(&attributes);
+    return (result == 0);
+#endif
+}
+
+// static
+void VConditionVariable::conditionDestroy(VConditionVariable_Type* condition) {
+    (void) ::pthread_cond_destroy(condition);
+}
+
+// static
+bool VConditionVariable::conditionWait(VConditionVariable_Type* condition, VMutex_Type* mutex, const VDuration& timeout, bool& timedOut) {
+    timedOut = false;
+
+    if (timeout == VDuration::POSITIVE_INFINITY()) {
+        return (::pthread_cond_wait(condition, mutex) == 0);
+    }
+
+    const Vs64 timeoutMilliseconds = timeout.getDurationMilliseconds();
+
+#ifdef VPLATFORM_MAC
+    struct timespec timeoutSpec;
+    timeoutSpec.tv_sec = static_cast<time_t>(timeoutMilliseconds / CONST_S64(1000));
+    timeoutSpec.tv_nsec = static_cast<long>(CONST_S64(1000000) * (timeoutMilliseconds % CONST_S64(1000)));
+
+    int result = ::pthread_cond_timedwait_relative_np(condition, mutex, &timeoutSpec);
+#else
+    // The timespec is an absolute time on the clock selected in conditionInit().
+    struct timespec timeoutSpec;
+    (void) ::clock_gettime(CLOCK_MONOTONIC, &timeoutSpec);
+    timeoutSpec.tv_sec += static_cast<time_t>(timeoutMilliseconds / CONST_S64(1000));
+    timeoutSpec.tv_nsec += static_cast<long>(CONST_S64(1000000) * (timeoutMilliseconds % CONST_S64(1000)));
+    if (timeoutSpec.tv_nsec >= 1000000000L) {
+        timeoutSpec.tv_sec += 1;
+        timeoutSpec.tv_nsec -= 1000000000L;
+    }
+
+    int result = ::pthread_cond_timedwait(condition, mutex, &timeoutSpec);
+#endif
+
+    if (result == ETIMEDOUT) {
+        timedOut = true;
+        return true;
+    }
+
+    return (result == 0);
+}
+
+// static
+bool VConditionVariable::conditionSignal(VConditionVariable_Type* condition) {
+    return (::pthread_cond_signal(condition) == 0);
+}
+
+// static
+bool VConditionVariable::conditionBroadcast(VConditionVariable_Type* condition) {
+    return (::pthread_cond_broadcast(condition) == 0);
+}
+
+// static
+Vs64 VConditionVariable::conditionClockMilliseconds() {
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    (void) ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return (static_cast<Vs64>(now.tv_sec) * CONST_S64(1000)) + static_cast<Vs64>(now.tv_nsec / 1000000L);
+#else
+    struct timeval now;
+    (void) ::gettimeofday(&now, NULL);
+    return (static_cast<Vs64>(now.tv_sec) * CONST_S64(1000)) + static_cast<Vs64>(now.tv_usec / 1000);
+#endif
+}
+
 // VSemaphore platform-specific functions ------------------------------------
 
 // static
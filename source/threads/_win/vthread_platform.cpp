@@ -10,6 +10,8 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vthread.h"
 #include "vmutex.h"
 #include "vsemaphore.h"
+#include "vreadwritelock.h"
+#include "vconditionvariable.h"
 #include "vexception.h"
 #include "vmutexlocker.h"
 
@@ -101,6 +103,53 @@ bool VThread::setPriority(int /*nice*/) {
     return true;
 }
 
+// static
+bool VThread::setAffinity(const VThreadCPUList& cpus) {
+    DWORD_PTR affinityMask = 0;
+    for (VThreadCPUList::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+        // Without processor groups, a mask reaches only the first 32 or 64 CPUs.
+        if ((*i < 0) || (*i >= static_cast<int>(8 * sizeof(affinityMask)))) {
+            return false;
+        }
+
+        affinityMask |= (static_cast<DWORD_PTR>(1) << *i);
+    }
+
+    return (::SetThreadAffinityMask(::GetCurrentThread(), affinityMask) != 0);
+}
+
+// static
+bool VThread::setPreferredNUMANode(int numaNode) {
+    // Windows allocates from the node of the CPU the thread runs on, so binding the
+    // CPUs is what matters; we only check that the node exists.
+    ULONG highestNode = 0;
+    return (numaNode >= 0) && (::GetNumaHighestNodeNumber(&highestNode) != 0) && (static_cast<ULONG>(numaNode) <= highestNode);
+}
+
+// static
+bool VThread::getNUMANodeCPUs(int numaNode, VThreadCPUList& cpus) {
+    ULONGLONG processorMask = 0;
+    if ((numaNode < 0) || (numaNode > 255) || (::GetNumaNodeProcessorMask(static_cast<UCHAR>(numaNode), &processorMask) == 0)) {
+        return false;
+    }
+
+    cpus.clear();
+    for (int cpu = 0; cpu < 64; ++cpu) {
+        if ((processorMask & (static_cast<ULONGLONG>(1) << cpu)) != 0) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return ! cpus.empty();
+}
+
+// static
+int VThread::getNumProcessors() {
+    SYSTEM_INFO systemInfo;
+    ::GetSystemInfo(&systemInfo);
+    return (systemInfo.dwNumberOfProcessors < 1) ? 1 : static_cast<int>(systemInfo.dwNumberOfProcessors);
+}
+
 // static
 void VThread::sleep(const VDuration& interval) {
     Sleep(static_cast<DWORD>(interval.getDurationMilliseconds()));
@@ -132,12 +181,107 @@ bool VMutex::mutexLock(VMutex_Type* mutex) {
     return true;
 }
 
+// static
+bool VMutex::mutexTryLock(VMutex_Type* mutex) {
+    return (TryEnterCriticalSection(mutex) != 0);
+}
+
 // static
 bool VMutex::mutexUnlock(VMutex_Type* mutex) {
     LeaveCriticalSection(mutex);
     return true;
 }
 
+// VReadWriteLock platform-specific functions --------------------------------
+
+// static
+bool VReadWriteLock::rwlockInit(VReadWriteLock_Type* rwlock, bool /*preferWriters*/) {
+    // Slim reader/writer locks have no policy setting.
+    InitializeSRWLock(rwlock);
+    return true;
+}
+
+// static
+void VReadWriteLock::rwlockDestroy(VReadWriteLock_Type* /*rwlock*/) {
+    // Slim reader/writer locks hold no resources.
+}
+
+// static
+bool VReadWriteLock::rwlockReadLock(VReadWriteLock_Type* rwlock) {
+    AcquireSRWLockShared(rwlock);
+    return true;
+}
+
+// static
+bool VReadWriteLock::rwlockReadUnlock(VReadWriteLock_Type* rwlock) {
+    ReleaseSRWLockShared(rwlock);
+    return true;
+}
+
+// static
+bool VReadWriteLock::rwlockWriteLock(VReadWriteLock_Type* rwlock) {
+    AcquireSRWLockExclusive(rwlock);
+    return true;
+}
+
+// static
+bool VReadWriteLock::rwlockWriteUnlock(VReadWriteLock_Type* rwlock) {
+    ReleaseSRWLockExclusive(rwlock);
+    return true;
+}
+
+// VConditionVariable platform-specific functions ----------------------------
+
+// static
+bool VConditionVariable::conditionInit(VConditionVariable_Type* condition) {
+    InitializeConditionVariable(condition);
+    return true;
+}
+
+// static
+void VConditionVariable::conditionDestroy(VConditionVariable_Type* /*condition*/) {
+    // Condition variables hold no resources.
+}
+
+// static
+bool VConditionVariable::conditionWait(VConditionVariable_Type* condition, VMutex_Type* mutex, const VDuration& timeout, bool& timedOut) {
+    timedOut = false;
+
+    DWORD timeoutMillisecondsDWORD = INFINITE;
+    if (timeout != VDuration::POSITIVE_INFINITY()) {
+        // Stay below INFINITE, which would mean no timeout at all.
+        timeoutMillisecondsDWORD = static_cast<DWORD>(V_MIN(timeout.getDurationMilliseconds(), static_cast<Vs64>(INFINITE - 1)));
+    }
+
+    if (SleepConditionVariableCS(condition, mutex, timeoutMillisecondsDWORD)) {
+        return true;
+    }
+
+    if (GetLastError() == ERROR_TIMEOUT) {
+        timedOut = true;
+        return true;
+    }
+
+    return false;
+}
+
+// static
+bool VConditionVariable::conditionSignal(VConditionVariable_Type* condition) {
+    WakeConditionVariable(condition);
+    return true;
+}
+
+// static
+bool VConditionVariable::conditionBroadcast(VConditionVariable_Type* condition) {
+    WakeAllConditionVariable(condition);
+    return true;
+}
+
+// static
+Vs64 VConditionVariable::conditionClockMilliseconds() {
+    return static_cast<Vs64>(GetTickCount64());
+}
+
 // VSemaphore platform-specific functions ------------------------------------
 
 #define kSemaphoreMaxCount 1
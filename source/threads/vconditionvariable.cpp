@@ -0,0 +1,53 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vconditionvariable.h"
+
+#include "vmutex.h"
+#include "vexception.h"
+
+// VConditionVariable ---------------------------------------------------------
+
+VConditionVariable::VConditionVariable()
+    : mCondition()
+    {
+
+    if (! VConditionVariable::conditionInit(&mCondition)) {
+        throw VStackTraceException("VConditionVariable::VConditionVariable unable to initialize condition variable.");
+    }
+}
+
+VConditionVariable::~VConditionVariable() {
+    VConditionVariable::conditionDestroy(&mCondition);
+}
+
+bool VConditionVariable::wait(VMutex* ownedMutex, const VDuration& timeout) {
+    if (timeout <= VDuration::ZERO()) {
+        return false;
+    }
+
+    bool timedOut = false;
+    if (! VConditionVariable::conditionWait(&mCondition, ownedMutex->getMutex(), timeout, timedOut)) {
+        throw VStackTraceException("VConditionVariable::wait unable to wait on condition variable.");
+    }
+
+    return ! timedOut;
+}
+
+void VConditionVariable::signal() {
+    if (! VConditionVariable::conditionSignal(&mCondition)) {
+        throw VStackTraceException("VConditionVariable::signal unable to signal condition variable.");
+    }
+}
+
+void VConditionVariable::broadcast() {
+    if (! VConditionVariable::conditionBroadcast(&mCondition)) {
+        throw VStackTraceException("VConditionVariable::broadcast unable to broadcast condition variable.");
+    }
+}
@@ -0,0 +1,191 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vconditionvariable_h
+#define vconditionvariable_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include "vthread.h"
+#include "vinstant.h"
+
+class VMutex;
+
+/**
+    @ingroup vthread
+*/
+
+// VConditionVariable ---------------------------------------------------------
+
+/**
+VConditionVariable lets a thread wait, without holding a mutex, until another
+thread changes some state guarded by that mutex.
+
+Unlike VSemaphore, the wait always releases the mutex while the thread is
+blocked, on every platform, and reacquires it before returning. That closes the
+window in which a VSemaphore signal can be lost: as long as the waiter looks at
+the state and waits while holding the mutex, and the signaler changes the state
+while holding the same mutex, the signal cannot arrive "between" the look and the
+wait. Use waitUntil() with a predicate over the guarded state, and it also takes
+care of spurious wakeups and of being woken for a change that another waiter has
+already consumed.
+
+Timeouts are measured on a monotonic clock where the platform allows, so neither
+a change to the system clock nor VInstant's frozen or simulated time cuts a wait
+short or stretches it out. A waitUntil() deadline is a VInstant; it is turned into
+a timeout when the wait begins, and that timeout is then measured the same way.
+*/
+class VConditionVariable {
+    public:
+
+        /**
+        Creates and initializes the condition variable.
+        */
+        VConditionVariable();
+        /**
+        Destructs the condition variable. No thread may be waiting on it.
+        */
+        ~VConditionVariable();
+
+        /**
+        Waits once for a signal. The wait may end early with no signal (a spurious
+        wakeup), so callers should normally use waitUntil() instead.
+        @param  ownedMutex  the mutex that the caller has already locked; it is
+                            released while waiting and reacquired before returning
+        @param  timeout     the longest to wait; POSITIVE_INFINITY (the default)
+                            means no limit; zero or less means do not wait
+        @return false if the wait timed out; true otherwise
+        */
+        bool wait(VMutex* ownedMutex, const VDuration& timeout = VDuration::POSITIVE_INFINITY());
+        /**
+        Waits until a predicate is true or a deadline passes. The predicate is
+        evaluated with the mutex held, first before waiting at all and then after
+        each wakeup.
+        @param  ownedMutex  the mutex that the caller has already locked, which
+                            guards the state the predicate looks at
+        @param  predicate   a function or function object taking no arguments and
+                            returning something convertible to bool
+        @param  deadline    when to give up; INFINITE_FUTURE means never; it is
+                            compared with the current VInstant only once, when the
+                            wait begins
+        @return the final value of the predicate, which is false only if the deadline passed
+        */
+        template <typename Predicate>
+        bool waitUntil(VMutex* ownedMutex, Predicate predicate, const VInstant& deadline = VInstant::INFINITE_FUTURE());
+        /**
+        Waits until a predicate is true or a timeout elapses, as waitUntil() does.
+        The timeout is measured on the monotonic clock (see conditionClockMilliseconds()).
+        @param  ownedMutex  the mutex that the caller has already locked
+        @param  predicate   as for waitUntil()
+        @param  timeout     the longest to wait; POSITIVE_INFINITY means no limit
+        @return the final value of the predicate, which is false only if the timeout elapsed
+        */
+        template <typename Predicate>
+        bool waitFor(VMutex* ownedMutex, Predicate predicate, const VDuration& timeout);
+
+        /**
+        Wakes one waiting thread, if any. The caller should change the state the
+        waiter is looking at while holding the mutex; it may signal afterwards with
+        or without the mutex held.
+        */
+        void signal();
+        /**
+        Wakes all waiting threads.
+        */
+        void broadcast();
+
+        /* PLATFORM-SPECIFIC STATIC FUNCTIONS --------------------------------
+        The remaining functions defined here are the low-level interfaces to
+        the platform-specific condition variable APIs. These are implemented in
+        each platform-specific version of vthread_platform.cpp.
+        */
+
+        /**
+        Initializes the platform condition variable.
+        Wrapper on Unix for pthread_cond_init, using the monotonic clock where supported.
+        @return true on success; false on failure
+        */
+        static bool conditionInit(VConditionVariable_Type* condition);
+        /**
+        Destroys the platform condition variable.
+        Wrapper on Unix for pthread_cond_destroy.
+        */
+        static void conditionDestroy(VConditionVariable_Type* condition);
+        /**
+        Waits on the platform condition variable.
+        Wrapper on Unix for pthread_cond_wait and pthread_cond_timedwait.
+        @param  condition       the platform condition variable
+        @param  mutex           a platform mutex locked by the calling thread; it is
+                                unlocked while waiting and locked again on return
+        @param  timeout         a positive interval, or POSITIVE_INFINITY for no limit
+        @param  timedOut        set to true if the wait timed out
+        @return true on success (including timeout); false on failure
+        */
+        static bool conditionWait(VConditionVariable_Type* condition, VMutex_Type* mutex, const VDuration& timeout, bool& timedOut);
+        /**
+        Wakes one thread waiting on the platform condition variable.
+        Wrapper on Unix for pthread_cond_signal.
+        @return true on success; false on failure
+        */
+        static bool conditionSignal(VConditionVariable_Type* condition);
+        /**
+        Wakes all threads waiting on the platform condition variable.
+        Wrapper on Unix for pthread_cond_broadcast.
+        @return true on success; false on failure
+        */
+        static bool conditionBroadcast(VConditionVariable_Type* condition);
+        /**
+        Returns the time in milliseconds on the clock that conditionWait() measures
+        its timeouts with: CLOCK_MONOTONIC on Unix, GetTickCount64 on Windows. The
+        value only means something relative to another value from this function.
+        */
+        static Vs64 conditionClockMilliseconds();
+
+    private:
+
+        VConditionVariable(const VConditionVariable&); // not copyable
+        VConditionVariable& operator=(const VConditionVariable&); // not assignable
+
+        VConditionVariable_Type mCondition; ///< The OS condition variable.
+};
+
+template <typename Predicate>
+bool VConditionVariable::waitUntil(VMutex* ownedMutex, Predicate predicate, const VInstant& deadline) {
+    if (deadline == VInstant::INFINITE_FUTURE()) {
+        return this->waitFor(ownedMutex, predicate, VDuration::POSITIVE_INFINITY());
+    }
+
+    const VInstant now;
+    return this->waitFor(ownedMutex, predicate, deadline - now);
+}
+
+template <typename Predicate>
+bool VConditionVariable::waitFor(VMutex* ownedMutex, Predicate predicate, const VDuration& timeout) {
+    if (timeout == VDuration::POSITIVE_INFINITY()) {
+        while (! predicate()) {
+            (void) this->wait(ownedMutex);
+        }
+
+        return true;
+    }
+
+    const Vs64 deadlineMilliseconds = VConditionVariable::conditionClockMilliseconds() + timeout.getDurationMilliseconds();
+    while (! predicate()) {
+        const Vs64 remainingMilliseconds = deadlineMilliseconds - VConditionVariable::conditionClockMilliseconds();
+        if (remainingMilliseconds <= 0) {
+            return false;
+        }
+
+        (void) this->wait(ownedMutex, VDuration::MILLISECOND() * remainingMilliseconds);
+    }
+
+    return true;
+}
+
+#endif /* vconditionvariable_h */
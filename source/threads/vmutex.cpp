@@ -10,19 +10,294 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vmutex.h"
 
 #include "vexception.h"
+#include "vmutexlocker.h"
 #include "vthread.h"
 #include "vlogger.h"
+#include "vbento.h"
+
+#include <chrono>
+#include <map>
 
 VDuration VMutex::gVMutexLockDelayLoggingThreshold(100 * VDuration::MILLISECOND());
 int VMutex::gVMutexLockDelayLoggingLevel(VLoggerLevel::DEBUG);
+int VMutex::gVMutexLockTimingSampleInterval(64);
+std::atomic<bool> VMutex::gVMutexContentionProfilingEnabled(false);
+
+#ifdef VAULT_MUTEX_LOCK_DELAY_CHECK
+// Counts down each thread's locks to the next one that is timed. Thread-local so that
+// deciding costs no shared write and needs no lock.
+static V_THREAD_LOCAL int gLockTimingCountdown = 0;
+
+static bool _shouldTimeLock() {
+    const int interval = VMutex::getLockTimingSampleInterval();
+    if (interval <= 0) {
+        return false;
+    }
+
+    if (--gLockTimingCountdown > 0) {
+        return false;
+    }
+
+    gLockTimingCountdown = interval;
+    return true;
+}
+#endif
+
+#ifndef VAULT_MUTEX_BARE_LOCKS
+
+// VMutexContentionStats ------------------------------------------------------
+
+/**
+The contention profiling counters for all mutexes of one name. Each thread adds
+to one of several stripes of counters, picked once per thread, so that recording
+needs no lock and busy threads mostly write to cache lines of their own. Reading
+sums the stripes; the sums are not a consistent snapshot, which is fine for
+diagnostics. Instances live in a registry keyed by profiling key and are never
+deleted, so a VMutex can keep a plain pointer to its stats. The registry holds at
+most VMutex::kMaxContentionProfilingKeys keys; later keys share one "(other)"
+entry, so mutexes named per instance cannot grow it without bound.
+*/
+class VMutexContentionStats {
+    public:
+
+        static const int kNumHistogramBuckets = 20; ///< Bucket 0 is under 1us; bucket i is [2^(i-1), 2^i)us; the last also takes everything longer.
+
+        static VMutexContentionStats* find(const VString& name);
+        static void getAllInfo(VBentoNode& bento);
+        static void resetAll();
+
+        void recordAcquisition(bool contended, Vs64 waitMicroseconds);
+        void recordHold(Vs64 holdMicroseconds);
+
+    private:
+
+        VMutexContentionStats() {}
+        ~VMutexContentionStats() {}
+
+        VMutexContentionStats(const VMutexContentionStats&); // not copyable
+        VMutexContentionStats& operator=(const VMutexContentionStats&); // not assignable
+
+        static const int kNumStripes = 16;
+        static const int kCacheLineSize = 64;
+
+        struct Stripe {
+            std::atomic<Vs64>   mAcquisitions;
+            std::atomic<Vs64>   mContended;
+            std::atomic<Vs64>   mWaitMicroseconds;
+            std::atomic<Vs64>   mHoldMicroseconds;
+            std::atomic<Vs64>   mWaitHistogram[kNumHistogramBuckets];
+            std::atomic<Vs64>   mHoldHistogram[kNumHistogramBuckets];
+            char                mPadding[kCacheLineSize]; // keeps neighboring stripes' hot counters off each other's cache lines
+        };
+
+        static int _getBucket(Vs64 microseconds);
+        static Stripe& _getStripe(VMutexContentionStats* stats);
+        static Vs64 _sum(const std::atomic<Vs64> Stripe::* counter, const Stripe* stripes);
+
+        void _getInfo(VBentoNode& bento) const;
+        void _reset();
+
+        Stripe mStripes[kNumStripes];
+};
+
+typedef std::map<VString, VMutexContentionStats*> VMutexContentionStatsMap;
+
+/**
+The registry of stats by mutex name. It is guarded by a platform mutex rather than
+a VMutex, which would profile itself. It is constructed on first use, since mutexes
+may be locked during static initialization.
+*/
+struct VMutexContentionRegistry {
+    VMutexContentionRegistry() : mMutex(), mStats() { VMutex::mutexInit(&mMutex); }
+
+    VMutex_Type                 mMutex;
+    VMutexContentionStatsMap    mStats;
+};
+
+static VMutexContentionRegistry& _getContentionRegistry() {
+    static VMutexContentionRegistry gRegistry;
+    return gRegistry;
+}
+
+// True while this thread is inside the registry. A lock attempted from there (say, by an
+// allocator that uses a VMutex) is not profiled, since that would re-enter the registry.
+static V_THREAD_LOCAL bool gInContentionRegistry = false;
+// The stripe index for this thread, plus one so that zero means not yet assigned.
+static V_THREAD_LOCAL int gContentionStripe = 0;
+static std::atomic<int> gNextContentionStripe(0);
+// The key shared by mutexes whose own keys arrive once the registry is full.
+static const char* const kOtherContentionKey = "(other)";
+
+static Vs64 _getProfilingMicroseconds() {
+    // VInstant only resolves milliseconds, which is coarser than most lock waits.
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// static
+VMutexContentionStats* VMutexContentionStats::find(const VString& name) {
+    VMutexContentionRegistry& registry = _getContentionRegistry();
+    VMutexContentionStats* stats = NULL;
+
+    gInContentionRegistry = true;
+    VMutex::mutexLock(&registry.mMutex);
+
+    try {
+        VString key = name;
+        VMutexContentionStatsMap::iterator position = registry.mStats.find(key);
+        if ((position == registry.mStats.end()) && (static_cast<int>(registry.mStats.size()) >= VMutex::kMaxContentionProfilingKeys)) {
+            key = kOtherContentionKey;
+            position = registry.mStats.find(key);
+        }
+
+        if (position == registry.mStats.end()) {
+            stats = new VMutexContentionStats();
+            stats->_reset();
+            registry.mStats[key] = stats;
+        } else {
+            stats = (*position).second;
+        }
+    } catch (...) {} // leave stats NULL; the caller just doesn't profile this lock
+
+    VMutex::mutexUnlock(&registry.mMutex);
+    gInContentionRegistry = false;
+
+    return stats;
+}
+
+// static
+void VMutexContentionStats::getAllInfo(VBentoNode& bento) {
+    VMutexContentionRegistry& registry = _getContentionRegistry();
+
+    gInContentionRegistry = true;
+    VMutex::mutexLock(&registry.mMutex);
+
+    try {
+        for (VMutexContentionStatsMap::const_iterator i = registry.mStats.begin(); i != registry.mStats.end(); ++i) {
+            VBentoNode* child = bento.addNewChildNode("mutex");
+            child->addString("name", (*i).first.isEmpty() ? VString("(unnamed)") : (*i).first);
+            (*i).second->_getInfo(*child);
+        }
+    } catch (...) {
+        VMutex::mutexUnlock(&registry.mMutex);
+        gInContentionRegistry = false;
+        throw;
+    }
+
+    VMutex::mutexUnlock(&registry.mMutex);
+    gInContentionRegistry = false;
+}
+
+// static
+void VMutexContentionStats::resetAll() {
+    VMutexContentionRegistry& registry = _getContentionRegistry();
+
+    gInContentionRegistry = true;
+    VMutex::mutexLock(&registry.mMutex);
+
+    for (VMutexContentionStatsMap::const_iterator i = registry.mStats.begin(); i != registry.mStats.end(); ++i) {
+        (*i).second->_reset();
+    }
+
+    VMutex::mutexUnlock(&registry.mMutex);
+    gInContentionRegistry = false;
+}
+
+void VMutexContentionStats::recordAcquisition(bool contended, Vs64 waitMicroseconds) {
+    Stripe& stripe = _getStripe(this);
+    stripe.mAcquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    if (contended) {
+        stripe.mContended.fetch_add(1, std::memory_order_relaxed);
+        stripe.mWaitMicroseconds.fetch_add(waitMicroseconds, std::memory_order_relaxed);
+    }
+
+    stripe.mWaitHistogram[_getBucket(waitMicroseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void VMutexContentionStats::recordHold(Vs64 holdMicroseconds) {
+    Stripe& stripe = _getStripe(this);
+    stripe.mHoldMicroseconds.fetch_add(holdMicroseconds, std::memory_order_relaxed);
+    stripe.mHoldHistogram[_getBucket(holdMicroseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+// static
+int VMutexContentionStats::_getBucket(Vs64 microseconds) {
+    int bucket = 0;
+    while ((microseconds > 0) && (bucket < kNumHistogramBuckets - 1)) {
+        microseconds >>= 1;
+        ++bucket;
+    }
+
+    return bucket;
+}
 
-VMutex::VMutex(const VString& name, bool suppressLogging)
+// static
+VMutexContentionStats::Stripe& VMutexContentionStats::_getStripe(VMutexContentionStats* stats) {
+    if (gContentionStripe == 0) {
+        gContentionStripe = 1 + (gNextContentionStripe.fetch_add(1, std::memory_order_relaxed) % kNumStripes);
+    }
+
+    return stats->mStripes[gContentionStripe - 1];
+}
+
+// static
+Vs64 VMutexContentionStats::_sum(const std::atomic<Vs64> Stripe::* counter, const Stripe* stripes) {
+    Vs64 total = 0;
+    for (int i = 0; i < kNumStripes; ++i) {
+        total += (stripes[i].*counter).load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void VMutexContentionStats::_getInfo(VBentoNode& bento) const {
+    bento.addS64("acquisitions", _sum(&Stripe::mAcquisitions, mStripes));
+    bento.addS64("contended", _sum(&Stripe::mContended, mStripes));
+    bento.addS64("waitMicroseconds", _sum(&Stripe::mWaitMicroseconds, mStripes));
+    bento.addS64("holdMicroseconds", _sum(&Stripe::mHoldMicroseconds, mStripes));
+
+    Vs64Array waitHistogram(kNumHistogramBuckets, 0);
+    Vs64Array holdHistogram(kNumHistogramBuckets, 0);
+    for (int i = 0; i < kNumStripes; ++i) {
+        for (int bucket = 0; bucket < kNumHistogramBuckets; ++bucket) {
+            waitHistogram[bucket] += mStripes[i].mWaitHistogram[bucket].load(std::memory_order_relaxed);
+            holdHistogram[bucket] += mStripes[i].mHoldHistogram[bucket].load(std::memory_order_relaxed);
+        }
+    }
+
+    bento.addS64Array("waitHistogram", waitHistogram);
+    bento.addS64Array("holdHistogram", holdHistogram);
+}
+
+void VMutexContentionStats::_reset() {
+    for (int i = 0; i < kNumStripes; ++i) {
+        mStripes[i].mAcquisitions.store(0, std::memory_order_relaxed);
+        mStripes[i].mContended.store(0, std::memory_order_relaxed);
+        mStripes[i].mWaitMicroseconds.store(0, std::memory_order_relaxed);
+        mStripes[i].mHoldMicroseconds.store(0, std::memory_order_relaxed);
+        for (int bucket = 0; bucket < kNumHistogramBuckets; ++bucket) {
+            mStripes[i].mWaitHistogram[bucket].store(0, std::memory_order_relaxed);
+            mStripes[i].mHoldHistogram[bucket].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+#endif /* VAULT_MUTEX_BARE_LOCKS */
+
+// VMutex ---------------------------------------------------------------------
+
+VMutex::VMutex(const VString& name, bool suppressLogging, const char* profilingKey)
     : mMutex()
     , mName(name)
     , mSuppressLogging(suppressLogging)
     , mLastLockThread((VThreadID_Type) - 1)
-    , mLastLockerName()
+    , mLastLockerName(NULL)
     , mLastLockTime(VInstant::NEVER_OCCURRED())
+    , mLastLockTimed(false)
+    , mProfilingKey(profilingKey)
+    , mContentionStats(NULL)
+    , mProfiledLockMicroseconds(0)
+    , mLastLockStats(NULL)
     , mIsLocked(false)
     {
 
@@ -36,70 +311,171 @@ VMutex::~VMutex() {
 
 void VMutex::setName(const VString& name) {
     mName = name;
+
+    if (mProfilingKey == NULL) {
+        // Looked up again under the new name on the next profiled lock. We don't lock the mutex
+        // to do this, since the caller may hold it; a lock in progress keeps the stats it found.
+        mContentionStats.store(NULL, std::memory_order_relaxed);
+    }
 }
 
 VMutex_Type* VMutex::getMutex() {
     return &mMutex;
 }
 
+// static
+void VMutex::setContentionProfilingEnabled(bool enabled) {
+#ifdef VAULT_MUTEX_BARE_LOCKS
+    if (enabled) {
+        VLOGGER_WARN("VMutex::setContentionProfilingEnabled: Contention profiling is not available with VAULT_MUTEX_BARE_LOCKS.");
+    }
+#else
+    gVMutexContentionProfilingEnabled.store(enabled, std::memory_order_relaxed);
+#endif
+}
+
+// static
+void VMutex::getMutexesInfo(VBentoNode& bento) {
+    bento.setName("mutexes");
+    bento.addBool("profiling", VMutex::isContentionProfilingEnabled());
+#ifndef VAULT_MUTEX_BARE_LOCKS
+    VMutexContentionStats::getAllInfo(bento);
+#endif
+}
+
+// static
+void VMutex::resetContentionInfo() {
+#ifndef VAULT_MUTEX_BARE_LOCKS
+    VMutexContentionStats::resetAll();
+#endif
+}
+
 bool VMutex::isLockedByCurrentThread() const {
+#ifdef VAULT_MUTEX_BARE_LOCKS
+    return false;
+#else
     return mIsLocked && (mLastLockThread == VThread::threadSelf());
+#endif
+}
+
+#ifdef VAULT_MUTEX_BARE_LOCKS
+
+void VMutex::_lock(const char* /*lockerName*/) {
+    if (! VMutex::mutexLock(&mMutex)) {
+        this->_throwLockFailure("lock");
+    }
 }
 
-void VMutex::_lock(const VString& lockerName) {
+void VMutex::_unlock() {
+    if (! VMutex::mutexUnlock(&mMutex)) {
+        this->_throwLockFailure("unlock");
+    }
+}
+
+#else /* VAULT_MUTEX_BARE_LOCKS */
+
+void VMutex::_lock(const char* lockerName) {
 #ifdef VAULT_MUTEX_LOCK_DELAY_CHECK
-    VInstant start;
+    const bool timed = (gVMutexLockDelayLoggingThreshold >= VDuration::ZERO()) && ! mSuppressLogging && _shouldTimeLock();
+    VInstant start = timed ? VInstant(/*now*/) : VInstant::NEVER_OCCURRED();
 #endif
-    if (VMutex::mutexLock(&mMutex)) {
-        mLastLockTime.setNow();
+    VMutexContentionStats* profiledStats = NULL;
+    if (VMutex::isContentionProfilingEnabled() && ! gInContentionRegistry) {
+        profiledStats = this->_lockProfiled();
+    } else if (! VMutex::mutexLock(&mMutex)) {
+        this->_throwLockFailure("lock");
+    }
 
 #ifdef VAULT_MUTEX_LOCK_DELAY_CHECK
-        if ((gVMutexLockDelayLoggingThreshold >= VDuration::ZERO()) && ! mSuppressLogging) {
-            VInstant end;
-            VDuration waitTime = end - start;
-
-            if (waitTime >= gVMutexLockDelayLoggingThreshold) {
-                VLOGGER_LEVEL(gVMutexLockDelayLoggingLevel, VSTRING_FORMAT("Delay: '%s' was blocked " VSTRING_FORMATTER_S64 "ms on mutex '%s' released by '%s'.",
-                                                                           lockerName.chars(), waitTime.getDurationMilliseconds(), mName.chars(), mLastLockerName.chars()));
-            }
+    if (timed) {
+        mLastLockTime.setNow();
+        VDuration waitTime = mLastLockTime - start;
+
+        if (waitTime >= gVMutexLockDelayLoggingThreshold) {
+            VLOGGER_LEVEL(gVMutexLockDelayLoggingLevel, VSTRING_FORMAT("Delay: '%s' was blocked " VSTRING_FORMATTER_S64 "ms on mutex '%s' released by '%s'.",
+                                                                       (lockerName == NULL ? "" : lockerName), waitTime.getDurationMilliseconds(), mName.chars(), (mLastLockerName == NULL ? "" : mLastLockerName)));
         }
+    }
+
+    mLastLockTimed = timed;
 #endif
 
-        // Note: These properties are only valid with the understanding that they are not set atomically during lock/unlock.
-        // The only guarantee is that they end up set to their new values after the lock is acquired above, and before we return.
-        // They may only be used for mutex diagnostics (e.g. isLockedByCurrentThread() and lock delay reporting), not for concurrency control.
-        mLastLockThread = VThread::threadSelf();
-        mLastLockerName = lockerName;
-        mIsLocked = true;
+    // Note: These properties are only valid with the understanding that they are not set atomically during lock/unlock.
+    // The only guarantee is that they end up set to their new values after the lock is acquired above, and before we return.
+    // They may only be used for mutex diagnostics (e.g. isLockedByCurrentThread() and lock delay reporting), not for concurrency control.
+    mLastLockThread = VThread::threadSelf();
+    mLastLockerName = lockerName;
+    mLastLockStats = profiledStats;
+    mIsLocked = true;
+}
+
+VMutexContentionStats* VMutex::_lockProfiled() {
+    bool contended = false;
+    Vs64 waitMicroseconds = 0;
+
+    if (VMutex::mutexTryLock(&mMutex)) {
+        mProfiledLockMicroseconds = _getProfilingMicroseconds();
     } else {
-        if (mName.isEmpty()) {
-            throw VStackTraceException("VMutex::lock unable to lock mutex.");
-        } else {
-            throw VStackTraceException(VSTRING_FORMAT("VMutex::lock unable to lock mutex '%s'.", mName.chars()));
+        contended = true;
+        Vs64 start = _getProfilingMicroseconds();
+        if (! VMutex::mutexLock(&mMutex)) {
+            this->_throwLockFailure("lock");
         }
+
+        mProfiledLockMicroseconds = _getProfilingMicroseconds();
+        waitMicroseconds = mProfiledLockMicroseconds - start;
     }
+
+    // setName() may clear the cached stats at any time, so we load them once and record both
+    // the acquisition and (via mLastLockStats) the hold on what we loaded. Taking the registry's
+    // mutex here is safe: it is a leaf, since nothing is profiled while in the registry.
+    VMutexContentionStats* stats = mContentionStats.load(std::memory_order_relaxed);
+    if (stats == NULL) {
+        stats = VMutexContentionStats::find((mProfilingKey == NULL) ? mName : VString(mProfilingKey));
+        if (stats == NULL) {
+            return NULL;
+        }
+
+        mContentionStats.store(stats, std::memory_order_relaxed);
+    }
+
+    stats->recordAcquisition(contended, waitMicroseconds);
+    return stats;
 }
 
 void VMutex::_unlock() {
 #ifdef VAULT_MUTEX_LOCK_DELAY_CHECK
-    if ((gVMutexLockDelayLoggingThreshold >= VDuration::ZERO()) && ! mSuppressLogging) {
+    if (mLastLockTimed) {
+        mLastLockTimed = false;
+
         VInstant now;
         VDuration delay = now - mLastLockTime;
         if (delay >= gVMutexLockDelayLoggingThreshold) {
             VLOGGER_LEVEL(gVMutexLockDelayLoggingLevel, VSTRING_FORMAT("Delay: '%s' is unlocking mutex '%s' after holding it for " VSTRING_FORMATTER_S64 "ms.",
-                                                                       mLastLockerName.chars(), mName.chars(), delay.getDurationMilliseconds()));
+                                                                       (mLastLockerName == NULL ? "" : mLastLockerName), mName.chars(), delay.getDurationMilliseconds()));
         }
     }
 #endif
 
+    if (mLastLockStats != NULL) {
+        VMutexContentionStats* stats = mLastLockStats;
+        mLastLockStats = NULL;
+        stats->recordHold(_getProfilingMicroseconds() - mProfiledLockMicroseconds);
+    }
+
     mIsLocked = false; // Note: Must set false *before* unlocking, otherwise we may set it false after another thread jumps in, locks, sets it true, confusing isLockedByCurrentThread(). Part of non-atomicity warning above.
     if (! VMutex::mutexUnlock(&mMutex)) {
         mIsLocked = true; // Restore value since we failed to unlock.
-        if (mName.isEmpty()) {
-            throw VStackTraceException("VMutex::unlock unable to unlock mutex.");
-        } else {
-            throw VStackTraceException(VSTRING_FORMAT("VMutex::unlock unable to unlock mutex '%s'.", mName.chars()));
-        }
+        this->_throwLockFailure("unlock");
     }
 }
 
+#endif /* VAULT_MUTEX_BARE_LOCKS */
+
+void VMutex::_throwLockFailure(const char* operation) const {
+    if (mName.isEmpty()) {
+        throw VStackTraceException(VSTRING_FORMAT("VMutex::%s unable to %s mutex.", operation, operation));
+    } else {
+        throw VStackTraceException(VSTRING_FORMAT("VMutex::%s unable to %s mutex '%s'.", operation, operation, mName.chars()));
+    }
+}
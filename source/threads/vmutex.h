@@ -16,6 +16,11 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vstring.h"
 #include "vinstant.h"
 
+#include <atomic>
+
+class VBentoNode;
+class VMutexContentionStats;
+
 /**
     @ingroup vthread
 */
@@ -25,6 +30,14 @@ VMutex implements a platform-independent mutex that you can embed in an
 object or place on the stack to guarantee its cleanup when the VMutex object
 is destructed.
 
+Lock diagnostics are designed to cost nothing beyond the OS lock in the normal
+case: the locker name is a const char* (normally a string literal) that is
+stored, not copied, and no clock is read. Lock delay checking (compiled in with
+VAULT_MUTEX_LOCK_DELAY_CHECK) only times a sample of locks; see
+setLockTimingSampleInterval(). Compiling with VAULT_MUTEX_BARE_LOCKS removes
+even the bookkeeping, so that locking and unlocking are exactly the OS calls;
+in that configuration isLockedByCurrentThread() is not supported.
+
 You can call the lock() and unlock() methods to acquire and release
 the mutex lock. However, it is recommended that you use the
 helper class VMutexLocker to do this, because you can use VMutexLocker
@@ -44,8 +57,13 @@ class VMutex {
         @param suppressLogging  if this mutex is specifically locked during logging, this flag
                 must be set so that VMutex doesn't try to log information
                 about this mutex (avoids recursive locking deadlock)
+        @param profilingKey     the name under which contention profiling aggregates this mutex,
+                or NULL to use the mutex name; give a per-instance name (one that includes
+                a session or thread name) a class-level key such as "VClientSession::mMutex",
+                so that all instances share one set of counters; only the pointer is kept,
+                so it should be a string literal
         */
-        VMutex(const VString& name = VString::EMPTY(), bool suppressLogging = false);
+        VMutex(const VString& name = VString::EMPTY(), bool suppressLogging = false, const char* profilingKey = NULL);
         /**
         Destructs the mutex.
         */
@@ -54,7 +72,9 @@ class VMutex {
         /**
         In some cases it's more convenient to name a mutex after constructing,
         in which case you can call setName(). The name is only used for
-        diagnostic purposes when debugging mutex and lock behavior.
+        diagnostic purposes when debugging mutex and lock behavior. If the mutex
+        has no profiling key, the mutex's contention counters are looked up again
+        under the new name. It may be called whether or not the caller holds the mutex.
         @param name     a name for the mutex; should be unique to avoid confusion
         */
         void setName(const VString& name);
@@ -75,6 +95,8 @@ class VMutex {
         this call, but in a way that still allows this test to work.
         Note that you can't test whether a mutex is locked or unlocked in
         general because the answer is obsolete on return.
+        If compiled with VAULT_MUTEX_BARE_LOCKS, the lock state is not
+        tracked and this always returns false.
         @return true if the mutex was locked on the current thread
         */
         bool isLockedByCurrentThread() const;
@@ -107,6 +129,13 @@ class VMutex {
         */
         static bool mutexLock(VMutex_Type* mutex);
 
+        /**
+        Locks the platform mutex value if it is not locked, without waiting.
+        Wrapper on Unix for pthread_mutex_trylock.
+        @return true if the lock was acquired; false if it is held elsewhere
+        */
+        static bool mutexTryLock(VMutex_Type* mutex);
+
         /**
         Unlocks the platform mutex value.
         Wrapper on Unix for pthread_mutex_unlock.
@@ -119,13 +148,49 @@ class VMutex {
         a log message if there is a lengthy holding of, or delay in acquiring
         a lock. First, you must compile with VAULT_MUTEX_LOCK_DELAY_CHECK
         defined (presumably in vconfigure.h) to have the delay checking code in place.
-        The default delay threshold is 50ms. If you specify 0, every lock will log a message.
+        The default delay threshold is 100ms. If you specify 0, every timed lock will log a message.
         You can set the log leve at which the output will be emitted.
+        Timing a lock costs two clock reads, so only one in every N locks on each thread
+        is timed, where N is the sample interval: the default of 64 keeps the clock off
+        nearly every uncontended lock, 1 times every lock, and 0 turns timing off at runtime.
         */
         static void setLockDelayLoggingThreshold(const VDuration& threshold)    { gVMutexLockDelayLoggingThreshold = threshold; }
         static VDuration getLockDelayLoggingThreshold()                         { return gVMutexLockDelayLoggingThreshold; }
         static void setLockDelayLoggingLevel(int logLevel)                      { gVMutexLockDelayLoggingLevel = logLevel; }
         static int getLockDelayLoggingLevel()                                   { return gVMutexLockDelayLoggingLevel; }
+        static void setLockTimingSampleInterval(int interval)                   { gVMutexLockTimingSampleInterval = interval; }
+        static int getLockTimingSampleInterval()                                { return gVMutexLockTimingSampleInterval; }
+
+        /**
+        Turns mutex contention profiling on or off. While it is on, every lock
+        records, aggregated by profiling key (the mutex name unless the constructor
+        was given a key): the number of acquisitions, how many
+        of them found the mutex already held, the total time spent waiting and
+        holding, and histograms of wait and hold times in power-of-two
+        microsecond buckets. The counters are spread over per-thread stripes of
+        atomics, so recording takes no lock and threads rarely share a cache
+        line. While it is off, a lock costs one extra flag test. Profiling is
+        not available when compiled with VAULT_MUTEX_BARE_LOCKS. At most
+        kMaxContentionProfilingKeys keys are tracked separately; mutexes with keys
+        first seen after that are aggregated under "(other)".
+        @param  enabled true to start profiling; false to stop (counts are kept)
+        */
+        static void setContentionProfilingEnabled(bool enabled);
+        static bool isContentionProfilingEnabled() { return gVMutexContentionProfilingEnabled.load(std::memory_order_relaxed); }
+        /**
+        Adds a child node for each profiled mutex name to the supplied bento node,
+        with the counters and histograms described in setContentionProfilingEnabled().
+        This is the mutex counterpart of VThread::getThreadsInfo(), for use by
+        management interfaces.
+        @param  bento   the node to fill in
+        */
+        static void getMutexesInfo(VBentoNode& bento);
+        /**
+        Zeroes all contention profiling counters.
+        */
+        static void resetContentionInfo();
+
+        static const int kMaxContentionProfilingKeys = 1024; ///< The most profiling keys given their own counters.
 
     private:
 
@@ -142,27 +207,45 @@ class VMutex {
         thread, this call blocks until the mutex lock can be acquired (if
         several threads are competing, the order in which they acquire the
         mutex is not known). You can supply a name to identify who is attempting
-        to lock, for diagnostic purposes (the name is stored).
-        @param lockerName the name of the caller, for diagnostic purposes
+        to lock, for diagnostic purposes. Only the pointer is stored, so the name
+        must remain valid while the lock is held; normally it is a string literal.
+        @param lockerName the name of the caller, for diagnostic purposes, or NULL
         */
-        void _lock(const VString& lockerName = VString::EMPTY());
+        void _lock(const char* lockerName = NULL);
         /**
         Releases the mutex lock; if one or more other threads is waiting on
         the mutex, one of them will unblock and acquire the mutex lock once
         this thread releases it.
         */
         void _unlock();
+        /**
+        Throws the exception for a failed OS lock or unlock call.
+        @param operation    "lock" or "unlock"
+        */
+        void _throwLockFailure(const char* operation) const;
+        /**
+        Acquires the lock while contention profiling is on, recording the acquisition.
+        @return the counters the acquisition was recorded on, on which the hold is recorded at unlock; NULL if none
+        */
+        VMutexContentionStats* _lockProfiled();
 
         VMutex_Type             mMutex;             ///< The OS mutex handle.
         VString                 mName;              ///< The name of this mutex for diagnostic purposes.
         bool                    mSuppressLogging;   ///< True if this VMutex must not call logger functions.
         volatile VThreadID_Type mLastLockThread;    ///< If locked, the thread that acquired the lock.
-        VString                 mLastLockerName;    ///< The name of the last (or current) caller of lock().
-        VInstant                mLastLockTime;      ///< When the last acquisition of the lock occurred.
+        const char*             mLastLockerName;    ///< The name of the last (or current) caller of lock(), or NULL; not owned.
+        VInstant                mLastLockTime;      ///< When the current lock was acquired, if mLastLockTimed.
+        bool                    mLastLockTimed;     ///< True if the current lock was sampled for timing.
+        const char*             mProfilingKey;      ///< The key our contention is profiled under, or NULL to use mName; not owned.
+        std::atomic<VMutexContentionStats*> mContentionStats; ///< The profiling counters for our key, found on the first profiled lock; cleared by setName() without locking.
+        Vs64                    mProfiledLockMicroseconds; ///< When the current lock was acquired, if mLastLockStats is set.
+        VMutexContentionStats*  mLastLockStats;     ///< If the current lock was acquired with contention profiling on, the counters to record its hold on; else NULL.
         volatile bool           mIsLocked;          ///< For use only by isLockedByCurrentThread(); value may change concurrently.
 
         static VDuration gVMutexLockDelayLoggingThreshold;  ///< If >=0, lock delays are logged.
         static int gVMutexLockDelayLoggingLevel;            ///< Log level at which lock delays are logged.
+        static int gVMutexLockTimingSampleInterval;         ///< Time one in this many locks per thread; 0 means none.
+        static std::atomic<bool> gVMutexContentionProfilingEnabled; ///< True while contention profiling is on.
 };
 
 #endif /* vmutex_h */
@@ -14,7 +14,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 // VMutexLocker ----------------------------------------------------------------
 
-VMutexLocker::VMutexLocker(VMutex* mutex, const VString& name, bool lockInitially)
+VMutexLocker::VMutexLocker(VMutex* mutex, const char* name, bool lockInitially)
     : mMutex(mutex)
     , mIsLocked(false)
     , mName(name)
@@ -76,10 +76,17 @@ class VMutexLocker {
         pointer to be passed to a routine that needs to lock it if supplied.
 
         @param    mutex            the VMutex to lock, or NULL if no action is wanted
-        @param    name             the mutex locker name; calling object/function name is a useful string
+        @param    name             the mutex locker name; calling object/function name is a useful string;
+                                   only the pointer is kept, so it should be a string literal (it must
+                                   remain valid until the locker is destructed)
         @param    lockInitially    true if the lock should be acquired on construction
         */
-        VMutexLocker(VMutex* mutex, const VString& name, bool lockInitially = true);
+        VMutexLocker(VMutex* mutex, const char* name, bool lockInitially = true);
+        /**
+        Deleted: a VString would convert to a const char* that dangles once a temporary
+        string is destroyed, and only the pointer is kept. Pass a string literal.
+        */
+        VMutexLocker(VMutex* mutex, const VString& name, bool lockInitially = true) = delete;
         /**
         Destructor, unlocks the mutex if this object has acquired it.
         */
@@ -120,7 +127,7 @@ class VMutexLocker {
 
         VMutex* mMutex;     ///< Pointer to the VMutex object, or NULL.
         bool    mIsLocked;  ///< True if this object has acquired the lock.
-        VString mName;      ///< The name of this locker, for diagnostic purposes.
+        const char* mName;  ///< The name of this locker, for diagnostic purposes; not owned.
 
     private:
 
@@ -0,0 +1,132 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vreadwritelock.h"
+
+#include "vexception.h"
+
+// VReadWriteLock --------------------------------------------------------------
+
+VReadWriteLock::VReadWriteLock(const VString& name, Policy policy)
+    : mLock()
+    , mName(name)
+    , mPolicy(policy)
+    {
+
+    if (! VReadWriteLock::rwlockInit(&mLock, policy == kPreferWriters))
+        throw VStackTraceException(VSTRING_FORMAT("VReadWriteLock::VReadWriteLock unable to initialize lock '%s'.", name.chars()));
+}
+
+VReadWriteLock::~VReadWriteLock() {
+    VReadWriteLock::rwlockDestroy(&mLock);
+}
+
+void VReadWriteLock::_readLock(const char* lockerName) {
+    if (! VReadWriteLock::rwlockReadLock(&mLock)) {
+        this->_throwLockFailure("_readLock", lockerName);
+    }
+}
+
+void VReadWriteLock::_readUnlock(const char* lockerName) {
+    if (! VReadWriteLock::rwlockReadUnlock(&mLock)) {
+        this->_throwLockFailure("_readUnlock", lockerName);
+    }
+}
+
+void VReadWriteLock::_writeLock(const char* lockerName) {
+    if (! VReadWriteLock::rwlockWriteLock(&mLock)) {
+        this->_throwLockFailure("_writeLock", lockerName);
+    }
+}
+
+void VReadWriteLock::_writeUnlock(const char* lockerName) {
+    if (! VReadWriteLock::rwlockWriteUnlock(&mLock)) {
+        this->_throwLockFailure("_writeUnlock", lockerName);
+    }
+}
+
+void VReadWriteLock::_throwLockFailure(const char* operation, const char* lockerName) const {
+    throw VStackTraceException(VSTRING_FORMAT("VReadWriteLock::%s failed on lock '%s' for '%s'.", operation, mName.chars(), (lockerName == NULL ? "" : lockerName)));
+}
+
+// VReadLocker -----------------------------------------------------------------
+
+VReadLocker::VReadLocker(VReadWriteLock* rwlock, const char* name, bool lockInitially)
+    : mLock(rwlock)
+    , mIsLocked(false)
+    , mName(name)
+    {
+
+    if (lockInitially) {
+        this->lock();
+    }
+}
+
+VReadLocker::~VReadLocker() {
+    if (this->isLocked()) {
+        // Prevent all exceptions from escaping destructor.
+        try {
+            this->unlock();
+        } catch (...) {}
+    }
+
+    mLock = NULL;
+}
+
+void VReadLocker::lock() {
+    if ((mLock != NULL) && ! this->isLocked()) {
+        mLock->_readLock(mName); // specific friend access to private API
+        mIsLocked = true;
+    }
+}
+
+void VReadLocker::unlock() {
+    if ((mLock != NULL) && this->isLocked()) {
+        mLock->_readUnlock(mName); // specific friend access to private API
+        mIsLocked = false;
+    }
+}
+
+// VWriteLocker ----------------------------------------------------------------
+
+VWriteLocker::VWriteLocker(VReadWriteLock* rwlock, const char* name, bool lockInitially)
+    : mLock(rwlock)
+    , mIsLocked(false)
+    , mName(name)
+    {
+
+    if (lockInitially) {
+        this->lock();
+    }
+}
+
+VWriteLocker::~VWriteLocker() {
+    if (this->isLocked()) {
+        // Prevent all exceptions from escaping destructor.
+        try {
+            this->unlock();
+        } catch (...) {}
+    }
+
+    mLock = NULL;
+}
+
+void VWriteLocker::lock() {
+    if ((mLock != NULL) && ! this->isLocked()) {
+        mLock->_writeLock(mName); // specific friend access to private API
+        mIsLocked = true;
+    }
+}
+
+void VWriteLocker::unlock() {
+    if ((mLock != NULL) && this->isLocked()) {
+        mLock->_writeUnlock(mName); // specific friend access to private API
+        mIsLocked = false;
+    }
+}
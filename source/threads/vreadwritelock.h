@@ -0,0 +1,250 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vreadwritelock_h
+#define vreadwritelock_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include "vthread_platform.h"
+#include "vstring.h"
+
+/**
+    @ingroup vthread
+*/
+
+// VReadWriteLock --------------------------------------------------------------
+
+/**
+VReadWriteLock is a lock that any number of readers may hold at once, or one
+writer may hold alone. It suits data that is read far more often than it is
+changed, such as a registry that is searched on every use but only updated at
+configuration time: with a VMutex the readers would needlessly wait on each
+other.
+
+As with VMutex, you do not lock and unlock it directly; use a VReadLocker or a
+VWriteLocker so that the lock is released even when an exception is thrown.
+
+The lock is not recursive. A thread that holds a read lock must not acquire the
+lock again, for read or for write: if a writer is waiting in between, a
+writer-preferring lock will deadlock.
+
+The lock policy determines who goes first when readers hold the lock and a writer
+is waiting. With kPreferWriters, new readers wait behind the writer, so a steady
+stream of readers cannot starve writers. With kPlatformDefault, the platform
+decides; on Linux that lets new readers in ahead of the writer. The policy is
+honored as far as the platform allows: some platforms prefer writers regardless,
+and on Windows the slim reader/writer lock makes no ordering promise either way.
+
+@see    VReadLocker
+@see    VWriteLocker
+*/
+class VReadWriteLock {
+    public:
+
+        /**
+        Who acquires the lock first when a writer is waiting and readers hold it.
+        */
+        enum Policy {
+            kPlatformDefault,   ///< Whatever the platform does by default; may let new readers in ahead of a waiting writer.
+            kPreferWriters      ///< New readers wait behind a waiting writer.
+        };
+
+        /**
+        Constructs the lock.
+        @param  name    a name for the lock, for diagnostic purposes
+        @param  policy  whether waiting writers go ahead of new readers
+        */
+        VReadWriteLock(const VString& name, Policy policy = kPlatformDefault);
+        /**
+        Destructor, destroys the lock. It must not be held.
+        */
+        ~VReadWriteLock();
+
+        /**
+        Sets the lock's name, in case it could not be known at construction.
+        @param  name    a name for the lock, for diagnostic purposes
+        */
+        void setName(const VString& name) { mName = name; }
+        /**
+        Returns the lock's name.
+        */
+        const VString& getName() const { return mName; }
+        /**
+        Returns the policy the lock was constructed with.
+        */
+        Policy getPolicy() const { return mPolicy; }
+
+        /* PLATFORM-SPECIFIC STATIC FUNCTIONS --------------------------------
+        The remaining functions defined here are the low-level interfaces to
+        the platform-specific read-write lock APIs. These are implemented in each
+        platform-specific version of vthread_platform.cpp.
+        */
+
+        /**
+        Initializes the platform lock value.
+        Wrapper on Unix for pthread_rwlock_init.
+        @param  rwlock          pointer to the platform lock
+        @param  preferWriters   true to make new readers wait behind a waiting writer, where supported
+        @return true on success; false on failure
+        */
+        static bool rwlockInit(VReadWriteLock_Type* rwlock, bool preferWriters);
+        /**
+        Destroys the platform lock value.
+        Wrapper on Unix for pthread_rwlock_destroy.
+        */
+        static void rwlockDestroy(VReadWriteLock_Type* rwlock);
+        /**
+        Acquires the platform lock for reading.
+        Wrapper on Unix for pthread_rwlock_rdlock.
+        @return true on success; false on failure
+        */
+        static bool rwlockReadLock(VReadWriteLock_Type* rwlock);
+        /**
+        Releases the platform lock after reading.
+        Wrapper on Unix for pthread_rwlock_unlock.
+        @return true on success; false on failure
+        */
+        static bool rwlockReadUnlock(VReadWriteLock_Type* rwlock);
+        /**
+        Acquires the platform lock for writing.
+        Wrapper on Unix for pthread_rwlock_wrlock.
+        @return true on success; false on failure
+        */
+        static bool rwlockWriteLock(VReadWriteLock_Type* rwlock);
+        /**
+        Releases the platform lock after writing.
+        Wrapper on Unix for pthread_rwlock_unlock.
+        @return true on success; false on failure
+        */
+        static bool rwlockWriteUnlock(VReadWriteLock_Type* rwlock);
+
+    private:
+
+        VReadWriteLock(const VReadWriteLock&); // not copyable
+        VReadWriteLock& operator=(const VReadWriteLock&); // not assignable
+
+        // The lock and unlock functions are only accessible to the locker classes.
+        friend class VReadLocker;
+        friend class VWriteLocker;
+
+        // Each takes the locker's name, for the exception thrown if the platform call fails.
+        void _readLock(const char* lockerName);
+        void _readUnlock(const char* lockerName);
+        void _writeLock(const char* lockerName);
+        void _writeUnlock(const char* lockerName);
+        void _throwLockFailure(const char* operation, const char* lockerName) const;
+
+        VReadWriteLock_Type mLock;      ///< The OS lock.
+        VString             mName;      ///< The name of this lock for diagnostic purposes.
+        Policy              mPolicy;    ///< The policy the lock was constructed with.
+};
+
+// VReadLocker -----------------------------------------------------------------
+
+/**
+VReadLocker holds a VReadWriteLock for reading, in the same way that a
+VMutexLocker holds a VMutex: it acquires the lock on construction (unless told
+not to) and releases it on destruction if it holds it.
+*/
+class VReadLocker {
+    public:
+
+        /**
+        Constructs the locker, and if specified, acquires the lock for reading,
+        waiting while a writer holds it.
+        @param    rwlock        the lock to acquire, or NULL if no action is wanted
+        @param    name          the locker name, for diagnostic purposes; only the pointer
+                                is kept, so it should be a string literal
+        @param    lockInitially true if the lock should be acquired on construction
+        */
+        VReadLocker(VReadWriteLock* rwlock, const char* name, bool lockInitially = true);
+        /**
+        Deleted for the same reason as the VMutexLocker one: only the name pointer is kept.
+        */
+        VReadLocker(VReadWriteLock* rwlock, const VString& name, bool lockInitially = true) = delete;
+        /**
+        Destructor, releases the lock if this object has acquired it.
+        */
+        ~VReadLocker();
+
+        /**
+        Acquires the lock for reading.
+        */
+        void lock();
+        /**
+        Releases the lock.
+        */
+        void unlock();
+        /**
+        Returns true if this object has acquired the lock.
+        */
+        bool isLocked() const { return mIsLocked; }
+
+    private:
+
+        VReadLocker(const VReadLocker&); // not copyable
+        VReadLocker& operator=(const VReadLocker&); // not assignable
+
+        VReadWriteLock* mLock;      ///< The lock, or NULL.
+        bool            mIsLocked;  ///< True if this object has acquired the lock.
+        const char*     mName;      ///< The name of this locker, for diagnostic purposes; not owned.
+};
+
+// VWriteLocker ----------------------------------------------------------------
+
+/**
+VWriteLocker holds a VReadWriteLock for writing, excluding all readers and
+other writers, in the same way that a VMutexLocker holds a VMutex.
+*/
+class VWriteLocker {
+    public:
+
+        /**
+        Constructs the locker, and if specified, acquires the lock for writing,
+        waiting while any reader or another writer holds it.
+        @param    rwlock        the lock to acquire, or NULL if no action is wanted
+        @param    name          the locker name, for diagnostic purposes; only the pointer
+                                is kept, so it should be a string literal
+        @param    lockInitially true if the lock should be acquired on construction
+        */
+        VWriteLocker(VReadWriteLock* rwlock, const char* name, bool lockInitially = true);
+        /**
+        Deleted for the same reason as the VMutexLocker one: only the name pointer is kept.
+        */
+        VWriteLocker(VReadWriteLock* rwlock, const VString& name, bool lockInitially = true) = delete;
+        /**
+        Destructor, releases the lock if this object has acquired it.
+        */
+        ~VWriteLocker();
+
+        /**
+        Acquires the lock for writing.
+        */
+        void lock();
+        /**
+        Releases the lock.
+        */
+        void unlock();
+        /**
+        Returns true if this object has acquired the lock.
+        */
+        bool isLocked() const { return mIsLocked; }
+
+    private:
+
+        VWriteLocker(const VWriteLocker&); // not copyable
+        VWriteLocker& operator=(const VWriteLocker&); // not assignable
+
+        VReadWriteLock* mLock;      ///< The lock, or NULL.
+        bool            mIsLocked;  ///< True if this object has acquired the lock.
+        const char*     mName;      ///< The name of this locker, for diagnostic purposes; not owned.
+};
+
+#endif /* vreadwritelock_h */
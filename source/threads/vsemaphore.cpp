@@ -11,6 +11,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vexception.h"
 #include "vmutex.h"
+#include "vmutexlocker.h"
 
 VSemaphore::VSemaphore()
     : mSemaphore()
@@ -37,3 +38,45 @@ void VSemaphore::signal() {
     }
 }
 
+// VCountingSemaphore ---------------------------------------------------------
+
+VCountingSemaphore::VCountingSemaphore(int initialCount)
+    : mMutex("VCountingSemaphore::mMutex", true/*suppress logging*/)
+    , mCondition()
+    , mCount(initialCount)
+    {
+}
+
+void VCountingSemaphore::acquire() {
+    VMutexLocker locker(&mMutex, "VCountingSemaphore::acquire()");
+    (void) mCondition.waitUntil(&mMutex, std::bind(&VCountingSemaphore::_hasPermit, this));
+    --mCount;
+}
+
+bool VCountingSemaphore::tryAcquire(const VDuration& timeout) {
+    VMutexLocker locker(&mMutex, "VCountingSemaphore::tryAcquire()");
+    if (! mCondition.waitFor(&mMutex, std::bind(&VCountingSemaphore::_hasPermit, this), timeout)) {
+        return false;
+    }
+
+    --mCount;
+    return true;
+}
+
+void VCountingSemaphore::release(int count) {
+    /* locker scope */ {
+        VMutexLocker locker(&mMutex, "VCountingSemaphore::release()");
+        mCount += count;
+    }
+
+    if (count == 1) {
+        mCondition.signal();
+    } else {
+        mCondition.broadcast(); // the waiters that find no permit left simply wait again
+    }
+}
+
+int VCountingSemaphore::getCount() const {
+    VMutexLocker locker(&mMutex, "VCountingSemaphore::getCount()");
+    return mCount;
+}
@@ -11,6 +11,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 /** @file */
 
 #include "vthread.h"
+#include "vconditionvariable.h"
 
 class VMutex;
 
@@ -112,5 +113,58 @@ class VSemaphore {
         VSemaphore_Type mSemaphore; ///< The OS semaphore handle.
 };
 
+// VCountingSemaphore ---------------------------------------------------------
+
+/**
+VCountingSemaphore is a classic counting semaphore: release() adds to a count of
+permits, and acquire() takes one, blocking while there are none. Unlike
+VSemaphore, it needs no mutex from the caller, and a release() with nobody
+waiting is not lost; the next acquire() takes it without blocking.
+*/
+class VCountingSemaphore {
+    public:
+
+        /**
+        Creates the semaphore.
+        @param  initialCount    the number of permits available at the start
+        */
+        VCountingSemaphore(int initialCount = 0);
+        /**
+        Destructs the semaphore. No thread may be waiting on it.
+        */
+        ~VCountingSemaphore() {}
+
+        /**
+        Takes a permit, waiting as long as necessary for one to be released.
+        */
+        void acquire();
+        /**
+        Takes a permit if one is available, waiting up to a timeout for one to be released.
+        @param  timeout the longest to wait; zero means do not wait at all
+        @return true if a permit was taken; false if the timeout elapsed first
+        */
+        bool tryAcquire(const VDuration& timeout = VDuration::ZERO());
+        /**
+        Releases permits, waking as many waiters as it can satisfy.
+        @param  count   the number of permits to release
+        */
+        void release(int count = 1);
+        /**
+        Returns the number of permits currently available.
+        */
+        int getCount() const;
+
+    private:
+
+        VCountingSemaphore(const VCountingSemaphore&); // not copyable
+        VCountingSemaphore& operator=(const VCountingSemaphore&); // not assignable
+
+        bool _hasPermit() const { return mCount > 0; } ///< The wait predicate. ASSUMES CALLER HOLDS mMutex.
+
+        mutable VMutex      mMutex;     ///< Guards mCount.
+        VConditionVariable  mCondition; ///< Signaled when permits are released.
+        int                 mCount;     ///< The number of permits available.
+};
+
 #endif /* vsemaphore_h */
 
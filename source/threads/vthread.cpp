@@ -14,27 +14,59 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vmanagementinterface.h"
 #include "vlogger.h"
 #include "vmutexlocker.h"
+#include "vreadwritelock.h"
 #include "vbento.h"
+#include "vsettings.h"
 
-// This private map allows us to keep track of all VThread objects, and therefore to
-// find the current thread's VThread object from the thread ID. We also have an API
-// to get info about all these threads.
+// This private map allows us to keep track of all VThread objects, so that we can
+// get info about all these threads, and find or stop one by its thread ID.
 typedef std::map<VThreadID_Type, VThread*> VThreadIDToVThreadMap;
 VThreadIDToVThreadMap gVThreadIDToVThreadMap;
-static VMutex gVThreadMapMutex("gVThreadMapMutex", true/*suppress logging because logging itself uses this*/);
+// Threads are added and removed at start and end, but looked up (for info, names, and stopping) far more often.
+static VReadWriteLock gVThreadMapLock("gVThreadMapLock", VReadWriteLock::kPreferWriters);
 
+// Each thread's own VThread object, so that finding the current thread (which the
+// logger does for every line that shows the thread name) needs neither the map nor
+// its mutex. It is NULL in threads that are not VThreads.
+static V_THREAD_LOCAL VThread* gCurrentVThread = NULL;
+
+// For threads that are not VThreads, the formatted OS thread ID, built on first use.
+static V_THREAD_LOCAL char gCurrentThreadIDName[32] = { 0 };
+
+// Called on the thread itself, by threadMain() or the VMainThread/VForeignThread constructor.
 static void _vthreadStarting(VThread* thread) {
-    VMutexLocker locker(&gVThreadMapMutex, "_vthreadStarting");
+    gCurrentVThread = thread;
+
+    VWriteLocker locker(&gVThreadMapLock, "_vthreadStarting");
     gVThreadIDToVThreadMap[thread->threadID()] = thread;
 }
 
 static void _vthreadEnded(VThread* thread) {
-    VMutexLocker locker(&gVThreadMapMutex, "_vthreadEnded");
+    if (gCurrentVThread == thread) {
+        gCurrentVThread = NULL;
+    }
+
+    VWriteLocker locker(&gVThreadMapLock, "_vthreadEnded");
     VThreadIDToVThreadMap::iterator position = gVThreadIDToVThreadMap.find(thread->threadID());
     if (position != gVThreadIDToVThreadMap.end())
         gVThreadIDToVThreadMap.erase(position);
 }
 
+// The rules set by VThread::configurePlacement(). Each thread without an explicit
+// placement looks them up once, as it starts.
+struct VThreadPlacementRule {
+    VThreadPlacementRule() : mNamePrefix(), mPlacement(), mSpread(false), mNextSpreadIndex(0) {}
+
+    VString             mNamePrefix;        ///< Threads whose names start with this match the rule.
+    VThreadPlacement    mPlacement;         ///< The placement to give matching threads.
+    bool                mSpread;            ///< True to pin each matching thread to one CPU, in turn.
+    size_t              mNextSpreadIndex;   ///< Which of the candidate CPUs the next matching thread gets, if spreading.
+};
+
+typedef std::vector<VThreadPlacementRule> VThreadPlacementRuleVector;
+static VThreadPlacementRuleVector gVThreadPlacementRules;
+static VMutex gVThreadPlacementRulesMutex("gVThreadPlacementRulesMutex", true/*suppress logging*/);
+
 /**
 VStandinThread is a special VThread object we simply declare as gStandinThread (but never execute) and reference
 if we need to return a reference to the current thread but it's not one of our threads.
@@ -49,13 +81,11 @@ class VStandinThread : public VThread {
 static VStandinThread gStandinThread;
 
 static VThread* _getCurrentVThread() {
-    VThreadID_Type currentThreadID = VThread::threadSelf();
-    VMutexLocker locker(&gVThreadMapMutex, "_getCurrentVThread");
-    VThreadIDToVThreadMap::const_iterator position = gVThreadIDToVThreadMap.find(currentThreadID);
-    if (position == gVThreadIDToVThreadMap.end())
+    VThread* currentThread = gCurrentVThread;
+    if (currentThread == NULL)
         return &gStandinThread; // If called from main thread, or non-VThread-derived thread, we won't find a VThread. This allows us to return something workable to any caller.
 
-    return (*position).second;
+    return currentThread;
     // Note: once we return, the thread could stop.
     // But since this is called from the current thread, it really can't disappear while caller lives.
     // It just can't be passed around to other threads!
@@ -70,6 +100,9 @@ VThread::VThread(const VString& name, const VString& loggerName, bool deleteAtEn
     , mManager(manager)
     , mThreadID((VThreadID_Type) - 1)
     , mIsRunning(false)
+    , mPlacement()
+    , mPlacementRule()
+    , mPlacementApplied(false)
     {
 }
 
@@ -147,6 +180,7 @@ void* VThread::threadMain(void* arg) {
 
     try {
         VAutoreleasePool pool;
+        thread->_applyPlacement();
         _vthreadStarting(thread);
         VThread::_threadStarting(thread);
 
@@ -182,6 +216,8 @@ void* VThread::threadMain(void* arg) {
 
     VLOGGER_NAMED_TRACE(threadLoggerName, VSTRING_FORMAT("VThread::threadMain: completed thread '%s'.", threadName.chars()));
 
+    VStringScratchScope::releaseThreadArena(); // nothing formats on this thread after here
+
     return NULL;
 }
 
@@ -198,32 +234,48 @@ VString VThread::getCurrentThreadName() {
     }
 
     // It's the stand-in thread for non-VThread threads. Its name is meaningless.
-    // Format the current OS thread ID.
-    Vs64 id64 = (Vs64) VThread::threadSelf();
-    return VSTRING_S64(id64);
+    // Format the current OS thread ID, once per thread.
+    if (gCurrentThreadIDName[0] == 0) {
+        Vs64 id64 = (Vs64) VThread::threadSelf();
+        VSTRING_S64(id64).copyToBuffer(gCurrentThreadIDName, static_cast<int>(sizeof(gCurrentThreadIDName)));
+    }
+
+    return VString(gCurrentThreadIDName);
 }
 
 // static
 void VThread::getThreadsInfo(VBentoNode& bento) {
     bento.setName("threads");
 
-    VMutexLocker locker(&gVThreadMapMutex, "VThread::getThreadsInfo");
+    VReadLocker locker(&gVThreadMapLock, "VThread::getThreadsInfo");
     for (VThreadIDToVThreadMap::const_iterator i = gVThreadIDToVThreadMap.begin(); i != gVThreadIDToVThreadMap.end(); ++i) {
         VThread* thread = (*i).second;
         VBentoNode* child = bento.addNewChildNode("thread");
-        child->addString("name", thread->getName());
-        child->addS64("threadID", reinterpret_cast<Vs64>((void*) thread->mThreadID)); // Convoluted casting to make all platforms happy showing different id types as a 64-bit number.
-        child->addBool("isRunning", thread->mIsRunning);
-        child->addBool("isDeleted", thread->mIsDeleted);
-        child->addBool("deleteAtEnd", thread->mDeleteAtEnd);
-        child->addBool("createdDetached", thread->mCreateDetached);
-        child->addBool("hasManager", thread->mManager != NULL);
+        thread->addInfo(*child);
+    }
+}
+
+void VThread::addInfo(VBentoNode& infoNode) const {
+    infoNode.addString("name", mName);
+    infoNode.addS64("threadID", reinterpret_cast<Vs64>((void*) mThreadID)); // Convoluted casting to make all platforms happy showing different id types as a 64-bit number.
+    infoNode.addBool("isRunning", mIsRunning);
+    infoNode.addBool("isDeleted", mIsDeleted);
+    infoNode.addBool("deleteAtEnd", mDeleteAtEnd);
+    infoNode.addBool("createdDetached", mCreateDetached);
+    infoNode.addBool("hasManager", mManager != NULL);
+
+    if (! mPlacement.isEmpty()) {
+        infoNode.addString("cpus", VThreadPlacement::formatCPUList(mPlacement.mCPUs));
+        infoNode.addInt("numaNode", mPlacement.mNUMANode);
+        infoNode.addString("osName", mPlacement.mOSName);
+        infoNode.addString("placementRule", mPlacementRule);
+        infoNode.addBool("placementApplied", mPlacementApplied);
     }
 }
 
 // static
 VString VThread::getThreadName(VThreadID_Type threadID) {
-    VMutexLocker locker(&gVThreadMapMutex, "VThread::getThreadName");
+    VReadLocker locker(&gVThreadMapLock, "VThread::getThreadName");
     VThreadIDToVThreadMap::iterator position = gVThreadIDToVThreadMap.find(threadID);
     if (position == gVThreadIDToVThreadMap.end()) {
         return VString::EMPTY();
@@ -236,7 +288,7 @@ VString VThread::getThreadName(VThreadID_Type threadID) {
 
 // static
 void VThread::stopThread(VThreadID_Type threadID) {
-    VMutexLocker locker(&gVThreadMapMutex, "VThread::stopThread");
+    VReadLocker locker(&gVThreadMapLock, "VThread::stopThread");
     VThreadIDToVThreadMap::iterator position = gVThreadIDToVThreadMap.find(threadID);
     if (position != gVThreadIDToVThreadMap.end()) {
         VThread* thread = (*position).second;
@@ -255,6 +307,148 @@ void VThread::logStackCrawl(const VString& headerMessage, VNamedLoggerPtr logger
 }
 #endif /* VAULT_USER_STACKCRAWL_SUPPORT */
 
+// static
+void VThread::configurePlacement(const VSettingsNode& placementSettings) {
+    // Parse everything before touching the current rules, so a bad rule leaves them unchanged.
+    VThreadPlacementRuleVector rules;
+    int numRules = placementSettings.countNamedChildren("rule");
+    for (int i = 0; i < numRules; ++i) {
+        const VSettingsNode* ruleNode = placementSettings.getNamedChild("rule", i);
+        VThreadPlacementRule rule;
+        rule.mNamePrefix = ruleNode->getString("name-prefix", VString::EMPTY());
+        rule.mPlacement.mCPUs = VThreadPlacement::parseCPUList(ruleNode->getString("cpus", VString::EMPTY()));
+        rule.mPlacement.mNUMANode = ruleNode->getInt("numa-node", -1);
+        rule.mPlacement.mOSName = ruleNode->getString("os-name", VString::EMPTY());
+        rule.mSpread = ruleNode->getBoolean("spread", false);
+        rules.push_back(rule);
+    }
+
+    VMutexLocker locker(&gVThreadPlacementRulesMutex, "VThread::configurePlacement");
+    gVThreadPlacementRules.swap(rules);
+}
+
+void VThread::_applyPlacement() {
+    if (mPlacement.isEmpty()) {
+        VMutexLocker locker(&gVThreadPlacementRulesMutex, "VThread::_applyPlacement");
+        for (VThreadPlacementRuleVector::iterator i = gVThreadPlacementRules.begin(); i != gVThreadPlacementRules.end(); ++i) {
+            if (! mName.startsWith((*i).mNamePrefix)) {
+                continue;
+            }
+
+            mPlacement = (*i).mPlacement;
+            mPlacementRule = (*i).mNamePrefix.isEmpty() ? VString("*") : (*i).mNamePrefix;
+
+            if ((*i).mSpread) {
+                VThreadCPUList candidates = mPlacement.mCPUs;
+                if (candidates.empty() && (mPlacement.mNUMANode >= 0)) {
+                    (void) VThread::getNUMANodeCPUs(mPlacement.mNUMANode, candidates);
+                }
+
+                if (candidates.empty()) {
+                    int numProcessors = VThread::getNumProcessors();
+                    for (int cpu = 0; cpu < numProcessors; ++cpu) {
+                        candidates.push_back(cpu);
+                    }
+                }
+
+                const size_t spreadIndex = (*i).mNextSpreadIndex % candidates.size();
+                (*i).mNextSpreadIndex = spreadIndex + 1;
+                mPlacement.mCPUs.assign(1, candidates[spreadIndex]);
+            }
+
+            break;
+        }
+    }
+
+    // The OS name is applied by _threadStarting(), which cannot fail in a way we can see.
+    bool applied = true;
+    VThreadCPUList cpus = mPlacement.mCPUs;
+    if (mPlacement.mNUMANode >= 0) {
+        if (cpus.empty() && ! VThread::getNUMANodeCPUs(mPlacement.mNUMANode, cpus)) {
+            applied = false;
+        }
+
+        if (! VThread::setPreferredNUMANode(mPlacement.mNUMANode)) {
+            applied = false;
+        }
+    }
+
+    if (! cpus.empty() && ! VThread::setAffinity(cpus)) {
+        applied = false;
+    }
+
+    mPlacement.mCPUs = cpus; // so that getThreadsInfo() shows the NUMA node's CPUs if that is where they came from
+    mPlacementApplied = applied;
+
+    if (! applied) {
+        VLOGGER_NAMED_WARN(mLoggerName, VSTRING_FORMAT("Thread '%s' could not fully apply its placement (cpus '%s', NUMA node %d).",
+            mName.chars(), VThreadPlacement::formatCPUList(mPlacement.mCPUs).chars(), mPlacement.mNUMANode));
+    }
+}
+
+// VThreadPlacement -----------------------------------------------------------
+
+// static
+VThreadCPUList VThreadPlacement::parseCPUList(const VString& cpuList) {
+    VThreadCPUList cpus;
+    VStringVector ranges = cpuList.split(VCodePoint(','), 0, false); // we skip empty items ourselves
+    for (VStringVector::iterator i = ranges.begin(); i != ranges.end(); ++i) {
+        VString range = *i;
+        range.trim();
+        if (range.isEmpty()) {
+            continue;
+        }
+
+        VString first = range;
+        VString last = range;
+        int dashIndex = range.indexOf('-');
+        if (dashIndex >= 0) {
+            range.getSubstring(first, 0, dashIndex);
+            range.getSubstring(last, dashIndex + 1);
+            first.trim();
+            last.trim();
+        }
+
+        // parseInt() throws a VRangeException on anything but digits, which is what we want.
+        int firstCPU = first.parseInt();
+        int lastCPU = last.parseInt();
+        if ((firstCPU < 0) || (lastCPU < firstCPU)) {
+            throw VRangeException(VSTRING_FORMAT("VThreadPlacement::parseCPUList: invalid range '%s' in CPU list '%s'.", range.chars(), cpuList.chars()));
+        }
+
+        for (int cpu = firstCPU; cpu <= lastCPU; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+// static
+VString VThreadPlacement::formatCPUList(const VThreadCPUList& cpus) {
+    VString result;
+    VThreadCPUList::const_iterator i = cpus.begin();
+    while (i != cpus.end()) {
+        const int firstCPU = *i;
+        int lastCPU = firstCPU;
+        for (++i; (i != cpus.end()) && (*i == lastCPU + 1); ++i) {
+            lastCPU = *i;
+        }
+
+        if (! result.isEmpty()) {
+            result += ',';
+        }
+
+        if (lastCPU == firstCPU) {
+            result += VSTRING_INT(firstCPU);
+        } else {
+            result += VSTRING_FORMAT("%d-%d", firstCPU, lastCPU);
+        }
+    }
+
+    return result;
+}
+
 // VMainThread ----------------------------------------------------------------
 
 VMainThread::VMainThread()
@@ -296,5 +490,3 @@ void VForeignThread::start() {
     VLOGGER_NAMED_FATAL(mLoggerName, errorMessage);
     throw VStackTraceException(errorMessage);
 }
-
-
@@ -19,6 +19,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 class VDuration;
 class VManagementInterface;
 class VBentoNode;
+class VSettingsNode;
 
 /**
 
@@ -89,6 +90,40 @@ class VBentoNode;
     @ingroup vthread
 */
 
+typedef std::vector<int> VThreadCPUList; ///< A list of CPU numbers, as the OS numbers them.
+
+/**
+VThreadPlacement describes where a thread should run: which CPUs it may be
+scheduled on, which NUMA node's memory it should prefer, and what name the OS
+should show for it in debuggers and tools like top. Each part is optional. A
+thread gets its placement either from VThread::setPlacement() before it is
+started, or from the first matching rule given to VThread::configurePlacement().
+*/
+struct VThreadPlacement {
+    VThreadPlacement() : mCPUs(), mNUMANode(-1), mOSName() {}
+
+    /**
+    Returns true if the placement asks for nothing at all.
+    */
+    bool isEmpty() const { return mCPUs.empty() && (mNUMANode < 0) && mOSName.isEmpty(); }
+
+    /**
+    Parses a CPU list in the form Linux uses in /sys and taskset, such as "0-3,8,10-11".
+    @param  cpuList the text to parse; empty yields an empty list
+    @return the CPU numbers, in the order given
+    @throws VRangeException if the text is not a valid CPU list
+    */
+    static VThreadCPUList parseCPUList(const VString& cpuList);
+    /**
+    Formats a CPU list in the form parseCPUList() accepts, collapsing runs into ranges.
+    */
+    static VString formatCPUList(const VThreadCPUList& cpus);
+
+    VThreadCPUList  mCPUs;      ///< The CPUs the thread may run on; empty means any.
+    int             mNUMANode;  ///< The NUMA node whose CPUs and memory the thread should use; -1 means no preference.
+    VString         mOSName;    ///< The name to give the OS thread; empty means the VThread name.
+};
+
 /**
 VThread is class that provides an easy way to create a thread of execution.
 
@@ -282,6 +317,26 @@ class VThread {
         @return the thread's logger name
         */
         const VString& getLoggerName() const { return mLoggerName; }
+        /**
+        For diagnostic purposes, adds the properties/state of this thread to the supplied
+        Bento node; getThreadsInfo() calls this for each thread. Subclasses that have
+        useful state of their own should call inherited and then add it.
+        @param  infoNode    the node to add attributes to
+        */
+        virtual void addInfo(VBentoNode& infoNode) const;
+        /**
+        Sets where the thread should run, overriding any configurePlacement() rule.
+        Must be called before start(); the thread applies it to itself as it starts.
+        @param  placement   the CPUs, NUMA node and OS name to use
+        */
+        void setPlacement(const VThreadPlacement& placement) { mPlacement = placement; }
+        /**
+        Returns the thread's placement. Once the thread is running, this is the
+        placement it resolved and tried to apply, whether set explicitly or taken
+        from a rule; getThreadsInfo() reports it along with whether it succeeded.
+        @return the placement
+        */
+        const VThreadPlacement& getPlacement() const { return mPlacement; }
 
         /**
         The main function that invokes the thread's run() and cleans up when
@@ -316,6 +371,25 @@ class VThread {
         */
         static void stopThread(VThreadID_Type threadID);
 
+        /**
+        Replaces the rules that place threads that have no explicit placement. Each
+        thread takes the first rule whose name prefix matches the start of its name,
+        when it starts; threads already running are not moved. The settings look like:
+            <thread-placement>
+                <rule name-prefix="session:" cpus="2-15" spread="true" />
+                <rule name-prefix="listener" numa-node="0" os-name="listener" />
+            </thread-placement>
+        A rule may give cpus (a CPU list), numa-node, and os-name, any of which may
+        be omitted. With spread="true", each thread the rule matches is pinned to a
+        single CPU, taken in turn from the rule's CPUs (or from the NUMA node's CPUs,
+        or from all CPUs), so that a set of similar threads such as session I/O
+        threads is spread across cores rather than left to drift between them.
+        @param  placementSettings   the node whose "rule" children define the rules;
+                                    a node with no rules removes all rules
+        @throws VException if a rule is malformed
+        */
+        static void configurePlacement(const VSettingsNode& placementSettings);
+
         /* PLATFORM-SPECIFIC STATIC FUNCTIONS --------------------------------
         The remaining functions defined here are the low-level interfaces to
         the platform-specific threading APIs. These are implemented in each
@@ -372,6 +446,7 @@ class VThread {
         Returns the current thread's VThread. If the current thread is main or a thread that
         was not created using VThread, a dummy "stand-in" object is returned, that is not actually
         running or having a valid thread ID. But this means we guarantee to not return NULL.
+        This is a thread-local read; it takes no lock.
         */
         static VThread* getCurrentThread();
 
@@ -391,6 +466,38 @@ class VThread {
         */
         static bool setPriority(int nice);
 
+        /**
+        Restricts the current thread to run only on the specified CPUs.
+        Wrapper on Linux for pthread_setaffinity_np; not supported on other Unix platforms.
+        @param  cpus    the CPU numbers
+        @return true on success; false on failure or if not supported
+        */
+        static bool setAffinity(const VThreadCPUList& cpus);
+
+        /**
+        Makes the current thread's memory allocations prefer the specified NUMA node.
+        Wrapper on Linux for set_mempolicy with MPOL_PREFERRED; on Windows, memory
+        already comes from the node of the CPU the thread is running on.
+        @param  numaNode    the node number
+        @return true on success; false on failure or if not supported
+        */
+        static bool setPreferredNUMANode(int numaNode);
+
+        /**
+        Returns the CPUs that belong to a NUMA node.
+        Reads /sys/devices/system/node on Linux; wrapper on Windows for GetNumaNodeProcessorMask.
+        @param  numaNode    the node number
+        @param  cpus        filled in with the node's CPU numbers
+        @return true on success; false if the node does not exist or the platform does not say
+        */
+        static bool getNUMANodeCPUs(int numaNode, VThreadCPUList& cpus);
+
+        /**
+        Returns the number of CPUs currently online.
+        @return the number of CPUs; at least 1
+        */
+        static int getNumProcessors();
+
         /**
         Blocks the current thread for a specified number of milliseconds.
         The thread will resume execution after approximately that amount
@@ -418,6 +525,9 @@ class VThread {
         VManagementInterface*   mManager;           ///< The VManagementInterface that manages us, or NULL.
         VThreadID_Type          mThreadID;          ///< The OS-specific thread ID value.
         volatile bool           mIsRunning;         ///< The running state of the thread (@see isRunning()).
+        VThreadPlacement        mPlacement;         ///< Where the thread should run (@see setPlacement()).
+        VString                 mPlacementRule;     ///< The name prefix of the rule that supplied mPlacement, if any.
+        bool                    mPlacementApplied;  ///< True if every part of mPlacement was applied when the thread started.
 
     private:
 
@@ -431,6 +541,10 @@ class VThread {
         // threadEnded() calls.
         static void _threadStarting(const VThread* thread);
         static void _threadEnded(const VThread* thread);
+
+        // Called from VThread::threadMain() on the new thread before it is registered, to
+        // resolve mPlacement from the rules if it was not set explicitly, and apply it.
+        void _applyPlacement();
 };
 
 /**
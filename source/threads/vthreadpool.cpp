@@ -0,0 +1,496 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vthreadpool.h"
+
+#include "vthread.h"
+#include "vmutexlocker.h"
+#include "vbento.h"
+#include "vlogger.h"
+
+// VThreadPoolWorkerThread ----------------------------------------------------
+
+/**
+The thread class that runs a pool's jobs. It is private to the pool, which
+starts, joins, and deletes it.
+*/
+class VThreadPoolWorkerThread : public VThread {
+    public:
+
+        VThreadPoolWorkerThread(const VString& name, const VString& loggerName, VManagementInterface* manager, VThreadPool* pool, int index)
+            : VThread(name, loggerName, kDontDeleteSelfAtEnd, kCreateThreadJoinable, manager)
+            , mPool(pool)
+            , mIndex(index)
+            {}
+        virtual ~VThreadPoolWorkerThread() {}
+
+        virtual void run();
+        virtual void addInfo(VBentoNode& infoNode) const;
+
+        VThreadPool* getPool() const { return mPool; }
+        int getIndex() const { return mIndex; }
+
+    private:
+
+        VThreadPoolWorkerThread(const VThreadPoolWorkerThread&); // not copyable
+        VThreadPoolWorkerThread& operator=(const VThreadPoolWorkerThread&); // not assignable
+
+        VThreadPool*    mPool;  ///< The pool whose jobs we run.
+        int             mIndex; ///< Our index in the pool, which is also the index of our queue.
+};
+
+// The pool worker running on this thread, if any, so that a submit or wait from
+// within a task can find its own queue without a lookup.
+static V_THREAD_LOCAL VThreadPoolWorkerThread* gCurrentPoolWorker = NULL;
+
+void VThreadPoolWorkerThread::run() {
+    gCurrentPoolWorker = this;
+
+    while (mPool->_runNextJob(mIndex)) {
+    }
+
+    gCurrentPoolWorker = NULL;
+}
+
+void VThreadPoolWorkerThread::addInfo(VBentoNode& infoNode) const {
+    VThread::addInfo(infoNode);
+
+    infoNode.addString("pool", mPool->getName());
+    infoNode.addInt("poolWorkerIndex", mIndex);
+    infoNode.addS64("tasksRun", mPool->mQueues[mIndex]->mNumRun.load());
+    infoNode.addS64("tasksStolen", mPool->mQueues[mIndex]->mNumStolen.load());
+}
+
+// VThreadPoolParallelFor -----------------------------------------------------
+
+/**
+The shared state of one parallelFor() call. The range is cut into chunks that
+the calling thread and the helper tasks claim in turn, so however many helpers
+actually get to run, every chunk is run exactly once. The helpers hold a
+reference to this, so one that runs after the call has returned finds nothing
+left to claim and simply ends.
+*/
+class VThreadPoolParallelFor {
+    public:
+
+        VThreadPoolParallelFor(VThreadPool* pool, int begin, int end, int grainSize, const VThreadPoolIndexTask& task)
+            : mBegin(begin)
+            , mEnd(end)
+            , mGrainSize(grainSize)
+            , mNumChunks((end - begin + grainSize - 1) / grainSize)
+            , mTask(task)
+            , mNextChunk(0)
+            , mNumChunksDone(0)
+            , mErrorMutex("VThreadPoolParallelFor::mErrorMutex", true/*suppress logging*/)
+            , mError()
+            , mDone(new VThreadPoolFuture(pool))
+            {}
+        ~VThreadPoolParallelFor() {}
+
+        int getNumChunks() const { return mNumChunks; }
+        VThreadPoolFuturePtr getDone() const { return mDone; }
+
+        /**
+        Claims and runs chunks until there are none left. Completes mDone if
+        it was the one to finish the last chunk.
+        */
+        void runChunks();
+
+    private:
+
+        VThreadPoolParallelFor(const VThreadPoolParallelFor&); // not copyable
+        VThreadPoolParallelFor& operator=(const VThreadPoolParallelFor&); // not assignable
+
+        const int               mBegin;         ///< The first index.
+        const int               mEnd;           ///< One past the last index.
+        const int               mGrainSize;     ///< The number of indexes per chunk.
+        const int               mNumChunks;     ///< The number of chunks the range is cut into.
+        VThreadPoolIndexTask    mTask;          ///< The loop body.
+        std::atomic<int>        mNextChunk;     ///< The next chunk to be claimed.
+        std::atomic<int>        mNumChunksDone; ///< The number of chunks finished.
+        VMutex                  mErrorMutex;    ///< Guards mError.
+        std::exception_ptr      mError;         ///< The first exception thrown by the loop body.
+        VThreadPoolFuturePtr    mDone;          ///< Completed when all chunks have finished.
+};
+
+typedef VSharedPtr<VThreadPoolParallelFor> VThreadPoolParallelForPtr;
+
+void VThreadPoolParallelFor::runChunks() {
+    for (int chunk = mNextChunk++; chunk < mNumChunks; chunk = mNextChunk++) {
+        const int first = mBegin + (chunk * mGrainSize);
+        const int last = (mEnd - first > mGrainSize) ? first + mGrainSize : mEnd;
+
+        try {
+            for (int i = first; i < last; ++i) {
+                mTask(i);
+            }
+        } catch (...) {
+            VMutexLocker locker(&mErrorMutex, "VThreadPoolParallelFor::runChunks()");
+            if (mError == nullptr) {
+                mError = std::current_exception();
+            }
+        }
+
+        // The increments order each chunk's work (and any error it recorded) before the last one's completion.
+        if (++mNumChunksDone == mNumChunks) {
+            mDone->_complete(mError);
+        }
+    }
+}
+
+// VThreadPoolFuture ----------------------------------------------------------
+
+VThreadPoolFuture::VThreadPoolFuture(VThreadPool* pool)
+    : mPool(pool)
+    , mDone(false)
+    , mError()
+    , mNumWaiters(0)
+    , mBlockingMutex("VThreadPoolFuture::mBlockingMutex", true/*suppress logging*/)
+    , mBlockingCondition()
+    {
+}
+
+void VThreadPoolFuture::wait() {
+    const int workerIndex = (mPool == NULL) ? -1 : mPool->_getCurrentWorkerIndex();
+
+    while (! mDone.load()) {
+        if (workerIndex < 0) {
+            this->_waitBriefly(VDuration::SECOND());
+        } else if (! mPool->_runOneJob(workerIndex)) {
+            // Nothing to help with; our task is running elsewhere. Look again soon, since
+            // jobs submitted meanwhile won't wake us.
+            this->_waitBriefly(10 * VDuration::MILLISECOND());
+        }
+    }
+
+    if (mError != nullptr) {
+        std::rethrow_exception(mError);
+    }
+}
+
+void VThreadPoolFuture::_complete(std::exception_ptr error) {
+    mError = error;
+    mDone.store(true);
+
+    if (mNumWaiters.load() > 0) {
+        VMutexLocker locker(&mBlockingMutex, "VThreadPoolFuture::_complete()");
+        mBlockingCondition.broadcast();
+    }
+}
+
+void VThreadPoolFuture::_waitBriefly(const VDuration& timeout) {
+    VMutexLocker locker(&mBlockingMutex, "VThreadPoolFuture::_waitBriefly()");
+
+    // Announce that we're about to block, then look again; see _complete().
+    ++mNumWaiters;
+    if (! mDone.load()) {
+        (void) mBlockingCondition.wait(&mBlockingMutex, timeout);
+    }
+
+    --mNumWaiters;
+}
+
+// VThreadPool ----------------------------------------------------------------
+
+VThreadPool::VThreadPool(const VString& name, int numWorkerThreads, VManagementInterface* manager)
+    : mName(name)
+    , mLoggerName("vault.threads.VThreadPool")
+    , mNumWorkerThreads(V_MAX(1, numWorkerThreads))
+    , mManager(manager)
+    , mQueues()
+    , mWorkers()
+    , mNextQueue(0)
+    , mNumQueued(0)
+    , mStopping(false)
+    , mNumSubmitting(0)
+    , mNumIdleWorkers(0)
+    , mIdleMutex(VSTRING_FORMAT("VThreadPool(%s)::mIdleMutex", name.chars()))
+    , mIdleCondition()
+    , mNumSubmitted(0)
+    , mNumCompleted(0)
+    {
+
+    for (int i = 0; i < mNumWorkerThreads; ++i) {
+        mQueues.push_back(new WorkerQueue(VSTRING_FORMAT("VThreadPool(%s)::mQueues[%d]", name.chars(), i)));
+    }
+}
+
+VThreadPool::~VThreadPool() {
+    try {
+        this->stop();
+    } catch (...) {} // prevent exception from propagating
+
+    for (std::vector<WorkerQueue*>::iterator i = mQueues.begin(); i != mQueues.end(); ++i) {
+        delete (*i);
+    }
+
+    mManager = NULL;
+}
+
+void VThreadPool::start() {
+    if (! mWorkers.empty()) {
+        return;
+    }
+
+    mStopping = false;
+
+    for (int i = 0; i < mNumWorkerThreads; ++i) {
+        VThreadPoolWorkerThread* worker = new VThreadPoolWorkerThread(VSTRING_FORMAT("%s.%d", mName.chars(), i), mLoggerName, mManager, this, i);
+        mWorkers.push_back(worker);
+        worker->start();
+    }
+
+    VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VThreadPool: Started %d worker threads.", mName.chars(), mNumWorkerThreads));
+}
+
+void VThreadPool::stop() {
+    mStopping = true;
+
+    // A submit() that saw mStopping clear is still queueing its job; let it finish so the job is found below.
+    while (mNumSubmitting.load() > 0) {
+        VThread::yield();
+    }
+
+    if (mWorkers.empty()) {
+        // Never started (or already stopped): run anything submitted meanwhile, so its future completes.
+        this->_runQueuedJobs();
+        return;
+    }
+
+    // Each idle worker will see mStopping once woken; busy ones will see it when the queues empty.
+    for (int i = 0; i < mNumWorkerThreads; ++i) {
+        this->_wakeWorker();
+    }
+
+    for (std::vector<VThreadPoolWorkerThread*>::iterator i = mWorkers.begin(); i != mWorkers.end(); ++i) {
+        (*i)->join();
+        delete (*i);
+    }
+
+    mWorkers.clear();
+
+    // A worker may have found the queues empty and ended just before a racing submit() queued its job.
+    this->_runQueuedJobs();
+
+    VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VThreadPool: Stopped worker threads after " VSTRING_FORMATTER_S64 " tasks.", mName.chars(), mNumCompleted.load()));
+}
+
+VThreadPoolFuturePtr VThreadPool::submit(const VThreadPoolTask& task, const VThreadPoolCompletion& completion) {
+    VThreadPoolFuturePtr future(new VThreadPoolFuture(this));
+
+    // Count ourselves before looking at mStopping, so that stop() either sees us or we see it.
+    ++mNumSubmitting;
+    if (mStopping) {
+        --mNumSubmitting;
+        ++mNumSubmitted;
+
+        Job job(task, completion, future);
+        this->_runJob(-1, job); // no worker will run it, so run it here
+        return future;
+    }
+
+    int queueIndex = this->_getCurrentWorkerIndex();
+    if (queueIndex < 0) {
+        queueIndex = static_cast<int>(static_cast<unsigned int>(mNextQueue++) % static_cast<unsigned int>(mNumWorkerThreads));
+    }
+
+    WorkerQueue* queue = mQueues[queueIndex];
+    /* locker scope */ {
+        VMutexLocker locker(&queue->mMutex, "VThreadPool::submit()");
+        queue->mJobs.push_back(Job(task, completion, future));
+        ++mNumQueued;
+    }
+
+    --mNumSubmitting;
+    ++mNumSubmitted;
+    this->_wakeWorker();
+
+    return future;
+}
+
+void VThreadPool::parallelFor(int begin, int end, const VThreadPoolIndexTask& task, int grainSize) {
+    if (end <= begin) {
+        return;
+    }
+
+    if (grainSize <= 0) {
+        grainSize = V_MAX(1, (end - begin) / ((mNumWorkerThreads + 1) * 4));
+    }
+
+    VThreadPoolParallelForPtr loop(new VThreadPoolParallelFor(this, begin, end, grainSize, task));
+
+    // We take a share of the chunks ourselves, so we need at most one helper per remaining chunk.
+    const int numHelpers = V_MIN(mNumWorkerThreads, loop->getNumChunks() - 1);
+    for (int i = 0; i < numHelpers; ++i) {
+        (void) this->submit(std::bind(&VThreadPoolParallelFor::runChunks, loop));
+    }
+
+    loop->runChunks();
+    loop->getDone()->wait();
+}
+
+void VThreadPool::getPoolInfo(VBentoNode& bento) const {
+    bento.addString("name", mName);
+    bento.addInt("workers", mNumWorkerThreads);
+    bento.addInt("idle", mNumIdleWorkers.load());
+    bento.addInt("queued", mNumQueued.load());
+    bento.addS64("submitted", mNumSubmitted.load());
+    bento.addS64("completed", mNumCompleted.load());
+
+    Vs64 numStolen = 0;
+    for (std::vector<WorkerQueue*>::const_iterator i = mQueues.begin(); i != mQueues.end(); ++i) {
+        numStolen += (*i)->mNumStolen.load();
+    }
+
+    bento.addS64("stolen", numStolen);
+}
+
+bool VThreadPool::_runNextJob(int workerIndex) {
+    if (this->_runOneJob(workerIndex)) {
+        return true;
+    }
+
+    if (mStopping) {
+        return false;
+    }
+
+    Job job;
+    bool tookJob = false;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mIdleMutex, "VThreadPool::_runNextJob()");
+
+        // Announce that we're about to go idle, then look again; see _wakeWorker().
+        ++mNumIdleWorkers;
+        tookJob = this->_takeJob(workerIndex, job);
+        if (! tookJob && ! mStopping) {
+            (void) mIdleCondition.wait(&mIdleMutex, VDuration::SECOND());
+        }
+
+        --mNumIdleWorkers;
+    }
+
+    if (tookJob) {
+        this->_runJob(workerIndex, job);
+    }
+
+    return true; // loop around and look again
+}
+
+bool VThreadPool::_runOneJob(int workerIndex) {
+    Job job;
+    if (! this->_takeJob(workerIndex, job)) {
+        return false;
+    }
+
+    this->_runJob(workerIndex, job);
+    return true;
+}
+
+bool VThreadPool::_takeJob(int workerIndex, Job& job) {
+    WorkerQueue* ownQueue = mQueues[workerIndex];
+
+    /* locker scope */ {
+        VMutexLocker locker(&ownQueue->mMutex, "VThreadPool::_takeJob() own");
+        if (! ownQueue->mJobs.empty()) {
+            job = ownQueue->mJobs.back();
+            ownQueue->mJobs.pop_back();
+            --mNumQueued;
+            return true;
+        }
+    }
+
+    // Only go around the other queues' locks if something is queued somewhere.
+    if (mNumQueued.load() == 0) {
+        return false;
+    }
+
+    for (int i = 1; i < mNumWorkerThreads; ++i) {
+        WorkerQueue* victimQueue = mQueues[(workerIndex + i) % mNumWorkerThreads];
+
+        VMutexLocker locker(&victimQueue->mMutex, "VThreadPool::_takeJob() steal");
+        if (! victimQueue->mJobs.empty()) {
+            job = victimQueue->mJobs.front();
+            victimQueue->mJobs.pop_front();
+            --mNumQueued;
+            ++ownQueue->mNumStolen;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void VThreadPool::_runJob(int workerIndex, Job& job) {
+    std::exception_ptr error;
+
+    try {
+        job.mTask();
+    } catch (...) {
+        error = std::current_exception(); // delivered through the future
+    }
+
+    job.mFuture->_complete(error);
+    if (workerIndex >= 0) {
+        ++mQueues[workerIndex]->mNumRun;
+    }
+
+    ++mNumCompleted;
+
+    if (job.mCompletion) {
+        // Last resort so that a worker survives a failing completion callback.
+        try {
+            job.mCompletion(job.mFuture);
+        } catch (const std::exception& ex) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VThreadPool: Caught exception from completion callback: %s", mName.chars(), ex.what()));
+        } catch (...) {
+            VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VThreadPool: Caught unknown exception from completion callback.", mName.chars()));
+        }
+    }
+
+    job = Job(); // release the task's captures now rather than when the next job overwrites them
+}
+
+void VThreadPool::_runQueuedJobs() {
+    for (std::vector<WorkerQueue*>::iterator i = mQueues.begin(); i != mQueues.end(); ++i) {
+        for (;;) {
+            Job job;
+
+            /* locker scope */ {
+                VMutexLocker locker(&(*i)->mMutex, "VThreadPool::_runQueuedJobs()");
+                if ((*i)->mJobs.empty()) {
+                    break;
+                }
+
+                job = (*i)->mJobs.front();
+                (*i)->mJobs.pop_front();
+                --mNumQueued;
+            }
+
+            this->_runJob(-1, job);
+        }
+    }
+}
+
+void VThreadPool::_wakeWorker() {
+    if (mNumIdleWorkers.load() == 0) {
+        return; // busy workers look at the queues again before they go idle
+    }
+
+    VMutexLocker locker(&mIdleMutex, "VThreadPool::_wakeWorker()");
+    mIdleCondition.signal();
+}
+
+int VThreadPool::_getCurrentWorkerIndex() const {
+    if ((gCurrentPoolWorker != NULL) && (gCurrentPoolWorker->getPool() == this)) {
+        return gCurrentPoolWorker->getIndex();
+    }
+
+    return -1;
+}
@@ -0,0 +1,249 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vthreadpool_h
+#define vthreadpool_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include "vstring.h"
+#include "vmutex.h"
+#include "vinstant.h"
+#include "vconditionvariable.h"
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <vector>
+
+class VBentoNode;
+class VManagementInterface;
+class VThreadPool;
+class VThreadPoolFuture;
+class VThreadPoolWorkerThread;
+
+/**
+    @ingroup vthread
+*/
+
+typedef VSharedPtr<VThreadPoolFuture> VThreadPoolFuturePtr;
+
+typedef std::function<void()> VThreadPoolTask;                              ///< A unit of work to run on a pool thread.
+typedef std::function<void(int index)> VThreadPoolIndexTask;                ///< The body of a parallelFor() loop, called once per index.
+typedef std::function<void(VThreadPoolFuturePtr future)> VThreadPoolCompletion; ///< Called on the pool thread once a task has finished.
+
+// VThreadPoolFuture -----------------------------------------------------------
+
+/**
+VThreadPoolFuture is the result of a task submitted to a VThreadPool. You can
+poll it with isDone(), or block on it with wait(), which rethrows whatever the
+task threw. If wait() is called on one of the pool's own worker threads, the
+worker runs other queued tasks while it waits rather than sitting idle, so a
+task may wait on tasks it submitted without starving the pool.
+*/
+class VThreadPoolFuture {
+    public:
+
+        ~VThreadPoolFuture() {}
+
+        /**
+        Returns true once the task has finished, whether or not it succeeded.
+        */
+        bool isDone() const { return mDone.load(); }
+        /**
+        Returns true if the task finished without throwing. Only meaningful once isDone().
+        */
+        bool succeeded() const { return isDone() && (mError == nullptr); }
+        /**
+        Blocks until the task has finished. If the task threw an exception, it
+        is rethrown here.
+        */
+        void wait();
+
+    private:
+
+        VThreadPoolFuture(VThreadPool* pool);
+
+        VThreadPoolFuture(const VThreadPoolFuture&); // not copyable
+        VThreadPoolFuture& operator=(const VThreadPoolFuture&); // not assignable
+
+        friend class VThreadPool;
+        friend class VThreadPoolParallelFor;
+
+        void _complete(std::exception_ptr error);  ///< Records the outcome and releases any waiters.
+        void _waitBriefly(const VDuration& timeout); ///< Blocks until done or the timeout passes.
+
+        VThreadPool*        mPool;              ///< The pool the task runs in; used to help while waiting on a worker.
+        std::atomic<bool>   mDone;              ///< True once the task has finished.
+        std::exception_ptr  mError;             ///< What the task threw, if anything; set before mDone.
+        std::atomic<int>    mNumWaiters;        ///< Threads that are (about to be) waiting on mBlockingCondition.
+        VMutex              mBlockingMutex;     ///< The mutex held by a waiter while it waits on mBlockingCondition.
+        VConditionVariable  mBlockingCondition; ///< Broadcast when the task finishes while someone is waiting.
+};
+
+// VThreadPool -----------------------------------------------------------------
+
+/**
+VThreadPool runs short tasks on a fixed set of worker threads, so that code
+wanting to do several things in parallel need not create and join threads of
+its own.
+
+Each worker has its own queue of tasks. A task submitted from a worker goes on
+that worker's queue, and the worker takes its newest task first, which tends to
+keep related data in its cache. Tasks submitted from other threads are spread
+over the queues in turn. A worker whose queue is empty steals the oldest task
+from another worker's queue before it goes idle, so the load evens out without
+a single shared queue that every worker contends on.
+
+The workers are ordinary VThreads: they notify the management interface when
+they start and end, and appear in VThread::getThreadsInfo() with their pool name
+and task counts.
+
+Tasks should not block for long periods, since a blocked task holds a worker.
+Tasks submitted after stop() has begun are run at once on the submitting thread,
+since no worker would be left to run them; their futures are already done when
+submit() returns. Tasks submitted before start() wait in the queues until it is called.
+*/
+class VThreadPool {
+    public:
+
+        static const int kDefaultNumWorkerThreads = 4; ///< Default number of worker threads.
+
+        /**
+        Constructs the pool. The workers are not started until start() is called.
+        @param  name                the name of the pool, used to name the worker threads
+        @param  numWorkerThreads    the number of worker threads to run
+        @param  manager             the management interface to supply to the worker threads, or NULL
+        */
+        VThreadPool(const VString& name, int numWorkerThreads = kDefaultNumWorkerThreads, VManagementInterface* manager = NULL);
+        /**
+        Destructor. Stops the workers if they are still running.
+        */
+        ~VThreadPool();
+
+        /**
+        Starts the worker threads.
+        */
+        void start();
+        /**
+        Stops the worker threads after they have run all queued tasks, and
+        waits for them to end. Tasks submitted to a pool that was never started
+        are run by the calling thread.
+        */
+        void stop();
+
+        /**
+        Queues a task to run on a worker thread.
+        @param  task        the task to run
+        @param  completion  if supplied, called on the worker thread after the task
+                            has finished (the future is already done at that point)
+        @return the future for the task
+        */
+        VThreadPoolFuturePtr submit(const VThreadPoolTask& task, const VThreadPoolCompletion& completion = VThreadPoolCompletion());
+        /**
+        Returns true once stop() has begun, after which submit() runs tasks on the
+        submitting thread instead of queueing them.
+        */
+        bool isStopping() const { return mStopping.load(); }
+        /**
+        Calls a function for each index in [begin, end), spread over the worker
+        threads, and returns once all calls have finished. The calling thread takes
+        part in the work, so this makes progress even if every worker is busy. If
+        any call throws, the remaining chunks are still run, and the first
+        exception is rethrown here.
+        @param  begin       the first index
+        @param  end         one past the last index
+        @param  task        the function to call with each index
+        @param  grainSize   the number of consecutive indexes handed out at a time;
+                            0 picks a size that gives each thread several chunks
+        */
+        void parallelFor(int begin, int end, const VThreadPoolIndexTask& task, int grainSize = 0);
+
+        /**
+        Returns the pool name.
+        */
+        const VString& getName() const { return mName; }
+        /**
+        Returns the number of worker threads.
+        */
+        int getNumWorkerThreads() const { return mNumWorkerThreads; }
+        /**
+        Returns the number of tasks queued and not yet taken by a worker.
+        */
+        int getQueueSize() const { return mNumQueued.load(); }
+        /**
+        Adds the pool's state and counters to a bento node, for diagnostics.
+        @param  bento   the node to add to
+        */
+        void getPoolInfo(VBentoNode& bento) const;
+
+    private:
+
+        VThreadPool(const VThreadPool&); // not copyable
+        VThreadPool& operator=(const VThreadPool&); // not assignable
+
+        /**
+        A submitted task, with what to do when it finishes.
+        */
+        struct Job {
+            Job() : mTask(), mCompletion(), mFuture() {}
+            Job(const VThreadPoolTask& task, const VThreadPoolCompletion& completion, VThreadPoolFuturePtr future) : mTask(task), mCompletion(completion), mFuture(future) {}
+
+            VThreadPoolTask         mTask;          ///< The task to run.
+            VThreadPoolCompletion   mCompletion;    ///< Called after the task, if set.
+            VThreadPoolFuturePtr    mFuture;        ///< Completed when the task has run.
+        };
+
+        /**
+        One worker's queue of jobs. The worker takes from the back; thieves take from the front.
+        */
+        struct WorkerQueue {
+            WorkerQueue(const VString& mutexName) : mMutex(mutexName, true/*suppress logging*/), mJobs(), mNumRun(0), mNumStolen(0) {}
+
+            VMutex              mMutex;     ///< Guards mJobs.
+            std::deque<Job>     mJobs;      ///< Jobs queued for this worker.
+            std::atomic<Vs64>   mNumRun;    ///< Jobs run by this worker.
+            std::atomic<Vs64>   mNumStolen; ///< Jobs this worker took from other workers' queues.
+        };
+
+        friend class VThreadPoolWorkerThread;
+        friend class VThreadPoolFuture;
+
+        /**
+        Called by a worker thread; runs its next job, or a stolen one, waiting up to
+        a short while for one to be submitted.
+        @return false if the pool is stopping and there is no more work
+        */
+        bool _runNextJob(int workerIndex);
+        bool _runOneJob(int workerIndex);               ///< Runs one job if one can be taken without waiting; returns false if none.
+        bool _takeJob(int workerIndex, Job& job);       ///< Takes from the worker's own queue, else steals; returns false if all are empty.
+        void _runJob(int workerIndex, Job& job);        ///< Runs the task, completes its future, and calls its completion. workerIndex is -1 off the workers.
+        void _runQueuedJobs();                          ///< Runs whatever is left in the queues on the calling thread, once the workers have ended.
+        void _wakeWorker();                             ///< Wakes one idle worker, if any, after a job has been queued.
+        int _getCurrentWorkerIndex() const;             ///< Returns the index of the calling thread if it is one of our workers, else -1.
+
+        VString                                 mName;              ///< The pool name, for thread names and log output.
+        VString                                 mLoggerName;        ///< The logger name which we will use when emitting log output.
+        int                                     mNumWorkerThreads;  ///< The number of worker threads to run.
+        VManagementInterface*                   mManager;           ///< The management interface supplied to the worker threads.
+        std::vector<WorkerQueue*>               mQueues;            ///< One queue per worker (we own them).
+        std::vector<VThreadPoolWorkerThread*>   mWorkers;           ///< The worker threads we started (we own them).
+        std::atomic<int>                        mNextQueue;         ///< Where the next job submitted from outside the pool goes, modulo the count.
+        std::atomic<int>                        mNumQueued;         ///< Jobs queued and not yet taken.
+        std::atomic<bool>                       mStopping;          ///< Set by stop() so workers end once all queues are empty.
+        std::atomic<int>                        mNumSubmitting;     ///< Threads inside submit() that may still queue a job; stop() waits for them.
+        std::atomic<int>                        mNumIdleWorkers;    ///< Workers that are (about to be) waiting on mIdleCondition.
+        VMutex                                  mIdleMutex;         ///< The mutex held by an idle worker while it waits on mIdleCondition.
+        VConditionVariable                      mIdleCondition;     ///< Signaled when a job is queued and a worker is idle.
+        std::atomic<Vs64>                       mNumSubmitted;      ///< Counter of jobs submitted.
+        std::atomic<Vs64>                       mNumCompleted;      ///< Counter of jobs finished.
+};
+
+#endif /* vthreadpool_h */
@@ -0,0 +1,431 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vtimerwheel.h"
+
+#include "vthread.h"
+#include "vmutexlocker.h"
+#include "vshutdownregistry.h"
+#include "vbento.h"
+#include "vlogger.h"
+
+#include <chrono>
+
+// VTimerWheelThread ----------------------------------------------------------
+
+/**
+The thread class that turns a timer wheel. It is private to the wheel, which
+starts, joins, and deletes it.
+*/
+class VTimerWheelThread : public VThread {
+    public:
+
+        VTimerWheelThread(const VString& name, const VString& loggerName, VManagementInterface* manager, VTimerWheel* wheel)
+            : VThread(name, loggerName, kDontDeleteSelfAtEnd, kCreateThreadJoinable, manager)
+            , mWheel(wheel)
+            {}
+        virtual ~VTimerWheelThread() {}
+
+        virtual void run() { mWheel->_run(this); }
+        // The wheel sleeps until its next timer, so it has to be woken to notice it has been stopped.
+        virtual void stop() { VThread::stop(); mWheel->_wakeThread(); }
+
+    private:
+
+        VTimerWheelThread(const VTimerWheelThread&); // not copyable
+        VTimerWheelThread& operator=(const VTimerWheelThread&); // not assignable
+
+        VTimerWheel* mWheel; ///< The wheel we turn.
+};
+
+// VTimerWheel ----------------------------------------------------------------
+
+const int VTimerWheel::kNumLevels;
+const int VTimerWheel::kSlotBits;
+const int VTimerWheel::kNumSlots;
+const Vs64 VTimerWheel::kSlotMask;
+const Vs64 VTimerWheel::kMaxTicksAhead;
+
+static Vs64 _getMonotonicMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// This style of static mutex declaration and access ensures correct
+// initialization if accessed during the static initialization phase.
+static VMutex* _mutexSharedInstance() {
+    static VMutex gMutex("VTimerWheel _mutexSharedInstance() gMutex");
+    return &gMutex;
+}
+
+static VTimerWheel* gSharedInstance = NULL;
+
+static void _deleteSharedInstance() {
+    VMutexLocker locker(_mutexSharedInstance(), "VTimerWheel _deleteSharedInstance()");
+    delete gSharedInstance; // stops it
+    gSharedInstance = NULL;
+}
+
+// static
+VTimerWheel* VTimerWheel::getSharedInstance() {
+    VMutexLocker locker(_mutexSharedInstance(), "VTimerWheel::getSharedInstance()");
+
+    if (gSharedInstance == NULL) {
+        gSharedInstance = new VTimerWheel("VTimerWheel.shared");
+        gSharedInstance->start();
+        VShutdownRegistry::instance()->registerFunction(_deleteSharedInstance);
+    }
+
+    return gSharedInstance;
+}
+
+VTimerWheel::VTimerWheel(const VString& name, const VDuration& tickDuration, VManagementInterface* manager)
+    : mName(name)
+    , mLoggerName("vault.threads.VTimerWheel")
+    , mTickDuration(V_MAX(VDuration::MILLISECOND(), tickDuration))
+    , mTickMicroseconds(CONST_S64(1000) * mTickDuration.getDurationMilliseconds())
+    , mOriginMicroseconds(_getMonotonicMicroseconds())
+    , mManager(manager)
+    , mThread(NULL)
+    , mStopping(false)
+    , mWakeRequested(false)
+    , mBlockingMutex(VSTRING_FORMAT("VTimerWheel(%s)::mBlockingMutex", name.chars()))
+    , mWakeCondition()
+    , mMutex(VSTRING_FORMAT("VTimerWheel(%s)::mMutex", name.chars()))
+    , mTimers()
+    , mCurrentTick(0)
+    , mNextWakeTick(V_MAX_S64)
+    , mNextTimerID(1)
+    , mNumFired(0)
+    , mNumCancelled(0)
+    {
+
+    for (int level = 0; level < kNumLevels; ++level) {
+        for (int slot = 0; slot < kNumSlots; ++slot) {
+            mSlots[level][slot] = NULL;
+        }
+    }
+}
+
+VTimerWheel::~VTimerWheel() {
+    try {
+        this->stop();
+    } catch (...) {} // prevent exception from propagating
+
+    for (TimerMap::iterator i = mTimers.begin(); i != mTimers.end(); ++i) {
+        delete i->second;
+    }
+
+    mManager = NULL;
+}
+
+void VTimerWheel::start() {
+    if (mThread != NULL) {
+        return;
+    }
+
+    mStopping = false;
+    mThread = new VTimerWheelThread(mName, mLoggerName, mManager, this);
+    mThread->start();
+
+    VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VTimerWheel: Started with " VSTRING_FORMATTER_S64 "ms ticks.", mName.chars(), mTickDuration.getDurationMilliseconds()));
+}
+
+void VTimerWheel::stop() {
+    if (mThread == NULL) {
+        return;
+    }
+
+    mStopping = true;
+    this->_wakeThread();
+
+    mThread->join();
+    delete mThread;
+    mThread = NULL;
+
+    VLOGGER_NAMED_DEBUG(mLoggerName, VSTRING_FORMAT("[%s] VTimerWheel: Stopped after " VSTRING_FORMATTER_S64 " timer calls.", mName.chars(), mNumFired));
+}
+
+VTimerID VTimerWheel::schedule(const VDuration& delay, const VTimerTask& task) {
+    return this->_schedule(this->_durationToTicks(delay), 0, task);
+}
+
+VTimerID VTimerWheel::scheduleRepeating(const VDuration& interval, const VTimerTask& task, const VDuration& initialDelay) {
+    const Vs64 intervalTicks = V_MAX(static_cast<Vs64>(1), this->_durationToTicks(interval));
+    const Vs64 delayTicks = (initialDelay < VDuration::ZERO()) ? intervalTicks : this->_durationToTicks(initialDelay);
+    return this->_schedule(delayTicks, intervalTicks, task);
+}
+
+bool VTimerWheel::cancel(VTimerID timerID) {
+    VMutexLocker locker(&mMutex, "VTimerWheel::cancel()");
+
+    TimerMap::iterator position = mTimers.find(timerID);
+    if (position == mTimers.end()) {
+        return false;
+    }
+
+    Timer* timer = position->second;
+    mTimers.erase(position);
+    ++mNumCancelled;
+
+    // A repeating timer whose task is being called is not in a slot; the wheel
+    // thread sees that it is no longer in mTimers and deletes it afterwards.
+    if (timer->mLevel != -1) {
+        this->_unlink(timer);
+        delete timer;
+    }
+
+    return true;
+}
+
+int VTimerWheel::getNumTimers() const {
+    VMutexLocker locker(&mMutex, "VTimerWheel::getNumTimers()");
+    return static_cast<int>(mTimers.size());
+}
+
+void VTimerWheel::getWheelInfo(VBentoNode& bento) const {
+    VMutexLocker locker(&mMutex, "VTimerWheel::getWheelInfo()");
+
+    bento.addString("name", mName);
+    bento.addS64("tickMilliseconds", mTickDuration.getDurationMilliseconds());
+    bento.addBool("running", mThread != NULL);
+    bento.addInt("timers", static_cast<int>(mTimers.size()));
+    bento.addS64("currentTick", mCurrentTick);
+    bento.addS64("fired", mNumFired);
+    bento.addS64("cancelled", mNumCancelled);
+}
+
+void VTimerWheel::_run(VThread* thread) {
+    while (! mStopping && thread->isRunning()) {
+        Timer* dueTimers = NULL;
+        Vs64 wakeTick = V_MAX_S64;
+
+        /* locker scope */ {
+            VMutexLocker locker(&mMutex, "VTimerWheel::_run() advance");
+
+            const Vs64 nowTick = this->_getElapsedTicks();
+
+            if (mTimers.empty()) {
+                mCurrentTick = V_MAX(mCurrentTick, nowTick + 1); // nothing to turn through
+            }
+
+            while ((dueTimers == NULL) && (mCurrentTick <= nowTick)) {
+                dueTimers = this->_advance();
+            }
+
+            if (dueTimers == NULL) {
+                mNextWakeTick = mTimers.empty() ? V_MAX_S64 : this->_getNextWakeTick();
+                wakeTick = mNextWakeTick;
+            }
+        }
+
+        if (dueTimers != NULL) {
+            // Call the tasks without holding mMutex, so they may schedule and cancel timers.
+            for (Timer* timer = dueTimers; timer != NULL; timer = timer->mNext) {
+                try {
+                    timer->mTask();
+                } catch (const std::exception& ex) {
+                    VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VTimerWheel: Caught exception from timer " VSTRING_FORMATTER_S64 ": %s", mName.chars(), timer->mID, ex.what()));
+                } catch (...) {
+                    VLOGGER_NAMED_ERROR(mLoggerName, VSTRING_FORMAT("[%s] VTimerWheel: Caught unknown exception from timer " VSTRING_FORMATTER_S64 ".", mName.chars(), timer->mID));
+                }
+            }
+
+            VMutexLocker locker(&mMutex, "VTimerWheel::_run() rearm");
+
+            Timer* timer = dueTimers;
+            while (timer != NULL) {
+                Timer* nextTimer = timer->mNext;
+                ++mNumFired;
+
+                if ((timer->mIntervalTicks != 0) && (mTimers.find(timer->mID) != mTimers.end())) {
+                    timer->mExpiryTick += timer->mIntervalTicks;
+                    if (timer->mExpiryTick < mCurrentTick) {
+                        // We fell behind; skip the calls we missed rather than making them all at once.
+                        const Vs64 missedIntervals = (mCurrentTick - timer->mExpiryTick + timer->mIntervalTicks - 1) / timer->mIntervalTicks;
+                        timer->mExpiryTick += missedIntervals * timer->mIntervalTicks;
+                    }
+
+                    this->_insert(timer);
+                } else {
+                    delete timer; // a one-shot timer, or a repeating one that was cancelled while it ran
+                }
+
+                timer = nextTimer;
+            }
+
+            continue; // there may be more due ticks to process
+        }
+
+        VMutexLocker locker(&mBlockingMutex, "VTimerWheel::_run() wait");
+
+        // A scheduler that set mWakeRequested before we got here would have signaled before we
+        // were waiting; one that sets it from now on cannot signal until we are waiting.
+        if (! mWakeRequested.exchange(false) && ! mStopping) {
+            VDuration timeout = VDuration::POSITIVE_INFINITY(); // no deadline if there are no timers
+            if (wakeTick != V_MAX_S64) {
+                const Vs64 waitMicroseconds = (wakeTick * mTickMicroseconds) - (_getMonotonicMicroseconds() - mOriginMicroseconds);
+                timeout = V_MAX(static_cast<Vs64>(1), (waitMicroseconds + 999) / 1000) * VDuration::MILLISECOND();
+            }
+
+            (void) mWakeCondition.wait(&mBlockingMutex, timeout);
+        }
+    }
+}
+
+VTimerID VTimerWheel::_schedule(Vs64 delayTicks, Vs64 intervalTicks, const VTimerTask& task) {
+    bool wake = false;
+    VTimerID timerID;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mMutex, "VTimerWheel::_schedule()");
+
+        // The current tick is partly over, so count from the next one; that way a timer fires late but never early.
+        const Vs64 expiryTick = V_MAX(mCurrentTick, this->_getElapsedTicks() + 1 + delayTicks);
+
+        timerID = mNextTimerID++;
+        Timer* timer = new Timer(timerID, expiryTick, intervalTicks, task);
+        mTimers[timerID] = timer;
+        this->_insert(timer);
+
+        if (expiryTick < mNextWakeTick) {
+            mNextWakeTick = expiryTick;
+            wake = true;
+        }
+    }
+
+    if (wake) {
+        this->_wakeThread();
+    }
+
+    return timerID;
+}
+
+Vs64 VTimerWheel::_getElapsedTicks() const {
+    return (_getMonotonicMicroseconds() - mOriginMicroseconds) / mTickMicroseconds;
+}
+
+Vs64 VTimerWheel::_durationToTicks(const VDuration& duration) const {
+    if (duration <= VDuration::ZERO()) {
+        return 0;
+    }
+
+    const Vs64 tickMilliseconds = mTickDuration.getDurationMilliseconds();
+    return (duration.getDurationMilliseconds() + tickMilliseconds - 1) / tickMilliseconds;
+}
+
+void VTimerWheel::_insert(Timer* timer) {
+    const Vs64 expiryTick = V_MAX(timer->mExpiryTick, mCurrentTick);
+    const Vs64 ticksAhead = expiryTick - mCurrentTick;
+
+    // Place the timer on the finest wheel whose span covers it, in the slot for its expiry.
+    // Beyond the last wheel's span, park it in the furthest slot; it is re-placed when that slot comes round.
+    int level = 0;
+    while ((level < kNumLevels - 1) && (ticksAhead >= (CONST_S64(1) << ((level + 1) * kSlotBits)))) {
+        ++level;
+    }
+
+    const Vs64 placementTick = (ticksAhead > kMaxTicksAhead) ? (mCurrentTick + kMaxTicksAhead) : expiryTick;
+    const int slot = static_cast<int>((placementTick >> (level * kSlotBits)) & kSlotMask);
+
+    timer->mLevel = level;
+    timer->mSlot = slot;
+    timer->mPrev = NULL;
+    timer->mNext = mSlots[level][slot];
+    if (timer->mNext != NULL) {
+        timer->mNext->mPrev = timer;
+    }
+
+    mSlots[level][slot] = timer;
+}
+
+void VTimerWheel::_unlink(Timer* timer) {
+    if (timer->mPrev == NULL) {
+        mSlots[timer->mLevel][timer->mSlot] = timer->mNext;
+    } else {
+        timer->mPrev->mNext = timer->mNext;
+    }
+
+    if (timer->mNext != NULL) {
+        timer->mNext->mPrev = timer->mPrev;
+    }
+
+    timer->mLevel = -1;
+    timer->mSlot = -1;
+    timer->mPrev = NULL;
+    timer->mNext = NULL;
+}
+
+void VTimerWheel::_cascade(int level) {
+    const int slot = static_cast<int>((mCurrentTick >> (level * kSlotBits)) & kSlotMask);
+
+    Timer* timer = mSlots[level][slot];
+    mSlots[level][slot] = NULL;
+
+    while (timer != NULL) {
+        Timer* nextTimer = timer->mNext;
+        this->_insert(timer); // lands on a finer wheel, unless it is still beyond the last wheel's span
+        timer = nextTimer;
+    }
+}
+
+VTimerWheel::Timer* VTimerWheel::_advance() {
+    const int slot = static_cast<int>(mCurrentTick & kSlotMask);
+
+    // When the first wheel comes round, bring down the next wheel's current slot, and so on up.
+    for (int level = 1; level < kNumLevels; ++level) {
+        if (((mCurrentTick >> ((level - 1) * kSlotBits)) & kSlotMask) != 0) {
+            break;
+        }
+
+        this->_cascade(level);
+    }
+
+    Timer* dueTimers = mSlots[0][slot];
+    mSlots[0][slot] = NULL;
+
+    // Detach them from the wheel. One-shot timers can no longer be cancelled; repeating
+    // ones stay in mTimers so that cancel() can stop them being re-armed.
+    for (Timer* timer = dueTimers; timer != NULL; timer = timer->mNext) {
+        timer->mLevel = -1;
+        timer->mSlot = -1;
+        if (timer->mIntervalTicks == 0) {
+            mTimers.erase(timer->mID);
+        }
+    }
+
+    ++mCurrentTick;
+    return dueTimers;
+}
+
+Vs64 VTimerWheel::_getNextWakeTick() const {
+    // Look ahead on the first wheel for an occupied slot. If there is none before it
+    // comes round, wake then, so that the next wheel's timers can be brought down.
+    // That includes the case where it is about to come round on the very next tick.
+    Vs64 tick = mCurrentTick;
+    if ((tick & kSlotMask) == 0) {
+        return tick;
+    }
+
+    do {
+        if (mSlots[0][tick & kSlotMask] != NULL) {
+            return tick;
+        }
+
+        ++tick;
+    } while ((tick & kSlotMask) != 0);
+
+    return tick;
+}
+
+void VTimerWheel::_wakeThread() {
+    mWakeRequested.store(true);
+
+    VMutexLocker locker(&mBlockingMutex, "VTimerWheel::_wakeThread()");
+    mWakeCondition.signal();
+}
@@ -0,0 +1,200 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vtimerwheel_h
+#define vtimerwheel_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include "vstring.h"
+#include "vmutex.h"
+#include "vinstant.h"
+#include "vconditionvariable.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+
+class VBentoNode;
+class VManagementInterface;
+class VThread;
+
+/**
+    @ingroup vthread
+*/
+
+typedef std::function<void()> VTimerTask;   ///< The function a timer calls when it expires.
+typedef Vs64 VTimerID;                      ///< Identifies a scheduled timer, for cancellation. Never 0.
+
+// VTimerWheel ----------------------------------------------------------------
+
+/**
+VTimerWheel runs delayed and periodic tasks for any number of timers on a single
+thread, so that code needing a wakeup "in a while" does not have to dedicate a
+thread to sleeping.
+
+Time is divided into ticks (10ms by default), and each timer is placed in a slot
+of a hierarchy of wheels according to how many ticks away it expires: the first
+wheel has a slot for each of the next 64 ticks, the next a slot for each of the
+next 64 groups of 64 ticks, and so on. Scheduling and cancelling are constant
+time regardless of how many timers exist; as each wheel comes round, the timers
+in its current slot are moved down to a finer wheel. The thread sleeps until the
+next slot that holds a timer, rather than waking on every tick, and sleeps
+without a deadline when there are no timers at all.
+
+A timer may fire up to one tick late, never early. Tasks are called on the
+wheel's thread, one after another, so they should be brief: a task that needs
+to do real work should hand it to a VThreadPool or signal the thread that owns
+it. A task may schedule or cancel timers, including its own.
+
+Most code can use the shared instance returned by getSharedInstance(), which is
+started on first use and stopped by the VShutdownRegistry.
+*/
+class VTimerWheel {
+    public:
+
+        /**
+        Returns the process-wide wheel, creating and starting it on first use. It is
+        stopped and deleted when the VShutdownRegistry shuts down.
+        */
+        static VTimerWheel* getSharedInstance();
+
+        /**
+        Constructs the wheel. Its thread is not started until start() is called.
+        @param  name            the name of the wheel, used to name its thread
+        @param  tickDuration    the granularity of timer expiry; delays are rounded up to a whole number of ticks
+        @param  manager         the management interface to supply to the thread, or NULL
+        */
+        VTimerWheel(const VString& name, const VDuration& tickDuration = 10 * VDuration::MILLISECOND(), VManagementInterface* manager = NULL);
+        /**
+        Destructor. Stops the thread if it is running; pending timers are discarded
+        without being called.
+        */
+        ~VTimerWheel();
+
+        /**
+        Starts the wheel's thread.
+        */
+        void start();
+        /**
+        Stops the wheel's thread and waits for it to end. Timers remain scheduled,
+        and fire late if the wheel is started again.
+        */
+        void stop();
+
+        /**
+        Schedules a task to be called once after a delay.
+        @param  delay   how long from now to call the task; zero or negative means the next tick
+        @param  task    the task to call
+        @return the timer ID, which may be passed to cancel()
+        */
+        VTimerID schedule(const VDuration& delay, const VTimerTask& task);
+        /**
+        Schedules a task to be called repeatedly. If the wheel falls behind, missed
+        calls are skipped rather than made in a burst.
+        @param  interval        the time between calls; must be at least one tick
+        @param  task            the task to call
+        @param  initialDelay    the time until the first call; negative (the default) means one interval
+        @return the timer ID, which may be passed to cancel()
+        */
+        VTimerID scheduleRepeating(const VDuration& interval, const VTimerTask& task, const VDuration& initialDelay = VDuration::NEGATIVE_INFINITY());
+        /**
+        Cancels a timer. A one-shot timer whose task has already been called (or is
+        being called) cannot be cancelled. A repeating timer that is cancelled while
+        its task is being called is not called again.
+        @param  timerID the ID returned by schedule() or scheduleRepeating()
+        @return true if the timer was found and cancelled; false if it had already fired or been cancelled
+        */
+        bool cancel(VTimerID timerID);
+
+        /**
+        Returns the wheel name.
+        */
+        const VString& getName() const { return mName; }
+        /**
+        Returns the tick duration.
+        */
+        const VDuration& getTickDuration() const { return mTickDuration; }
+        /**
+        Returns the number of timers currently scheduled.
+        */
+        int getNumTimers() const;
+        /**
+        Adds the wheel's state and counters to a bento node, for diagnostics.
+        @param  bento   the node to add to
+        */
+        void getWheelInfo(VBentoNode& bento) const;
+
+    private:
+
+        VTimerWheel(const VTimerWheel&); // not copyable
+        VTimerWheel& operator=(const VTimerWheel&); // not assignable
+
+        static const int kNumLevels = 4;                    ///< Number of wheels in the hierarchy.
+        static const int kSlotBits = 6;                     ///< Each wheel has 2^kSlotBits slots.
+        static const int kNumSlots = 1 << kSlotBits;        ///< Number of slots per wheel.
+        static const Vs64 kSlotMask = kNumSlots - 1;        ///< Mask to get a slot index from a tick count.
+        static const Vs64 kMaxTicksAhead = (CONST_S64(1) << (kNumLevels * kSlotBits)) - 1; ///< Timers further out are parked on the last wheel and re-placed as it turns.
+
+        /**
+        A scheduled timer. Timers in the same slot form a doubly linked list, so a
+        cancelled timer can be unlinked without searching.
+        */
+        struct Timer {
+            Timer(VTimerID id, Vs64 expiryTick, Vs64 intervalTicks, const VTimerTask& task) : mID(id), mExpiryTick(expiryTick), mIntervalTicks(intervalTicks), mTask(task), mLevel(-1), mSlot(-1), mPrev(NULL), mNext(NULL) {}
+
+            VTimerID    mID;            ///< The ID handed out for this timer.
+            Vs64        mExpiryTick;    ///< The tick at which the timer fires.
+            Vs64        mIntervalTicks; ///< The repeat interval, or 0 for a one-shot timer.
+            VTimerTask  mTask;          ///< The task to call.
+            int         mLevel;         ///< The wheel the timer is in, or -1 if it is not in a slot (it is firing).
+            int         mSlot;          ///< The slot the timer is in, if mLevel is not -1.
+            Timer*      mPrev;          ///< Previous timer in the slot.
+            Timer*      mNext;          ///< Next timer in the slot.
+        };
+
+        typedef std::map<VTimerID, Timer*> TimerMap;
+
+        friend class VTimerWheelThread;
+
+        void _run(VThread* thread);                 ///< The wheel thread's main loop.
+        VTimerID _schedule(Vs64 delayTicks, Vs64 intervalTicks, const VTimerTask& task);
+        Vs64 _getElapsedTicks() const;              ///< Returns the number of ticks since construction, from a monotonic clock.
+        Vs64 _durationToTicks(const VDuration& duration) const; ///< Rounds up to whole ticks.
+        void _insert(Timer* timer);                 ///< Places a timer in the right slot relative to mCurrentTick. ASSUMES CALLER HOLDS mMutex.
+        void _unlink(Timer* timer);                 ///< Removes a timer from its slot. ASSUMES CALLER HOLDS mMutex.
+        void _cascade(int level);                   ///< Re-places the timers in a wheel's current slot. ASSUMES CALLER HOLDS mMutex.
+        Timer* _advance();                          ///< Processes mCurrentTick and returns the list of due timers. ASSUMES CALLER HOLDS mMutex.
+        Vs64 _getNextWakeTick() const;              ///< Returns the earliest tick at which there may be work. ASSUMES CALLER HOLDS mMutex.
+        void _wakeThread();                         ///< Wakes the thread so it looks at the wheel again.
+
+        VString             mName;                  ///< The wheel name, for the thread name and log output.
+        VString             mLoggerName;            ///< The logger name which we will use when emitting log output.
+        VDuration           mTickDuration;          ///< The length of a tick.
+        Vs64                mTickMicroseconds;      ///< The length of a tick in microseconds.
+        Vs64                mOriginMicroseconds;    ///< The monotonic clock value at construction, in microseconds.
+        VManagementInterface* mManager;             ///< The management interface supplied to the thread.
+        VThread*            mThread;                ///< The wheel thread while it is running (we own it).
+        volatile bool       mStopping;              ///< Set by stop() to end the thread.
+
+        std::atomic<bool>   mWakeRequested;         ///< Set before mWakeCondition is signaled, so a wakeup is not lost if the thread is not yet waiting.
+        VMutex              mBlockingMutex;         ///< The mutex held by the thread while it waits on mWakeCondition.
+        VConditionVariable  mWakeCondition;         ///< Signaled when a timer is scheduled before mNextWakeTick, or on stop().
+
+        mutable VMutex      mMutex;                 ///< Guards everything below.
+        Timer*              mSlots[kNumLevels][kNumSlots]; ///< The wheels; each slot heads a list of timers.
+        TimerMap            mTimers;                ///< Every scheduled timer, by ID; a timer being called is here only if it repeats.
+        Vs64                mCurrentTick;           ///< The next tick to be processed.
+        Vs64                mNextWakeTick;          ///< The tick the thread will wake at if not signaled.
+        VTimerID            mNextTimerID;           ///< The ID to hand out next.
+        Vs64                mNumFired;              ///< Counter of task calls.
+        Vs64                mNumCancelled;          ///< Counter of successful cancellations.
+};
+
+#endif /* vtimerwheel_h */
@@ -0,0 +1,659 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vasynclogappender.h"
+
+#include "vthread.h"
+#include "vmutexlocker.h"
+#include "vshutdownregistry.h"
+#include "vsettings.h"
+#include "vbento.h"
+#include "vexception.h"
+
+#include <algorithm>
+#include <set>
+
+// VAsyncLogAppenderThread ----------------------------------------------------
+
+/**
+The background thread of an async appender. It is private to the appender, which
+starts, joins, and deletes it.
+*/
+class VAsyncLogAppenderThread : public VThread {
+    public:
+
+        VAsyncLogAppenderThread(const VString& name, VAsyncLogAppender* appender)
+            : VThread(name, "vault.toolbox.VAsyncLogAppender", kDontDeleteSelfAtEnd, kCreateThreadJoinable, NULL)
+            , mAppender(appender)
+            {}
+        virtual ~VAsyncLogAppenderThread() {}
+
+        virtual void run() { mAppender->_run(this); }
+        // The appender waits for records, so it has to be woken to notice it has been stopped.
+        virtual void stop() { VThread::stop(); mAppender->mStopping = true; mAppender->_wakeWriter(); }
+
+    private:
+
+        VAsyncLogAppenderThread(const VAsyncLogAppenderThread&); // not copyable
+        VAsyncLogAppenderThread& operator=(const VAsyncLogAppenderThread&); // not assignable
+
+        VAsyncLogAppender* mAppender; ///< The appender we write for.
+};
+
+// VAsyncLogAppender ----------------------------------------------------------
+
+// A producer waiting for room is broadcast to after every batch; this only covers a missed wakeup.
+static const VDuration kRoomWaitBackstop = 10 * VDuration::MILLISECOND();
+// Likewise the background thread is signaled when a record arrives.
+static const VDuration kRecordsWaitBackstop = VDuration::SECOND();
+static const VDuration kDrainWaitBackstop = 100 * VDuration::MILLISECOND();
+// While a ring keeps overflowing, warn about it this often rather than after every batch.
+static const VDuration kDroppedReportInterval = VDuration::SECOND();
+
+// Each thread is given a ring index the first time it logs to any async appender, and uses
+// it modulo the number of rings of whichever appender it is logging to.
+static std::atomic<int> gNextRingIndex(0);
+static V_THREAD_LOCAL int gRingIndex = -1;
+// Set on each appender's background thread. Anything it logs while writing is written through.
+static V_THREAD_LOCAL bool gIsAsyncLogWriter = false;
+
+// This style of static mutex declaration and access ensures correct
+// initialization if accessed during the static initialization phase.
+static VMutex* _mutexLiveAppenders() {
+    static VMutex gMutex("VAsyncLogAppender _mutexLiveAppenders() gMutex", true/*suppress logging*/);
+    return &gMutex;
+}
+
+// _mutexLiveAppenders() must be locked whenever referencing these:
+
+typedef std::set<VAsyncLogAppender*> VAsyncLogAppenderSet;
+static VAsyncLogAppenderSet& _getLiveAppenders() {
+    static VAsyncLogAppenderSet* gLiveAppenders = new VAsyncLogAppenderSet();
+    return *gLiveAppenders;
+}
+
+static bool gStopAllRegistered = false;
+
+static bool _isLoggedBefore(const VLogRecord* a, const VLogRecord* b) {
+    return a->mSequenceNumber < b->mSequenceNumber;
+}
+
+static Vu64 _roundUpToPowerOfTwo(int value) {
+    Vu64 result = 1;
+    while (result < static_cast<Vu64>(value)) {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+VAsyncLogAppender::Ring::Ring(int size)
+    : mSlots(NULL)
+    , mMask(_roundUpToPowerOfTwo(size) - 1)
+    , mWritePosition(0)
+    , mReadPosition(0)
+    , mNumTaken(0)
+    {
+
+    mSlots = new Slot[mMask + 1];
+    for (Vu64 i = 0; i <= mMask; ++i) {
+        mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+VAsyncLogAppender::VAsyncLogAppender(const VString& name, VLogAppenderPtr target, OverflowPolicy overflowPolicy, int overflowKeepLevel, int numRings, int ringSize, int batchSize)
+    : VLogAppender(name, DONT_FORMAT_OUTPUT, VString::EMPTY(), VString::EMPTY())
+    , mTargetName((target == nullptr) ? VString::EMPTY() : target->getName())
+    , mTarget(target)
+    , mOverflowPolicy(overflowPolicy)
+    , mOverflowKeepLevel(overflowKeepLevel)
+    , mNumRings(V_MAX(1, numRings))
+    , mRings(NULL)
+    , mBatchSize(V_MAX(1, batchSize))
+    , mBatch()
+    , mThread(NULL)
+    , mHasTarget(target != nullptr)
+    , mStopping(false)
+    , mWriterWaiting(false)
+    , mNumWaitingProducers(0)
+    , mNumEnqueuing(0)
+    , mNextSequenceNumber(0)
+    , mNumQueued(0)
+    , mNumDequeued(0)
+    , mNumWritten(0)
+    , mNumDropped(0)
+    , mNumBlocked(0)
+    , mNumDroppedReported(0)
+    , mWhenDroppedReported(VInstant::INFINITE_PAST())
+    , mQueueMutex(VSTRING_FORMAT("VAsyncLogAppender(%s)::mQueueMutex", name.chars()), true/*this mutex itself must not log*/)
+    , mRecordsAvailable()
+    , mRoomAvailable()
+    , mBatchWritten()
+    {
+
+    this->_construct(ringSize);
+}
+
+VAsyncLogAppender::VAsyncLogAppender(const VSettingsNode& settings, const VSettingsNode& defaults)
+    : VLogAppender(settings, defaults)
+    , mTargetName(VLogAppender::_getStringInitSetting("target", settings, defaults, VString::EMPTY()))
+    , mTarget()
+    , mOverflowPolicy(VAsyncLogAppender::parseOverflowPolicy(VLogAppender::_getStringInitSetting("overflow", settings, defaults, "block")))
+    , mOverflowKeepLevel(VLoggerLevel::fromString(VLogAppender::_getStringInitSetting("overflow-keep-level", settings, defaults, "WARN")))
+    , mNumRings(V_MAX(1, VLogAppender::_getIntInitSetting("num-rings", settings, defaults, 8)))
+    , mRings(NULL)
+    , mBatchSize(V_MAX(1, VLogAppender::_getIntInitSetting("batch-size", settings, defaults, 512)))
+    , mBatch()
+    , mThread(NULL)
+    , mHasTarget(false)
+    , mStopping(false)
+    , mWriterWaiting(false)
+    , mNumWaitingProducers(0)
+    , mNumEnqueuing(0)
+    , mNextSequenceNumber(0)
+    , mNumQueued(0)
+    , mNumDequeued(0)
+    , mNumWritten(0)
+    , mNumDropped(0)
+    , mNumBlocked(0)
+    , mNumDroppedReported(0)
+    , mWhenDroppedReported(VInstant::INFINITE_PAST())
+    , mQueueMutex(VSTRING_FORMAT("VAsyncLogAppender(%s)::mQueueMutex", mName.chars()), true/*this mutex itself must not log*/)
+    , mRecordsAvailable()
+    , mRoomAvailable()
+    , mBatchWritten()
+    {
+
+    if (mTargetName.isEmpty() || (mTargetName == mName)) {
+        throw VStackTraceException(VSTRING_FORMAT("VAsyncLogAppender '%s': The target appender name '%s' is missing or names this appender.", mName.chars(), mTargetName.chars()));
+    }
+
+    this->_construct(VLogAppender::_getIntInitSetting("ring-size", settings, defaults, 1024));
+}
+
+VAsyncLogAppender::~VAsyncLogAppender() {
+    try {
+        VMutexLocker locker(_mutexLiveAppenders(), "VAsyncLogAppender::~VAsyncLogAppender()");
+        _getLiveAppenders().erase(this);
+        this->_stop();
+    } catch (...) {} // prevent exception from propagating
+
+    for (int i = 0; i < mNumRings; ++i) {
+        delete mRings[i];
+    }
+
+    delete [] mRings;
+}
+
+void VAsyncLogAppender::emit(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName, bool emitRawLine, const VString& rawLine) {
+    const VString threadName = VThread::getCurrentThreadName();
+
+    Emission emission;
+    emission.mLevel = level;
+    emission.mFile = file;
+    emission.mLine = line;
+    emission.mEmitMessage = emitMessage;
+    emission.mMessage = &message;
+    emission.mDeferredMessage = NULL;
+    emission.mSpecifiedLoggerName = &specifiedLoggerName;
+    emission.mActualLoggerName = &actualLoggerName;
+    emission.mEmitRawLine = emitRawLine;
+    emission.mRawLine = &rawLine;
+    emission.mThreadName = &threadName;
+    // emission.mWhen was constructed as the current time.
+
+    this->_enqueue(emission);
+}
+
+void VAsyncLogAppender::emitDeferred(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
+    const VString threadName = VThread::getCurrentThreadName();
+
+    Emission emission;
+    emission.mLevel = level;
+    emission.mFile = file;
+    emission.mLine = line;
+    emission.mEmitMessage = true;
+    emission.mMessage = &VString::EMPTY();
+    emission.mDeferredMessage = &message;
+    emission.mSpecifiedLoggerName = &specifiedLoggerName;
+    emission.mActualLoggerName = &actualLoggerName;
+    emission.mEmitRawLine = false;
+    emission.mRawLine = &VString::EMPTY();
+    emission.mThreadName = &threadName;
+    // emission.mWhen was constructed as the current time.
+
+    this->_enqueue(emission);
+}
+
+void VAsyncLogAppender::emitRecords(const VLogRecordList& records) {
+    for (VLogRecordList::const_iterator i = records.begin(); i != records.end(); ++i) {
+        const VLogRecord& record = **i;
+
+        Emission emission;
+        emission.mLevel = record.mLevel;
+        emission.mFile = record.mFile;
+        emission.mLine = record.mLine;
+        emission.mEmitMessage = record.mEmitMessage;
+        emission.mMessage = &record.mMessage;
+        emission.mDeferredMessage = record.mMessageIsDeferred ? &record.mDeferredMessage : NULL;
+        emission.mSpecifiedLoggerName = &record.mSpecifiedLoggerName;
+        emission.mActualLoggerName = &record.mActualLoggerName;
+        emission.mEmitRawLine = record.mEmitRawLine;
+        emission.mRawLine = &record.mRawLine;
+        emission.mWhen = record.mWhen;
+        emission.mThreadName = &record.mThreadName;
+
+        this->_enqueue(emission);
+    }
+}
+
+void VAsyncLogAppender::addInfo(VBentoNode& infoNode) const {
+    VLogAppender::addInfo(infoNode);
+
+    infoNode.addString("type", "VAsyncLogAppender");
+    infoNode.addString("target", mTargetName);
+    infoNode.addString("overflow", (mOverflowPolicy == kBlock) ? "block" : ((mOverflowPolicy == kDrop) ? "drop" : "drop-verbose"));
+    infoNode.addString("overflow-keep-level", VLoggerLevel::getName(mOverflowKeepLevel));
+    infoNode.addInt("num-rings", mNumRings);
+    infoNode.addInt("ring-size", static_cast<int>(mRings[0]->mMask + 1));
+    infoNode.addInt("batch-size", mBatchSize);
+    infoNode.addS64("queued", mNumQueued.load(std::memory_order_relaxed));
+    infoNode.addS64("written", mNumWritten.load(std::memory_order_relaxed));
+    infoNode.addS64("dropped", mNumDropped.load(std::memory_order_relaxed));
+    infoNode.addS64("blocked", mNumBlocked.load(std::memory_order_relaxed));
+}
+
+void VAsyncLogAppender::drain() {
+    const Vs64 numQueued = mNumQueued.load();
+
+    VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::drain()");
+    while (! mStopping.load() && (mNumDequeued.load() < numQueued)) {
+        (void) mBatchWritten.wait(&mQueueMutex, kDrainWaitBackstop);
+    }
+}
+
+void VAsyncLogAppender::stop() {
+    VMutexLocker locker(_mutexLiveAppenders(), "VAsyncLogAppender::stop()");
+    this->_stop();
+}
+
+// static
+VAsyncLogAppender::OverflowPolicy VAsyncLogAppender::parseOverflowPolicy(const VString& value) {
+    if (value.equalsIgnoreCase("block")) {
+        return kBlock;
+    } else if (value.equalsIgnoreCase("drop")) {
+        return kDrop;
+    } else if (value.equalsIgnoreCase("drop-verbose")) {
+        return kDropVerbose;
+    }
+
+    throw VRangeException(VSTRING_FORMAT("VAsyncLogAppender::parseOverflowPolicy: Invalid overflow policy '%s'.", value.chars()));
+}
+
+void VAsyncLogAppender::_construct(int ringSize) {
+    mRings = new Ring*[mNumRings];
+    for (int i = 0; i < mNumRings; ++i) {
+        mRings[i] = new Ring(V_MAX(2, ringSize));
+    }
+
+    mBatch.reserve(mNumRings * mBatchSize);
+
+    /* locker scope */ {
+        VMutexLocker locker(_mutexLiveAppenders(), "VAsyncLogAppender::_construct()");
+        _getLiveAppenders().insert(this);
+
+        if (! gStopAllRegistered) {
+            gStopAllRegistered = true;
+            VShutdownRegistry::instance()->registerFunction(VAsyncLogAppender::_stopAll);
+        }
+    }
+
+    mThread = new VAsyncLogAppenderThread(VSTRING_FORMAT("VAsyncLogAppender(%s)", mName.chars()), this);
+    mThread->start();
+}
+
+void VAsyncLogAppender::_run(VThread* /*thread*/) {
+    gIsAsyncLogWriter = true;
+
+    while (! mStopping.load()) {
+        if (this->_writeBatch()) {
+            continue;
+        }
+
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_run() wait");
+
+        // A producer publishes its record and then looks at mWriterWaiting; we set mWriterWaiting
+        // and then look for records. With a full fence between each pair, one of us sees the other.
+        mWriterWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (! mStopping.load() && ! this->_hasQueuedRecords()) {
+            (void) mRecordsAvailable.wait(&mQueueMutex, kRecordsWaitBackstop);
+        }
+
+        mWriterWaiting.store(false, std::memory_order_relaxed);
+    }
+
+    // Write out whatever was queued before we were stopped.
+    while (this->_writeBatch()) {
+    }
+}
+
+bool VAsyncLogAppender::_writeBatch() {
+    mBatch.clear();
+
+    for (int i = 0; i < mNumRings; ++i) {
+        mRings[i]->mNumTaken = 0;
+    }
+
+    // Merge the rings: always take the oldest record at the head of any ring. When that record's
+    // ring has given its share of the batch, stop, so that it does not wait for the next batch
+    // behind records from other rings that were logged after it.
+    for (;;) {
+        Ring* oldestRing = NULL;
+        VLogRecord* oldestRecord = NULL;
+
+        for (int i = 0; i < mNumRings; ++i) {
+            Ring& ring = *mRings[i];
+            const Vu64 position = ring.mReadPosition + ring.mNumTaken;
+            Slot& slot = ring.mSlots[position & ring.mMask];
+
+            if ((slot.mSequence.load(std::memory_order_acquire) == position + 1) &&
+                ((oldestRecord == NULL) || _isLoggedBefore(&slot.mRecord, oldestRecord))) {
+                oldestRing = &ring;
+                oldestRecord = &slot.mRecord;
+            }
+        }
+
+        if ((oldestRecord == NULL) || (oldestRing->mNumTaken == mBatchSize)) {
+            break;
+        }
+
+        mBatch.push_back(oldestRecord);
+        ++oldestRing->mNumTaken;
+    }
+
+    if (mBatch.empty()) {
+        return false;
+    }
+
+    // Threads that share a ring may have claimed its slots out of order of their sequence
+    // numbers, so the merge leaves a few records out of place; put them back in logging order.
+    std::sort(mBatch.begin(), mBatch.end(), _isLoggedBefore);
+
+    const Vs64 numRecords = static_cast<Vs64>(mBatch.size());
+    VLogAppenderPtr target = this->_getTarget();
+    if (target == nullptr) {
+        mNumDropped.fetch_add(numRecords);
+    } else {
+        try {
+            target->emitRecords(mBatch);
+            mNumWritten.fetch_add(numRecords);
+        } catch (...) {} // the target failed; there is nobody to tell, and nothing left to do with the records
+    }
+
+    // Hand the slots back to the producers.
+    for (int i = 0; i < mNumRings; ++i) {
+        Ring& ring = *mRings[i];
+        for (int n = 0; n < ring.mNumTaken; ++n, ++ring.mReadPosition) {
+            ring.mSlots[ring.mReadPosition & ring.mMask].mSequence.store(ring.mReadPosition + ring.mMask + 1, std::memory_order_release);
+        }
+    }
+
+    mNumDequeued.fetch_add(numRecords);
+
+    /* locker scope */ {
+        // Waiting producers change mNumWaitingProducers and try for room with this mutex held,
+        // so any that did not see the slots we just freed are waiting by now.
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_writeBatch() notify");
+
+        if (mNumWaitingProducers.load() != 0) {
+            mRoomAvailable.broadcast();
+        }
+
+        mBatchWritten.broadcast();
+    }
+
+    this->_reportDropped(target);
+
+    return true;
+}
+
+void VAsyncLogAppender::_stop() {
+    if (mThread == NULL) {
+        return;
+    }
+
+    mStopping = true;
+    this->_wakeWriter();
+
+    mThread->join();
+    delete mThread;
+    mThread = NULL;
+
+    // A producer that looked at mStopping before we set it may still be adding a record.
+    while (mNumEnqueuing.load() != 0) {
+        VThread::yield();
+    }
+
+    while (this->_writeBatch()) {
+    }
+
+    this->_reportDropped(mTarget); // the thread is gone, so nothing else changes mTarget
+
+    /* locker scope */ {
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_stop()");
+        mBatchWritten.broadcast();
+    }
+}
+
+// static
+void VAsyncLogAppender::_stopAll() {
+    VMutexLocker locker(_mutexLiveAppenders(), "VAsyncLogAppender::_stopAll()");
+
+    for (VAsyncLogAppenderSet::const_iterator i = _getLiveAppenders().begin(); i != _getLiveAppenders().end(); ++i) {
+        try {
+            (*i)->_stop();
+        } catch (...) {} // keep going so that the rest are stopped
+    }
+
+    gStopAllRegistered = false; // the registry forgets its functions once it has called them
+}
+
+void VAsyncLogAppender::_reportDropped(VLogAppenderPtr target) {
+    const Vs64 numDropped = mNumDropped.load();
+    if ((numDropped == mNumDroppedReported) || (target == nullptr)) {
+        return;
+    }
+
+    const VInstant now;
+    if (! mStopping.load() && ((now - mWhenDroppedReported) < kDroppedReportInterval)) {
+        return;
+    }
+
+    const VString message(VSTRING_FORMAT("VAsyncLogAppender '%s': Dropped " VSTRING_FORMATTER_S64 " log records since the last report.", mName.chars(), numDropped - mNumDroppedReported));
+    mNumDroppedReported = numDropped;
+    mWhenDroppedReported = now;
+
+    try {
+        target->emit(VLoggerLevel::WARN, NULL, 0, true, message, VString::EMPTY(), mName, false, VString::EMPTY());
+    } catch (...) {}
+}
+
+void VAsyncLogAppender::_enqueue(const Emission& emission) {
+    // Counted before looking at mStopping, so that _stop() can wait for us if we miss it.
+    mNumEnqueuing.fetch_add(1);
+
+    if (gIsAsyncLogWriter || mStopping.load()) {
+        mNumEnqueuing.fetch_sub(1);
+        this->_writeThrough(emission);
+        return;
+    }
+
+    if (gRingIndex < 0) {
+        gRingIndex = static_cast<int>(gNextRingIndex.fetch_add(1, std::memory_order_relaxed) & V_MAX_S32);
+    }
+
+    Ring& ring = *mRings[gRingIndex % mNumRings];
+    const Vs64 sequenceNumber = mNextSequenceNumber.fetch_add(1, std::memory_order_relaxed);
+    bool queued = this->_tryEnqueue(ring, emission, sequenceNumber);
+
+    if (! queued) {
+        // Until the target is found, the background thread may need the VLogger registry lock to look it up,
+        // and we may be holding that lock (VLogger::emitToGlobalAppenders() does), so we must not wait for it.
+        if (! mHasTarget.load() || (mOverflowPolicy == kDrop) || ((mOverflowPolicy == kDropVerbose) && (emission.mLevel > mOverflowKeepLevel))) {
+            mNumDropped.fetch_add(1);
+            mNumEnqueuing.fetch_sub(1);
+            return;
+        }
+
+        mNumBlocked.fetch_add(1);
+
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_enqueue() wait for room");
+        mNumWaitingProducers.fetch_add(1);
+
+        while (! mStopping.load() && ! (queued = this->_tryEnqueue(ring, emission, sequenceNumber))) {
+            (void) mRoomAvailable.wait(&mQueueMutex, kRoomWaitBackstop);
+        }
+
+        mNumWaitingProducers.fetch_sub(1);
+    }
+
+    if (queued) {
+        mNumQueued.fetch_add(1);
+    }
+
+    mNumEnqueuing.fetch_sub(1);
+
+    if (queued) {
+        this->_wakeWriter();
+    } else {
+        this->_writeThrough(emission); // stopped while we waited for room
+    }
+}
+
+bool VAsyncLogAppender::_tryEnqueue(Ring& ring, const Emission& emission, Vs64 sequenceNumber) {
+    Vu64 position = ring.mWritePosition.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Slot& slot = ring.mSlots[position & ring.mMask];
+        const Vs64 difference = static_cast<Vs64>(slot.mSequence.load(std::memory_order_acquire) - position);
+
+        if (difference == 0) {
+            // The slot is free for this position; claim the position.
+            if (ring.mWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                VLogRecord& record = slot.mRecord;
+                VAsyncLogAppender::_copyToRecord(emission, record);
+                record.mSequenceNumber = sequenceNumber;
+
+                slot.mSequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+            // compare_exchange_weak reloaded position; try again.
+        } else if (difference < 0) {
+            return false; // the slot still holds a record from one lap ago, so the ring is full
+        } else {
+            position = ring.mWritePosition.load(std::memory_order_relaxed); // another producer claimed it
+        }
+    }
+}
+
+// static
+void VAsyncLogAppender::_copyToRecord(const Emission& emission, VLogRecord& record) {
+    record.mLevel = emission.mLevel;
+    record.mFile = emission.mFile;
+    record.mLine = emission.mLine;
+    record.mEmitMessage = emission.mEmitMessage;
+
+    // A deferred message that some other appender has already formatted is copied as text.
+    record.mMessageIsDeferred = (emission.mDeferredMessage != NULL) && ! emission.mDeferredMessage->isFormatted();
+    if (record.mMessageIsDeferred) {
+        record.mDeferredMessage = *emission.mDeferredMessage;
+    } else {
+        record.mMessage = (emission.mDeferredMessage != NULL) ? emission.mDeferredMessage->getText() : *emission.mMessage;
+    }
+
+    record.mSpecifiedLoggerName = *emission.mSpecifiedLoggerName;
+    record.mActualLoggerName = *emission.mActualLoggerName;
+    record.mEmitRawLine = emission.mEmitRawLine;
+    record.mRawLine = *emission.mRawLine;
+    record.mWhen = emission.mWhen;
+    record.mThreadName = *emission.mThreadName;
+}
+
+bool VAsyncLogAppender::_hasQueuedRecords() const {
+    for (int i = 0; i < mNumRings; ++i) {
+        const Ring& ring = *mRings[i];
+        if (ring.mSlots[ring.mReadPosition & ring.mMask].mSequence.load(std::memory_order_acquire) == ring.mReadPosition + 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void VAsyncLogAppender::_writeThrough(const Emission& emission) {
+    VLogAppenderPtr target;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_writeThrough()");
+        target = mTarget;
+    }
+
+    // We may be called with the VLogger registry locked, so we cannot look up the target here.
+    if (target == nullptr) {
+        mNumDropped.fetch_add(1);
+        return;
+    }
+
+    VLogRecord record;
+    VAsyncLogAppender::_copyToRecord(emission, record);
+
+    VLogRecordList records;
+    records.push_back(&record);
+    target->emitRecords(records);
+}
+
+VLogAppenderPtr VAsyncLogAppender::_getTarget() {
+    /* locker scope */ {
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_getTarget()");
+        if (mTarget != nullptr) {
+            return mTarget;
+        }
+    }
+
+    // Look it up without holding mQueueMutex: a producer may be waiting for room on mQueueMutex
+    // while holding the VLogger registry's read lock, and a pending writer would then keep us
+    // from getting the read lock ourselves.
+    VLogAppenderPtr target = VLogger::getAppender(mTargetName);
+
+    if (target.get() == this) {
+        return VLogAppenderPtr(); // we are the default appender, and our target is not configured
+    }
+
+    // getAppender() falls back to the default appender. Use that for now, but keep looking
+    // for the real target in case it is configured after us.
+    if ((target != nullptr) && (target->getName() == mTargetName)) {
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_getTarget() store");
+        mTarget = target;
+        mHasTarget.store(true);
+    }
+
+    return target;
+}
+
+void VAsyncLogAppender::_wakeWriter() {
+    // Pairs with the fence in _run(); see there.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (mWriterWaiting.load(std::memory_order_relaxed)) {
+        VMutexLocker locker(&mQueueMutex, "VAsyncLogAppender::_wakeWriter()");
+        mRecordsAvailable.signal();
+    }
+}
@@ -0,0 +1,242 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vasynclogappender_h
+#define vasynclogappender_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include "vlogger.h"
+#include "vconditionvariable.h"
+
+#include <atomic>
+
+class VThread;
+
+/**
+    @ingroup vlogger
+*/
+
+// VAsyncLogAppender ----------------------------------------------------------
+
+/**
+VAsyncLogAppender takes log output off the calling threads. It does no writing of its
+own: emit() copies its arguments, along with the time and the calling thread's name,
+into a record on a queue, and returns. A background thread takes the records off the
+queue in batches and hands each batch to a target appender via emitRecords(), so the
+target is locked and flushed once per batch rather than once per line, and a slow disk
+holds up only the background thread.
+
+The queue is a set of fixed-size rings. Each calling thread is assigned one ring the
+first time it logs, round robin, so with no more logging threads than rings every
+thread has its own. A ring is a lock-free bounded queue: adding a record is a
+compare-and-swap on the ring's write position, and the background thread is the only
+reader. Records carry a sequence number, and the background thread builds each batch
+by merging the rings in sequence order, so records come out in the order they were
+logged even when one ring holds more than a batch.
+
+When a ring is full the overflow policy decides what the calling thread does:
+- kBlock waits until the background thread has made room. Nothing is lost.
+- kDrop discards the record and counts it.
+- kDropVerbose discards the record if it is less severe than the keep level, and
+  otherwise waits as for kBlock. So warnings and errors are never lost, but a burst
+  of debug output cannot stall the application.
+Discarded records are counted in a warning emitted through the target appender, at
+most once a second, and in addInfo(). Until the target has been found (see "target"
+below), no calling thread waits for room, whatever the policy: a record that does not
+fit is discarded. The calling thread may be holding the VLogger registry lock, which
+the background thread needs in order to look the target up.
+
+The appender registers with VShutdownRegistry, and on shutdown (or when it is
+destroyed) it writes out everything that is queued before its thread ends. After that,
+emit() writes through to the target on the calling thread.
+
+It defines the following additional settings properties:
+- "target" (string)
+  Required. The name of the appender to write to. It is looked up when the first batch
+  is written, so it may be configured after this one.
+- "overflow" (string)
+  "block" (the default), "drop", or "drop-verbose".
+- "overflow-keep-level" (int or level name)
+  Defaults to WARN. For "drop-verbose", records at this level or more severe are not dropped.
+- "num-rings" (int)
+  Defaults to 8. The number of rings.
+- "ring-size" (int)
+  Defaults to 1024. The number of records each ring holds; rounded up to a power of 2.
+- "batch-size" (int)
+  Defaults to 512. The most records taken from each ring for one batch. A batch ends
+  early when the oldest queued record is in a ring that has given its share.
+*/
+class VAsyncLogAppender : public VLogAppender {
+    public:
+
+        /**
+        What a calling thread does when its ring is full.
+        */
+        enum OverflowPolicy {
+            kBlock,         ///< Wait for room.
+            kDrop,          ///< Discard the record.
+            kDropVerbose    ///< Discard the record if it is less severe than the keep level; otherwise wait.
+        };
+
+        /**
+        Constructs the appender and starts its thread.
+        @param  name                the appender name
+        @param  target              the appender to write to
+        @param  overflowPolicy      what to do when a ring is full
+        @param  overflowKeepLevel   for kDropVerbose, the least severe level that is never dropped
+        @param  numRings            the number of rings
+        @param  ringSize            the number of records each ring holds
+        @param  batchSize           the most records taken from each ring for one batch
+        */
+        VAsyncLogAppender(const VString& name, VLogAppenderPtr target, OverflowPolicy overflowPolicy = kBlock, int overflowKeepLevel = VLoggerLevel::WARN, int numRings = 8, int ringSize = 1024, int batchSize = 512);
+        /**
+        Constructs the appender from settings and starts its thread.
+        @param  settings    the appender settings, described above
+        @param  defaults    default settings for the appender kind
+        */
+        VAsyncLogAppender(const VSettingsNode& settings, const VSettingsNode& defaults);
+        /**
+        Writes out all queued records and stops the thread.
+        */
+        virtual ~VAsyncLogAppender();
+
+        /**
+        Queues the output for the background thread. @see VLogAppender::emit()
+        */
+        virtual void emit(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName, bool emitRawLine, const VString& rawLine);
+        /**
+        Queues the message without formatting it; the background thread formats it when it
+        hands it to the target. A record that is dropped is never formatted.
+        */
+        virtual void emitDeferred(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
+        /**
+        Queues each of the records for the background thread, keeping their time stamps and thread names.
+        */
+        virtual void emitRecords(const VLogRecordList& records);
+        virtual void addInfo(VBentoNode& infoNode) const;
+
+        /**
+        Waits until every record queued before the call has been handed to the target.
+        Returns at once if the background thread has been stopped.
+        */
+        void drain();
+        /**
+        Writes out all queued records and stops the background thread. Later output is
+        written through to the target on the calling thread. Called for every appender
+        when VShutdownRegistry shuts down.
+        */
+        void stop();
+
+        Vs64 getNumDropped() const { return mNumDropped.load(std::memory_order_relaxed); }      ///< Returns the number of records discarded because their ring was full or there was no target.
+        Vs64 getNumBlocked() const { return mNumBlocked.load(std::memory_order_relaxed); }      ///< Returns the number of times a calling thread waited for room.
+        Vs64 getNumWritten() const { return mNumWritten.load(std::memory_order_relaxed); }      ///< Returns the number of records handed to the target.
+
+        /**
+        Parses an "overflow" setting value. Throws a VRangeException if it is not recognized.
+        */
+        static OverflowPolicy parseOverflowPolicy(const VString& value);
+
+    private:
+
+        VAsyncLogAppender(const VAsyncLogAppender&); // not copyable
+        VAsyncLogAppender& operator=(const VAsyncLogAppender&); // not assignable
+
+        /**
+        One slot in a ring. mSequence tells producers and the consumer whose turn it is: a
+        producer may fill the slot when it equals the write position, and the consumer may
+        read it when it equals the read position plus one.
+        */
+        struct Slot {
+            Slot() : mSequence(0), mRecord() {}
+
+            std::atomic<Vu64>   mSequence;  ///< The slot's turn, as described above.
+            VLogRecord          mRecord;    ///< The record; its strings keep their buffers for reuse by the next record.
+        };
+
+        /**
+        A bounded multi-producer, single-consumer ring of records.
+        */
+        struct Ring {
+            Ring(int size);
+            ~Ring() { delete [] mSlots; }
+
+            Slot*               mSlots;         ///< The slots; there are mMask + 1 of them.
+            Vu64                mMask;          ///< The ring size minus one; the size is a power of 2.
+            std::atomic<Vu64>   mWritePosition; ///< The next position a producer will claim.
+            Vu64                mReadPosition;  ///< The next position the background thread will read. Only it touches this.
+            int                 mNumTaken;      ///< The number of records in the current batch taken from this ring. Only the background thread touches this.
+        };
+
+        /**
+        The arguments of one emit() call, referred to rather than copied, so that the strings
+        are copied only once, straight into a slot.
+        */
+        struct Emission {
+            int             mLevel;
+            const char*     mFile;
+            int             mLine;
+            bool            mEmitMessage;
+            const VString*  mMessage;
+            const VDeferredLogMessage* mDeferredMessage; ///< If not null, the message, in place of mMessage.
+            const VString*  mSpecifiedLoggerName;
+            const VString*  mActualLoggerName;
+            bool            mEmitRawLine;
+            const VString*  mRawLine;
+            VInstant        mWhen;
+            const VString*  mThreadName;
+        };
+
+        friend class VAsyncLogAppenderThread;
+
+        void _construct(int ringSize);                              ///< Constructor helper; creates the rings and starts the thread.
+        void _run(VThread* thread);                                 ///< The background thread's main loop.
+        bool _writeBatch();                                         ///< Hands the oldest queued records to the target. Returns false if there were none.
+        void _stop();                                               ///< Implements stop(). ASSUMES CALLER HOLDS THE LIVE APPENDERS MUTEX.
+        static void _stopAll();                                     ///< Stops every live appender; registered with VShutdownRegistry.
+        void _reportDropped(VLogAppenderPtr target);                ///< Emits a warning to the target if records were dropped since the last report, at most once a second until stopped.
+        void _enqueue(const Emission& emission);                    ///< Queues an emission in the caller's ring, applying the overflow policy, or writes it through if we are stopped.
+        static void _copyToRecord(const Emission& emission, VLogRecord& record); ///< Copies the emission into a record, reusing the record's string buffers.
+        bool _tryEnqueue(Ring& ring, const Emission& emission, Vs64 sequenceNumber); ///< Copies an emission into a ring if it has room. Returns false if it is full.
+        bool _hasQueuedRecords() const;                             ///< Returns true if any ring has a record ready to read.
+        void _writeThrough(const Emission& emission);               ///< Emits to the target on the calling thread.
+        VLogAppenderPtr _getTarget();                               ///< Returns the target, looking it up by name on first use. May return null.
+        void _wakeWriter();                                         ///< Wakes the background thread if it is waiting for records.
+
+        VString             mTargetName;            ///< The name of the target, if it was given by name.
+        VLogAppenderPtr     mTarget;                ///< The target, once known. Guarded by mQueueMutex.
+        OverflowPolicy      mOverflowPolicy;        ///< What to do when a ring is full.
+        int                 mOverflowKeepLevel;     ///< For kDropVerbose, the least severe level that is never dropped.
+        int                 mNumRings;              ///< The number of rings.
+        Ring**              mRings;                 ///< The rings.
+        int                 mBatchSize;             ///< The most records taken from each ring for one batch.
+        VLogRecordList      mBatch;                 ///< The background thread's batch under construction.
+
+        VThread*            mThread;                ///< The background thread while it is running (we own it).
+        std::atomic<bool>   mHasTarget;             ///< True once mTarget is set; until then producers never wait for room.
+        std::atomic<bool>   mStopping;              ///< Set by stop() to make the thread finish up.
+        std::atomic<bool>   mWriterWaiting;         ///< True while the background thread is waiting for records.
+        std::atomic<int>    mNumWaitingProducers;   ///< The number of calling threads waiting for room. Changed only with mQueueMutex held.
+        std::atomic<int>    mNumEnqueuing;          ///< The number of calling threads inside _enqueue(); stop() waits for them before its final drain.
+        std::atomic<Vs64>   mNextSequenceNumber;    ///< The sequence number for the next record.
+        std::atomic<Vs64>   mNumQueued;             ///< Counter of records queued.
+        std::atomic<Vs64>   mNumDequeued;           ///< Counter of records taken off the rings, whether or not there was a target to hand them to.
+        std::atomic<Vs64>   mNumWritten;            ///< Counter of records handed to the target.
+        std::atomic<Vs64>   mNumDropped;            ///< Counter of records discarded.
+        std::atomic<Vs64>   mNumBlocked;            ///< Counter of waits for room.
+        Vs64                mNumDroppedReported;    ///< mNumDropped as of the last warning about it. Only the background thread touches this.
+        VInstant            mWhenDroppedReported;   ///< When the last warning about dropped records was emitted. Only the background thread touches this.
+
+        mutable VMutex      mQueueMutex;            ///< The mutex for the conditions below; not held while queueing.
+        VConditionVariable  mRecordsAvailable;      ///< Signaled when a record is queued while the background thread waits.
+        VConditionVariable  mRoomAvailable;         ///< Broadcast when the background thread frees slots while producers wait.
+        VConditionVariable  mBatchWritten;          ///< Broadcast after each batch, for drain().
+};
+
+#endif /* vasynclogappender_h */
@@ -0,0 +1,413 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+/** @file */
+
+#include "vdeferredlogmessage.h"
+
+// A conversion spec is rebuilt without its length modifier; this holds the longest one we accept.
+static const int kMaxSpecLength = 64;
+
+static bool _isFlagChar(char c) {
+    return (c == '-') || (c == '+') || (c == ' ') || (c == '#') || (c == '0');
+}
+
+static bool _isLengthChar(char c) {
+    return (c == 'h') || (c == 'l') || (c == 'L') || (c == 'q') || (c == 'j') || (c == 'z') || (c == 't');
+}
+
+// VDeferredLogMessage --------------------------------------------------------
+
+VDeferredLogMessage::VDeferredLogMessage()
+    : mFormat("")
+    , mFormatCopy()
+    , mFormatIsCopied(false)
+    , mNumArgs(0)
+    // mArgs are filled in as they are captured
+    , mStringData()
+    , mText()
+    , mIsFormatted(false)
+    {
+}
+
+VDeferredLogMessage::VDeferredLogMessage(const VDeferredLogMessage& other)
+    : mFormat("")
+    , mFormatCopy()
+    , mFormatIsCopied(false)
+    , mNumArgs(0)
+    // mArgs are filled in as they are captured
+    , mStringData()
+    , mText()
+    , mIsFormatted(false)
+    {
+
+    *this = other;
+}
+
+VDeferredLogMessage& VDeferredLogMessage::operator=(const VDeferredLogMessage& other) {
+    if (this == &other) {
+        return *this;
+    }
+
+    if (other.mFormatIsCopied) {
+        mFormatCopy.copyFromCString(other.mFormat);
+        mFormat = mFormatCopy.chars();
+        mFormatIsCopied = true;
+    } else {
+        mFormat = other.mFormat;
+        mFormatIsCopied = false;
+    }
+
+    mNumArgs = other.mNumArgs;
+
+    for (int i = 0; i < mNumArgs; ++i) {
+        mArgs[i] = other.mArgs[i];
+    }
+
+    mStringData = other.mStringData;
+    this->_copyStringArgs(); // the copy may outlive the caller's VStrings that other refers to
+
+    mIsFormatted = other.mIsFormatted;
+    if (mIsFormatted) {
+        mText = other.mText;
+    }
+
+    return *this;
+}
+
+void VDeferredLogMessage::copyFormat() {
+    if (! mFormatIsCopied) {
+        mFormatCopy.copyFromCString(mFormat);
+        mFormat = mFormatCopy.chars();
+        mFormatIsCopied = true;
+    }
+
+    this->_copyStringArgs();
+}
+
+bool VDeferredLogMessage::isSameMessage(const VDeferredLogMessage& other) const {
+    if ((mNumArgs != other.mNumArgs) || (strcmp(mFormat, other.mFormat) != 0)) {
+        return false;
+    }
+
+    for (int i = 0; i < mNumArgs; ++i) {
+        const Arg& arg = mArgs[i];
+        const Arg& otherArg = other.mArgs[i];
+
+        if (arg.mKind != otherArg.mKind) {
+            return false;
+        }
+
+        switch (arg.mKind) {
+            case Arg::kSigned:      if (arg.mSigned != otherArg.mSigned) { return false; } break;
+            case Arg::kUnsigned:    if (arg.mUnsigned != otherArg.mUnsigned) { return false; } break;
+            case Arg::kDouble:      if (arg.mDouble != otherArg.mDouble) { return false; } break;
+            case Arg::kPointer:     if (arg.mPointer != otherArg.mPointer) { return false; } break;
+            case Arg::kString:
+                if ((arg.mString.mLength != otherArg.mString.mLength) ||
+                    (::memcmp(this->_getStringArgChars(arg), other._getStringArgChars(otherArg), static_cast<size_t>(arg.mString.mLength)) != 0)) {
+                    return false;
+                }
+
+                break;
+            case Arg::kNullString:  break;
+        }
+    }
+
+    return true;
+}
+
+const VString& VDeferredLogMessage::getText() const {
+    if (! mIsFormatted) {
+        this->_format(mText);
+        mIsFormatted = true;
+    }
+
+    return mText;
+}
+
+void VDeferredLogMessage::_capture(const char* value) {
+    if (value == NULL) {
+        (void) this->_nextArg(Arg::kNullString);
+        return;
+    }
+
+    Arg& arg = this->_nextArg(Arg::kString);
+    arg.mString.mPointer = value;
+    arg.mString.mOffset = mStringData.length();
+    mStringData += value;
+    arg.mString.mLength = mStringData.length() - arg.mString.mOffset;
+}
+
+void VDeferredLogMessage::_capture(const VString& value) {
+    // The VString lives at least as long as the statement logging us; copies take its text (see _copyStringArgs()).
+    Arg& arg = this->_nextArg(Arg::kString);
+    arg.mString.mPointer = value.chars();
+    arg.mString.mOffset = -1;
+    arg.mString.mLength = value.length();
+}
+
+VDeferredLogMessage::Arg& VDeferredLogMessage::_nextArg(Arg::Kind kind) {
+    // The constructor's static_assert keeps mNumArgs in range.
+    Arg& arg = mArgs[mNumArgs++];
+    arg.mKind = kind;
+    return arg;
+}
+
+void VDeferredLogMessage::_copyStringArgs() {
+    for (int i = 0; i < mNumArgs; ++i) {
+        Arg& arg = mArgs[i];
+        if ((arg.mKind == Arg::kString) && (arg.mString.mOffset < 0)) {
+            const int offset = mStringData.length();
+            mStringData.preflight(offset + arg.mString.mLength);
+            ::memcpy(mStringData.buffer() + offset, arg.mString.mPointer, static_cast<size_t>(arg.mString.mLength));
+            mStringData.postflight(offset + arg.mString.mLength);
+            arg.mString.mOffset = offset;
+        }
+    }
+}
+
+const char* VDeferredLogMessage::_getStringArgChars(const Arg& arg) const {
+    if (arg.mString.mOffset < 0) {
+        return static_cast<const char*>(arg.mString.mPointer);
+    }
+
+    return mStringData.chars() + arg.mString.mOffset;
+}
+
+void VDeferredLogMessage::_format(VString& text) const {
+    text = VString::EMPTY();
+
+    VString piece;
+    VString argText;
+    char spec[kMaxSpecLength + 4]; // room for "ll", the conversion, and the null terminator
+    int argIndex = 0;
+    const char* p = mFormat;
+
+    while (*p != 0) {
+        if (*p != '%') {
+            text += *p++;
+            continue;
+        }
+
+        const char* specStart = p++;
+        if (*p == '%') {
+            text += '%';
+            ++p;
+            continue;
+        }
+
+        // Copy the flags, width, and precision; replace a '*' with the value of the next argument.
+        // A spec too long for the buffer is still parsed to its end, then shown as is.
+        int specLength = 0;
+        bool isSpecTooLong = false;
+        spec[specLength++] = '%';
+
+        while (_isFlagChar(*p)) {
+            if (specLength < kMaxSpecLength) {
+                spec[specLength++] = *p;
+            } else {
+                isSpecTooLong = true;
+            }
+
+            ++p;
+        }
+
+        for (int part = 0; part < 2; ++part) {
+            if (part == 1) {
+                if (*p != '.') {
+                    break;
+                }
+
+                if (specLength < kMaxSpecLength) {
+                    spec[specLength++] = *p;
+                } else {
+                    isSpecTooLong = true;
+                }
+
+                ++p;
+            }
+
+            if (*p == '*') {
+                ++p;
+                int value = 0;
+                if (argIndex < mNumArgs) {
+                    const Arg& arg = mArgs[argIndex++];
+                    value = (arg.mKind == Arg::kUnsigned) ? static_cast<int>(arg.mUnsigned) : static_cast<int>(arg.mSigned);
+                }
+
+                const int room = V_MAX(0, kMaxSpecLength - specLength);
+                const int valueLength = snprintf(spec + specLength, static_cast<size_t>(room), "%d", value);
+                if ((valueLength < 0) || (valueLength >= room)) {
+                    isSpecTooLong = true;
+                } else {
+                    specLength += valueLength;
+                }
+            } else {
+                while ((*p >= '0') && (*p <= '9')) {
+                    if (specLength < kMaxSpecLength) {
+                        spec[specLength++] = *p;
+                    } else {
+                        isSpecTooLong = true;
+                    }
+
+                    ++p;
+                }
+            }
+        }
+
+        // Note the length modifier. The value is already the right size; the modifier only says how to truncate it.
+        char length1 = 0;
+        char length2 = 0;
+        while (_isLengthChar(*p)) {
+            if (length1 == 0) {
+                length1 = *p;
+            } else {
+                length2 = *p;
+            }
+
+            ++p;
+        }
+
+        const char conversion = *p;
+        if (conversion == 0) {
+            text += specStart; // a dangling spec at the end; show it as is
+            break;
+        }
+
+        ++p;
+
+        if (conversion == 'n') {
+            ++argIndex; // never written through
+            continue;
+        }
+
+        const bool isKnownConversion = (strchr("diouxXcCeEfFgGaAsSp", conversion) != NULL);
+        if (! isKnownConversion) {
+            for (const char* c = specStart; c < p; ++c) {
+                text += *c; // not a conversion we know; show it as is
+            }
+
+            continue;
+        }
+
+        if (argIndex >= mNumArgs) {
+            text += "(missing)";
+            continue;
+        }
+
+        if (isSpecTooLong) {
+            ++argIndex; // the argument is consumed, but the spec is shown as is
+            for (const char* c = specStart; c < p; ++c) {
+                text += *c;
+            }
+
+            continue;
+        }
+
+        const Arg& arg = mArgs[argIndex++];
+
+        switch (conversion) {
+            case 'd':
+            case 'i': {
+                Vs64 value = (arg.mKind == Arg::kUnsigned) ? static_cast<Vs64>(arg.mUnsigned) : ((arg.mKind == Arg::kDouble) ? static_cast<Vs64>(arg.mDouble) : arg.mSigned);
+                if ((length1 == 'h') && (length2 == 'h')) {
+                    value = static_cast<signed char>(value);
+                } else if (length1 == 'h') {
+                    value = static_cast<short>(value);
+                } else if (length1 == 0) {
+                    value = static_cast<int>(value);
+                } else if ((length1 == 'l') && (length2 == 0)) {
+                    value = static_cast<long>(value);
+                }
+
+                spec[specLength] = 'l';
+                spec[specLength + 1] = 'l';
+                spec[specLength + 2] = conversion;
+                spec[specLength + 3] = 0;
+                piece.format(spec, static_cast<long long>(value));
+                break;
+            }
+
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X': {
+                Vu64 value = (arg.mKind == Arg::kSigned) ? static_cast<Vu64>(arg.mSigned) : ((arg.mKind == Arg::kDouble) ? static_cast<Vu64>(arg.mDouble) : arg.mUnsigned);
+                if ((length1 == 'h') && (length2 == 'h')) {
+                    value = static_cast<unsigned char>(value);
+                } else if (length1 == 'h') {
+                    value = static_cast<unsigned short>(value);
+                } else if (length1 == 0) {
+                    value = static_cast<unsigned int>(value);
+                } else if ((length1 == 'l') && (length2 == 0)) {
+                    value = static_cast<unsigned long>(value);
+                }
+
+                spec[specLength] = 'l';
+                spec[specLength + 1] = 'l';
+                spec[specLength + 2] = conversion;
+                spec[specLength + 3] = 0;
+                piece.format(spec, static_cast<unsigned long long>(value));
+                break;
+            }
+
+            case 'c':
+            case 'C':
+                spec[specLength] = 'c';
+                spec[specLength + 1] = 0;
+                piece.format(spec, static_cast<int>((arg.mKind == Arg::kUnsigned) ? arg.mUnsigned : arg.mSigned));
+                break;
+
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A': {
+                VDouble value = (arg.mKind == Arg::kSigned) ? static_cast<VDouble>(arg.mSigned) : ((arg.mKind == Arg::kUnsigned) ? static_cast<VDouble>(arg.mUnsigned) : arg.mDouble);
+                spec[specLength] = conversion;
+                spec[specLength + 1] = 0;
+                piece.format(spec, value);
+                break;
+            }
+
+            case 's':
+            case 'S':
+                if (arg.mKind == Arg::kString) {
+                    argText.copyFromBuffer(this->_getStringArgChars(arg), 0, arg.mString.mLength);
+                } else {
+                    argText = (arg.mKind == Arg::kNullString) ? "(null)" : "(?)";
+                }
+
+                spec[specLength] = 's';
+                spec[specLength + 1] = 0;
+                piece.format(spec, argText.chars());
+                break;
+
+            case 'p': {
+                const void* value = NULL;
+                if (arg.mKind == Arg::kPointer) {
+                    value = arg.mPointer;
+                } else if (arg.mKind == Arg::kString) {
+                    value = arg.mString.mPointer;
+                } else if (arg.mKind != Arg::kNullString) {
+                    value = reinterpret_cast<const void*>(static_cast<size_t>(arg.mSigned));
+                }
+
+                spec[specLength] = 'p';
+                spec[specLength + 1] = 0;
+                piece.format(spec, value);
+                break;
+            }
+        }
+
+        text += piece;
+    }
+}
@@ -0,0 +1,178 @@
+/*
+Copyright c1997-2014 Trygve Isaacson. All rights reserved.
+This file is part of the Code Vault version 4.1
+http://www.bombaydigital.com/
+License: MIT. See LICENSE.md in the Vault top level directory.
+*/
+
+#ifndef vdeferredlogmessage_h
+#define vdeferredlogmessage_h
+
+/** @file */
+
+#include "vtypes.h"
+
+#include "vstring.h"
+
+/**
+    @ingroup vlogger
+*/
+
+// VDeferredLogMessage --------------------------------------------------------
+
+/**
+VDeferredLogMessage is a log message that has not been formatted yet: a printf-style
+format string and copies of its arguments. It is what the VLOGGER_NAMED_*_FORMAT macros
+pass down in place of a VSTRING_FORMAT() result, so that the text is produced only by an
+appender that actually writes it. A VAsyncLogAppender copies the record into its queue
+and leaves the formatting to its background thread, so the calling thread never formats
+at all; a record the queue drops is never formatted.
+
+The arguments are captured when the message is constructed. Numbers and pointers are
+copied as they are, and the text of char pointer strings is copied into one buffer, so
+the message does not depend on the caller's char buffers. A VString argument is only
+referred to, since a message is normally logged and gone before the statement that
+built it ends; like the format string, its text is copied when the message is copied
+(as an appender's queue does) or when copyFormat() is called. Pass
+the same arguments you would pass to VSTRING_FORMAT(). The conversion used for each
+argument is taken from the format string, so, for example, a Vs64 printed with
+VSTRING_FORMATTER_S64 or a pointer printed with %08X comes out the same as it would
+from printf. Positional arguments ("%1$d") are not supported.
+
+The format string itself is not copied; it must be a string literal or otherwise outlive
+the message, and copying a message (as an appender's queue does) just copies the pointer.
+If the format is built at run time, call copyFormat() to give the message its own copy;
+copies made after that have their own copies as well.
+
+The text is produced once, on the first call to getText(); later calls, including those
+from the other appenders the message is given to, return the same string.
+*/
+class VDeferredLogMessage {
+    public:
+
+        static const int kMaxNumArgs = 12; ///< The most arguments a message can capture; checked at compile time.
+
+        /**
+        Constructs an empty message.
+        */
+        VDeferredLogMessage();
+        /**
+        Captures a format string and its arguments.
+        @param  format  the printf-style format string; it must outlive the message
+        @param  args    the values for the format string's conversions
+        */
+        template <typename... Args>
+        explicit VDeferredLogMessage(const char* format, const Args&... args);
+        /**
+        Copies a message. The format text is copied only if the original's was (see copyFormat()).
+        */
+        VDeferredLogMessage(const VDeferredLogMessage& other);
+        ~VDeferredLogMessage() {}
+
+        /**
+        Copies a message. The format text is copied only if the original's was (see copyFormat());
+        otherwise the caller's format pointer is kept. This reuses this object's string buffers,
+        so an appender that keeps a message in a queue slot does not allocate once warmed up.
+        */
+        VDeferredLogMessage& operator=(const VDeferredLogMessage& other);
+
+        /**
+        Copies the format text, and the text of any VString arguments, into the message,
+        for a message that will outlive the caller's strings.
+        */
+        void copyFormat();
+
+        /**
+        Returns the formatted text, formatting it on the first call.
+        */
+        const VString& getText() const;
+        /**
+        Returns true if getText() has already formatted the text.
+        */
+        bool isFormatted() const { return mIsFormatted; }
+        /**
+        Returns true if the other message has the same format text and argument values, and
+        so would format to the same text. Used by the repetition filter without formatting either.
+        */
+        bool isSameMessage(const VDeferredLogMessage& other) const;
+
+    private:
+
+        friend class VLoggerUnit; // unit tests directly examine our state
+
+        /**
+        One captured argument. A string's text is kept in mStringData; the argument has its place there.
+        */
+        struct Arg {
+            enum Kind { kSigned, kUnsigned, kDouble, kPointer, kString, kNullString };
+
+            Kind mKind; ///< Which member of the union was captured.
+            union {
+                Vs64        mSigned;    ///< For kSigned.
+                Vu64        mUnsigned;  ///< For kUnsigned.
+                VDouble     mDouble;    ///< For kDouble.
+                const void* mPointer;   ///< For kPointer.
+                struct {
+                    const void* mPointer;   ///< For kString, the caller's pointer, which is what %p prints.
+                    int         mOffset;    ///< For kString, where its text starts in mStringData; -1 while it is the caller's VString text at mPointer.
+                    int         mLength;    ///< For kString, the length of its text.
+                } mString;
+            };
+        };
+
+        void _captureAll() {}
+        template <typename First, typename... Rest>
+        void _captureAll(const First& first, const Rest&... rest) { this->_capture(first); this->_captureAll(rest...); }
+
+        // One overload per kind of value printf can take. Enumerations promote to int.
+        void _capture(bool value) { this->_nextArg(Arg::kSigned).mSigned = value ? 1 : 0; }
+        void _capture(char value) { this->_nextArg(Arg::kSigned).mSigned = value; }
+        void _capture(signed char value) { this->_nextArg(Arg::kSigned).mSigned = value; }
+        void _capture(unsigned char value) { this->_nextArg(Arg::kUnsigned).mUnsigned = value; }
+        void _capture(short value) { this->_nextArg(Arg::kSigned).mSigned = value; }
+        void _capture(unsigned short value) { this->_nextArg(Arg::kUnsigned).mUnsigned = value; }
+        void _capture(int value) { this->_nextArg(Arg::kSigned).mSigned = value; }
+        void _capture(unsigned int value) { this->_nextArg(Arg::kUnsigned).mUnsigned = value; }
+        void _capture(long value) { this->_nextArg(Arg::kSigned).mSigned = value; }
+        void _capture(unsigned long value) { this->_nextArg(Arg::kUnsigned).mUnsigned = value; }
+        void _capture(long long value) { this->_nextArg(Arg::kSigned).mSigned = value; }
+        void _capture(unsigned long long value) { this->_nextArg(Arg::kUnsigned).mUnsigned = value; }
+        void _capture(float value) { this->_nextArg(Arg::kDouble).mDouble = value; }
+        void _capture(double value) { this->_nextArg(Arg::kDouble).mDouble = value; }
+        void _capture(long double value) { this->_nextArg(Arg::kDouble).mDouble = static_cast<VDouble>(value); }
+        void _capture(const char* value);
+        void _capture(const VString& value);
+        template <typename T>
+        void _capture(const T* value) { this->_nextArg(Arg::kPointer).mPointer = value; }
+
+        Arg& _nextArg(Arg::Kind kind);          ///< Returns the next unused argument, set to the specified kind.
+        void _copyStringArgs();                 ///< Copies the text of the VString arguments we only refer to into mStringData.
+        const char* _getStringArgChars(const Arg& arg) const; ///< Returns the text of a kString argument, wherever it is.
+        void _format(VString& text) const;      ///< Formats the message into the string, replacing its contents.
+
+        const char*     mFormat;                ///< The format string; either the caller's, or mFormatCopy's buffer.
+        VString         mFormatCopy;            ///< The format text, when copyFormat() has been called.
+        bool            mFormatIsCopied;        ///< True if mFormat points to mFormatCopy's buffer.
+        int             mNumArgs;               ///< The number of arguments captured.
+        Arg             mArgs[kMaxNumArgs];     ///< The captured arguments.
+        VString         mStringData;            ///< The text of the copied string arguments, one after another.
+        mutable VString mText;                  ///< The formatted text, once getText() has been called.
+        mutable bool    mIsFormatted;           ///< True once mText holds the formatted text.
+};
+
+template <typename... Args>
+VDeferredLogMessage::VDeferredLogMessage(const char* format, const Args&... args)
+    : mFormat(format)
+    , mFormatCopy()
+    , mFormatIsCopied(false)
+    , mNumArgs(0)
+    // mArgs are filled in as they are captured
+    , mStringData()
+    , mText()
+    , mIsFormatted(false)
+    {
+    static_assert(sizeof...(Args) <= kMaxNumArgs, "too many arguments for VDeferredLogMessage");
+    this->_captureAll(args...);
+}
+
+#endif /* vdeferredlogmessage_h */
@@ -9,8 +9,13 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vlogger.h"
 
+#include "vasynclogappender.h"
 #include "vthread.h"
+#include "vthreadpool.h"
 #include "vmutexlocker.h"
+#include "vshutdownregistry.h"
+#include "vdirectiofilestream.h"
+#include "vreadwritelock.h"
 #include "vsettings.h"
 #include "vbento.h"
 #include "vchar.h"
@@ -22,6 +27,7 @@ volatile int VLogger::gMaxActiveLevel = 0;
 VNamedLoggerPtr VLogger::gDefaultLogger = NULL_NAMED_LOGGER_PTR;
 VLogAppenderPtr VLogger::gDefaultAppender = NULL_LOG_APPENDER_PTR;
 VFSNode VLogger::gBaseLogDirectory(".");
+std::atomic<Vu32> VLogger::gConfigurationGeneration(0);
 
 // VNamedLogger ---------------------------------------------------------------
 
@@ -77,6 +83,28 @@ void VNamedLogger::log(int level, const char* file, int line, const VString& mes
     }
 }
 
+void VNamedLogger::log(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName) {
+    if (level > mLevel) {
+        return;
+    }
+
+    VNamedLogger::_breakpointLocationForLog();
+
+    if (mRepetitionFilter.isEnabled()) { // avoid mutex if no need to check filter
+        VMutexLocker timeoutLocker(&mAppendersMutex, "VNamedLogger::log() checkTimeout");
+        mRepetitionFilter.checkTimeout(*this);
+    }
+
+    VMutexLocker locker(&mAppendersMutex, "VNamedLogger::log");
+    if (mRepetitionFilter.checkMessage(*this, level, file, line, message, specifiedLoggerName, mName)) {
+        this->_emitDeferredToAppenders(level, file, line, message, specifiedLoggerName);
+        if (mPrintStackConfig.shouldPrintStack(level, *this)) {
+            locker.unlock(); // avoid recursive deadlock, we're done with our data until we recur
+            VThread::logStackCrawl(message.getText(), VNamedLoggerPtr(shared_from_this()), false);
+        }
+    }
+}
+
 void VNamedLogger::addInfo(VBentoNode& infoNode) const {
     infoNode.addString("name", mName);
     infoNode.addInt("level", mLevel);
@@ -151,6 +179,19 @@ void VNamedLogger::_emitToAppenders(int level, const char* file, int line, bool
     VLogger::emitToGlobalAppenders(level, file, line, emitMessage, message, specifiedLoggerName, mName, emitRawLine, rawLine);
 }
 
+void VNamedLogger::_emitDeferredToAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName) {
+    if (mSpecificAppender != NULL_LOG_APPENDER_PTR) {
+        mSpecificAppender->emitDeferred(level, file, line, message, specifiedLoggerName, mName);
+    }
+
+    for (VStringVector::const_iterator i = mAppenderNames.begin(); i != mAppenderNames.end(); ++i) {
+        VLogAppenderPtr appender = (*i).isEmpty() ? VLogger::getDefaultAppender() : VLogger::getAppender(*i);
+        appender->emitDeferred(level, file, line, message, specifiedLoggerName, mName);
+    }
+
+    VLogger::emitDeferredToGlobalAppenders(level, file, line, message, specifiedLoggerName, mName);
+}
+
 VString VNamedLogger::_toString() const {
     VString s(VSTRING_ARGS("VNamedLogger '%s' (%d) ->", mName.chars(), mLevel));
 
@@ -236,16 +277,29 @@ class VStringVectorLogAppenderFactory : public VLogAppenderFactory {
             { infoNode.addString("type", "VStringVectorLogAppenderFactory"); }
 };
 
+class VAsyncLogAppenderFactory : public VLogAppenderFactory {
+    public:
+        VAsyncLogAppenderFactory() : VLogAppenderFactory() {}
+        virtual ~VAsyncLogAppenderFactory() {}
+
+        virtual VLogAppenderPtr instantiateLogAppender(const VSettingsNode& settings, const VSettingsNode& defaults) const
+            { return VLogAppenderPtr(new VAsyncLogAppender(settings, defaults)); }
+        virtual void addInfo(VBentoNode& infoNode) const
+            { infoNode.addString("type", "VAsyncLogAppenderFactory"); }
+};
+
 // VLogger -------------------------------------------------------------------
 
-// This style of static mutex declaration and access ensures correct
+// This style of static lock declaration and access ensures correct
 // initialization if accessed during the static initialization phase.
-static VMutex* _mutexInstance() {
-    static VMutex* gVLoggerMutex = new VMutex("gVLoggerMutex", true/*suppress logging of the logger mutex*/);
-    return gVLoggerMutex;
+// The registries are searched on nearly every log call but changed only during
+// configuration, so lookups take the lock for reading and run concurrently.
+static VReadWriteLock* _lockInstance() {
+    static VReadWriteLock* gVLoggerLock = new VReadWriteLock("gVLoggerLock", VReadWriteLock::kPreferWriters);
+    return gVLoggerLock;
 }
 
-// _mutexInstance() must be used internally whenever referencing these static accessors:
+// _lockInstance() must be used internally whenever referencing these static accessors:
 
 typedef std::map<VString, VNamedLoggerPtr> VNamedLoggerMap;
 static VNamedLoggerMap& _getLoggerMap() {
@@ -324,7 +378,7 @@ int VLoggerLevel::fromString(const VString& value) {
 
 // static
 void VLogger::installNewLogAppender(const VSettingsNode& appenderSettings, const VSettingsNode& appenderDefaults) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::installNewLogAppender");
+    VWriteLocker locker(_lockInstance(), "VLogger::installNewLogAppender");
     VLogAppenderFactoriesMap::const_iterator pos = _getAppenderFactoriesMap().find(appenderSettings.getString("kind"));
     if (pos != _getAppenderFactoriesMap().end()) {
         VLogAppenderPtr appender = pos->second->instantiateLogAppender(appenderSettings, appenderDefaults);
@@ -362,7 +416,7 @@ void VLogger::installNewNamedLogger(const VSettingsNode& loggerSettings) {
         logger->setPrintStackInfo(printStackLevel, maxNumOccurrences, timeLimit);
     }
 
-    VMutexLocker locker(_mutexInstance(), "VLogger::installNewNamedLogger");
+    VWriteLocker locker(_lockInstance(), "VLogger::installNewNamedLogger");
     VLogger::_registerLogger(logger, false);
 }
 
@@ -370,7 +424,7 @@ void VLogger::installNewNamedLogger(const VSettingsNode& loggerSettings) {
 void VLogger::installNewNamedLogger(const VString& name, int level, const VStringVector& appenderNames) {
     VNamedLoggerPtr logger(new VNamedLogger(name, level, appenderNames));
 
-    VMutexLocker locker(_mutexInstance(), "VLogger::installNewNamedLogger");
+    VWriteLocker locker(_lockInstance(), "VLogger::installNewNamedLogger");
     VLogger::_registerLogger(logger, false);
 }
 
@@ -383,7 +437,7 @@ void VLogger::installNewNamedLogger(const VString& name, int level, const VStrin
 
 // static
 void VLogger::registerLogAppenderFactory(const VString& appenderKind, VLogAppenderFactoryPtr factory) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::registerLogAppenderFactory");
+    VWriteLocker locker(_lockInstance(), "VLogger::registerLogAppenderFactory");
     _getAppenderFactoriesMap()[appenderKind] = factory;
 }
 
@@ -399,6 +453,7 @@ void VLogger::configure(const VFSNode& baseLogDirectory, const VSettingsNode& lo
     VLogger::registerLogAppenderFactory("silent", VLogAppenderFactoryPtr(new VSilentLogAppenderFactory()));
     VLogger::registerLogAppenderFactory("string", VLogAppenderFactoryPtr(new VStringLogAppenderFactory()));
     VLogger::registerLogAppenderFactory("string-vector", VLogAppenderFactoryPtr(new VStringVectorLogAppenderFactory()));
+    VLogger::registerLogAppenderFactory("async", VLogAppenderFactoryPtr(new VAsyncLogAppenderFactory()));
 
     // Stash any per-appender defaults in a map while we configure, so we can pass them to the factories we call.
     std::map<VString, const VSettingsNode*> defaultsForAppenders;
@@ -429,39 +484,50 @@ void VLogger::configure(const VFSNode& baseLogDirectory, const VSettingsNode& lo
 
 // static
 void VLogger::shutdown() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::shutdown");
-
     // Clear all shared_ptr references. This will allow all referenced objects to be deleted (unless someone outside retains a reference).
-    gDefaultLogger.reset();
-    gDefaultAppender.reset();
-    _getLoggerMap().clear();
-    _getAppendersMap().clear();
-    _getAppenderFactoriesMap().clear();
+    // They are moved out under the lock but destroyed after it is released, because an appender's
+    // destructor may need to look up other appenders (VAsyncLogAppender writes out its queue).
+    VNamedLoggerPtr defaultLogger;
+    VLogAppenderPtr defaultAppender;
+    VNamedLoggerMap loggers;
+    VLogAppendersMap appenders;
+    VLogAppenderFactoriesMap factories;
+
+    /* locker scope */ {
+        VWriteLocker locker(_lockInstance(), "VLogger::shutdown");
+
+        defaultLogger.swap(gDefaultLogger);
+        defaultAppender.swap(gDefaultAppender);
+        loggers.swap(_getLoggerMap());
+        appenders.swap(_getAppendersMap());
+        factories.swap(_getAppenderFactoriesMap());
 
-    gMaxActiveLevel = 0;
+        gMaxActiveLevel = 0;
+        VLogger::_invalidateCallSites();
+    }
 }
 
 // static
 void VLogger::registerLogAppender(VLogAppenderPtr appender, bool asDefaultAppender) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::registerLogAppender");
+    VWriteLocker locker(_lockInstance(), "VLogger::registerLogAppender");
     VLogger::_registerAppender(appender, asDefaultAppender, false);
 }
 
 // static
 void VLogger::registerGlobalAppender(VLogAppenderPtr appender, bool asDefaultAppender) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::registerLogAppender");
+    VWriteLocker locker(_lockInstance(), "VLogger::registerLogAppender");
     VLogger::_registerAppender(appender, asDefaultAppender, true);
 }
 
 // static
 void VLogger::registerLogger(VNamedLoggerPtr namedLogger, bool asDefaultLogger) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::registerLogger");
+    VWriteLocker locker(_lockInstance(), "VLogger::registerLogger");
     VLogger::_registerLogger(namedLogger, asDefaultLogger);
 }
 
 // static
 void VLogger::deregisterLogAppender(VLogAppenderPtr appender) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::deregisterLogAppender");
+    VWriteLocker locker(_lockInstance(), "VLogger::deregisterLogAppender");
 
     if (gDefaultAppender == appender) {
         gDefaultAppender.reset();
@@ -489,7 +555,7 @@ void VLogger::deregisterLogAppender(const VString& name) {
 
 // static
 void VLogger::deregisterLogger(VNamedLoggerPtr namedLogger) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::deregisterLogger");
+    VWriteLocker locker(_lockInstance(), "VLogger::deregisterLogger");
 
     if (gDefaultLogger == namedLogger) {
         gDefaultLogger.reset();
@@ -501,6 +567,7 @@ void VLogger::deregisterLogger(VNamedLoggerPtr namedLogger) {
     }
 
     VLogger::_checkMaxActiveLogLevelForRemovedLogger(namedLogger->getLevel());
+    VLogger::_invalidateCallSites();
 }
 
 // static
@@ -524,7 +591,15 @@ bool VLogger::isLogLevelActive(int level) {
 
 // static
 VNamedLoggerPtr VLogger::getDefaultLogger() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::getDefaultLogger");
+    /* locker scope */ {
+        VReadLocker locker(_lockInstance(), "VLogger::getDefaultLogger");
+        if (gDefaultLogger != nullptr) {
+            return gDefaultLogger;
+        }
+    }
+
+    // Not created yet; look again while excluding other threads that may be doing the same.
+    VWriteLocker locker(_lockInstance(), "VLogger::getDefaultLogger");
 
     if (gDefaultLogger == nullptr) {
         VLogger::_registerLogger(VNamedLoggerPtr(new VNamedLogger("auto-default-logger", VLoggerLevel::INFO, VStringVector())), true);
@@ -545,9 +620,10 @@ void VLogger::_reportLoggerChange(bool before, const VString& label, const VName
 
 // static
 void VLogger::setDefaultLogger(VNamedLoggerPtr namedLogger) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::getDefaultLogger");
+    VWriteLocker locker(_lockInstance(), "VLogger::getDefaultLogger");
     VLogger::_reportLoggerChange(true, "setDefaultLogger", gDefaultLogger, namedLogger);
     gDefaultLogger = namedLogger;
+    VLogger::_invalidateCallSites();
     VLogger::_reportLoggerChange(false, "setDefaultLogger", gDefaultLogger, namedLogger);
 }
 
@@ -564,13 +640,20 @@ VNamedLoggerPtr VLogger::getLogger(const VString& name) {
 
 // static
 VNamedLoggerPtr VLogger::findDefaultLogger() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::findDefaultLogger");
+    VReadLocker locker(_lockInstance(), "VLogger::findDefaultLogger");
     return gDefaultLogger;
 }
 
 // static
 VNamedLoggerPtr VLogger::findDefaultLoggerForLevel(int level) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::findDefaultLoggerForLevel");
+    /* locker scope */ {
+        VReadLocker locker(_lockInstance(), "VLogger::findDefaultLoggerForLevel");
+        if (gDefaultLogger != nullptr) {
+            return gDefaultLogger->isEnabledFor(level) ? gDefaultLogger : NULL_NAMED_LOGGER_PTR;
+        }
+    }
+
+    VWriteLocker locker(_lockInstance(), "VLogger::findDefaultLoggerForLevel");
 
     if (gDefaultLogger == nullptr) {
         VLogger::_registerLogger(VNamedLoggerPtr(new VNamedLogger("default", VLoggerLevel::INFO, VStringVector())), true);
@@ -581,7 +664,7 @@ VNamedLoggerPtr VLogger::findDefaultLoggerForLevel(int level) {
 
 // static
 VNamedLoggerPtr VLogger::findNamedLogger(const VString& name) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::findNamedLogger");
+    VReadLocker locker(_lockInstance(), "VLogger::findNamedLogger");
     return VLogger::_findNamedLoggerFromPathName(name);
 }
 
@@ -619,7 +702,14 @@ void VLogger::_reportAppenderChange(bool before, const VString& label, const VLo
 
 // static
 VLogAppenderPtr VLogger::getDefaultAppender() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::getDefaultAppender");
+    /* locker scope */ {
+        VReadLocker locker(_lockInstance(), "VLogger::getDefaultAppender");
+        if (gDefaultAppender != nullptr) {
+            return gDefaultAppender;
+        }
+    }
+
+    VWriteLocker locker(_lockInstance(), "VLogger::getDefaultAppender");
 
     if (gDefaultAppender == nullptr) {
         VLogger::_registerAppender(VLogAppenderPtr(new VCoutLogAppender("auto-default-cout-appender", VLogAppender::DO_FORMAT_OUTPUT, VString::EMPTY(), VString::EMPTY())), true);
@@ -631,7 +721,7 @@ VLogAppenderPtr VLogger::getDefaultAppender() {
 // static
 VLogAppenderPtr VLogger::getAppender(const VString& appenderName) {
     /* locker scope */ {
-        VMutexLocker locker(_mutexInstance(), "VLogger::getAppender");
+        VReadLocker locker(_lockInstance(), "VLogger::getAppender");
         VLogAppendersMap::const_iterator pos = _getAppendersMap().find(appenderName);
         if (pos != _getAppendersMap().end()) {
             return pos->second;
@@ -647,7 +737,7 @@ VLogAppenderPtrList VLogger::getAllAppenders() {
     VLogAppenderPtrList result;
 
     /* locker scope */ {
-        VMutexLocker locker(_mutexInstance(), "VLogger::getAllAppenders");
+        VReadLocker locker(_lockInstance(), "VLogger::getAllAppenders");
 
         for (VLogAppendersMap::const_iterator i = _getAppendersMap().begin(); i != _getAppendersMap().end(); ++i) {
             result.push_back((*i).second);
@@ -663,7 +753,7 @@ VLogAppenderPtrList VLogger::getAllAppenders() {
 
 // static
 VLogAppenderPtr VLogger::findDefaultAppender() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::findDefaultAppender");
+    VReadLocker locker(_lockInstance(), "VLogger::findDefaultAppender");
     return gDefaultAppender;
 }
 
@@ -684,7 +774,7 @@ const VFSNode& VLogger::getBaseLogDirectory() {
 
 // static
 VBentoNode* VLogger::commandGetInfo() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::commandGetInfo");
+    VReadLocker locker(_lockInstance(), "VLogger::commandGetInfo");
     return VLogger::_commandGetInfo();
 }
 
@@ -720,7 +810,7 @@ VBentoNode* VLogger::_commandGetInfo() {
 
 // static
 VString VLogger::commandGetInfoString() {
-    VMutexLocker locker(_mutexInstance(), "VLogger::commandGetInfoString");
+    VReadLocker locker(_lockInstance(), "VLogger::commandGetInfoString");
     return VLogger::_commandGetInfoString();
 }
 
@@ -732,6 +822,29 @@ VString VLogger::_commandGetInfoString() {
     return s;
 }
 
+// static
+void VLogger::commandRollAppender(const VString& appenderName) {
+
+    std::vector<VLogAppenderPtr> targetAppenders;
+
+    // First, get all the desired appenders, with required locking in place.
+    /* locker scope */ {
+        VReadLocker locker(_lockInstance(), "VLogger::commandRollAppender()");
+        const VLogAppendersMap& appenders = _getAppendersMap();
+        for (VLogAppendersMap::const_iterator i = appenders.begin(); i != appenders.end(); ++i) {
+            VLogAppenderPtr appender = (*i).second;
+            if ((dynamic_cast<VRollingFileLogAppender*>(appender.get()) != NULL) && (appenderName.isEmpty() || (appender->getName() == appenderName))) {
+                targetAppenders.push_back(appender);
+            }
+        }
+    }
+
+    // Now, roll each one over. That waits for the file system, so it is done without the lock.
+    for (std::vector<VLogAppenderPtr>::const_iterator i = targetAppenders.begin(); i != targetAppenders.end(); ++i) {
+        static_cast<VRollingFileLogAppender*>((*i).get())->rollOver();
+    }
+}
+
 // static
 void VLogger::commandSetLogLevel(const VString& loggerName, int level) {
 
@@ -739,7 +852,7 @@ void VLogger::commandSetLogLevel(const VString& loggerName, int level) {
 
     // First, get all the desired loggers, with required locking in place.
     /* locker scope */ {
-        VMutexLocker locker(_mutexInstance(), "VLogger::commandSetLogLevel()");
+        VReadLocker locker(_lockInstance(), "VLogger::commandSetLogLevel()");
         const VNamedLoggerMap& loggers = _getLoggerMap();
         for (VNamedLoggerMap::const_iterator i = loggers.begin(); i != loggers.end(); ++i) {
             VNamedLoggerPtr logger = (*i).second;
@@ -757,7 +870,7 @@ void VLogger::commandSetLogLevel(const VString& loggerName, int level) {
 
 // static
 void VLogger::commandSetPrintStackLevel(const VString& loggerName, int printStackLevel, int count, const VDuration& timeLimit) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::commandSetLogLevel()");
+    VWriteLocker locker(_lockInstance(), "VLogger::commandSetLogLevel()");
     const VNamedLoggerMap& loggers = _getLoggerMap();
     for (VNamedLoggerMap::const_iterator i = loggers.begin(); i != loggers.end(); ++i) {
         VNamedLoggerPtr logger = (*i).second;
@@ -769,13 +882,22 @@ void VLogger::commandSetPrintStackLevel(const VString& loggerName, int printStac
 
 // static
 void VLogger::emitToGlobalAppenders(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName, bool emitRawLine, const VString& rawLine) {
-    VMutexLocker locker(_mutexInstance(), "VLogger::emitToGlobalAppenders");
+    VReadLocker locker(_lockInstance(), "VLogger::emitToGlobalAppenders");
     for (VLogAppendersMap::const_iterator i = _getGlobalAppendersMap().begin(); i != _getGlobalAppendersMap().end(); ++i) {
         VLogAppenderPtr appender = (*i).second;
         appender->emit(level, file, line, emitMessage, message, specifiedLoggerName, actualLoggerName, emitRawLine, rawLine);
     }
 }
 
+// static
+void VLogger::emitDeferredToGlobalAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
+    VReadLocker locker(_lockInstance(), "VLogger::emitDeferredToGlobalAppenders");
+    for (VLogAppendersMap::const_iterator i = _getGlobalAppendersMap().begin(); i != _getGlobalAppendersMap().end(); ++i) {
+        VLogAppenderPtr appender = (*i).second;
+        appender->emitDeferred(level, file, line, message, specifiedLoggerName, actualLoggerName);
+    }
+}
+
 // static
 VString VLogger::getCleansedLoggerName(const VString& s) {
     VString cleansed(s);
@@ -785,7 +907,7 @@ VString VLogger::getCleansedLoggerName(const VString& s) {
 
 // static
 void VLogger::_registerAppender(VLogAppenderPtr appender, bool asDefaultAppender, bool asGlobalAppender) {
-    // ASSUMES CALLER HOLDS _mutexInstance().
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING.
 
     VLogger::_reportAppenderChange(true, "_registerAppender", gDefaultAppender, appender);
 
@@ -805,7 +927,7 @@ void VLogger::_registerAppender(VLogAppenderPtr appender, bool asDefaultAppender
 
 // static
 void VLogger::_registerLogger(VNamedLoggerPtr namedLogger, bool asDefaultLogger) {
-    // ASSUMES CALLER HOLDS _mutexInstance().
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING.
 
     VLogger::_reportLoggerChange(true, "_registerLogger", gDefaultLogger, namedLogger);
 
@@ -816,13 +938,14 @@ void VLogger::_registerLogger(VNamedLoggerPtr namedLogger, bool asDefaultLogger)
     _getLoggerMap()[namedLogger->getName()] = namedLogger;
 
     VLogger::_checkMaxActiveLogLevelForNewLogger(namedLogger->getLevel());
+    VLogger::_invalidateCallSites();
 
     VLogger::_reportLoggerChange(false, "_registerLogger", gDefaultLogger, namedLogger);
 }
 
 // static
 void VLogger::_checkMaxActiveLogLevelForNewLogger(int newActiveLevel) {
-    // ASSUMES CALLER HOLDS _mutexInstance().
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING.
 
     // If the logger has a higher level, then its level is the new max.
     if (newActiveLevel > gMaxActiveLevel) {
@@ -832,13 +955,13 @@ void VLogger::_checkMaxActiveLogLevelForNewLogger(int newActiveLevel) {
 
 // static
 void VLogger::checkMaxActiveLogLevelForRemovedLogger(int removedActiveLevel) {
-    VMutexLocker locker(_mutexInstance(), "checkMaxActiveLogLevelForRemovedLogger");
+    VWriteLocker locker(_lockInstance(), "checkMaxActiveLogLevelForRemovedLogger");
     _checkMaxActiveLogLevelForRemovedLogger(removedActiveLevel);
 }
 
 // static
 void VLogger::_checkMaxActiveLogLevelForRemovedLogger(int removedActiveLevel) {
-    // ASSUMES CALLER HOLDS _mutexInstance().
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING.
 
     // If the logger had the highest level, we need to search to find the new max.
     if (removedActiveLevel >= gMaxActiveLevel) {
@@ -848,13 +971,14 @@ void VLogger::_checkMaxActiveLogLevelForRemovedLogger(int removedActiveLevel) {
 
 // static
 void VLogger::checkMaxActiveLogLevelForChangedLogger(int oldActiveLevel, int newActiveLevel) {
-    VMutexLocker locker(_mutexInstance(), "checkMaxActiveLogLevelForChangedLogger");
+    VWriteLocker locker(_lockInstance(), "checkMaxActiveLogLevelForChangedLogger");
     _checkMaxActiveLogLevelForChangedLogger(oldActiveLevel, newActiveLevel);
+    VLogger::_invalidateCallSites(); // call sites remember the level of the logger they resolved
 }
 
 // static
 void VLogger::_checkMaxActiveLogLevelForChangedLogger(int oldActiveLevel, int newActiveLevel) {
-    // ASSUMES CALLER HOLDS _mutexInstance().
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING.
 
     // If the logger's new level is higher than current max, then its level is the new max.
     // Otherwise, if the old level was the max, and the new level is lower than it, we need to search to find the new max.
@@ -867,7 +991,7 @@ void VLogger::_checkMaxActiveLogLevelForChangedLogger(int oldActiveLevel, int ne
 
 // static
 void VLogger::_recalculateMaxActiveLogLevel() {
-    // ASSUMES CALLER HOLDS _mutexInstance().
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING.
 
     // This value is less than previous max. Scan all loggers to see what the new max is.
     int newMax = 0;
@@ -904,6 +1028,174 @@ VNamedLoggerPtr VLogger::_findNamedLoggerFromPathName(const VString& pathName) {
     return VLogger::_findNamedLoggerFromExactName(nextNameToSearch);
 }
 
+// static
+void VLogger::_invalidateCallSites() {
+    // ASSUMES CALLER HOLDS _lockInstance() FOR WRITING, and has finished making its changes.
+    gConfigurationGeneration.fetch_add(1, std::memory_order_release);
+
+    // Call sites will now replace their results; delete those replaced earlier if no one can still be reading them.
+    VNamedLoggerCallSite::_reclaimRetired();
+}
+
+// VNamedLoggerCallSite -------------------------------------------------------
+
+// Readers of published resolutions count themselves in one of kNumReaderCells cells for the
+// current phase; each thread always uses the same cell. The cells are a cache line apart.
+static const int kNumReaderCells = 16;
+
+struct VNamedLoggerCallSiteReaderCell {
+    std::atomic<int>    mCount;
+    char                mPadding[64 - sizeof(std::atomic<int>)];
+};
+
+static std::atomic<int> gCallSiteReadPhase(0);
+static VNamedLoggerCallSiteReaderCell gCallSiteReaders[2][kNumReaderCells];
+static std::atomic<int> gNextCallSiteReaderCell(0);
+static V_THREAD_LOCAL int gCallSiteReaderCell = -1;
+
+VNamedLoggerCallSite::ReadGuard::ReadGuard()
+    : mReaderCount(NULL)
+    {
+
+    if (gCallSiteReaderCell < 0) {
+        gCallSiteReaderCell = gNextCallSiteReaderCell.fetch_add(1, std::memory_order_relaxed) & (kNumReaderCells - 1);
+    }
+
+    // If the phase switched while we were adding ourselves, _switchReadPhaseIfQuiescent() may already
+    // have found no readers in the phase we counted ourselves in, so count ourselves in the new one instead.
+    for (;;) {
+        const int phase = gCallSiteReadPhase.load();
+        mReaderCount = &gCallSiteReaders[phase][gCallSiteReaderCell].mCount;
+        mReaderCount->fetch_add(1);
+
+        if (gCallSiteReadPhase.load() == phase) {
+            break;
+        }
+
+        mReaderCount->fetch_sub(1);
+    }
+}
+
+VNamedLoggerCallSite::ReadGuard::~ReadGuard() {
+    mReaderCount->fetch_sub(1);
+}
+
+VNamedLoggerPtr VNamedLoggerCallSite::_resolve(const VString& name, int level) {
+    // Note the generation before looking, so that if the configuration changes while we look,
+    // what we publish is already stale and will be looked up again next time.
+    const Vu32 generation = VLogger::gConfigurationGeneration.load(std::memory_order_acquire);
+
+    // If the published result is current, we are here because this site was handed another name
+    // (or its logger has just gone). Don't replace it; look this name up the ordinary way.
+    bool publishedIsCurrent = false;
+    bool publishedIsOtherName = false;
+    /* read guard scope */ {
+        ReadGuard guard;
+        const Resolution* published = mResolution.load();
+        publishedIsCurrent = (published != NULL) && (published->mGeneration == generation);
+        publishedIsOtherName = publishedIsCurrent && (published->mName != name);
+    }
+
+    if (publishedIsOtherName) {
+        // Remembering one of several names would only add a miss to most lookups, so from now on
+        // this site skips the cache, and no longer keeps its result alive.
+        mNameVaries.store(true);
+        const Resolution* published = mResolution.exchange(NULL);
+        if (published != NULL) {
+            VNamedLoggerCallSite::_retire(published);
+        }
+    }
+
+    if (publishedIsCurrent) {
+        return VLogger::findNamedLoggerForLevel(name, level);
+    }
+
+    VNamedLoggerPtr logger = VLogger::findNamedLogger(name);
+    if (logger == nullptr) {
+        logger = VLogger::findDefaultLogger();
+    }
+
+    // With no default logger yet, let the normal path create one (which starts a new generation).
+    if (logger == nullptr) {
+        return VLogger::findNamedLoggerForLevel(name, level);
+    }
+
+    // Only replace a result from an earlier generation; another thread may have published a current one meanwhile.
+    Resolution* resolution = new Resolution(generation, name, logger);
+    const Resolution* published = NULL;
+    bool replaced = false;
+
+    /* read guard scope */ {
+        // Another thread may replace and retire the published result while we look at it.
+        ReadGuard guard;
+        published = mResolution.load();
+        replaced = ((published == NULL) || (published->mGeneration != VLogger::gConfigurationGeneration.load(std::memory_order_acquire))) &&
+            mResolution.compare_exchange_strong(published, resolution);
+    }
+
+    if (! replaced) {
+        delete resolution; // not published
+    } else if (published != NULL) {
+        VNamedLoggerCallSite::_retire(published);
+    }
+
+    return logger->isEnabledFor(level) ? logger : NULL_NAMED_LOGGER_PTR;
+}
+
+// static
+void VNamedLoggerCallSite::_retire(const Resolution* resolution) {
+    // The result is no longer published, so a reader that counts itself in a later phase cannot
+    // find it. Rather than wait for those that found it, we queue it under the current phase.
+    VMutexLocker locker(VNamedLoggerCallSite::_getRetireMutex(), "VNamedLoggerCallSite::_retire()");
+    VNamedLoggerCallSite::_getRetired(gCallSiteReadPhase.load()).push_back(resolution);
+    VNamedLoggerCallSite::_switchReadPhaseIfQuiescent();
+}
+
+// static
+void VNamedLoggerCallSite::_reclaimRetired() {
+    VMutexLocker locker(VNamedLoggerCallSite::_getRetireMutex(), "VNamedLoggerCallSite::_reclaimRetired()");
+    VNamedLoggerCallSite::_switchReadPhaseIfQuiescent();
+}
+
+// static
+void VNamedLoggerCallSite::_switchReadPhaseIfQuiescent() {
+    // ASSUMES CALLER HOLDS _getRetireMutex().
+    // The results queued under the earlier phase were unpublished before we switched away from it,
+    // so a reader counted in the current phase cannot have found them, and one counted in the
+    // earlier phase may still be looking. If there are none of the latter, they can go. Otherwise
+    // we leave them for the next replacement or configuration change.
+    const int phase = gCallSiteReadPhase.load();
+    const int earlierPhase = 1 - phase;
+    for (int i = 0; i < kNumReaderCells; ++i) {
+        if (gCallSiteReaders[earlierPhase][i].mCount.load() != 0) {
+            return;
+        }
+    }
+
+    std::vector<const Resolution*>& retired = VNamedLoggerCallSite::_getRetired(earlierPhase);
+    for (std::vector<const Resolution*>::const_iterator i = retired.begin(); i != retired.end(); ++i) {
+        delete (*i);
+    }
+
+    retired.clear();
+
+    // What we queued under the current phase is deleted at the next switch, once its readers are done.
+    gCallSiteReadPhase.store(earlierPhase);
+}
+
+// static
+VMutex* VNamedLoggerCallSite::_getRetireMutex() {
+    // Function-local so that it exists for call sites used during static initialization.
+    static VMutex gRetireMutex("VNamedLoggerCallSite::gRetireMutex", true/*suppress logging*/);
+    return &gRetireMutex;
+}
+
+// static
+std::vector<const VNamedLoggerCallSite::Resolution*>& VNamedLoggerCallSite::_getRetired(int phase) {
+    static std::vector<const Resolution*> gRetiredResolutions[2];
+    return gRetiredResolutions[phase];
+}
+
 // VLogAppender ------------------------------------------------------
 
 //static const VString DEFAULT_APPENDER_FORMAT_SPEC("$localtime $level | $thread | $specifiedlogger=>$actuallogger | $location$message"); // <- useful for debugging the named logger routing
@@ -923,7 +1215,11 @@ VLogAppender::VLogAppender(const VString& name, bool formatOutput, const VString
     , mFormatUsesLocation(mFormatSpec.contains("$location"))
     , mFormatUsesSpecifiedLoggerName(mFormatSpec.contains("$specifiedlogger"))
     , mFormatUsesActualLoggerName(mFormatSpec.contains("$actuallogger"))
+    , mFormatTokens()
+    , mFormattedMessage()
+    , mReplayingRecord(NULL)
     {
+    VLogAppender::_parseFormatSpec(mFormatSpec, mFormatTokens);
 }
 
 VLogAppender::VLogAppender(const VSettingsNode& settings, const VSettingsNode& defaults)
@@ -939,7 +1235,11 @@ VLogAppender::VLogAppender(const VSettingsNode& settings, const VSettingsNode& d
     , mFormatUsesLocation(mFormatSpec.contains("$location"))
     , mFormatUsesSpecifiedLoggerName(mFormatSpec.contains("$specifiedlogger"))
     , mFormatUsesActualLoggerName(mFormatSpec.contains("$actuallogger"))
+    , mFormatTokens()
+    , mFormattedMessage()
+    , mReplayingRecord(NULL)
     {
+    VLogAppender::_parseFormatSpec(mFormatSpec, mFormatTokens);
 }
 
 VLogAppender::~VLogAppender() {
@@ -978,6 +1278,38 @@ void VLogAppender::emitRaw(const VString& message) {
     this->emit(VLoggerLevel::TRACE, NULL, 0, false, VString::EMPTY(), VString::EMPTY(), VString::EMPTY(), true, message);
 }
 
+void VLogAppender::emitDeferred(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
+    this->emit(level, file, line, true, message.getText(), specifiedLoggerName, actualLoggerName, false, VString::EMPTY());
+}
+
+void VLogAppender::emitRecords(const VLogRecordList& records) {
+    VLogAppender::_breakpointLocationForEmit();
+
+    VMutexLocker locker(&mMutex, "emitRecords");
+
+    try {
+        for (VLogRecordList::const_iterator i = records.begin(); i != records.end(); ++i) {
+            const VLogRecord& record = **i;
+            mReplayingRecord = &record;
+
+            if (record.mEmitMessage) {
+                this->_emitMessage(record.mLevel, record.mFile, record.mLine, record.getMessage(), record.mSpecifiedLoggerName, record.mActualLoggerName);
+            }
+
+            if (record.mEmitRawLine) {
+                this->_emitRawLine(record.mRawLine);
+            }
+        }
+    } catch (...) {
+        mReplayingRecord = NULL;
+        this->_flush();
+        throw;
+    }
+
+    mReplayingRecord = NULL;
+    this->_flush();
+}
+
 bool VLogAppender::isDefaultAppender() const {
     return VLogger::gDefaultAppender.get() == this;
 }
@@ -992,22 +1324,90 @@ int VLogAppender::_getIntInitSetting(const VString& attributePath, const VSettin
     return settings.getInt(attributePath, defaults.getInt(attributePath, defaultValue));
 }
 
+// static
+Vs64 VLogAppender::_getS64InitSetting(const VString& attributePath, const VSettingsNode& settings, const VSettingsNode& defaults, Vs64 defaultValue) {
+    return settings.getS64(attributePath, defaults.getS64(attributePath, defaultValue));
+}
+
 // static
 VString VLogAppender::_getStringInitSetting(const VString& attributePath, const VSettingsNode& settings, const VSettingsNode& defaults, const VString& defaultValue) {
     return settings.getString(attributePath, defaults.getString(attributePath, defaultValue));
 }
 
+// static
+void VLogAppender::_parseFormatSpec(const VString& formatSpec, FormatTokenList& tokens) {
+    struct Variable {
+        const char*         mName;
+        FormatToken::Kind   mKind;
+    };
+
+    static const Variable kVariables[] = {
+        { "$localtime", FormatToken::kLocalTime },
+        { "$utctime", FormatToken::kUTCTime },
+        { "$level", FormatToken::kLevel },
+        { "$thread", FormatToken::kThread },
+        { "$location", FormatToken::kLocation },
+        { "$specifiedlogger", FormatToken::kSpecifiedLoggerName },
+        { "$actuallogger", FormatToken::kActualLoggerName },
+        { "$message", FormatToken::kMessage }
+    };
+    static const int kNumVariables = static_cast<int>(sizeof(kVariables) / sizeof(kVariables[0]));
+
+    tokens.clear();
+
+    const char* spec = formatSpec.chars();
+    const int specLength = formatSpec.length();
+    int literalStart = 0;
+    int i = 0;
+
+    while (i < specLength) {
+        const Variable* variable = NULL;
+        if (spec[i] == '$') {
+            for (int v = 0; v < kNumVariables; ++v) {
+                if (::strncmp(spec + i, kVariables[v].mName, ::strlen(kVariables[v].mName)) == 0) {
+                    variable = &kVariables[v];
+                    break;
+                }
+            }
+        }
+
+        if (variable == NULL) {
+            ++i;
+            continue;
+        }
+
+        if (i > literalStart) {
+            VString literal;
+            formatSpec.getSubstring(literal, literalStart, i);
+            tokens.push_back(FormatToken(FormatToken::kLiteral, literal));
+        }
+
+        tokens.push_back(FormatToken(variable->mKind, VString::EMPTY()));
+        i += static_cast<int>(::strlen(variable->mName));
+        literalStart = i;
+    }
+
+    if (specLength > literalStart) {
+        VString literal;
+        formatSpec.getSubstring(literal, literalStart, specLength);
+        tokens.push_back(FormatToken(FormatToken::kLiteral, literal));
+    }
+}
+
 void VLogAppender::_emitMessage(int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
     if (mFormatOutput) {
-        VString formattedMessage = this->_formatMessage(level, file, line, message, specifiedLoggerName, actualLoggerName);
-        this->_emitRawLine(formattedMessage);
+        this->_formatMessage(mFormattedMessage, level, file, line, message, specifiedLoggerName, actualLoggerName);
+        this->_emitRawLine(mFormattedMessage);
     } else {
         this->_emitRawLine(message); // directly, without applying formatting
     }
 }
 
-VString VLogAppender::_formatMessage(int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
+void VLogAppender::_formatMessage(VString& formattedMessage, int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
     VInstant now;
+    if (mReplayingRecord != NULL) {
+        now = mReplayingRecord->mWhen;
+    }
     VInstant trueNow(now); // copy constructor avoids another call to read the clock
 
     // If we are running in simulated time, display both the current and simulated time.
@@ -1016,59 +1416,66 @@ VString VLogAppender::_formatMessage(int level, const char* file, int line, cons
         trueNow.setTrueNow();
     }
 
-    VString formattedMessage = mFormatSpec;
-    
-    // I am do replacement in this order (mainly with $message last) to be sure that
-    // none of the replacements put a $ specifier into the string.
-    if (mFormatUsesLocalTime) {
-        VString localTimeStampString;
-        if (prependTrueTime) {
-            localTimeStampString = trueNow.getLocalString(mTimeFormatter) + " ";
+    // Reusing the buffer means that after the first few messages this does not allocate.
+    // Values are appended as they are, so a '$' in a message or thread name is never taken for a variable.
+    formattedMessage.clearKeepingBuffer();
+
+    for (FormatTokenList::const_iterator i = mFormatTokens.begin(); i != mFormatTokens.end(); ++i) {
+        switch ((*i).mKind) {
+            case FormatToken::kLiteral:
+                formattedMessage += (*i).mLiteral;
+                break;
+
+            case FormatToken::kLocalTime:
+                if (prependTrueTime) {
+                    formattedMessage += trueNow.getLocalString(mTimeFormatter);
+                    formattedMessage += ' ';
+                }
+                formattedMessage += now.getLocalString(mTimeFormatter);
+                break;
+
+            case FormatToken::kUTCTime:
+                if (prependTrueTime) {
+                    formattedMessage += trueNow.getUTCString(mTimeFormatter);
+                    formattedMessage += ' ';
+                }
+                formattedMessage += now.getUTCString(mTimeFormatter);
+                break;
+
+            case FormatToken::kLevel:
+                formattedMessage += VLoggerLevel::getName(level);
+                break;
+
+            case FormatToken::kThread:
+                try {
+                    formattedMessage += (mReplayingRecord == NULL) ? VThread::getCurrentThreadName() : mReplayingRecord->mThreadName;
+                } catch (...) {
+                }
+                break;
+
+            case FormatToken::kLocation:
+                if (file != NULL) {
+                    formattedMessage += "@ ";
+                    formattedMessage += file;
+                    formattedMessage += ':';
+                    formattedMessage += line;
+                    formattedMessage += ": ";
+                }
+                break;
+
+            case FormatToken::kSpecifiedLoggerName:
+                formattedMessage += specifiedLoggerName;
+                break;
+
+            case FormatToken::kActualLoggerName:
+                formattedMessage += actualLoggerName;
+                break;
+
+            case FormatToken::kMessage:
+                formattedMessage += message;
+                break;
         }
-
-        localTimeStampString += now.getLocalString(mTimeFormatter);
-        formattedMessage.replace("$localtime", localTimeStampString);
     }
-
-    if (mFormatUsesUTCTime) {
-        VString utcTimeStampString;
-        if (prependTrueTime) {
-            utcTimeStampString = trueNow.getUTCString(mTimeFormatter) + " ";
-        }
-        utcTimeStampString += now.getUTCString(mTimeFormatter);
-        formattedMessage.replace("$utctime", utcTimeStampString);
-    }
-
-    if (mFormatUsesLevel) {
-        formattedMessage.replace("$level", VLoggerLevel::getName(level));
-    }
-
-    if (mFormatUsesLocation) {
-        if (file == NULL) {
-            formattedMessage.replace("$location", VString::EMPTY());
-        } else {
-            formattedMessage.replace("$location", VSTRING_FORMAT("@ %s:%d: ", file, line));
-        }
-    }
-
-    if (mFormatUsesThread) {
-        try {
-            formattedMessage.replace("$thread", VThread::getCurrentThreadName());
-        } catch (...) {
-        }
-    }
-
-    if (mFormatUsesSpecifiedLoggerName) {
-        formattedMessage.replace("$specifiedlogger", specifiedLoggerName);
-    }
-
-    if (mFormatUsesActualLoggerName) {
-        formattedMessage.replace("$actuallogger", actualLoggerName);
-    }
-
-    formattedMessage.replace("$message", message);
-
-    return formattedMessage;
 }
 
 VString VLogAppender::_toString() const {
@@ -1101,7 +1508,16 @@ void VCoutLogAppender::addInfo(VBentoNode& infoNode) const {
 }
 
 void VCoutLogAppender::_emitRawLine(const VString& line) {
-    std::cout << line.chars() << std::endl;
+    if (mReplayingRecord != NULL) {
+        std::cout << line.chars() << '\n';
+    } else {
+        std::cout << line.chars() << std::endl;
+        (void) ::fflush(stdout);
+    }
+}
+
+void VCoutLogAppender::_flush() {
+    std::cout.flush();
     (void) ::fflush(stdout);
 }
 
@@ -1148,34 +1564,358 @@ void VFileLogAppender::addInfo(VBentoNode& infoNode) const {
 
 void VFileLogAppender::_emitRawLine(const VString& line) {
     mOutputStream.writeLine(line);
+
+    if (mReplayingRecord == NULL) {
+        mOutputStream.flush();
+    }
+}
+
+void VFileLogAppender::_flush() {
     mOutputStream.flush();
 }
 
 // VRollingFileLogAppender ---------------------------------------------------
 
-VRollingFileLogAppender::VRollingFileLogAppender(const VString& name, bool formatOutput, const VString& formatSpec, const VString& timeFormat, const VString& /*dirPath*/, const VString& /*fileNamePrefix*/, int /*maxNumLines*/)
+// Lines emitted through emitRecords() are written when the batch ends, or when this many bytes are waiting.
+static const int kRollingFileMaxBufferedBytes = 65536;
+
+// This style of static mutex declaration and access ensures correct
+// initialization if accessed during the static initialization phase.
+static VMutex* _mutexRollingFileHousekeeper() {
+    static VMutex gMutex("VRollingFileLogAppender _mutexRollingFileHousekeeper() gMutex", true/*suppress logging*/);
+    return &gMutex;
+}
+
+static VThreadPool* gRollingFileHousekeeper = NULL;
+static bool gRollingFileHousekeeperShutDown = false;
+
+static void _deleteRollingFileHousekeeper() {
+    VMutexLocker locker(_mutexRollingFileHousekeeper(), "VRollingFileLogAppender _deleteRollingFileHousekeeper()");
+    delete gRollingFileHousekeeper; // runs the queued tasks before its thread ends
+    gRollingFileHousekeeper = NULL;
+    gRollingFileHousekeeperShutDown = true;
+}
+
+// All rolling file appenders share one housekeeping thread, which opens, closes, and removes their files.
+// Once it has been shut down it is not started again; the task is run here instead, and the returned future is null.
+static VThreadPoolFuturePtr _submitRollingFileHousekeeping(const VThreadPoolTask& task) {
+    /* locker scope */ {
+        VMutexLocker locker(_mutexRollingFileHousekeeper(), "VRollingFileLogAppender _submitRollingFileHousekeeping()");
+
+        if (! gRollingFileHousekeeperShutDown) {
+            if (gRollingFileHousekeeper == NULL) {
+                gRollingFileHousekeeper = new VThreadPool("VRollingFileLogAppender", 1);
+                gRollingFileHousekeeper->start();
+                VShutdownRegistry::instance()->registerFunction(_deleteRollingFileHousekeeper);
+            }
+
+            return gRollingFileHousekeeper->submit(task);
+        }
+    }
+
+    try {
+        task();
+    } catch (...) {} // as on the housekeeping thread, the caller looks at the outcome if it matters
+
+    return VThreadPoolFuturePtr();
+}
+
+static void _openRollingFile(VDirectIOFileStream* file, Vs64 numBytesToPreallocate) {
+    VFSNode directory;
+    file->getNode().getParentNode(directory);
+    directory.mkdirs();
+
+    file->openWrite();
+
+    if (numBytesToPreallocate > 0) {
+        (void) file->preallocate(numBytesToPreallocate); // an optimization only, so carry on without it
+    }
+}
+
+static void _closeRollingFile(VDirectIOFileStream* file, bool wasPreallocated) {
+    if (wasPreallocated && file->isOpen()) {
+        try {
+            file->truncate(file->getIOOffset()); // give back the space reserved but not used
+        } catch (...) {}
+    }
+
+    delete file; // closes it
+}
+
+// Returns the number in a file name of the form "<prefix>-<n>.log", or -1 if it is not one.
+static int _getRollingFileIndex(const VString& fileName, const VString& fileNamePrefix) {
+    const VString start = fileNamePrefix + "-";
+    const VString end(".log");
+
+    if ((fileName.length() <= start.length() + end.length()) || ! fileName.startsWith(start) || ! fileName.endsWith(end)) {
+        return -1;
+    }
+
+    VString number;
+    fileName.getSubstring(number, start.length(), fileName.length() - end.length());
+
+    for (int i = 0; i < number.length(); ++i) {
+        if (! number.at(i).isNumeric()) {
+            return -1;
+        }
+    }
+
+    return number.parseInt();
+}
+
+static void _removeOldRollingFiles(const VFSNode& directory, const VString& fileNamePrefix, int oldestFileIndexToKeep) {
+    VStringVector fileNames;
+    directory.list(fileNames);
+
+    for (VStringVector::const_iterator i = fileNames.begin(); i != fileNames.end(); ++i) {
+        const int fileIndex = _getRollingFileIndex(*i, fileNamePrefix);
+        if ((fileIndex >= 0) && (fileIndex < oldestFileIndexToKeep)) {
+            VFSNode oldFile;
+            directory.getChildNode(*i, oldFile);
+            (void) oldFile.rm();
+        }
+    }
+}
+
+VRollingFileLogAppender::VRollingFileLogAppender(const VString& name, bool formatOutput, const VString& formatSpec, const VString& timeFormat, const VString& dirPath, const VString& fileNamePrefix, int maxNumLines, Vs64 maxNumBytes, const VDuration& rollInterval, int maxNumFiles, bool preallocate)
     : VLogAppender(name, formatOutput, formatSpec, timeFormat)
+    , mDirectory(dirPath.isEmpty() ? VLogger::getBaseLogDirectory() : VFSNode(dirPath))
+    , mFileNamePrefix(fileNamePrefix.isEmpty() ? name : fileNamePrefix)
+    , mMaxNumLines(V_MAX(0, maxNumLines))
+    , mMaxNumBytes(V_MAX(static_cast<Vs64>(0), maxNumBytes))
+    , mRollInterval(rollInterval)
+    , mMaxNumFiles(V_MAX(0, maxNumFiles))
+    , mPreallocate(preallocate && (maxNumBytes > 0))
+    , mFileIndex(0)
+    , mFile(NULL)
+    , mNumLines(0)
+    , mNumBytes(0)
+    , mRollTime()
+    , mBuffer()
+    , mNextFile(NULL)
+    , mNextFileFuture()
+    , mRollOverPending(false)
+    , mNumRollOvers(0)
     {
+    this->_openFirstFile();
 }
 
 VRollingFileLogAppender::VRollingFileLogAppender(const VSettingsNode& settings, const VSettingsNode& defaults)
     : VLogAppender(settings, defaults)
+    , mDirectory(VLogAppender::_getStringInitSetting("dir", settings, defaults, VLogger::getBaseLogDirectory().getPath()))
+    , mFileNamePrefix(VLogAppender::_getStringInitSetting("prefix", settings, defaults, settings.getString("name")))
+    , mMaxNumLines(V_MAX(0, VLogAppender::_getIntInitSetting("max-lines", settings, defaults, 0)))
+    , mMaxNumBytes(V_MAX(static_cast<Vs64>(0), VLogAppender::_getS64InitSetting("max-bytes", settings, defaults, CONST_S64(0))))
+    , mRollInterval(VDuration::SECOND() * V_MAX(0, VLogAppender::_getIntInitSetting("roll-interval-seconds", settings, defaults, 0)))
+    , mMaxNumFiles(V_MAX(0, VLogAppender::_getIntInitSetting("max-files", settings, defaults, 0)))
+    , mPreallocate(VLogAppender::_getBooleanInitSetting("preallocate", settings, defaults, false) && (mMaxNumBytes > 0))
+    , mFileIndex(0)
+    , mFile(NULL)
+    , mNumLines(0)
+    , mNumBytes(0)
+    , mRollTime()
+    , mBuffer()
+    , mNextFile(NULL)
+    , mNextFileFuture()
+    , mRollOverPending(false)
+    , mNumRollOvers(0)
     {
-    /* todo: use these settings properties to construct, something like:
-        mDirPath = VLogAppender::_getStringInitSetting("dir", settings, defaults, VLogger::getBaseLogDirectory().getPath());
-        mPrefix = VLogAppender::_getStringInitSetting("prefix", settings, defaults, settings.getString("name"));
-        mMaxLines = VLogAppender::_getIntInitSetting("max-lines", settings, defaults, 10000);
-    */
+    this->_openFirstFile();
+}
+
+VRollingFileLogAppender::~VRollingFileLogAppender() {
+    try {
+        this->_writeBuffer();
+    } catch (...) {} // prevent exception from propagating
+
+    _closeRollingFile(mFile, mPreallocate);
+
+    // The next file was never used, so remove it rather than leave an empty file behind.
+    if (mNextFile != NULL) {
+        if (mNextFileFuture != nullptr) {
+            try {
+                mNextFileFuture->wait();
+            } catch (...) {}
+        }
+
+        VFSNode unusedFile = mNextFile->getNode();
+        delete mNextFile;
+        (void) unusedFile.rm();
+    }
 }
 
 void VRollingFileLogAppender::addInfo(VBentoNode& infoNode) const {
     VLogAppender::addInfo(infoNode);
     infoNode.addString("type", "VRollingFileLogAppender");
-    // TODO: current file etc.
+    infoNode.addString("dir", mDirectory.getPath());
+    infoNode.addString("prefix", mFileNamePrefix);
+    infoNode.addInt("max-lines", mMaxNumLines);
+    infoNode.addS64("max-bytes", mMaxNumBytes);
+    infoNode.addS64("roll-interval-seconds", mRollInterval.getDurationSeconds());
+    infoNode.addInt("max-files", mMaxNumFiles);
+    infoNode.addBool("preallocate", mPreallocate);
+
+    VMutexLocker locker(&mMutex, "VRollingFileLogAppender::addInfo()");
+    infoNode.addString("file", mFile->getNode().getPath());
+    infoNode.addInt("lines", mNumLines);
+    infoNode.addS64("bytes", mNumBytes);
+    infoNode.addS64("roll-overs", mNumRollOvers);
+}
+
+void VRollingFileLogAppender::rollOver() {
+    VThreadPoolFuturePtr nextFileFuture;
+
+    /* locker scope */ {
+        VMutexLocker locker(&mMutex, "VRollingFileLogAppender::rollOver() get next file");
+        nextFileFuture = mNextFileFuture;
+    }
+
+    // Let the next file be opened before we take mMutex again, so that _rollOver() need not put us off.
+    if (nextFileFuture != nullptr) {
+        try {
+            nextFileFuture->wait();
+        } catch (...) {} // _rollOver() tries again
+    }
+
+    VMutexLocker locker(&mMutex, "VRollingFileLogAppender::rollOver()");
+    this->_rollOver();
+}
+
+VString VRollingFileLogAppender::getCurrentFilePath() const {
+    VMutexLocker locker(&mMutex, "VRollingFileLogAppender::getCurrentFilePath()");
+    return mFile->getNode().getPath();
+}
+
+void VRollingFileLogAppender::_emitRawLine(const VString& line) {
+    // A time limit is checked before writing, so that the line goes in the file for the period it belongs to.
+    // So is a rollover that was put off.
+    if (mRollOverPending) {
+        this->_rollOver();
+    } else if ((mRollInterval > VDuration::ZERO()) && (mNumLines != 0)) {
+        const VInstant now = (mReplayingRecord == NULL) ? VInstant() : mReplayingRecord->mWhen;
+        if (now >= mRollTime) {
+            this->_rollOver();
+        }
+    }
+
+    mBuffer += line;
+    mBuffer += VString::NATIVE_LINE_ENDING();
+    ++mNumLines;
+    mNumBytes += line.length() + VString::NATIVE_LINE_ENDING().length();
+
+    if ((mReplayingRecord == NULL) || (mBuffer.length() >= kRollingFileMaxBufferedBytes)) {
+        this->_writeBuffer();
+    }
+
+    if (((mMaxNumLines != 0) && (mNumLines >= mMaxNumLines)) || ((mMaxNumBytes != 0) && (mNumBytes >= mMaxNumBytes))) {
+        this->_rollOver();
+    }
+}
+
+void VRollingFileLogAppender::_flush() {
+    this->_writeBuffer();
+}
+
+void VRollingFileLogAppender::_openFirstFile() {
+    // Carry on numbering after any files left by an earlier run.
+    int highestFileIndex = 0;
+    if (mDirectory.exists()) {
+        VStringVector fileNames;
+        mDirectory.list(fileNames);
+        for (VStringVector::const_iterator i = fileNames.begin(); i != fileNames.end(); ++i) {
+            highestFileIndex = V_MAX(highestFileIndex, _getRollingFileIndex(*i, mFileNamePrefix));
+        }
+    }
+
+    mFileIndex = highestFileIndex + 1;
+    mFile = new VDirectIOFileStream(this->_getFileNode(mFileIndex));
+    _openRollingFile(mFile, mPreallocate ? mMaxNumBytes : 0);
+    mRollTime = VInstant() + mRollInterval;
+
+    if (mMaxNumFiles != 0) {
+        (void) _submitRollingFileHousekeeping(std::bind(_removeOldRollingFiles, mDirectory, mFileNamePrefix, mFileIndex - mMaxNumFiles + 1));
+    }
+
+    this->_prepareNextFile();
 }
 
-void VRollingFileLogAppender::_emitRawLine(const VString& /*line*/) {
-    // TODO!
+VFSNode VRollingFileLogAppender::_getFileNode(int fileIndex) const {
+    VFSNode node;
+    mDirectory.getChildNode(VSTRING_FORMAT("%s-%06d.log", mFileNamePrefix.chars(), fileIndex), node);
+    return node;
+}
+
+void VRollingFileLogAppender::_prepareNextFile() {
+    mNextFile = new VDirectIOFileStream(this->_getFileNode(mFileIndex + 1));
+    mNextFileFuture = _submitRollingFileHousekeeping(std::bind(_openRollingFile, mNextFile, mPreallocate ? mMaxNumBytes : 0));
+}
+
+void VRollingFileLogAppender::_rollOver() {
+    // Normally the housekeeping thread opened the next file long ago. If it has not yet (it is
+    // shared, and may be busy removing files), do not hold up logging waiting for it; keep
+    // writing to the current file and try again with the next line.
+    if ((mNextFileFuture != nullptr) && ! mNextFileFuture->isDone()) {
+        mRollOverPending = true;
+        return;
+    }
+
+    mRollOverPending = false;
+    this->_writeBuffer();
+
+    // If the next file could not be opened, try once more here; if that fails too, stay with the
+    // current file until it reaches its limits again.
+    VDirectIOFileStream* nextFile = mNextFile;
+    mNextFile = NULL;
+    mNextFileFuture.reset();
+
+    if (! nextFile->isOpen()) {
+        try {
+            _openRollingFile(nextFile, mPreallocate ? mMaxNumBytes : 0);
+        } catch (...) {
+            delete nextFile;
+            nextFile = NULL;
+        }
+    }
+
+    if (nextFile == NULL) {
+        mNumLines = 0;
+        mNumBytes = 0;
+        mRollTime = VInstant() + mRollInterval;
+        this->_prepareNextFile(); // the same file number again
+        return;
+    }
+
+    VDirectIOFileStream* previousFile = mFile;
+    mFile = nextFile;
+    ++mFileIndex;
+    ++mNumRollOvers;
+    mNumLines = 0;
+    mNumBytes = 0;
+    mRollTime = VInstant() + mRollInterval;
+
+    (void) _submitRollingFileHousekeeping(std::bind(_closeRollingFile, previousFile, mPreallocate));
+
+    if (mMaxNumFiles != 0) {
+        (void) _submitRollingFileHousekeeping(std::bind(_removeOldRollingFiles, mDirectory, mFileNamePrefix, mFileIndex - mMaxNumFiles + 1));
+    }
+
+    this->_prepareNextFile();
+}
+
+void VRollingFileLogAppender::_writeBuffer() {
+    if (mBuffer.isEmpty()) {
+        return;
+    }
+
+    // Clear the buffer even if the write fails, so a bad disk does not make it grow without bound.
+    try {
+        (void) mFile->write(reinterpret_cast<const Vu8*>(mBuffer.chars()), mBuffer.length());
+    } catch (...) {
+        mBuffer.clearKeepingBuffer();
+        throw;
+    }
+
+    mBuffer.clearKeepingBuffer();
 }
 
 // VSilentLogAppender ----------------------------------------------------------
@@ -1260,6 +2000,10 @@ void VStringLogger::_emitToAppenders(int level, const char* file, int line, bool
     mAppender.emit(level, file, line, emitMessage, message, specifiedLoggerName, this->getName(), emitRawLine, rawLine);
 }
 
+void VStringLogger::_emitDeferredToAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName) {
+    mAppender.emitDeferred(level, file, line, message, specifiedLoggerName, this->getName());
+}
+
 // VStringVectorLogger -------------------------------------------------------------
 
 VStringVectorLogger::VStringVectorLogger(const VString& name, int level, /*@Nullable*/VStringVector* storage, bool formatOutput, const VString& formatSpec, const VString& timeFormat)
@@ -1277,6 +2021,10 @@ void VStringVectorLogger::_emitToAppenders(int level, const char* file, int line
     mAppender.emit(level, file, line, emitMessage, message, specifiedLoggerName, this->getName(), emitRawLine, rawLine);
 }
 
+void VStringVectorLogger::_emitDeferredToAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName) {
+    mAppender.emitDeferred(level, file, line, message, specifiedLoggerName, this->getName());
+}
+
 // VLoggerRepetitionFilter ---------------------------------------------------
 
 VLoggerRepetitionFilter::VLoggerRepetitionFilter()
@@ -1288,6 +2036,8 @@ VLoggerRepetitionFilter::VLoggerRepetitionFilter()
     , mFile(NULL)
     , mLine(0)
     , mMessage()
+    , mMessageIsDeferred(false)
+    , mDeferredMessage()
     , mSpecifiedLoggerName()
     , mActualLoggerName()
     {
@@ -1301,6 +2051,7 @@ void VLoggerRepetitionFilter::reset() {
     mFile = NULL;
     mLine = 0;
     mMessage = VString::EMPTY();
+    mMessageIsDeferred = false;
     mSpecifiedLoggerName = VString::EMPTY();
     mActualLoggerName = VString::EMPTY();
 }
@@ -1310,10 +2061,8 @@ bool VLoggerRepetitionFilter::checkMessage(VNamedLogger& logger, int level, cons
         return true;
     }
 
-    bool isRepeatMessage = mHasSavedMessage &&
-                           (level == mLevel) &&
-                           (file == mFile) &&
-                           (line == mLine) &&
+    bool isRepeatMessage = this->_isSavedLocation(level, file, line) &&
+                           !mMessageIsDeferred &&
                            (message == mMessage);
 
     if (isRepeatMessage) {
@@ -1326,22 +2075,31 @@ bool VLoggerRepetitionFilter::checkMessage(VNamedLogger& logger, int level, cons
         // then reset to store this message, and return true to indicate that
         // this message should be emitted (the first occurrence of a message is
         // always emitted).
+        this->_saveNewMessage(logger, level, file, line, specifiedLoggerName, actualLoggerName);
+        mMessage = message;
+        mMessageIsDeferred = false;
+    }
 
-        // Emit pending saved message.
-        if (mHasSavedMessage && (mNumSuppressedOccurrences > 0)) {
-            this->_emitSuppressedMessages(logger);
-        }
+    return ! isRepeatMessage;
+}
+
+bool VLoggerRepetitionFilter::checkMessage(VNamedLogger& logger, int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName) {
+    if (!mEnabled) {
+        return true;
+    }
 
-        // Reset and store this new message.
-        mHasSavedMessage = true;
-        mNumSuppressedOccurrences = 0;
+    bool isRepeatMessage = this->_isSavedLocation(level, file, line) &&
+                           mMessageIsDeferred &&
+                           message.isSameMessage(mDeferredMessage);
+
+    if (isRepeatMessage) {
+        ++mNumSuppressedOccurrences;
         mTimeOfLastOccurrence.setNow();
-        mLevel = level;
-        mFile = file;
-        mLine = line;
-        mMessage = message;
-        mSpecifiedLoggerName = specifiedLoggerName;
-        mActualLoggerName = actualLoggerName;
+    } else {
+        // As above. Copying the message leaves it unformatted; it is formatted only if it is suppressed and then emitted.
+        this->_saveNewMessage(logger, level, file, line, specifiedLoggerName, actualLoggerName);
+        mDeferredMessage = message;
+        mMessageIsDeferred = true;
     }
 
     return ! isRepeatMessage;
@@ -1361,18 +2119,44 @@ void VLoggerRepetitionFilter::checkTimeout(VNamedLogger& logger) {
 }
 
 void VLoggerRepetitionFilter::_emitSuppressedMessages(VNamedLogger& logger) {
+    const VString& message = mMessageIsDeferred ? mDeferredMessage.getText() : mMessage;
+
     // If there was only 1 suppressed message, no need to mark it.
     if (mNumSuppressedOccurrences > 1) {
-        VString tweakedMessage(VSTRING_ARGS("[%dx] %s", mNumSuppressedOccurrences, mMessage.chars()));
+        VString tweakedMessage(VSTRING_ARGS("[%dx] %s", mNumSuppressedOccurrences, message.chars()));
         logger._emitToAppenders(mLevel, mFile, mLine, true, tweakedMessage, mSpecifiedLoggerName, false, VString::EMPTY());
     } else {
-        logger._emitToAppenders(mLevel, mFile, mLine, true, mMessage, mSpecifiedLoggerName, false, VString::EMPTY());
+        logger._emitToAppenders(mLevel, mFile, mLine, true, message, mSpecifiedLoggerName, false, VString::EMPTY());
     }
 
     mHasSavedMessage = false;
     mNumSuppressedOccurrences = 0;
 }
 
+bool VLoggerRepetitionFilter::_isSavedLocation(int level, const char* file, int line) const {
+    return mHasSavedMessage &&
+           (level == mLevel) &&
+           (file == mFile) &&
+           (line == mLine);
+}
+
+void VLoggerRepetitionFilter::_saveNewMessage(VNamedLogger& logger, int level, const char* file, int line, const VString& specifiedLoggerName, const VString& actualLoggerName) {
+    // Emit pending saved message.
+    if (mHasSavedMessage && (mNumSuppressedOccurrences > 0)) {
+        this->_emitSuppressedMessages(logger);
+    }
+
+    // Reset and store this new message.
+    mHasSavedMessage = true;
+    mNumSuppressedOccurrences = 0;
+    mTimeOfLastOccurrence.setNow();
+    mLevel = level;
+    mFile = file;
+    mLine = line;
+    mSpecifiedLoggerName = specifiedLoggerName;
+    mActualLoggerName = actualLoggerName;
+}
+
 // VLoggerPrintStackConfig ----------------------------------------------------
 
 VLoggerPrintStackConfig::VLoggerPrintStackConfig()
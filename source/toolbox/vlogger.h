@@ -15,6 +15,9 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vmutex.h"
 #include "vbufferedfilestream.h"
 #include "vtextiostream.h"
+#include "vdeferredlogmessage.h"
+
+#include <atomic>
 
 // Microsoft steals this symbol name globally. Take it back.
 #ifdef VPLATFORM_WIN
@@ -28,6 +31,8 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 class VSettings;
 class VSettingsNode;
 class VBentoNode;
+class VDirectIOFileStream;
+class VThreadPoolFuture;
 
 /**
 
@@ -83,6 +88,15 @@ class VBentoNode;
     value to be used in subsequent logging), you can simply call VLOGGER_WOULD_LOG(level) or
     VLOGGER_NAMED_WOULD_LOG(name, level) in advance.
 
+    A message that will be logged still costs its formatting on the logging thread, for every message,
+    even when it is then queued for a VAsyncLogAppender or dropped. The VLOGGER_NAMED_<level>_FORMAT()
+    macros take the format string and arguments themselves, and leave the formatting to the appenders
+    (see VDeferredLogMessage):
+
+    <pre>
+        VLOGGER_NAMED_DEBUG_FORMAT("vault.sessions", "Session %s sent %d bytes.", sessionName, numBytes);
+    </pre>
+
     If a specified named logger is not found, the system emits to another logger. In the simple case,
     this just means using the default logger. However, you can set up a naming hierarchy where logger
     names use a "dot.separated.naming.convention", because the fallback search is done by repeatedly
@@ -212,8 +226,8 @@ class VBentoNode;
 */
 
 // This first set of macros sends output to the default logger.
-#define VLOGGER_LEVEL(level, message) do { if (!VLogger::isDefaultLogLevelActive(level)) break; VLogger::getDefaultLogger()->log(level, NULL, 0, message, VString::EMPTY()); } while (false)
-#define VLOGGER_LEVEL_FILELINE(level, message, file, line) do { if (!VLogger::isDefaultLogLevelActive(level)) break; VLogger::getDefaultLogger()->log(level, file, line, message, VString::EMPTY()); } while (false)
+#define VLOGGER_LEVEL(level, message) do { if (!VLogger::isDefaultLogLevelActive(level)) break; VStringScratchScope scratchScope; VLogger::getDefaultLogger()->log(level, NULL, 0, message, VString::EMPTY()); } while (false)
+#define VLOGGER_LEVEL_FILELINE(level, message, file, line) do { if (!VLogger::isDefaultLogLevelActive(level)) break; VStringScratchScope scratchScope; VLogger::getDefaultLogger()->log(level, file, line, message, VString::EMPTY()); } while (false)
 #define VLOGGER_LINE(level, message) VLOGGER_LEVEL_FILELINE(level, message, __FILE__, __LINE__)
 #define VLOGGER_FATAL_AND_THROW(message) do { VLogger::getDefaultLogger()->log(VLoggerLevel::FATAL, __FILE__, __LINE__, message); throw VStackTraceException(message); } while (false)
 #define VLOGGER_FATAL(message) VLOGGER_LEVEL_FILELINE(VLoggerLevel::FATAL, message, __FILE__, __LINE__)
@@ -222,12 +236,13 @@ class VBentoNode;
 #define VLOGGER_INFO(message) VLOGGER_LEVEL(VLoggerLevel::INFO, message)
 #define VLOGGER_DEBUG(message) VLOGGER_LEVEL(VLoggerLevel::DEBUG, message)
 #define VLOGGER_TRACE(message) VLOGGER_LEVEL(VLoggerLevel::TRACE, message)
-#define VLOGGER_HEXDUMP(level, message, buffer, length) do { if (!VLogger::isDefaultLogLevelActive(level)) break; VLogger::getDefaultLogger()->logHexDump(level, message, VString::EMPTY(), buffer, length); } while (false)
+#define VLOGGER_HEXDUMP(level, message, buffer, length) do { if (!VLogger::isDefaultLogLevelActive(level)) break; VStringScratchScope scratchScope; VLogger::getDefaultLogger()->logHexDump(level, message, VString::EMPTY(), buffer, length); } while (false)
 #define VLOGGER_WOULD_LOG(level) (VLogger::isDefaultLogLevelActive(level))
 
 // This set of macros sends output to a specified named logger.
-#define VLOGGER_NAMED_LEVEL(loggername, level, message) do { if (!VLogger::isLogLevelActive(level)) break; VNamedLoggerPtr nl = VLogger::findNamedLoggerForLevel(loggername, level); if (nl != nullptr) nl->log(level, NULL, 0, message, loggername); } while (false)
-#define VLOGGER_NAMED_LEVEL_FILELINE(loggername, level, message, file, line) do { if (!VLogger::isLogLevelActive(level)) break; VNamedLoggerPtr nl = VLogger::findNamedLoggerForLevel(loggername, level); if (nl != nullptr) nl->log(level, file, line, message, loggername); } while (false)
+// Each use remembers the logger it resolved (see VNamedLoggerCallSite), so a repeated log statement does not search the registry.
+#define VLOGGER_NAMED_LEVEL(loggername, level, message) do { if (!VLogger::isLogLevelActive(level)) break; static VNamedLoggerCallSite vloggerCallSite; VNamedLoggerPtr nl = vloggerCallSite.findForLevel(loggername, level); if (nl != nullptr) { VStringScratchScope scratchScope; nl->log(level, NULL, 0, message, loggername); } } while (false)
+#define VLOGGER_NAMED_LEVEL_FILELINE(loggername, level, message, file, line) do { if (!VLogger::isLogLevelActive(level)) break; static VNamedLoggerCallSite vloggerCallSite; VNamedLoggerPtr nl = vloggerCallSite.findForLevel(loggername, level); if (nl != nullptr) { VStringScratchScope scratchScope; nl->log(level, file, line, message, loggername); } } while (false)
 #define VLOGGER_NAMED_LINE(loggername, level, message) VLOGGER_NAMED_LEVEL_FILELINE(loggername, level, message, __FILE__, __LINE__)
 #define VLOGGER_NAMED_FATAL(loggername, message) VLOGGER_NAMED_LEVEL_FILELINE(loggername, VLoggerLevel::FATAL, message, __FILE__, __LINE__)
 #define VLOGGER_NAMED_ERROR(loggername, message) VLOGGER_NAMED_LEVEL_FILELINE(loggername, VLoggerLevel::ERROR, message, __FILE__, __LINE__)
@@ -235,12 +250,51 @@ class VBentoNode;
 #define VLOGGER_NAMED_INFO(loggername, message) VLOGGER_NAMED_LEVEL(loggername, VLoggerLevel::INFO, message)
 #define VLOGGER_NAMED_DEBUG(loggername, message) VLOGGER_NAMED_LEVEL(loggername, VLoggerLevel::DEBUG, message)
 #define VLOGGER_NAMED_TRACE(loggername, message) VLOGGER_NAMED_LEVEL(loggername, VLoggerLevel::TRACE, message)
-#define VLOGGER_NAMED_HEXDUMP(loggername, level, message, buffer, length) do { if (!VLogger::isLogLevelActive(level)) break; VNamedLoggerPtr nl = VLogger::findNamedLoggerForLevel(loggername, level); if (nl != nullptr) nl->logHexDump(level, message, loggername, buffer, length); } while (false)
+#define VLOGGER_NAMED_HEXDUMP(loggername, level, message, buffer, length) do { if (!VLogger::isLogLevelActive(level)) break; static VNamedLoggerCallSite vloggerCallSite; VNamedLoggerPtr nl = vloggerCallSite.findForLevel(loggername, level); if (nl != nullptr) { VStringScratchScope scratchScope; nl->logHexDump(level, message, loggername, buffer, length); } } while (false)
+// This set of macros sends a printf-style format string and its arguments to a specified named logger, to be
+// formatted only by an appender that writes the message (see VDeferredLogMessage). An async appender formats it
+// on its background thread. Use these in place of VLOGGER_NAMED_xxxx(loggername, VSTRING_FORMAT(...)).
+#define VLOGGER_NAMED_LEVEL_FORMAT(loggername, level, ...) do { if (!VLogger::isLogLevelActive(level)) break; static VNamedLoggerCallSite vloggerCallSite; VNamedLoggerPtr nl = vloggerCallSite.findForLevel(loggername, level); if (nl != nullptr) { VStringScratchScope scratchScope; nl->log(level, NULL, 0, VDeferredLogMessage(__VA_ARGS__), loggername); } } while (false)
+#define VLOGGER_NAMED_LEVEL_FILELINE_FORMAT(loggername, level, file, line, ...) do { if (!VLogger::isLogLevelActive(level)) break; static VNamedLoggerCallSite vloggerCallSite; VNamedLoggerPtr nl = vloggerCallSite.findForLevel(loggername, level); if (nl != nullptr) { VStringScratchScope scratchScope; nl->log(level, file, line, VDeferredLogMessage(__VA_ARGS__), loggername); } } while (false)
+#define VLOGGER_NAMED_FATAL_FORMAT(loggername, ...) VLOGGER_NAMED_LEVEL_FILELINE_FORMAT(loggername, VLoggerLevel::FATAL, __FILE__, __LINE__, __VA_ARGS__)
+#define VLOGGER_NAMED_ERROR_FORMAT(loggername, ...) VLOGGER_NAMED_LEVEL_FILELINE_FORMAT(loggername, VLoggerLevel::ERROR, __FILE__, __LINE__, __VA_ARGS__)
+#define VLOGGER_NAMED_WARN_FORMAT(loggername, ...) VLOGGER_NAMED_LEVEL_FORMAT(loggername, VLoggerLevel::WARN, __VA_ARGS__)
+#define VLOGGER_NAMED_INFO_FORMAT(loggername, ...) VLOGGER_NAMED_LEVEL_FORMAT(loggername, VLoggerLevel::INFO, __VA_ARGS__)
+#define VLOGGER_NAMED_DEBUG_FORMAT(loggername, ...) VLOGGER_NAMED_LEVEL_FORMAT(loggername, VLoggerLevel::DEBUG, __VA_ARGS__)
+#define VLOGGER_NAMED_TRACE_FORMAT(loggername, ...) VLOGGER_NAMED_LEVEL_FORMAT(loggername, VLoggerLevel::TRACE, __VA_ARGS__)
 #define VLOGGER_NAMED_WOULD_LOG(loggername, level) (VLogger::isLogLevelActive(level) && (VLogger::findNamedLoggerForLevel(loggername, level) != nullptr))
 
 #define VLOGGER_APPENDER_EMIT(appender, level, message) do { (appender).emit(level, (level <= VLoggerLevel::ERROR) ? __FILE__ : NULL, (level <= VLoggerLevel::ERROR) ? __LINE__ : 0, true, message, VString::EMPTY(), VString::EMPTY(), false, VString::EMPTY()); } while (false)
 #define VLOGGER_APPENDER_EMIT_FILELINE(appender, level, message, file, line) do { (appender).emit(level, file, line, true, message, VString::EMPTY(), VString::EMPTY(), false, VString::EMPTY()); } while (false)
 
+/**
+VLogRecord holds the arguments of one VLogAppender::emit() call, together with the time
+and the thread it was made from, so that it can be emitted later on another thread.
+VAsyncLogAppender queues these and hands them to its target appender in batches.
+*/
+struct VLogRecord {
+    VLogRecord() : mLevel(0), mFile(NULL), mLine(0), mEmitMessage(false), mMessage(), mMessageIsDeferred(false), mDeferredMessage(), mSpecifiedLoggerName(), mActualLoggerName(), mEmitRawLine(false), mRawLine(), mWhen(), mThreadName(), mSequenceNumber(0) {}
+
+    const VString& getMessage() const { return mMessageIsDeferred ? mDeferredMessage.getText() : mMessage; } ///< Returns the message text, formatting a deferred message.
+
+    int         mLevel;                 ///< @see VLogAppender::emit()
+    const char* mFile;                  ///< @see VLogAppender::emit()
+    int         mLine;                  ///< @see VLogAppender::emit()
+    bool        mEmitMessage;           ///< @see VLogAppender::emit()
+    VString     mMessage;               ///< @see VLogAppender::emit(); not used if mMessageIsDeferred.
+    bool        mMessageIsDeferred;     ///< True if the message is mDeferredMessage, to be formatted by whoever emits the record.
+    VDeferredLogMessage mDeferredMessage; ///< @see VLogAppender::emitDeferred(); used if mMessageIsDeferred.
+    VString     mSpecifiedLoggerName;   ///< @see VLogAppender::emit()
+    VString     mActualLoggerName;      ///< @see VLogAppender::emit()
+    bool        mEmitRawLine;           ///< @see VLogAppender::emit()
+    VString     mRawLine;               ///< @see VLogAppender::emit()
+    VInstant    mWhen;                  ///< When the record was logged; used for $localtime and $utctime.
+    VString     mThreadName;            ///< The name of the thread that logged it; used for $thread.
+    Vs64        mSequenceNumber;        ///< Orders records logged on different threads.
+};
+
+typedef std::vector<const VLogRecord*> VLogRecordList; ///< A batch of records to emit in order. The records are not owned by the list.
+
 /**
 VLogAppender is an abstract base class that defines the API for writing output to a destination.
 */
@@ -303,6 +357,27 @@ class VLogAppender {
         @param  message     the message to be emitted in raw form
         */
         void emitRaw(const VString& message);
+        /**
+        Emits a message that has not been formatted yet, as emit() does with emitMessage true and
+        emitRawLine false. This implementation formats it (once, however many appenders the message
+        is given to) and calls emit(); an appender that can put the formatting off, such as
+        VAsyncLogAppender, overrides it.
+        @param  level       the level at which the message is being logged
+        @param  file        if not null, the __FILE__ value indicating the source file that emitted the message
+        @param  line        if not 0, the __LINE__ value indicating the line number in the source file that emitted the message
+        @param  message     the format string and arguments of the message
+        @param  specifiedLoggerName if not empty, the logger name supplied by the original caller
+        @param  actualLoggerName if not empty, the name of the logger that is actually calling us
+        */
+        virtual void emitDeferred(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
+        /**
+        Emits a batch of records that were captured earlier, possibly on other threads, as if
+        each had been passed to emit() at the time and on the thread recorded in it. The appender
+        is locked once for the whole batch, and output is flushed once at the end rather than
+        after each line.
+        @param  records the records to emit, in order
+        */
+        virtual void emitRecords(const VLogRecordList& records);
 
         /**
         For diagnostic purposes, adds the properties/state of this appender to the supplied Bento node.
@@ -326,7 +401,8 @@ class VLogAppender {
         */
         virtual void _emitMessage(int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
         /**
-        Formats a message prior to output. If the standard formatting supplied here is not what is
+        Formats a message prior to output. The standard formatting renders the format spec tokens
+        parsed at construction in one pass. If the standard formatting supplied here is not what is
         desired, an appender can override this method. If this appender has mFormatOutput turned off, then this
         function is simply not called by _emitMessage() in the first place.
         (todo: This looks like a further opportunity to use a factory pattern to install a custom formatter
@@ -337,9 +413,10 @@ class VLogAppender {
         @param  message     the message to format
         @param  specifiedLoggerName if not empty, the logger name supplied by the original caller
         @param  actualLoggerName if not empty, the name of the logger that is actually calling us
-        @return the formatted message string
+        @param  formattedMessage    the string to format into; its previous contents are replaced, but its buffer
+                                    is reused, so _emitMessage() passes the same string every time
         */
-        virtual VString _formatMessage(int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
+        virtual void _formatMessage(VString& formattedMessage, int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
         /**
         This is the method that most concrete appenders must implement in order to write a message
         (whether it is in raw form or has already been formatted) to the output medium.
@@ -348,14 +425,42 @@ class VLogAppender {
         @param  line    the actual line to be emitted as is (it has already been formatted if that was needed)
         */
         virtual void _emitRawLine(const VString& /*line*/) {}
+        /**
+        Pushes any buffered output to the output medium. Appenders that write through a buffer
+        should flush in _emitRawLine() when mReplayingRecord is NULL, and otherwise leave it to
+        this method, which emitRecords() calls once at the end of a batch.
+        */
+        virtual void _flush() {}
 
         // These helper functions are meant to be used by subclasses constructing from settings.
         // Such constructors usually need to get settings, and fall back first to configured defaults, then to a specific default value.
         static bool _getBooleanInitSetting(const VString& attributePath, const VSettingsNode& settings, const VSettingsNode& defaults, bool defaultValue);
         static int _getIntInitSetting(const VString& attributePath, const VSettingsNode& settings, const VSettingsNode& defaults, int defaultValue);
+        static Vs64 _getS64InitSetting(const VString& attributePath, const VSettingsNode& settings, const VSettingsNode& defaults, Vs64 defaultValue);
         static VString _getStringInitSetting(const VString& attributePath, const VSettingsNode& settings, const VSettingsNode& defaults, const VString& defaultValue);
 
-        VMutex              mMutex;          ///< A mutex to protect against multiple threads' messages from being intertwined;
+        /**
+        One piece of a parsed format spec: either literal text, or a variable to fill in.
+        */
+        struct FormatToken {
+            enum Kind { kLiteral, kLocalTime, kUTCTime, kLevel, kThread, kLocation, kSpecifiedLoggerName, kActualLoggerName, kMessage };
+
+            FormatToken(Kind kind, const VString& literal) : mKind(kind), mLiteral(literal) {}
+
+            Kind    mKind;      ///< What the token stands for.
+            VString mLiteral;   ///< For kLiteral, the text.
+        };
+        typedef std::vector<FormatToken> FormatTokenList;
+
+        /**
+        Splits a format spec into literal text and the variables described for the "format-spec"
+        setting. A '$' that does not start a variable name is literal text.
+        @param  formatSpec  the format spec
+        @param  tokens      the list to fill in
+        */
+        static void _parseFormatSpec(const VString& formatSpec, FormatTokenList& tokens);
+
+        mutable VMutex      mMutex;          ///< A mutex to protect against multiple threads' messages from being intertwined;
                                                 // subclasses may access this carefully; note that it is locked prior to any
                                                 // call to emitMessage() or emitRawLine(), so implementors of those functions must
                                                 // not re-lock because to do so would cause a deadlock.
@@ -374,6 +479,10 @@ class VLogAppender {
         bool    mFormatUsesLocation;
         bool    mFormatUsesSpecifiedLoggerName;
         bool    mFormatUsesActualLoggerName;
+        FormatTokenList mFormatTokens;      ///< mFormatSpec, parsed at construction so that each message is formatted in a single pass.
+        VString         mFormattedMessage;  ///< The string _emitMessage() formats into, kept so that its buffer is allocated once rather than per message. Guarded by mMutex.
+
+        const VLogRecord* mReplayingRecord; ///< While emitRecords() is emitting a record, that record; otherwise NULL. Holds the time stamp and thread name to format.
 
     private:
 
@@ -433,6 +542,11 @@ class VLoggerRepetitionFilter {
         @return true if the caller should proceed to emit this message, false if not
         */
         bool checkMessage(VNamedLogger& logger, int level, const char* file, int line, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
+        /**
+        Checks a message that has not been formatted yet, as above. Repeats are recognized by
+        comparing format strings and argument values, so nothing is formatted here.
+        */
+        bool checkMessage(VNamedLogger& logger, int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
 
         /**
         Checks to see if a long time has elapsed since the pending repeat has been sitting
@@ -454,6 +568,15 @@ class VLoggerRepetitionFilter {
         @param  logger      the logger to which the backlog of messages will be emitted
         */
         void _emitSuppressedMessages(VNamedLogger& logger);
+        /**
+        Returns true if there is a saved message and it has the specified level, file, and line.
+        */
+        bool _isSavedLocation(int level, const char* file, int line) const;
+        /**
+        Emits any pending saved message, and saves the location and logger names of a new one.
+        The caller saves the message itself.
+        */
+        void _saveNewMessage(VNamedLogger& logger, int level, const char* file, int line, const VString& specifiedLoggerName, const VString& actualLoggerName);
 
         bool        mEnabled; ///< True if suppression filtering is allowed. Certain logger subclasses may want to turn off filtering entirely.
 
@@ -466,7 +589,9 @@ class VLoggerRepetitionFilter {
         int         mLevel;                     ///< The log level of the suppressed messages.
         const char* mFile;                      ///< The __FILE__ value of the suppressed messages.
         int         mLine;                      ///< The __LINE__ value of the suppressed messages.
-        VString     mMessage;                   ///< The text of the suppressed messages.
+        VString     mMessage;                   ///< The text of the suppressed messages, if !mMessageIsDeferred.
+        bool        mMessageIsDeferred;         ///< True if the suppressed messages were logged unformatted, and are held in mDeferredMessage.
+        VDeferredLogMessage mDeferredMessage;   ///< The suppressed messages, if mMessageIsDeferred.
         VString     mSpecifiedLoggerName;       ///< The specified logger name of the first suppressed message.
         VString     mActualLoggerName;          ///< The actual logger name of the first suppressed message.
 };
@@ -556,6 +681,16 @@ class VNamedLogger : public VEnableSharedFromThis<VNamedLogger> {
         */
         void log(int level, const VString& message);
         /**
+        Logs a message that has not been formatted yet (subject to filtering). It is formatted
+        only if an appender writes it, and at most once. @see VDeferredLogMessage
+        @param  level   the level of the message
+        @param  file    the source file name where the message was logged (from __FILE__ symbol)
+        @param  line    the line in the source file where the message was logged (from __LINE__ symbol)
+        @param  message the format string and arguments of the message
+        @param  specifiedLoggerName if not empty, the logger name supplied by caller
+        */
+        void log(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName = VString::EMPTY());
+        /**
         Logs a hex dump of the specified data (subject to filtering).
         @param  level               the level of the message
         @param  message             the message to be logged as the line of output preceding the hex data
@@ -619,6 +754,16 @@ class VNamedLogger : public VEnableSharedFromThis<VNamedLogger> {
         @param  rawLine     the raw line to be emitted if emitRawLine is true (the appenders should not format the raw line)
         */
         virtual void _emitToAppenders(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, bool emitRawLine, const VString& rawLine);
+        /**
+        Emits a message that has not been formatted yet to the same appenders as _emitToAppenders(),
+        via VLogAppender::emitDeferred().
+        @param  level       the level of the message
+        @param  file        the source file name where the message was logged (from __FILE__ symbol)
+        @param  line        the line in the source file where the message was logged (from __LINE__ symbol)
+        @param  message     the format string and arguments of the message
+        @param  specifiedLoggerName if not empty, the logger name supplied by caller
+        */
+        virtual void _emitDeferredToAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName);
 
     private:
 
@@ -958,6 +1103,8 @@ class VLogger {
 
         // Used specifically by VNamedLogger::_emitToAppenders to emit to all "global appenders" with correct locking. Should not be called elsewhere.
         static void emitToGlobalAppenders(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, const VString& actualLoggerName, bool emitRawLine, const VString& rawLine);
+        // Likewise for VNamedLogger::_emitDeferredToAppenders.
+        static void emitDeferredToGlobalAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName, const VString& actualLoggerName);
         
         // Utility function useful in forming a logger name; returns a copy of the input string with dots (our path separators) converted to dashes.
         static VString getCleansedLoggerName(const VString& s);
@@ -983,15 +1130,20 @@ class VLogger {
         static VNamedLoggerPtr _findNamedLoggerFromExactName(const VString& name);      ///< Return the logger with the specified name, or null if it doesn't exist. (@ Nullable)
         static VNamedLoggerPtr _findNamedLoggerFromPathName(const VString& pathName);   ///< Return a logger using a dot-separated path name, falling back to an exact name find. (@ Nullable)
 
-        // _mutexInstance() must be used internally whenever referencing these variables:
+        static void _invalidateCallSites(); ///< Makes every VNamedLoggerCallSite resolve its logger again. Called after any change that could alter what a name resolves to, or a logger's level.
+
+        // _lockInstance() must be used internally whenever referencing these variables:
         volatile static int     gMaxActiveLevel;    ///< The max level of any registered logger. Used to optimize the VLOGGER macros so they can return early if a log statement won't pass level filters.
         static VNamedLoggerPtr  gDefaultLogger;     ///< The default logger that is logged to by the simple VLOGGER macros and by the VLOGGER_NAMED macros if the named logger is not found. Created on first reference if needed.
         static VLogAppenderPtr  gDefaultAppender;   ///< The default appender that is emitted to by a logger if the logger has no appender specified. A VCoutAppender is created on first reference if needed.
         static VFSNode          gBaseLogDirectory;  ///< The directory within which any file-oriented loggers should write all their data.
 
+        static std::atomic<Vu32> gConfigurationGeneration; ///< Incremented by _invalidateCallSites(); read without locking by VNamedLoggerCallSite.
+
         friend class VLoggerUnit;  // unit tests directly examine our state
         friend bool VNamedLogger::isDefaultLogger() const;
         friend bool VLogAppender::isDefaultAppender() const;
+        friend class VNamedLoggerCallSite;
 
         // Internal development debugging methods. Only enabled as needed.
 //#define VLOGGER_INTERNAL_DEBUGGING
@@ -1004,6 +1156,134 @@ class VLogger {
 #endif /* VLOGGER_INTERNAL_DEBUGGING */
 };
 
+/**
+VNamedLoggerCallSite remembers which logger a VLOGGER_NAMED_* statement resolved its name to,
+so that later executions of the statement skip VLogger::findNamedLoggerForLevel(), which locks
+the registry and walks up the dotted logger name one lookup at a time.
+
+Each macro use declares its own static instance. The remembered result is stamped with the
+logger configuration generation, which VLogger increments whenever a logger is registered or
+removed, the default logger changes, or a logger's level changes. As long as the generation
+is unchanged and the name is the same one, findForLevel() costs an atomic pointer load, a
+generation compare, a name compare, and taking a reference to the logger; there is no lock.
+A site that is handed a different name while its result is current (a logger name held in a
+member, for example) drops its result and from then on skips the cache entirely, doing the
+plain VLogger::findNamedLoggerForLevel() lookup each time.
+
+A remembered result is never changed once it is published. One that is replaced is deleted
+once no thread can still be reading it, without waiting for that: a thread looking at a result
+counts itself as a reader in the current one of two phases, and a replaced result is queued
+under the current phase. The phase is switched, and the results queued under the earlier phase
+deleted, at a later replacement or configuration change that finds no reader still counted in
+the earlier phase. The readers are counted in several cells, so that threads logging at the same
+time do not all write the same cache line. Results hold the logger weakly, so they do not keep
+removed loggers alive.
+*/
+class VNamedLoggerCallSite {
+    public:
+
+        VNamedLoggerCallSite() : mResolution(NULL), mNameVaries(false) {}
+
+        /**
+        Returns the same result as VLogger::findNamedLoggerForLevel(), remembering it for next time.
+        @param  name    the name of the logger to find
+        @param  level   the level to check as active for the found logger
+        @return a logger (@ Nullable)
+        */
+        VNamedLoggerPtr findForLevel(const char* name, int level);
+        VNamedLoggerPtr findForLevel(const VString& name, int level);
+
+    private:
+
+        VNamedLoggerCallSite(const VNamedLoggerCallSite&); // not copyable
+        VNamedLoggerCallSite& operator=(const VNamedLoggerCallSite&); // not assignable
+
+        friend class VLogger; // it reclaims retired results when the configuration changes
+        friend class VLoggerUnit; // unit tests directly examine our state
+
+        /**
+        What a name resolved to. Immutable once published.
+        */
+        struct Resolution {
+            Resolution(Vu32 generation, const VString& name, VNamedLoggerPtr logger) : mGeneration(generation), mName(name), mLogger(logger), mLevel(logger->getLevel()) {}
+
+            Vu32                    mGeneration;    ///< The configuration generation it was resolved in.
+            VString                 mName;          ///< The name that was resolved.
+            VWeakPtr<VNamedLogger>  mLogger;        ///< The named logger, or the default logger if there was none by that name.
+            int                     mLevel;         ///< The logger's level when it was resolved; a level change starts a new generation.
+        };
+
+        /**
+        Counts the current thread as reading a published Resolution for the guard's lifetime,
+        so that a retired one the thread may still be looking at is not deleted.
+        */
+        class ReadGuard {
+            public:
+                ReadGuard();
+                ~ReadGuard();
+
+            private:
+                ReadGuard(const ReadGuard&); // not copyable
+                ReadGuard& operator=(const ReadGuard&); // not assignable
+
+                std::atomic<int>* mReaderCount; ///< The count this reader added itself to.
+        };
+
+        bool _findPublished(const char* name, int level, VNamedLoggerPtr& logger) const; ///< Returns true, with the result in logger, if the published result is current and for this name.
+        VNamedLoggerPtr _resolve(const VString& name, int level); ///< Finds the logger the slow way, and publishes the result if nothing current is published.
+        static void _retire(const Resolution* resolution);      ///< Queues a replaced result to be deleted once no reader can still be looking at it. Does not wait.
+        static void _reclaimRetired();                          ///< Deletes the retired results that no reader can still be looking at, if any.
+        static void _switchReadPhaseIfQuiescent();              ///< Switches phase and deletes the earlier phase's results, if it has no readers. The caller holds _getRetireMutex().
+        static VMutex* _getRetireMutex();                       ///< Returns the mutex that guards the retired results and phase switches.
+        static std::vector<const Resolution*>& _getRetired(int phase); ///< Returns the results retired during the phase, not yet deleted.
+
+        std::atomic<const Resolution*> mResolution; ///< The published result, or NULL before the first call or once the name varies.
+        std::atomic<bool>               mNameVaries; ///< True once the site has been handed more than one name; it then skips the cache.
+};
+
+inline VNamedLoggerPtr VNamedLoggerCallSite::findForLevel(const char* name, int level) {
+    if (mNameVaries.load(std::memory_order_relaxed)) {
+        return VLogger::findNamedLoggerForLevel(name, level);
+    }
+
+    VNamedLoggerPtr logger;
+    if (this->_findPublished(name, level, logger)) {
+        return logger;
+    }
+
+    return this->_resolve(VString(name), level);
+}
+
+inline VNamedLoggerPtr VNamedLoggerCallSite::findForLevel(const VString& name, int level) {
+    if (mNameVaries.load(std::memory_order_relaxed)) {
+        return VLogger::findNamedLoggerForLevel(name, level);
+    }
+
+    VNamedLoggerPtr logger;
+    if (this->_findPublished(name.chars(), level, logger)) {
+        return logger;
+    }
+
+    return this->_resolve(name, level);
+}
+
+inline bool VNamedLoggerCallSite::_findPublished(const char* name, int level, VNamedLoggerPtr& logger) const {
+    ReadGuard guard;
+    const Resolution* resolution = mResolution.load();
+    if ((resolution == NULL) ||
+        (resolution->mGeneration != VLogger::gConfigurationGeneration.load(std::memory_order_acquire)) ||
+        (::strcmp(resolution->mName.chars(), name) != 0)) {
+        return false;
+    }
+
+    if (level > resolution->mLevel) {
+        return true; // the logger is there but filters this level
+    }
+
+    logger = resolution->mLogger.lock();
+    return (logger != nullptr);
+}
+
 /**
 An appender that emits to the console using the std::cout stream.
 It defines no additional settings properties.
@@ -1016,6 +1296,7 @@ class VCoutLogAppender : public VLogAppender {
         virtual void addInfo(VBentoNode& infoNode) const;
     protected:
         virtual void _emitRawLine(const VString& line);
+        virtual void _flush();
 };
 
 /**
@@ -1032,6 +1313,7 @@ class VFileLogAppender : public VLogAppender {
         virtual void addInfo(VBentoNode& infoNode) const;
     protected:
         virtual void _emitRawLine(const VString& line);
+        virtual void _flush();
     private:
         void _openFile(); // constructor helper
         VBufferedFileStream mFileStream;    ///< The underlying file stream we open and write to.
@@ -1039,24 +1321,97 @@ class VFileLogAppender : public VLogAppender {
 };
 
 /**
-Not yet implemented. An appender that emits to rolling log files.
-It will define several properties to control the limits on log file size
-and the lifecycle for cleaning up "old" files. I plan to define a class
-that has a global housekeeping object which all rolling file appenders register with,
-to indicate their file patterns, directories, lifetimes, and currently in use file.
-The housekeeper task will periodically remove sufficiently old files as long as they
-are not currently in use. Another approach might be to only fire a cleaning job upon
-rollover, since although a file can become old due to the passing of time, if no rollover
-occurs then there is no growth in the number of files on disk.
+An appender that emits to a series of log files, moving on to a new file when the current
+one reaches a limit, and removing the oldest files beyond a retention count. The files are
+named "<prefix>-<n>.log", where n counts up (zero-padded to 6 digits) and carries on from
+the highest number already in the directory, so the newest file is the highest-numbered
+one. Nothing is ever renamed or truncated behind a writer's back, so no lines are lost at
+rollover.
+
+Lines are collected in a buffer and written with a single write() per line emitted
+directly, or per batch when emitted through emitRecords(). The work around a rollover is
+kept off the logging thread: the next file is opened (and optionally preallocated) ahead of
+time, and the previous file is closed and old files are removed afterwards, all on a
+housekeeping thread shared by all rolling file appenders. The logging thread that crosses
+a limit only swaps one open file for the other. It never waits for the housekeeping
+thread: if the next file is not open yet, lines keep going to the current file and the
+rollover happens with the first line after it is. The prepared next file exists on disk,
+empty, until it is used; it is removed if the appender is destroyed first. After
+VShutdownRegistry has shut the housekeeping thread down, its work is done on the logging
+thread.
+
+It defines the following additional properties:
+- "dir" (string)
+  Defaults to the base log directory. The directory to write the files in.
+- "prefix" (string)
+  Defaults to the appender name. The start of each file name.
+- "max-lines" (int)
+  Defaults to 0, meaning no limit. Move to a new file after this many lines.
+- "max-bytes" (s64)
+  Defaults to 0, meaning no limit. Move to a new file once this many bytes are written.
+- "roll-interval-seconds" (int)
+  Defaults to 0, meaning no limit. Move to a new file when the first line is emitted
+  this long after the current file was started.
+- "max-files" (int)
+  Defaults to 0, meaning keep all files. The number of files to keep, including the
+  current one.
+- "preallocate" (boolean)
+  Defaults to false. Reserve "max-bytes" of disk space for each file when it is opened,
+  so that writes do not have to allocate blocks as they extend the file. Only Linux
+  supports this; elsewhere it is ignored.
 */
 class VRollingFileLogAppender : public VLogAppender {
     public:
-        VRollingFileLogAppender(const VString& name, bool formatOutput, const VString& formatSpec, const VString& timeFormat, const VString& dirPath, const VString& fileNamePrefix, int maxNumLines);
+        VRollingFileLogAppender(const VString& name, bool formatOutput, const VString& formatSpec, const VString& timeFormat, const VString& dirPath, const VString& fileNamePrefix, int maxNumLines, Vs64 maxNumBytes = 0, const VDuration& rollInterval = VDuration::ZERO(), int maxNumFiles = 0, bool preallocate = false);
         VRollingFileLogAppender(const VSettingsNode& settings, const VSettingsNode& defaults);
-        virtual ~VRollingFileLogAppender() {}
+        virtual ~VRollingFileLogAppender();
         virtual void addInfo(VBentoNode& infoNode) const;
+
+        /**
+        Closes the current file and continues in a new one, regardless of the limits.
+        Waits (without blocking logging) for the next file to be opened. Called for
+        VLogger::commandRollAppender().
+        */
+        void rollOver();
+
+        /**
+        Returns the path of the file currently being written.
+        */
+        VString getCurrentFilePath() const;
+
     protected:
         virtual void _emitRawLine(const VString& line);
+        virtual void _flush();
+
+    private:
+
+        VRollingFileLogAppender(const VRollingFileLogAppender&); // not copyable
+        VRollingFileLogAppender& operator=(const VRollingFileLogAppender&); // not assignable
+
+        void _openFirstFile();                      ///< Constructor helper; starts the file after the highest-numbered one found.
+        VFSNode _getFileNode(int fileIndex) const;  ///< Returns the node for the file with the specified number.
+        void _prepareNextFile();                    ///< Has the housekeeping thread open the file after the current one.
+        void _rollOver();                           ///< Switches to the next file, or puts it off if that is not open yet. ASSUMES CALLER HOLDS mMutex.
+        void _writeBuffer();                        ///< Writes out the buffered lines. ASSUMES CALLER HOLDS mMutex.
+
+        VFSNode                 mDirectory;         ///< The directory the files are written in.
+        VString                 mFileNamePrefix;    ///< The start of each file name.
+        int                     mMaxNumLines;       ///< The line count at which to move to a new file; 0 for no limit.
+        Vs64                    mMaxNumBytes;       ///< The byte count at which to move to a new file; 0 for no limit.
+        VDuration               mRollInterval;      ///< How long to use a file before moving to a new one; zero for no limit.
+        int                     mMaxNumFiles;       ///< The number of files to keep; 0 to keep all.
+        bool                    mPreallocate;       ///< True if each file is preallocated to mMaxNumBytes.
+
+        int                     mFileIndex;         ///< The number of the current file.
+        VDirectIOFileStream*    mFile;              ///< The current file (we own it).
+        int                     mNumLines;          ///< The number of lines emitted to the current file.
+        Vs64                    mNumBytes;          ///< The number of bytes emitted to the current file, written or buffered.
+        VInstant                mRollTime;          ///< When to move to a new file, if mRollInterval is set.
+        VString                 mBuffer;            ///< Lines emitted but not yet written.
+        VDirectIOFileStream*    mNextFile;          ///< The next file (we own it); open once mNextFileFuture is done.
+        VSharedPtr<VThreadPoolFuture> mNextFileFuture; ///< The housekeeping task opening mNextFile; null if it was opened on this thread.
+        bool                    mRollOverPending;   ///< True if a rollover was put off because mNextFile was not open yet.
+        Vs64                    mNumRollOvers;      ///< Counter of moves to a new file.
 };
 
 /**
@@ -1136,6 +1491,7 @@ class VStringLogger : public VNamedLogger {
     protected:
 
         virtual void _emitToAppenders(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, bool emitRawLine, const VString& rawLine);
+        virtual void _emitDeferredToAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName);
 
     private:
 
@@ -1162,6 +1518,7 @@ class VStringVectorLogger : public VNamedLogger {
     protected:
 
         virtual void _emitToAppenders(int level, const char* file, int line, bool emitMessage, const VString& message, const VString& specifiedLoggerName, bool emitRawLine, const VString& rawLine);
+        virtual void _emitDeferredToAppenders(int level, const char* file, int line, const VDeferredLogMessage& message, const VString& specifiedLoggerName);
 
     private:
 
@@ -176,7 +176,7 @@ static size_t gTrackAllocationssUnder = V_MAX_SIZE;
 Puts an item to the map. The allocation record must not be null.
 */
 static void _putToMap(const void* p, const AllocationRecord* r) {
-    VMutexLocker locker(&gAllocationMapMutex, VString::EMPTY());
+    VMutexLocker locker(&gAllocationMapMutex, NULL);
     r->mAllocationNumber = gNextAllocationNumber++; // We do this manually so that AllocationRecord ctor doesn't also need to lock
     ++gCurrentNumAllocations;
     gAllocationMap[p] = r;
@@ -187,7 +187,7 @@ Removes an item from the map. It's presumed that it's in the map, but
 it is harmless if not.
 */
 static void _removeFromMap(const void* p) {
-    VMutexLocker locker(&gAllocationMapMutex, VString::EMPTY());
+    VMutexLocker locker(&gAllocationMapMutex, NULL);
     --gCurrentNumAllocations;
     gAllocationMap[p] = NULL;
 }
@@ -250,7 +250,7 @@ static bool _isCodeLocationCrawlEnabled(const char* file, int line) {
 Returns an item from the map. The result might be null.
 */
 static const AllocationRecord* _getFromMap(const void* p) {
-    VMutexLocker locker(&gAllocationMapMutex, VString::EMPTY());
+    VMutexLocker locker(&gAllocationMapMutex, NULL);
     return gAllocationMap[p];
 }
 
@@ -284,7 +284,7 @@ void VMemoryTracker::disable() {
 
 // static
 void VMemoryTracker::reset() {
-    VMutexLocker locker(&gAllocationMapMutex, VString::EMPTY());
+    VMutexLocker locker(&gAllocationMapMutex, NULL);
     bool wasTracking = gTrackMemory;
     gTrackMemory = false;
     gInsideLockedMutex = true; // prevents our deletes from triggering delete processing while we hold the mutex
@@ -500,7 +500,7 @@ static void _reportText(const VString& s, bool toLogger, bool toConsole, VTextIO
 void VMemoryTracker::reportMemoryTracking(const VString& label, bool toLogger, bool toConsole, VTextIOStream* toStream, Vs64 bufferLengthLimit, bool showDetails, bool /*performAnalysis*/) {
     VMemoryTracker::omitPointer(label.getDataBufferConst()); // don't include the label in the report
 
-    VMutexLocker locker(&gAllocationMapMutex, VString::EMPTY());
+    VMutexLocker locker(&gAllocationMapMutex, NULL);
     gInsideLockedMutex = true; // prevents our deletes from triggering delete processing while we hold the mutex
     Vs64 numObjects = 0;
     size_t numBytes = 0;
@@ -9,14 +9,30 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vloggerunit.h"
 #include "vlogger.h"
+#include "vasynclogappender.h"
+#include "vmutexlocker.h"
 #include "vmessage.h"
 #include "vbento.h"
 #include "vsettings.h"
+#include "vfsnode.h"
+#include "vthreadpool.h"
 
 typedef std::vector<VNamedLogger*> VLoggerUnitLoggerList;
 
 // VLoggerUnit ------------------------------------------------------------------------
 
+static void _findRepeatedly(VNamedLoggerCallSite* site, int numTimes, std::atomic<int>* numFound) {
+    for (int i = 0; i < numTimes; ++i) {
+        if (site->findForLevel("callsite.child", VLoggerLevel::INFO) != nullptr) {
+            ++(*numFound);
+        }
+    }
+}
+
+static void _emitToAppender(VLogAppender* appender, const VString& message) {
+    VLOGGER_APPENDER_EMIT(*appender, VLoggerLevel::INFO, message);
+}
+
 static void _printLoggerInfo(const VString& label) {
     std::cout << "***** " << label << " *****" << std::endl;
     std::cout << VLogger::commandGetInfoString() << std::endl;
@@ -34,9 +50,14 @@ void VLoggerUnit::run() {
     */
     this->_testMacros();
     this->_testStringLoggers();
+    this->_testFormatSpec();
     this->_testMaxActiveLogLevel();
     this->_testLoggerPathNames();
+    this->_testNamedLoggerCallSites();
     this->_testSmartPtrLifecycle();
+    this->_testAsyncAppender();
+    this->_testDeferredMessages();
+    this->_testRollingFileAppender();
 //    this->_testOptimizationPerformance();
 }
 
@@ -153,6 +174,26 @@ void VLoggerUnit::_testStringLoggers() {
     VInstant::unfreezeTime();
 }
 
+void VLoggerUnit::_testFormatSpec() {
+    VStringVector lines;
+
+    // Variables are filled in wherever they appear; a '$' that starts no variable is left alone, and so is
+    // a variable name inside a substituted value.
+    VStringVectorLogAppender appender("format-spec-test", VLogAppender::DO_FORMAT_OUTPUT, "[$level] $location$message|$actuallogger|$cost $", VString::EMPTY(), &lines);
+    appender.emit(VLoggerLevel::ERROR, "file.cpp", 12, true, "hello $thread", VString::EMPTY(), "format.logger", false, VString::EMPTY());
+    appender.emit(VLoggerLevel::INFO, NULL, 0, true, "again", VString::EMPTY(), VString::EMPTY(), false, VString::EMPTY());
+    VUNIT_ASSERT_EQUAL_LABELED(static_cast<int>(lines.size()), 2, "format spec line count");
+    if (lines.size() == 2) {
+        VUNIT_ASSERT_EQUAL_LABELED(lines[0], "[ERROR] @ file.cpp:12: hello $thread|format.logger|$cost $", "format spec with location");
+        VUNIT_ASSERT_EQUAL_LABELED(lines[1], "[INFO ] again||$cost $", "format spec without location");
+    }
+
+    lines.clear();
+    VStringVectorLogAppender plainAppender("format-spec-plain-test", VLogAppender::DO_FORMAT_OUTPUT, "no variables", VString::EMPTY(), &lines);
+    VLOGGER_APPENDER_EMIT(plainAppender, VLoggerLevel::INFO, "ignored");
+    VUNIT_ASSERT_TRUE_LABELED((lines.size() == 1) && (lines[0] == "no variables"), "format spec with no variables");
+}
+
 void VLoggerUnit::_testMaxActiveLogLevel() {
     // We assume the existing max logger level is less than 90.
     // We need to special case the use of the "VUnit" logger which may be present for routing
@@ -414,6 +455,103 @@ void VLoggerUnit::_testLoggerPathNames() {
     // Do not reference them after the loop. Destructing the list is OK.
 }
 
+void VLoggerUnit::_testNamedLoggerCallSites() {
+    VStringLogger* parentLogger = new VStringLogger("callsite", VLoggerLevel::INFO, VLogAppender::DONT_FORMAT_OUTPUT);
+    VNamedLoggerPtr parent(parentLogger);
+    VLogger::registerLogger(parent);
+
+    // A call site resolves along the dotted path like findNamedLoggerForLevel(), and honors the level.
+    VNamedLoggerCallSite site;
+    VNamedLoggerPtr found = site.findForLevel("callsite.child", VLoggerLevel::INFO);
+    VUNIT_ASSERT_TRUE_LABELED((found != nullptr) && (found->getName() == "callsite"), "call site resolves parent");
+    found = site.findForLevel("callsite.child", VLoggerLevel::INFO);
+    VUNIT_ASSERT_TRUE_LABELED((found != nullptr) && (found->getName() == "callsite"), "call site resolves parent again");
+    VUNIT_ASSERT_TRUE_LABELED(site.findForLevel("callsite.child", VLoggerLevel::DEBUG) == nullptr, "call site filters level");
+
+    // Changing the level, adding a closer logger, and removing it are all seen.
+    parent->setLevel(VLoggerLevel::DEBUG);
+    VUNIT_ASSERT_TRUE_LABELED(site.findForLevel("callsite.child", VLoggerLevel::DEBUG) == parent, "call site sees level change");
+
+    VNamedLoggerPtr child(new VStringLogger("callsite.child", VLoggerLevel::INFO, VLogAppender::DONT_FORMAT_OUTPUT));
+    VLogger::registerLogger(child);
+    VUNIT_ASSERT_TRUE_LABELED(site.findForLevel("callsite.child", VLoggerLevel::INFO) == child, "call site sees new logger");
+
+    VLogger::deregisterLogger(child);
+    VUNIT_ASSERT_TRUE_LABELED(site.findForLevel("callsite.child", VLoggerLevel::INFO) == parent, "call site sees removed logger");
+
+    // A different name at the same site is still resolved correctly.
+    found = site.findForLevel("callsite-unrelated", VLoggerLevel::FATAL);
+    VUNIT_ASSERT_TRUE_LABELED((found != nullptr) && (found == VLogger::getDefaultLogger()), "call site resolves a second name");
+    VUNIT_ASSERT_TRUE_LABELED(site.findForLevel(VString("callsite.child"), VLoggerLevel::INFO) == parent, "call site resolves first name after second");
+
+    // A site handed more than one name drops its result and skips the cache from then on.
+    VUNIT_ASSERT_TRUE_LABELED(site.mNameVaries.load(), "call site with varying names skips cache");
+    VUNIT_ASSERT_TRUE_LABELED(site.mResolution.load() == NULL, "call site with varying names keeps no result");
+    for (int i = 0; i < 10; ++i) {
+        VUNIT_ASSERT_TRUE_LABELED(site.findForLevel(VSTRING_FORMAT("callsite.child.%d", i), VLoggerLevel::INFO) == parent, "call site resolves a varying name");
+    }
+    VUNIT_ASSERT_TRUE_LABELED(site.mResolution.load() == NULL, "call site result not republished for varying names");
+    parent->setLevel(VLoggerLevel::INFO);
+    VUNIT_ASSERT_TRUE_LABELED(site.findForLevel("callsite.child", VLoggerLevel::DEBUG) == nullptr, "call site with varying names sees level change");
+    parent->setLevel(VLoggerLevel::DEBUG);
+
+    // Replacing a result while a reader may still be looking at it does not wait for the reader;
+    // the replaced result is deleted at a later replacement once the reader is done.
+    VNamedLoggerCallSite replacedSite;
+    VUNIT_ASSERT_TRUE_LABELED(replacedSite.findForLevel("callsite.child", VLoggerLevel::DEBUG) == parent, "replaced call site resolves");
+    const void* firstResult = replacedSite.mResolution.load();
+    /* read guard scope */ {
+        VNamedLoggerCallSite::ReadGuard guard; // stands for a reader on another thread
+        parent->setLevel(VLoggerLevel::INFO);
+        VUNIT_ASSERT_TRUE_LABELED(replacedSite.findForLevel("callsite.child", VLoggerLevel::INFO) == parent, "call site replaced while read");
+        VUNIT_ASSERT_TRUE_LABELED(replacedSite.mResolution.load() != firstResult, "call site result replaced while read");
+        parent->setLevel(VLoggerLevel::DEBUG);
+        VUNIT_ASSERT_TRUE_LABELED(replacedSite.findForLevel("callsite.child", VLoggerLevel::DEBUG) == parent, "call site replaced again while read");
+    }
+
+    size_t numRetiredWhileRead = 0;
+    /* locker scope */ {
+        VMutexLocker locker(VNamedLoggerCallSite::_getRetireMutex(), "VLoggerUnit::_testNamedLoggerCallSites()");
+        numRetiredWhileRead = VNamedLoggerCallSite::_getRetired(0).size() + VNamedLoggerCallSite::_getRetired(1).size();
+    }
+    VUNIT_ASSERT_TRUE_LABELED(numRetiredWhileRead >= 2, "call site results retired while read are kept");
+
+    for (int i = 0; i < 2; ++i) {
+        parent->setLevel(((i % 2) == 0) ? VLoggerLevel::INFO : VLoggerLevel::DEBUG);
+        (void) replacedSite.findForLevel("callsite.child", VLoggerLevel::INFO);
+    }
+
+    size_t numRetiredAfterRead = 0;
+    /* locker scope */ {
+        VMutexLocker locker(VNamedLoggerCallSite::_getRetireMutex(), "VLoggerUnit::_testNamedLoggerCallSites()");
+        numRetiredAfterRead = VNamedLoggerCallSite::_getRetired(0).size() + VNamedLoggerCallSite::_getRetired(1).size();
+    }
+    VUNIT_ASSERT_TRUE_LABELED(numRetiredAfterRead < numRetiredWhileRead, "call site results retired while read are deleted once read");
+
+    // The macros each have their own call site.
+    for (int i = 0; i < 3; ++i) {
+        VLOGGER_NAMED_INFO("callsite.child", VSTRING_FORMAT("call site line %d", i));
+    }
+    VUNIT_ASSERT_TRUE_LABELED(parentLogger->getLines().contains("call site line 2"), "call site macro output");
+
+    // Results replaced while other threads are reading them are deleted safely.
+    VThreadPool pool("callsite-test", 2);
+    pool.start();
+    std::atomic<int> numFound(0);
+    VThreadPoolFuturePtr reader1 = pool.submit(std::bind(_findRepeatedly, &replacedSite, 100000, &numFound));
+    VThreadPoolFuturePtr reader2 = pool.submit(std::bind(_findRepeatedly, &replacedSite, 100000, &numFound));
+    for (int i = 0; (i < 1000) && ! (reader1->isDone() && reader2->isDone()); ++i) {
+        parent->setLevel(((i % 2) == 0) ? VLoggerLevel::INFO : VLoggerLevel::DEBUG);
+    }
+
+    reader1->wait();
+    reader2->wait();
+    pool.stop();
+    VUNIT_ASSERT_EQUAL_LABELED(numFound.load(), 200000, "call site resolved while being replaced");
+
+    VLogger::deregisterLogger(parent);
+}
+
 void VLoggerUnit::_testSmartPtrLifecycle() {
 
     // Regression test for bug in VNamedLogger::log() that incorrectly passed naked (this) to VNamedLoggerPtr() for VThread::logStackCrawl() parameter, causing premature destruction of logger on return.
@@ -423,11 +561,273 @@ void VLoggerUnit::_testSmartPtrLifecycle() {
 
 }
 
+void VLoggerUnit::_testAsyncAppender() {
+    VStringVector lines;
+    VStringVectorLogAppender* targetAppender = new VStringVectorLogAppender("async-test-target", VLogAppender::DONT_FORMAT_OUTPUT, VString::EMPTY(), VString::EMPTY(), &lines);
+    VLogAppenderPtr target(targetAppender);
+
+    // Everything queued comes out, in order, once drained.
+    /* scope for appender */ {
+        VAsyncLogAppender appender("async-test", target, VAsyncLogAppender::kBlock, VLoggerLevel::WARN, 2, 8, 4);
+        for (int i = 0; i < 100; ++i) {
+            VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::INFO, VSTRING_FORMAT("async %d", i));
+        }
+
+        appender.drain();
+        VUNIT_ASSERT_EQUAL_LABELED(static_cast<int>(lines.size()), 100, "async appender wrote all lines");
+        VUNIT_ASSERT_EQUAL_LABELED(appender.getNumWritten(), CONST_S64(100), "async appender written count");
+        VUNIT_ASSERT_EQUAL_LABELED(appender.getNumDropped(), CONST_S64(0), "async appender dropped none while blocking");
+
+        bool inOrder = (lines.size() == 100);
+        for (size_t i = 0; inOrder && (i < lines.size()); ++i) {
+            inOrder = (lines[i] == VSTRING_FORMAT("async %d", static_cast<int>(i)));
+        }
+        VUNIT_ASSERT_TRUE_LABELED(inOrder, "async appender preserved order");
+
+        // After stop(), output is written through on the calling thread.
+        appender.stop();
+        VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::INFO, "after stop");
+        VUNIT_ASSERT_TRUE_LABELED((lines.size() == 101) && (lines.back() == "after stop"), "async appender writes through after stop");
+    }
+
+    // With the target held up, a small ring overflows and the drop policy discards the excess.
+    lines.clear();
+    /* scope for appender */ {
+        VAsyncLogAppender appender("async-drop-test", target, VAsyncLogAppender::kDrop, VLoggerLevel::WARN, 1, 4, 4);
+
+        /* locker scope */ {
+            VMutexLocker locker(&targetAppender->getMutex(), "VLoggerUnit::_testAsyncAppender()");
+            for (int i = 0; i < 50; ++i) {
+                VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::DEBUG, VSTRING_FORMAT("drop %d", i));
+            }
+        }
+
+        appender.drain();
+        VUNIT_ASSERT_TRUE_LABELED(appender.getNumDropped() >= 42, "async appender dropped the overflow");
+        VUNIT_ASSERT_EQUAL_LABELED(appender.getNumDropped() + appender.getNumWritten(), CONST_S64(50), "async appender accounted for every record");
+    }
+
+    VUNIT_ASSERT_TRUE_LABELED(lines.back().contains("Dropped"), "async appender reported dropped records");
+
+    // A ring holding more than a batch does not let a later record from another ring
+    // (here, the pool worker's) overtake the records it has left over for the next batch.
+    lines.clear();
+    /* scope for appender */ {
+        VAsyncLogAppender appender("async-merge-test", target, VAsyncLogAppender::kBlock, VLoggerLevel::WARN, 2, 16, 4);
+        VThreadPool pool("async-merge-test", 1);
+        pool.start();
+
+        /* locker scope */ {
+            VMutexLocker locker(&targetAppender->getMutex(), "VLoggerUnit::_testAsyncAppender()");
+            for (int i = 0; i < 10; ++i) {
+                VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::INFO, VSTRING_FORMAT("merge %d", i));
+            }
+
+            pool.submit(std::bind(_emitToAppender, &appender, VString("merge 10")))->wait();
+        }
+
+        appender.drain();
+        pool.stop();
+
+        bool inOrder = (lines.size() == 11);
+        for (size_t i = 0; inOrder && (i < lines.size()); ++i) {
+            inOrder = (lines[i] == VSTRING_FORMAT("merge %d", static_cast<int>(i)));
+        }
+        VUNIT_ASSERT_TRUE_LABELED(inOrder, "async appender merged rings in order across batches");
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED(static_cast<int>(VAsyncLogAppender::parseOverflowPolicy("drop-verbose")), static_cast<int>(VAsyncLogAppender::kDropVerbose), "parse overflow policy");
+    try {
+        (void) VAsyncLogAppender::parseOverflowPolicy("sometimes");
+        VUNIT_ASSERT_FAILURE("parse invalid overflow policy did not throw");
+    } catch (const VRangeException& /*ex*/) {
+        VUNIT_ASSERT_SUCCESS("parse invalid overflow policy threw");
+    }
+}
+
 #define OLDEST_VLOGGER_NAMED_DEBUG(loggername, message) VLogger::getLogger(loggername)->log(VLoggerLevel::DEBUG, message)
 #define OLD_VLOGGER_NAMED_DEBUG(loggername, message) do { VNamedLoggerPtr vlcond = VLogger::findNamedLoggerForLevel(loggername, VLoggerLevel::DEBUG); if (vlcond != NULL) vlcond->log(VLoggerLevel::DEBUG, NULL, 0, message); } while (false)
 // for reference, as of this writing, the new one basically expands to:
 // #define VLOGGER_NAMED_DEBUG(loggername, message) do { if (!VLogger::isLogLevelActive(VLoggerLevel::DEBUG)) break; VLogger* vlcond = VLogger::getLoggerConditional(loggername, VLoggerLevel::DEBUG); if (vlcond != NULL) vlcond->log(VLoggerLevel::DEBUG, NULL, 0, message); } while (false)
 
+void VLoggerUnit::_testDeferredMessages() {
+    // A deferred message formats the same as VSTRING_FORMAT for the conversions in common use.
+    const Vs64 big = CONST_S64(-1234567890123);
+    const Vu64 bigUnsigned = CONST_U64(1234567890123);
+    const VString name("alpha");
+    const char* nullString = NULL;
+    int intValue = 42;
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%d|%5d|%-5d|%05d|%+d|%i", 7, -7, 7, 7, 7, -3).getText(), VSTRING_FORMAT("%d|%5d|%-5d|%05d|%+d|%i", 7, -7, 7, 7, 7, -3), "deferred signed");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%u|%x|%X|%o|%#x|%08X", 7u, -1, 255, 8, 255, 0xBEEF).getText(), VSTRING_FORMAT("%u|%x|%X|%o|%#x|%08X", 7u, -1, 255, 8, 255, 0xBEEF), "deferred unsigned");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage(VSTRING_FORMATTER_S64 "|" VSTRING_FORMATTER_U64, big, bigUnsigned).getText(), VSTRING_FORMAT(VSTRING_FORMATTER_S64 "|" VSTRING_FORMATTER_U64, big, bigUnsigned), "deferred 64-bit");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%hd|%hhu", 70000, 300).getText(), VSTRING_FORMAT("%hd|%hhu", 70000, 300), "deferred short");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%.3f|%10.2e|%g|%f", 3.14159, 12345.678, 0.5, 2).getText(), VSTRING_FORMAT("%.3f|%10.2e|%g|%f", 3.14159, 12345.678, 0.5, 2.0), "deferred double");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%s|%8s|%-6s|%.2s|%c", "lit", name, name, "abc", 'x').getText(), VSTRING_FORMAT("%s|%8s|%-6s|%.2s|%c", "lit", name.chars(), name.chars(), "abc", 'x'), "deferred string");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%*d|%-*d|%.*f", 4, 1, 3, 2, 1, 2.25).getText(), VSTRING_FORMAT("%*d|%-*d|%.*f", 4, 1, 3, 2, 1, 2.25), "deferred star");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%p", &intValue).getText(), VSTRING_FORMAT("%p", &intValue), "deferred pointer");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("%s@%p", name, name.chars()).getText(), VSTRING_FORMAT("%s@%p", name.chars(), name.chars()), "deferred string pointer");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("100%% of %s", nullString).getText(), VString("100% of (null)"), "deferred percent and null");
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage("a %d b").getText(), VString("a (missing) b"), "deferred missing argument");
+
+    // A spec too long to copy is shown as is, consuming its arguments, rather than overrunning the spec buffer.
+    VString longSpec("%");
+    for (int i = 0; i < 63; ++i) {
+        longSpec += '0';
+    }
+    longSpec += ".*d";
+    const VString longFormat = longSpec + " then %d";
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage(longFormat.chars(), 3, 5, 9).getText(), longSpec + " then 9", "deferred long spec with star precision");
+    const VString longWidthFormat = longSpec + "|%*d";
+    VUNIT_ASSERT_EQUAL_LABELED(VDeferredLogMessage(longWidthFormat.chars(), 3, 5, 4, 1).getText(), longSpec + "|" + VSTRING_FORMAT("%*d", 4, 1), "deferred long spec then star width");
+
+    // A message does not depend on the caller's buffers once captured, nor on its format string once copied.
+    char formatBuffer[32];
+    char argBuffer[32];
+    strcpy(formatBuffer, "copy %s %d");
+    strcpy(argBuffer, "arg");
+    VDeferredLogMessage original(formatBuffer, argBuffer, 1);
+    original.copyFormat();
+    VDeferredLogMessage copy(original);
+    strcpy(argBuffer, "XXX");
+    VUNIT_ASSERT_TRUE_LABELED(! original.isFormatted() && ! copy.isFormatted(), "deferred copy not formatted");
+    VUNIT_ASSERT_EQUAL_LABELED(original.getText(), VString("copy arg 1"), "deferred argument copied");
+    strcpy(formatBuffer, "changed");
+    VUNIT_ASSERT_EQUAL_LABELED(copy.getText(), VString("copy arg 1"), "deferred copy has its own format");
+    VUNIT_ASSERT_TRUE_LABELED(copy.isSameMessage(VDeferredLogMessage("copy %s %d", "arg", 1)), "deferred same message");
+    VUNIT_ASSERT_FALSE_LABELED(copy.isSameMessage(VDeferredLogMessage("copy %s %d", "arg", 2)), "deferred different argument");
+    VUNIT_ASSERT_FALSE_LABELED(copy.isSameMessage(VDeferredLogMessage("copy %s %d", "arh", 1)), "deferred different string argument");
+
+    // A VString argument is referred to, not copied, until the message is copied or copyFormat() is called.
+    const VString stringArg("referred");
+    VDeferredLogMessage referring("ref %s", stringArg);
+    VUNIT_ASSERT_TRUE_LABELED(referring.mStringData.isEmpty(), "deferred VString argument not copied at capture");
+    VUNIT_ASSERT_EQUAL_LABELED(referring.getText(), VString("ref referred"), "deferred VString argument formatted");
+    VDeferredLogMessage referringCopy(referring);
+    VUNIT_ASSERT_EQUAL_LABELED(referringCopy.mStringData, stringArg, "deferred VString argument copied with message");
+    VUNIT_ASSERT_TRUE_LABELED(referringCopy.isSameMessage(referring), "deferred copied VString argument same message");
+    VDeferredLogMessage referringCopied("ref %s", stringArg);
+    referringCopied.copyFormat();
+    VUNIT_ASSERT_EQUAL_LABELED(referringCopied.mStringData, stringArg, "deferred VString argument copied by copyFormat");
+
+    // Through a named logger, with the repetition filter comparing unformatted messages.
+    VStringVectorLogger* loggerPtr = new VStringVectorLogger("deferred", VLoggerLevel::INFO, NULL, VLogAppender::DONT_FORMAT_OUTPUT);
+    VNamedLoggerPtr logger(loggerPtr);
+    VLogger::registerLogger(logger);
+    for (int i = 0; i < 3; ++i) {
+        VLOGGER_NAMED_INFO_FORMAT("deferred", "repeated %s", name);
+    }
+    VLOGGER_NAMED_DEBUG_FORMAT("deferred", "filtered %d", 1);
+    VLOGGER_NAMED_WARN_FORMAT("deferred", "warning %d of %s", 2, name);
+    VStringVector expected;
+    expected.push_back("repeated alpha");
+    expected.push_back("[2x] repeated alpha");
+    expected.push_back("warning 2 of alpha");
+    VUNIT_ASSERT_TRUE_LABELED(loggerPtr->getLines() == expected, "deferred logger output");
+    VLogger::deregisterLogger(logger);
+
+    // An async appender queues the message unformatted and formats it on its own thread.
+    VStringVector lines;
+    VLogAppenderPtr target(new VStringVectorLogAppender("deferred-async-target", VLogAppender::DONT_FORMAT_OUTPUT, VString::EMPTY(), VString::EMPTY(), &lines));
+    /* scope for appender */ {
+        VAsyncLogAppender appender("deferred-async", target, VAsyncLogAppender::kBlock, VLoggerLevel::WARN, 2, 8, 4);
+        bool anyFormatted = false;
+        for (int i = 0; i < 50; ++i) {
+            VString argument(VSTRING_FORMAT("arg%d", i)); // gone before the record is written
+            VDeferredLogMessage message("async deferred %d %s", i, argument);
+            appender.emitDeferred(VLoggerLevel::INFO, NULL, 0, message, VString::EMPTY(), VString::EMPTY());
+            anyFormatted = anyFormatted || message.isFormatted();
+        }
+
+        appender.drain();
+        VUNIT_ASSERT_FALSE_LABELED(anyFormatted, "async deferred not formatted by caller");
+
+        bool allCorrect = (lines.size() == 50);
+        for (size_t i = 0; allCorrect && (i < lines.size()); ++i) {
+            allCorrect = (lines[i] == VSTRING_FORMAT("async deferred %d arg%d", static_cast<int>(i), static_cast<int>(i)));
+        }
+        VUNIT_ASSERT_TRUE_LABELED(allCorrect, "async deferred output");
+    }
+}
+
+// Old files are removed on the housekeeping thread, so wait a little for the count to settle.
+static int _waitForNumRollingFiles(const VFSNode& dir, int expectedNumFiles) {
+    VStringVector fileNames;
+    for (int i = 0; i < 100; ++i) {
+        fileNames.clear();
+        dir.list(fileNames);
+        if (static_cast<int>(fileNames.size()) == expectedNumFiles) {
+            break;
+        }
+
+        VThread::sleep(VDuration::MILLISECOND() * 50);
+    }
+
+    return static_cast<int>(fileNames.size());
+}
+
+void VLoggerUnit::_testRollingFileAppender() {
+    VFSNode tempDir = VFSNode::getKnownDirectoryNode(VFSNode::CACHED_DATA_DIRECTORY, "vault", "unittest");
+    VFSNode testDir(tempDir, "vloggerunit_rolling_temp");
+    if (testDir.exists()) {
+        (void) testDir.rmDirContents();
+    }
+
+    // 35 lines at 10 per file fill files 1 to 3 and start file 4; only the newest 3 are kept.
+    /* scope for appender */ {
+        VRollingFileLogAppender appender("rolling-test", VLogAppender::DONT_FORMAT_OUTPUT, VString::EMPTY(), VString::EMPTY(), testDir.getPath(), "test", 10, 0, VDuration::ZERO(), 3);
+        for (int i = 0; i < 35; ++i) {
+            // A rollover is put off until the housekeeping thread has opened the next file, so give
+            // it a moment before each file fills up, to keep the contents of the files predictable.
+            if ((i % 10) == 9) {
+                VThread::sleep(VDuration::MILLISECOND() * 20);
+            }
+
+            VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::INFO, VSTRING_FORMAT("rolling %d", i));
+        }
+
+        VUNIT_ASSERT_TRUE_LABELED(appender.getCurrentFilePath().endsWith("test-000004.log"), "rolling appender moved to file 4");
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED(_waitForNumRollingFiles(testDir, 3), 3, "rolling appender kept 3 files");
+    VUNIT_ASSERT_FALSE_LABELED(VFSNode(testDir, "test-000001.log").exists(), "rolling appender removed oldest file");
+
+    VStringVector lines;
+    VFSNode(testDir, "test-000002.log").readAll(lines);
+    VUNIT_ASSERT_TRUE_LABELED((lines.size() == 10) && (lines.front() == "rolling 10") && (lines.back() == "rolling 19"), "rolling appender file 2 contents");
+    lines.clear();
+    VFSNode(testDir, "test-000004.log").readAll(lines);
+    VUNIT_ASSERT_TRUE_LABELED((lines.size() == 5) && (lines.front() == "rolling 30") && (lines.back() == "rolling 34"), "rolling appender file 4 contents");
+
+    // A new appender carries on numbering from the existing files, and can be rolled over on demand.
+    /* scope for appender */ {
+        VRollingFileLogAppender appender("rolling-test", VLogAppender::DONT_FORMAT_OUTPUT, VString::EMPTY(), VString::EMPTY(), testDir.getPath(), "test", 0, 0, VDuration::ZERO(), 3);
+        VUNIT_ASSERT_TRUE_LABELED(appender.getCurrentFilePath().endsWith("test-000005.log"), "rolling appender continued numbering");
+        VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::INFO, "before roll");
+        appender.rollOver();
+        VLOGGER_APPENDER_EMIT(appender, VLoggerLevel::INFO, "after roll");
+        VUNIT_ASSERT_TRUE_LABELED(appender.getCurrentFilePath().endsWith("test-000006.log"), "rolling appender rolled over on demand");
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED(_waitForNumRollingFiles(testDir, 3), 3, "rolling appender still kept 3 files");
+    lines.clear();
+    VFSNode(testDir, "test-000006.log").readAll(lines);
+    VUNIT_ASSERT_TRUE_LABELED((lines.size() == 1) && (lines.front() == "after roll"), "rolling appender file 6 contents");
+
+    // A byte limit configured in settings may exceed what fits in an int.
+    VString settingsText(VSTRING_FORMAT("<appender name=\"rolling-settings-test\" kind=\"rolling\" dir=\"%s\" prefix=\"big\" max-bytes=\"6442450944\" />", testDir.getPath().chars()));
+    VMemoryStream buf(settingsText.getDataBuffer(), VMemoryStream::kAllocatedByOperatorNew, false, settingsText.length(), settingsText.length());
+    VTextIOStream in(buf);
+    VSettings settings(in);
+    /* scope for appender */ {
+        VRollingFileLogAppender appender(*(settings.findNode("appender")), VSettings());
+        VBentoNode info;
+        appender.addInfo(info);
+        VUNIT_ASSERT_EQUAL_LABELED(info.getS64("max-bytes"), CONST_S64(6442450944), "rolling appender max-bytes setting over 2GB");
+    }
+
+    (void) testDir.rm();
+}
+
 void VLoggerUnit::_testOptimizationPerformance() {
     const int numIterations = 10000000;
     const VString loggerName("speed-test-logger");
@@ -39,9 +39,14 @@ class VLoggerUnit : public VUnit {
         void _testNewInfrastructure();
         void _testMacros();
         void _testStringLoggers();
+        void _testFormatSpec();
         void _testMaxActiveLogLevel();
         void _testLoggerPathNames();
+        void _testNamedLoggerCallSites();
         void _testSmartPtrLifecycle();
+        void _testAsyncAppender();
+        void _testDeferredMessages();
+        void _testRollingFileAppender();
         void _testOptimizationPerformance();
 
 };
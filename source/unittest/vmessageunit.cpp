@@ -11,6 +11,28 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 
 #include "vmessage.h"
 #include "vcompactingdeque.h"
+#include "vlockfreemessagequeue.h"
+#include "vbroadcastmessage.h"
+#include "vmessagepool.h"
+#include "vmessagedispatcher.h"
+#include "vmessageinputthread.h"
+#include "vmessageoutputthread.h"
+#include "vmessagehandler.h"
+#include "vmutexlocker.h"
+#include "vclientsessionstats.h"
+#include "vthreadpool.h"
+#include "vmessagereactor.h"
+#include "vserver.h"
+#include "vsocket.h"
+#include "vbento.h"
+
+#ifdef __linux__
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+#endif
 
 class TestMessage;
 typedef VSharedPtr<TestMessage> TestMessagePtr;
@@ -74,6 +96,45 @@ TestMessage::~TestMessage() {
     ++gNumMessagesDestructed;
 }
 
+// A message with a simple length+ID+data wire format, so that send() produces bytes we can verify.
+class TestWireMessage : public VMessage {
+    public:
+
+        TestWireMessage(VMessageID messageID = 0) : VMessage(messageID) {}
+        virtual ~TestWireMessage() {}
+
+        virtual void send(const VString& /*sessionLabel*/, VBinaryIOStream& out) {
+            out.writeS32(this->getMessageDataLength());
+            out.writeS32(this->getMessageID());
+            this->seek0();
+            (void) VStream::streamCopy(*this, out, this->getMessageDataLength());
+        }
+        virtual void receive(const VString& /*sessionLabel*/, VBinaryIOStream& in) {
+            VMessageLength length = in.readS32();
+            this->setMessageID(static_cast<VMessageID>(in.readS32()));
+            (void) VStream::streamCopy(in, *this, length);
+        }
+};
+
+// A factory for TestWireMessage that can tell frame lengths from the header, as the reactor prefers.
+class TestWireMessageFactory : public VMessageFactory {
+    public:
+
+        TestWireMessageFactory() {}
+        virtual ~TestWireMessageFactory() {}
+
+        virtual VMessagePtr instantiateNewMessage(VMessageID messageID) const { return VMessagePtr(new TestWireMessage(messageID)); }
+        virtual Vs64 getFrameLength(const Vu8* buffer, Vs64 numBytes) const {
+            if (numBytes < 8) {
+                return kFrameHeaderIncomplete;
+            }
+
+            VReadOnlyMemoryStream   header(const_cast<Vu8*>(buffer), numBytes);
+            VBinaryIOStream         headerIO(header);
+            return 8 + headerIO.readS32();
+        }
+};
+
 class TestMessageFactory : public VMessageFactory {
     public:
 
@@ -88,6 +149,324 @@ class TestMessageFactory : public VMessageFactory {
         virtual VMessagePtr instantiateNewMessage(VMessageID messageID) const { return TestMessage::factory(messageID); }
 };
 
+// A factory that is only registered in a lookup table, never asked to create a handler.
+class TestHandlerFactory : public VMessageHandlerFactory {
+    public:
+
+        TestHandlerFactory() {}
+        virtual ~TestHandlerFactory() {}
+
+        virtual VMessageHandler* createHandler(VMessagePtr /*m*/, VServer* /*server*/, VClientSessionPtr /*session*/, VSocketThread* /*thread*/) { return NULL; }
+};
+
+// A factory that opts out of ordered dispatch, so that its registration is observable.
+class TestUnorderedHandlerFactory : public TestHandlerFactory {
+    public:
+
+        virtual bool requiresOrderedDispatch() const { return false; }
+};
+
+// A handler that counts its instances, for verifying where handlers are constructed and destroyed.
+class TestHandler : public VMessageHandler {
+    public:
+
+        TestHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread)
+            : VMessageHandler(name, m, server, session, thread, NULL, NULL)
+            { ++gNumInstances; }
+        virtual ~TestHandler() { --gNumInstances; }
+
+        virtual void processMessage() {}
+
+        const VString& getName() const { return mName; }
+        const VString& getLoggerName() const { return mLoggerName; }
+        const VString& getSessionName() const { return mSessionName; }
+
+        static int gNumInstances;
+
+    protected:
+
+        TestHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread, bool copyName)
+            : VMessageHandler(name, m, server, session, thread, NULL, NULL, copyName)
+            { ++gNumInstances; }
+};
+
+int TestHandler::gNumInstances = 0;
+
+// A handler that keeps its own copy of its name, as a handler with a name built at run time must.
+class TestCopiedNameHandler : public TestHandler {
+    public:
+
+        TestCopiedNameHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread)
+            : TestHandler(name, m, server, session, thread, true/*copy name*/)
+            {}
+        virtual ~TestCopiedNameHandler() {}
+};
+
+// A polymorphic class placed ahead of VMessageHandler, so that the handler base is not at offset zero.
+class TestHandlerMixin {
+    public:
+
+        TestHandlerMixin() : mMixinValue(0) {}
+        virtual ~TestHandlerMixin() {}
+
+        int mMixinValue;
+};
+
+// A handler whose VMessageHandler base follows another base in memory.
+class TestMixinHandler : public TestHandlerMixin, public TestHandler {
+    public:
+
+        TestMixinHandler(const VString& name, VMessagePtr m, VServer* server, VClientSessionPtr session, VSocketThread* thread)
+            : TestHandlerMixin()
+            , TestHandler(name, m, server, session, thread)
+            {}
+        virtual ~TestMixinHandler() {}
+};
+
+// An input thread that is never started; it lets the test post messages to a dispatcher
+// directly and records how the dispatcher's workers call _dispatchMessage().
+// Message ID -1 stands for a slow handler and takes 100 ms.
+class TestDispatchInputThread : public VMessageInputThread {
+    public:
+
+        TestDispatchInputThread(const VMessageFactory* messageFactory)
+            : VMessageInputThread("TestDispatchInputThread", NULL, NULL, NULL, messageFactory)
+            , mRecordMutex("TestDispatchInputThread")
+            , mDispatchedIDs()
+            , mNumActive(0)
+            , mMaxActive(0)
+            , mLowestStackAddress(NULL)
+            , mHighestStackAddress(NULL)
+            {}
+        virtual ~TestDispatchInputThread() {}
+
+        void post(VMessagePtr message, bool ordered) { mMessageDispatcher->postMessage(mDispatchStrand, std::move(message), ordered); }
+        void waitUntilInFlightBelow(int maxInFlight) { mDispatchStrand->waitUntilInFlightBelow(maxInFlight); }
+        int getNumInFlight() const { return mDispatchStrand->getNumInFlight(); }
+        int getNumPooledMessages() const { return mMessagePool.getNumPooledMessages(); }
+
+        std::vector<int> getDispatchedIDs() const { VMutexLocker locker(&mRecordMutex, "getDispatchedIDs"); return mDispatchedIDs; }
+        int getMaxActive() const { return mMaxActive; }
+        Vs64 getStackSpread() const { VMutexLocker locker(&mRecordMutex, "getStackSpread"); return static_cast<Vs64>(mHighestStackAddress - mLowestStackAddress); }
+        void resetRecord() { VMutexLocker locker(&mRecordMutex, "resetRecord"); mDispatchedIDs.clear(); mMaxActive = 0; mLowestStackAddress = mHighestStackAddress = NULL; }
+
+    protected:
+
+        virtual void _dispatchMessage(VMessagePtr message) {
+            Vu8 stackMarker = 0;
+
+            /* locker scope */ {
+                VMutexLocker locker(&mRecordMutex, "_dispatchMessage start");
+                mDispatchedIDs.push_back(message->getMessageID());
+                mMaxActive = V_MAX(mMaxActive, ++mNumActive);
+                mLowestStackAddress = ((mLowestStackAddress == NULL) || (&stackMarker < mLowestStackAddress)) ? &stackMarker : mLowestStackAddress;
+                mHighestStackAddress = ((mHighestStackAddress == NULL) || (&stackMarker > mHighestStackAddress)) ? &stackMarker : mHighestStackAddress;
+            }
+
+            VThread::sleep(VDuration::MILLISECOND() * ((message->getMessageID() == -1) ? 100 : 1));
+
+            VMutexLocker locker(&mRecordMutex, "_dispatchMessage end");
+            --mNumActive;
+        }
+
+    private:
+
+        mutable VMutex      mRecordMutex;
+        std::vector<int>    mDispatchedIDs;
+        int                 mNumActive;
+        int                 mMaxActive;
+        Vu8*                mLowestStackAddress;    // deepest and shallowest frames seen, to detect recursion
+        Vu8*                mHighestStackAddress;
+};
+
+// A server that only has to exist; the reactor test never broadcasts.
+class TestReactorServer : public VServer {
+    public:
+
+        TestReactorServer() : VServer() {}
+        virtual ~TestReactorServer() {}
+
+        virtual void postBroadcastMessage(const VString& /*clientType*/, VMessagePtr /*message*/, VClientSessionConstPtr /*omitSession*/) {}
+};
+
+// A session with no i/o threads of its own, for servicing by a reactor.
+class TestReactorSession : public VClientSession {
+    public:
+
+        TestReactorSession(VServer* server, VSocket* socket, Vs64 maxQueueDataSize = 0)
+            : VClientSession("TestReactorSession", server, "test", socket, NULL, NULL, VDuration::ZERO(), maxQueueDataSize)
+            {}
+        virtual ~TestReactorSession() {}
+
+        virtual bool isClientOnline() const { return true; }
+        virtual bool isClientGoingOffline() const { return false; }
+};
+
+// A reactor session that starts offline, so that broadcasts go to its standby queue until goOnline().
+class TestStandbyReactorSession : public VClientSession {
+    public:
+
+        TestStandbyReactorSession(VServer* server, VSocket* socket)
+            : VClientSession("TestStandbyReactorSession", server, "test", socket, NULL, NULL, VDuration::ZERO(), 0)
+            , mIsOnline(false)
+            {}
+        virtual ~TestStandbyReactorSession() {}
+
+        virtual bool isClientOnline() const { return mIsOnline; }
+        virtual bool isClientGoingOffline() const { return false; }
+
+        void goOnline() {
+            VMutexLocker locker(&mMutex, "TestStandbyReactorSession::goOnline");
+            mIsOnline = true;
+            this->_moveStandbyMessagesToAsyncOutputQueue();
+        }
+
+    private:
+
+        std::atomic<bool> mIsOnline;
+};
+
+// A reactor thread that records the messages it dispatches and answers each with ID+1.
+// Message ID 70 stands for a slow handler: it waits until holdSlowHandlers(false) is called.
+class TestReactorThread : public VMessageReactorThread {
+    public:
+
+        TestReactorThread(const VMessageFactory* messageFactory, VServer* server, volatile bool* ended)
+            : VMessageReactorThread("TestReactorThread", 0, server, messageFactory, NULL)
+            , mRecordMutex("TestReactorThread")
+            , mDispatchedIDs()
+            , mEnded(ended)
+            , mHoldSlowHandlers(false)
+            {}
+        virtual ~TestReactorThread() { *mEnded = true; }
+
+        std::vector<int> getDispatchedIDs() const { VMutexLocker locker(&mRecordMutex, "getDispatchedIDs"); return mDispatchedIDs; }
+        void holdSlowHandlers(bool hold) { mHoldSlowHandlers = hold; }
+
+    protected:
+
+        virtual void _dispatchMessage(VClientSessionPtr session, VMessagePtr message) {
+            /* locker scope */ {
+                VMutexLocker locker(&mRecordMutex, "_dispatchMessage");
+                mDispatchedIDs.push_back(message->getMessageID());
+            }
+
+            for (int i = 0; (i < 500) && (message->getMessageID() == 70) && mHoldSlowHandlers; ++i) {
+                VThread::sleep(VDuration::MILLISECOND() * 10);
+            }
+
+            VMessagePtr reply(new TestWireMessage(message->getMessageID() + 1));
+            reply->writeS32(static_cast<Vs32>(message->getMessageDataLength()));
+            session->postOutputMessage(reply);
+        }
+
+    private:
+
+        mutable VMutex      mRecordMutex;
+        std::vector<int>    mDispatchedIDs;
+        volatile bool*      mEnded;
+        std::atomic<bool>   mHoldSlowHandlers;
+};
+
+// Polls until the thread has dispatched the expected number of messages, or two seconds pass.
+static void _waitForNumDispatched(const TestReactorThread* thread, int numDispatched) {
+    for (int i = 0; (i < 200) && ((int) thread->getDispatchedIDs().size() < numDispatched); ++i) {
+        VThread::sleep(VDuration::MILLISECOND() * 10);
+    }
+}
+
+// Reads from one end of a connection without blocking, until numBytes have arrived or two seconds pass.
+static void _readFromReactor(VSocket& socket, VMemoryStream& buffer, Vs64 numBytes) {
+    Vu8 chunk[256];
+    for (int i = 0; (i < 200) && (buffer.getEOFOffset() < numBytes); ) {
+        int numBytesRead = socket.readNonBlocking(chunk, sizeof(chunk));
+        if (numBytesRead == 0) {
+            VThread::sleep(VDuration::MILLISECOND() * 10);
+            ++i;
+        } else {
+            (void) buffer.write(chunk, numBytesRead);
+        }
+    }
+}
+
+#ifdef __linux__
+
+// A socket that counts the writes made to it, and how many of them were made while it was corked.
+class TestCountingSocket : public VSocket {
+    public:
+
+        TestCountingSocket(VSocketID id) : VSocket(id), mNumWrites(0), mNumCorkedWrites(0), mLargestWrite(0) {}
+        virtual ~TestCountingSocket() {}
+
+        virtual int write(const Vu8* buffer, int numBytesToWrite) {
+            ++mNumWrites;
+            if (numBytesToWrite > mLargestWrite) {
+                mLargestWrite = numBytesToWrite;
+            }
+
+            if (this->isCorked()) {
+                ++mNumCorkedWrites;
+            }
+
+            return VSocket::write(buffer, numBytesToWrite);
+        }
+
+        bool isCorked() const {
+            int corked = 0;
+            socklen_t corkedLength = sizeof(corked);
+            (void) ::getsockopt(this->getSockID(), IPPROTO_TCP, TCP_CORK, &corked, &corkedLength);
+            return corked != 0;
+        }
+
+        volatile int mNumWrites;
+        volatile int mNumCorkedWrites;
+        volatile int mLargestWrite;
+};
+
+// An output thread that tells the test when it has deleted itself.
+class TestOutputThread : public VMessageOutputThread {
+    public:
+
+        TestOutputThread(VSocket* socket, volatile bool* ended)
+            : VMessageOutputThread("TestOutputThread", socket, NULL, NULL, VClientSessionPtr(), NULL)
+            , mEnded(ended)
+            {}
+        virtual ~TestOutputThread() { *mEnded = true; }
+
+    private:
+
+        volatile bool* mEnded;
+};
+
+// Connects a TCP socket pair over the loopback interface; returns false if that is not possible here.
+static bool _connectLoopbackPair(VSocketID& serverID, VSocketID& clientID) {
+    VSocketID listenerID = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    ::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0; // any free port
+    socklen_t addressLength = sizeof(address);
+
+    bool connected = (listenerID >= 0) &&
+        (::bind(listenerID, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) &&
+        (::listen(listenerID, 1) == 0) &&
+        (::getsockname(listenerID, reinterpret_cast<struct sockaddr*>(&address), &addressLength) == 0);
+
+    clientID = connected ? ::socket(AF_INET, SOCK_STREAM, 0) : -1;
+    connected = connected && (clientID >= 0) && (::connect(clientID, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+    serverID = connected ? ::accept(listenerID, NULL, NULL) : -1;
+    connected = connected && (serverID >= 0);
+
+    if (listenerID >= 0) {
+        (void) ::close(listenerID);
+    }
+
+    return connected;
+}
+
+#endif /* __linux__ */
+
 VMessageUnit::VMessageUnit(bool logOnSuccess, bool throwOnError) :
     VUnit("VMessageUnit", logOnSuccess, throwOnError) {
 }
@@ -156,5 +535,797 @@ void VMessageUnit::run() {
     VUNIT_ASSERT_EQUAL(q.mHighWaterMark, (size_t) 4); // <- verifies that pop_back updated mHighWaterMark to max before pop
     VUNIT_ASSERT_EQUAL(q.mHighWaterMarkRequired, HWM);
     VUNIT_ASSERT_EQUAL(q.mLowWaterMarkRequired, LWM);
+
+    this->_testLockFreeMessageQueue();
+    this->_testBroadcastMessage();
+    this->_testMessagePool();
+    this->_testMessageDispatcher();
+    this->_testMessageHandlerTable();
+    this->_testMessageHandlerStorage();
+    this->_testClientSessionStats();
+    this->_testMessageReactor();
+    this->_testMessageReactorStandby();
+    this->_testMessageReactorDispatcher();
+    this->_testMessageReactorThreadFailure();
+    this->_testOutputThreadBatching();
+}
+
+void VMessageUnit::_testLockFreeMessageQueue() {
+    VLockFreeMessageQueue mq(3); // rounds up to 4
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getCapacity(), 4, "lock-free queue capacity");
+
+    for (int i = 1; i <= 4; ++i) {
+        TestMessagePtr message = TestMessage::factory(i);
+        for (int j = 0; j < i; ++j) {
+            message->writeS32(j);
+        }
+        VUNIT_ASSERT_TRUE_LABELED(mq.postMessage(message), VSTRING_FORMAT("lock-free queue post %d", i));
+    }
+
+    VUNIT_ASSERT_FALSE_LABELED(mq.postMessage(TestMessage::factory(5)), "lock-free queue post when full");
+    VUNIT_ASSERT_EQUAL_LABELED((int) mq.getQueueSize(), 4, "lock-free queue size when full");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getQueueDataSize(), CONST_S64(40), "lock-free queue data size when full");
+
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getNextMessage()->getMessageID(), 1, "lock-free queue FIFO 1");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getNextMessage()->getMessageID(), 2, "lock-free queue FIFO 2");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getQueueDataSize(), CONST_S64(28), "lock-free queue data size after removal");
+
+    // Wrap around the ring.
+    VUNIT_ASSERT_TRUE_LABELED(mq.postMessage(TestMessage::factory(5)), "lock-free queue post after removal");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.blockUntilNextMessage()->getMessageID(), 3, "lock-free queue FIFO 3");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getNextMessage()->getMessageID(), 4, "lock-free queue FIFO 4");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getNextMessage()->getMessageID(), 5, "lock-free queue FIFO 5 after wrap");
+    VUNIT_ASSERT_TRUE_LABELED(mq.getNextMessage() == nullptr, "lock-free queue empty");
+    VUNIT_ASSERT_EQUAL_LABELED((int) mq.getQueueSize(), 0, "lock-free queue size when empty");
+    VUNIT_ASSERT_EQUAL_LABELED(mq.getQueueDataSize(), CONST_S64(0), "lock-free queue data size when empty");
+
+    // A wakeUp() that comes before the consumer blocks still ends its next wait at once.
+    mq.wakeUp();
+    const Vs64 wakeUpStart = VInstant::snapshot();
+    VUNIT_ASSERT_TRUE_LABELED(mq.blockUntilNextMessage() == nullptr, "lock-free queue early wakeup returns no message");
+    VUNIT_ASSERT_TRUE_LABELED(VInstant::snapshotDelta(wakeUpStart) < VDuration::SECOND(), "lock-free queue early wakeup does not wait");
+
+    (void) mq.postMessage(TestMessage::factory(6));
+    (void) mq.postMessage(TestMessage::factory(7));
+    mq.releaseAllMessages();
+    VUNIT_ASSERT_EQUAL_LABELED((int) mq.getQueueSize(), 0, "lock-free queue size after release");
+
+    // An unbounded queue overflows its ring and keeps the order.
+    VLockFreeMessageQueue unbounded(4, VLockFreeMessageQueue::kUnbounded);
+    for (int i = 1; i <= 10; ++i) {
+        TestMessagePtr message = TestMessage::factory(i);
+        message->writeS32(i);
+        VUNIT_ASSERT_TRUE_LABELED(unbounded.postMessage(message), VSTRING_FORMAT("unbounded lock-free queue post %d", i));
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED((int) unbounded.getQueueSize(), 10, "unbounded lock-free queue size");
+    VUNIT_ASSERT_EQUAL_LABELED(unbounded.getQueueDataSize(), CONST_S64(40), "unbounded lock-free queue data size");
+
+    for (int i = 1; i <= 6; ++i) {
+        VUNIT_ASSERT_EQUAL_LABELED(unbounded.getNextMessage()->getMessageID(), i, VSTRING_FORMAT("unbounded lock-free queue FIFO %d", i));
+    }
+
+    // The overflow still holds messages, so this post must queue behind them even though the ring has room.
+    VUNIT_ASSERT_TRUE_LABELED(unbounded.postMessage(TestMessage::factory(11)), "unbounded lock-free queue post while overflowing");
+    for (int i = 7; i <= 11; ++i) {
+        VUNIT_ASSERT_EQUAL_LABELED(unbounded.getNextMessage()->getMessageID(), i, VSTRING_FORMAT("unbounded lock-free queue FIFO %d", i));
+    }
+
+    VUNIT_ASSERT_TRUE_LABELED(unbounded.getNextMessage() == nullptr, "unbounded lock-free queue empty");
+    VUNIT_ASSERT_EQUAL_LABELED(unbounded.getQueueDataSize(), CONST_S64(0), "unbounded lock-free queue data size when empty");
+
+    // Once drained, posts use the ring again.
+    VUNIT_ASSERT_TRUE_LABELED(unbounded.postMessage(TestMessage::factory(12)), "unbounded lock-free queue post after drain");
+    VUNIT_ASSERT_EQUAL_LABELED(unbounded.blockUntilNextMessage()->getMessageID(), 12, "unbounded lock-free queue FIFO after drain");
+}
+
+void VMessageUnit::_testBroadcastMessage() {
+    VMessagePtr original(new TestWireMessage(77));
+    original->writeS32(1);
+    original->writeS32(2);
+
+    VMessagePtr shared = VBroadcastMessage::create(original);
+    VUNIT_ASSERT_EQUAL_LABELED(shared->getMessageID(), 77, "broadcast message ID");
+    VUNIT_ASSERT_EQUAL_LABELED((int) shared->getMessageDataLength(), 16, "broadcast message wire length");
+
+    // Two "sessions" sending the same shared message must see identical wire bytes.
+    VMemoryStream   session1Raw;
+    VBinaryIOStream session1(session1Raw);
+    VMemoryStream   session2Raw;
+    VBinaryIOStream session2(session2Raw);
+    shared->send("session1", session1);
+    shared->send("session2", session2);
+    VUNIT_ASSERT_TRUE_LABELED(session1Raw == session2Raw, "broadcast message identical sends");
+
+    session1.seek0();
+    VUNIT_ASSERT_EQUAL_LABELED(session1.readS32(), 8, "broadcast message wire length field");
+    VUNIT_ASSERT_EQUAL_LABELED(session1.readS32(), 77, "broadcast message wire ID field");
+    VUNIT_ASSERT_EQUAL_LABELED(session1.readS32(), 1, "broadcast message wire data 1");
+    VUNIT_ASSERT_EQUAL_LABELED(session1.readS32(), 2, "broadcast message wire data 2");
+}
+
+void VMessageUnit::_testMessagePool() {
+    TestMessageFactory  factory;
+    VMessagePool        pool(&factory, 2, 4096);
+
+    VMessagePtr m1 = pool.get(1);
+    m1->writeS32(42);
+    VMessage* m1Address = m1.get();
+    pool.release(m1);
+    VUNIT_ASSERT_TRUE_LABELED(m1 == nullptr, "pool release resets pointer");
+    VUNIT_ASSERT_EQUAL_LABELED(pool.getNumPooledMessages(), 1, "pool keeps released message");
+
+    VMessagePtr m2 = pool.get(2);
+    VUNIT_ASSERT_TRUE_LABELED(m2.get() == m1Address, "pool reuses released message");
+    VUNIT_ASSERT_EQUAL_LABELED(m2->getMessageID(), 2, "pool sets message ID on reuse");
+    VUNIT_ASSERT_EQUAL_LABELED((int) m2->getMessageDataLength(), 0, "pool recycles message data");
+
+    // A message someone else still references must not be recycled.
+    VMessagePtr retained = m2;
+    pool.release(m2);
+    VUNIT_ASSERT_EQUAL_LABELED(pool.getNumPooledMessages(), 0, "pool skips shared message");
+    VUNIT_ASSERT_EQUAL_LABELED(retained->getMessageID(), 2, "pool leaves shared message intact");
+
+    // A message whose buffer grew past the limit is not kept.
+    VMessagePtr big = pool.get(3);
+    for (int i = 0; i < 2048; ++i) {
+        big->writeS32(i);
+    }
+    pool.release(big);
+    VUNIT_ASSERT_EQUAL_LABELED(pool.getNumPooledMessages(), 0, "pool skips oversized message");
+
+    VMessagePtr a = pool.get();
+    VMessagePtr b = pool.get();
+    VMessagePtr c = pool.get();
+    VMessage* bAddress = b.get();
+    pool.release(a);
+    pool.release(b);
+    pool.release(c);
+    VUNIT_ASSERT_EQUAL_LABELED(pool.getNumPooledMessages(), 2, "pool capped at max");
+    pool.trim(1);
+    VUNIT_ASSERT_EQUAL_LABELED(pool.getNumPooledMessages(), 1, "pool trim");
+    VMessagePtr warm = pool.get();
+    VUNIT_ASSERT_TRUE_LABELED(warm.get() == bAddress, "pool trim keeps most recently released message");
+    pool.release(warm);
+
+    // After a burst, a pool whose thread only needs one message at a time shrinks back down.
+    VMessagePool burstPool(&factory, 8, 4096);
+    VMessagePtr burst[8];
+    for (int i = 0; i < 8; ++i) {
+        burst[i] = burstPool.get();
+    }
+    for (int i = 0; i < 8; ++i) {
+        burstPool.release(burst[i]);
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(burstPool.getNumPooledMessages(), 8, "pool keeps burst messages");
+
+    for (int i = 0; i < 2 * VMessagePool::kTrimInterval; ++i) {
+        VMessagePtr m = burstPool.get();
+        burstPool.release(m);
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(burstPool.getNumPooledMessages(), 1, "pool trims idle messages after a burst");
+}
+
+void VMessageUnit::_testMessageDispatcher() {
+    TestMessageFactory      factory;
+    VMessageDispatcher      dispatcher("TestDispatcher", 4);
+    TestDispatchInputThread thread(&factory);
+    const int               kNumMessages = 40;
+
+    thread.setMessageDispatcher(&dispatcher, 8);
+    dispatcher.start();
+
+    // Ordered messages run one at a time, in the order posted, even with several workers.
+    for (int i = 0; i < kNumMessages; ++i) {
+        thread.post(TestMessage::factory(i), true);
+        thread.waitUntilInFlightBelow(8);
+        VUNIT_ASSERT_TRUE_LABELED(thread.getNumInFlight() < 8, VSTRING_FORMAT("dispatcher backpressure %d", i));
+    }
+
+    thread.waitUntilInFlightBelow(1);
+    VUNIT_ASSERT_EQUAL_LABELED(thread.getNumInFlight(), 0, "dispatcher ordered drain");
+
+    std::vector<int> ids = thread.getDispatchedIDs();
+    VUNIT_ASSERT_EQUAL_LABELED((int) ids.size(), kNumMessages, "dispatcher ordered count");
+    bool inOrder = true;
+    for (int i = 0; i < (int) ids.size(); ++i) {
+        inOrder = inOrder && (ids[i] == i);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(inOrder, "dispatcher ordered sequence");
+    VUNIT_ASSERT_EQUAL_LABELED(thread.getMaxActive(), 1, "dispatcher ordered concurrency");
+    // The workers hold the last reference to each message, and return it to the input thread's pool.
+    VUNIT_ASSERT_EQUAL_LABELED(thread.getNumPooledMessages(), VMessagePool::kDefaultMaxPooledMessages, "dispatcher recycles finished messages");
+
+    // Unordered messages are all processed, and may overlap.
+    thread.resetRecord();
+    for (int i = 0; i < kNumMessages; ++i) {
+        thread.post(TestMessage::factory(i), false);
+        thread.waitUntilInFlightBelow(8);
+    }
+
+    thread.waitUntilInFlightBelow(1);
+    VUNIT_ASSERT_EQUAL_LABELED((int) thread.getDispatchedIDs().size(), kNumMessages, "dispatcher unordered count");
+    VUNIT_ASSERT_TRUE_LABELED(thread.getMaxActive() <= 4, "dispatcher unordered concurrency within worker count");
+
+    dispatcher.stop();
+    VUNIT_ASSERT_EQUAL_LABELED(dispatcher.getQueueSize(), 0, "dispatcher queue empty after stop");
+
+    // A long strand still waiting when stop() begins is drained in a loop by the worker that is
+    // running its head, not one nested submit() per message.
+    VMessageDispatcher  stoppingDispatcher("TestStoppingDispatcher", 2);
+    const int           kNumStrandMessages = 300;
+    thread.setMessageDispatcher(&stoppingDispatcher, kNumStrandMessages + 1);
+    thread.resetRecord();
+    stoppingDispatcher.start();
+    thread.post(TestMessage::factory(-1), true);
+    for (int i = 0; i < kNumStrandMessages; ++i) {
+        thread.post(TestMessage::factory(i), true);
+    }
+
+    stoppingDispatcher.stop();
+    ids = thread.getDispatchedIDs();
+    inOrder = ((int) ids.size() == kNumStrandMessages + 1) && (ids[0] == -1);
+    for (int i = 1; inOrder && (i < (int) ids.size()); ++i) {
+        inOrder = (ids[i] == i - 1);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(inOrder, "dispatcher stop drains strand in order");
+    VUNIT_ASSERT_EQUAL_LABELED(thread.getNumInFlight(), 0, "dispatcher stop drains strand");
+    VUNIT_ASSERT_TRUE_LABELED(thread.getStackSpread() < 16384, VSTRING_FORMAT("dispatcher stop does not recurse per message (" VSTRING_FORMATTER_S64 " bytes)", thread.getStackSpread()));
+}
+
+void VMessageUnit::_testMessageHandlerTable() {
+    TestHandlerFactory          factoryA;
+    TestHandlerFactory          factoryB;
+    VMessageHandlerFactoryMap   factories;
+
+    VMessageHandlerTable emptyTable(factories);
+    VUNIT_ASSERT_TRUE_LABELED(emptyTable.find(1) == NULL, "handler table empty lookup");
+
+    // A compact range of IDs becomes a direct array.
+    for (VMessageID id = 10; id < 40; id += 3) {
+        factories[id] = (id % 2 == 0) ? &factoryA : &factoryB;
+    }
+    factories[41] = NULL; // registered as NULL, must behave as unregistered
+
+    VMessageHandlerTable denseTable(factories);
+    VUNIT_ASSERT_TRUE_LABELED(denseTable.isDense(), "handler table dense form");
+    VUNIT_ASSERT_EQUAL_LABELED(denseTable.getNumFactories(), 10, "handler table dense count");
+    bool denseFound = true;
+    for (VMessageID id = 10; id < 40; id += 3) {
+        denseFound = denseFound && (denseTable.find(id) == ((id % 2 == 0) ? &factoryA : &factoryB));
+    }
+    VUNIT_ASSERT_TRUE_LABELED(denseFound, "handler table dense lookup");
+    VUNIT_ASSERT_TRUE_LABELED(denseTable.find(11) == NULL, "handler table dense miss inside range");
+    VUNIT_ASSERT_TRUE_LABELED(denseTable.find(9) == NULL, "handler table dense miss below range");
+    VUNIT_ASSERT_TRUE_LABELED(denseTable.find(41) == NULL, "handler table dense NULL entry");
+    VUNIT_ASSERT_TRUE_LABELED(denseTable.find(-1000000) == NULL, "handler table dense miss far away");
+
+    // Widely spread IDs become a perfect hash.
+    const VMessageID spreadIDs[] = { -5, 0, 1, 999, 70000, 123456789, 2000000000, -2000000000 };
+    const int numSpreadIDs = (int)(sizeof(spreadIDs) / sizeof(spreadIDs[0]));
+    for (int i = 0; i < numSpreadIDs; ++i) {
+        factories[spreadIDs[i]] = &factoryA;
+    }
+
+    VMessageHandlerTable hashedTable(factories);
+    VUNIT_ASSERT_FALSE_LABELED(hashedTable.isDense(), "handler table hashed form");
+    VUNIT_ASSERT_EQUAL_LABELED(hashedTable.getNumFactories(), 10 + numSpreadIDs, "handler table hashed count");
+    bool hashedFound = true;
+    for (VMessageHandlerFactoryMap::const_iterator i = factories.begin(); i != factories.end(); ++i) {
+        hashedFound = hashedFound && (hashedTable.find(i->first) == i->second);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(hashedFound, "handler table hashed lookup");
+    bool hashedMissed = true;
+    for (VMessageID id = 2; id < 500; ++id) {
+        if (factories.find(id) == factories.end()) {
+            hashedMissed = hashedMissed && (hashedTable.find(id) == NULL);
+        }
+    }
+    VUNIT_ASSERT_TRUE_LABELED(hashedMissed, "handler table hashed misses");
+    VUNIT_ASSERT_EQUAL_LABELED((int) factories.size(), 11 + numSpreadIDs, "handler table lookups do not modify registrations");
+    VUNIT_ASSERT_TRUE_LABELED(hashedTable.getNumSlots() <= 4 * hashedTable.getNumFactories(), "handler table hashed slots linear in IDs");
+    VUNIT_ASSERT_EQUAL_LABELED(*hashedTable.findLoggerName(123456789), VString("vault.messages.VMessageHandler.123456789"), "handler table hashed logger name");
+
+    // Many spread IDs still hash into a slot array linear in their number.
+    VMessageHandlerFactoryMap manyFactories;
+    for (int i = 0; i < 5000; ++i) {
+        manyFactories[static_cast<VMessageID>(i * 100003 - 250000000)] = &factoryB;
+    }
+
+    VMessageHandlerTable manyTable(manyFactories);
+    VUNIT_ASSERT_TRUE_LABELED(manyTable.getForm() == VMessageHandlerTable::kHashed, "handler table many IDs hashed");
+    VUNIT_ASSERT_TRUE_LABELED(manyTable.getNumSlots() <= 4 * manyTable.getNumFactories(), "handler table many IDs slots linear");
+    bool manyFound = true;
+    for (VMessageHandlerFactoryMap::const_iterator i = manyFactories.begin(); i != manyFactories.end(); ++i) {
+        manyFound = manyFound && (manyTable.find(i->first) == i->second) && (manyTable.find(i->first + 1) == NULL);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(manyFound, "handler table many IDs lookup");
+
+    // A registration after the factories are frozen is seen by later lookups.
+    TestUnorderedHandlerFactory lateFactory;
+    const VMessageID lateID = 987001;
+    VMessageHandler::freezeHandlerFactories();
+    VUNIT_ASSERT_TRUE_LABELED(VMessageHandler::requiresOrderedDispatch(lateID), "handler late ID unknown before registration");
+    VMessageHandler::registerHandlerFactory(lateID, &lateFactory);
+    VUNIT_ASSERT_FALSE_LABELED(VMessageHandler::requiresOrderedDispatch(lateID), "handler late registration seen");
+    VMessageHandler::registerHandlerFactory(lateID, NULL);
+    VUNIT_ASSERT_TRUE_LABELED(VMessageHandler::requiresOrderedDispatch(lateID), "handler late unregistration seen");
 }
 
+void VMessageUnit::_testMessageHandlerStorage() {
+    VMessageHandlerStorage  storage(8); // smaller than a handler, so the first use must grow it
+    const VString           handlerName("TestHandler (message handler storage test)");
+    VMessagePtr             message = TestMessage::factory(321);
+
+    VMessageHandler* first = VMessageHandlerStorage::construct<TestHandler>(storage, handlerName, message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_TRUE_LABELED(storage.contains(first), "handler constructed in storage");
+    VUNIT_ASSERT_EQUAL_LABELED(static_cast<TestHandler*>(first)->getName(), handlerName, "handler name");
+    VUNIT_ASSERT_EQUAL_LABELED(static_cast<TestHandler*>(first)->getLoggerName(), VString("vault.messages.VMessageHandler.321"), "handler logger name");
+
+    // Construction copies none of the names: the handler refers to the caller's name, the
+    // interned logger name, and (with no session or thread) the empty string.
+    VUNIT_ASSERT_TRUE_LABELED(&static_cast<TestHandler*>(first)->getName() == &handlerName, "handler refers to supplied name");
+    VUNIT_ASSERT_TRUE_LABELED(&static_cast<TestHandler*>(first)->getSessionName() == &VString::EMPTY(), "handler refers to empty session name");
+    VMessageHandler* loggerNameCheck = VMessageHandlerStorage::construct<TestHandler>(storage, handlerName, message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_TRUE_LABELED(&static_cast<TestHandler*>(loggerNameCheck)->getLoggerName() == &static_cast<TestHandler*>(first)->getLoggerName(), "handlers share interned logger name");
+    VMessageHandler::destroy(loggerNameCheck, &storage);
+
+    // While the storage is occupied, the next handler goes on the heap.
+    VMessageHandler* second = VMessageHandlerStorage::construct<TestHandler>(storage, handlerName, message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_FALSE_LABELED(storage.contains(second), "handler constructed on heap when storage in use");
+    VUNIT_ASSERT_EQUAL_LABELED(TestHandler::gNumInstances, 2, "handler instances constructed");
+    VUNIT_ASSERT_EQUAL_LABELED(static_cast<TestHandler*>(second)->getLoggerName(), VString("vault.messages.VMessageHandler.321"), "heap handler logger name");
+
+    VMessageHandler::destroy(second, &storage);
+    VMessageHandler::destroy(first, &storage);
+    VUNIT_ASSERT_EQUAL_LABELED(TestHandler::gNumInstances, 0, "handler instances destroyed");
+
+    // Once released, the same memory is reused.
+    VMessageHandler* third = VMessageHandlerStorage::construct<TestHandler>(storage, handlerName, message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_TRUE_LABELED(third == first, "handler storage reused");
+    VMessageHandler::destroy(third, &storage);
+    VUNIT_ASSERT_EQUAL_LABELED(TestHandler::gNumInstances, 0, "handler instance destroyed from reused storage");
+
+    // A handler that asks to copy its name may be given a temporary.
+    VMessageHandler* fourth = VMessageHandlerStorage::construct<TestCopiedNameHandler>(storage, VSTRING_FORMAT("TestHandler #%d", 4), message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_EQUAL_LABELED(static_cast<TestHandler*>(fourth)->getName(), VString("TestHandler #4"), "handler name from temporary");
+    VMessageHandler::destroy(fourth, &storage);
+
+    // A handler whose VMessageHandler base is not at the start of the block is still recognized as in the storage.
+    VMessageHandler* fifth = VMessageHandlerStorage::construct<TestMixinHandler>(storage, handlerName, message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_TRUE_LABELED(static_cast<void*>(fifth) != static_cast<void*>(static_cast<TestMixinHandler*>(fifth)), "mixin handler base not at start of object");
+    VUNIT_ASSERT_TRUE_LABELED(storage.contains(fifth), "mixin handler constructed in storage");
+    VMessageHandler::destroy(fifth, &storage);
+    VUNIT_ASSERT_EQUAL_LABELED(TestHandler::gNumInstances, 0, "mixin handler destroyed in storage");
+    VMessageHandler* sixth = VMessageHandlerStorage::construct<TestHandler>(storage, handlerName, message, NULL, VClientSessionPtr(), NULL);
+    VUNIT_ASSERT_TRUE_LABELED(storage.contains(sixth), "storage released after mixin handler");
+    VMessageHandler::destroy(sixth, &storage);
+}
+
+// Records messages in pairs with fixed sizes, so any snapshot has bytes == 10 x messages.
+static void _recordSessionTraffic(VClientSessionStats* stats, int numMessages) {
+    for (int i = 0; i < numMessages; ++i) {
+        stats->recordMessageIn(10);
+        stats->recordMessageOut(10);
+        stats->recordOutputQueueDepth(i % 100);
+    }
+}
+
+void VMessageUnit::_testClientSessionStats() {
+    VClientSessionStats stats;
+    stats.recordMessageIn(100);
+    stats.recordMessageIn(50);
+    stats.recordMessageOut(30);
+    stats.recordOutputQueueDepth(7);
+    stats.recordOutputQueueDepth(3);
+    stats.recordHandlerTime(40);
+    stats.recordHandlerTime(60);
+
+    VClientSessionStats::Snapshot snapshot = stats.getSnapshot();
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mNumMessagesIn, CONST_S64(2), "session stats messages in");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mNumBytesIn, CONST_S64(150), "session stats bytes in");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mNumMessagesOut, CONST_S64(1), "session stats messages out");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mNumBytesOut, CONST_S64(30), "session stats bytes out");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mOutputQueueHighWater, CONST_S64(7), "session stats queue high-water");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mNumHandlerCalls, CONST_S64(2), "session stats handler calls");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mHandlerMicroseconds, CONST_S64(100), "session stats handler time");
+    VUNIT_ASSERT_EQUAL_LABELED(snapshot.mMaxHandlerMicroseconds, CONST_S64(60), "session stats max handler time");
+
+    VClientSessionStats::Snapshot totals;
+    totals.add(snapshot);
+    totals.add(snapshot);
+    VUNIT_ASSERT_EQUAL_LABELED(totals.mNumBytesIn, CONST_S64(300), "session stats aggregate sum");
+    VUNIT_ASSERT_EQUAL_LABELED(totals.mOutputQueueHighWater, CONST_S64(7), "session stats aggregate high-water");
+
+    VBentoNode info;
+    totals.addToBento(info);
+    VUNIT_ASSERT_EQUAL_LABELED(info.getS64("messages-in"), CONST_S64(4), "session stats bento");
+
+    // Snapshots taken while several threads are recording must always be consistent.
+    VClientSessionStats sharedStats;
+    const int kNumWriters = 3;
+    const int kNumMessagesPerWriter = 20000;
+    VThreadPool pool("VMessageUnit.stats", kNumWriters);
+    pool.start();
+    for (int i = 0; i < kNumWriters; ++i) {
+        (void) pool.submit(std::bind(_recordSessionTraffic, &sharedStats, kNumMessagesPerWriter));
+    }
+
+    bool allConsistent = true;
+    for (;;) {
+        VClientSessionStats::Snapshot s = sharedStats.getSnapshot();
+        allConsistent = allConsistent && (s.mNumBytesIn == 10 * s.mNumMessagesIn) && (s.mNumBytesOut == 10 * s.mNumMessagesOut);
+        if (s.mNumMessagesOut == kNumWriters * kNumMessagesPerWriter) {
+            break;
+        }
+    }
+
+    pool.stop();
+    VUNIT_ASSERT_TRUE_LABELED(allConsistent, "session stats snapshots consistent under concurrent writers");
+    VUNIT_ASSERT_EQUAL_LABELED(sharedStats.getSnapshot().mNumMessagesIn, static_cast<Vs64>(kNumWriters * kNumMessagesPerWriter), "session stats concurrent count");
+    VUNIT_ASSERT_EQUAL_LABELED(sharedStats.getSnapshot().mOutputQueueHighWater, CONST_S64(99), "session stats concurrent high-water");
+}
+
+void VMessageUnit::_testMessageReactor() {
+#ifdef __linux__
+    TestWireMessageFactory  factory;
+    TestReactorServer       server;
+    volatile bool           threadEnded = false;
+    TestReactorThread*      thread = new TestReactorThread(&factory, &server, &threadEnded);
+    thread->start();
+
+    int socketIDs[2];
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor socketpair");
+    VSocket* serverSocket = new VSocket(socketIDs[0]); // owned by the session
+    VSocket client(socketIDs[1]);
+
+    VClientSessionPtr session(new TestReactorSession(&server, serverSocket));
+    thread->attachSession(session, serverSocket);
+    VUNIT_ASSERT_EQUAL_LABELED(thread->getNumSessions(), 1, "reactor attach");
+
+    // Two frames: the first arrives in three pieces, splitting its header; the second in one piece.
+    VMemoryStream   frames;
+    VBinaryIOStream framesIO(frames);
+    TestWireMessage request1(10);
+    request1.writeS32(1);
+    request1.writeS32(2);
+    request1.send("test", framesIO);
+    TestWireMessage request2(20);
+    request2.send("test", framesIO);
+    VUNIT_ASSERT_EQUAL_LABELED(frames.getEOFOffset(), CONST_S64(24), "reactor test frames");
+
+    (void) client.write(frames.getBuffer(), 5);
+    VThread::sleep(VDuration::MILLISECOND() * 50);
+    (void) client.write(frames.getBuffer() + 5, 10);
+    VThread::sleep(VDuration::MILLISECOND() * 50);
+    VUNIT_ASSERT_EQUAL_LABELED((int) thread->getDispatchedIDs().size(), 0, "reactor partial frame not dispatched");
+
+    (void) client.write(frames.getBuffer() + 15, 9);
+    _waitForNumDispatched(thread, 2);
+    std::vector<int> ids = thread->getDispatchedIDs();
+    VUNIT_ASSERT_EQUAL_LABELED((int) ids.size(), 2, "reactor dispatched complete frames");
+    VUNIT_ASSERT_TRUE_LABELED((ids.size() == 2) && (ids[0] == 10) && (ids[1] == 20), "reactor dispatch order");
+
+    // Each reply was queued by the posting thread and written by the event loop.
+    VMemoryStream   replies;
+    VBinaryIOStream repliesIO(replies);
+    _readFromReactor(client, replies, 24);
+    VUNIT_ASSERT_EQUAL_LABELED(replies.getEOFOffset(), CONST_S64(24), "reactor reply bytes");
+    if (replies.getEOFOffset() == 24) {
+        repliesIO.seek0();
+        VUNIT_ASSERT_EQUAL_LABELED(repliesIO.readS32(), 4, "reactor reply 1 length");
+        VUNIT_ASSERT_EQUAL_LABELED(repliesIO.readS32(), 11, "reactor reply 1 ID");
+        VUNIT_ASSERT_EQUAL_LABELED(repliesIO.readS32(), 8, "reactor reply 1 data");
+        VUNIT_ASSERT_EQUAL_LABELED(repliesIO.readS32(), 4, "reactor reply 2 length");
+        VUNIT_ASSERT_EQUAL_LABELED(repliesIO.readS32(), 21, "reactor reply 2 ID");
+        VUNIT_ASSERT_EQUAL_LABELED(repliesIO.readS32(), 0, "reactor reply 2 data");
+    }
+
+    // A header announcing a frame over the size limit closes the session without reading it.
+    VMemoryStream   oversized;
+    VBinaryIOStream oversizedIO(oversized);
+    oversizedIO.writeS32(100 * 1024 * 1024);
+    oversizedIO.writeS32(30);
+    (void) client.write(oversized.getBuffer(), static_cast<int>(oversized.getEOFOffset()));
+    for (int i = 0; (i < 200) && (thread->getNumSessions() != 0); ++i) {
+        VThread::sleep(VDuration::MILLISECOND() * 10);
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(thread->getNumSessions(), 0, "reactor closes session on oversized frame");
+    VUNIT_ASSERT_TRUE_LABELED(session->isShuttingDown(), "reactor shuts down closed session");
+    VUNIT_ASSERT_EQUAL_LABELED((int) thread->getDispatchedIDs().size(), 2, "reactor oversized frame not dispatched");
+
+    // A peer that closes its end has its session shut down.
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor socketpair 2");
+    serverSocket = new VSocket(socketIDs[0]);
+    VSocket* client2 = new VSocket(socketIDs[1]);
+    VClientSessionPtr session2(new TestReactorSession(&server, serverSocket));
+    thread->attachSession(session2, serverSocket);
+    (void) client2->write(frames.getBuffer() + 12, 12); // request2 again
+    _waitForNumDispatched(thread, 3);
+    VUNIT_ASSERT_EQUAL_LABELED((int) thread->getDispatchedIDs().size(), 3, "reactor second session dispatch");
+    delete client2;
+    for (int i = 0; (i < 200) && (thread->getNumSessions() != 0); ++i) {
+        VThread::sleep(VDuration::MILLISECOND() * 10);
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(thread->getNumSessions(), 0, "reactor closes session on peer close");
+    VUNIT_ASSERT_TRUE_LABELED(session2->isShuttingDown(), "reactor shuts down session on peer close");
+
+    // A peer that stops reading while this (non-reactor) thread keeps posting goes over the queue limit.
+    // The session only asks for the close; the event loop stops watching the socket and closes it.
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor socketpair 3");
+    serverSocket = new VSocket(socketIDs[0]);
+    VSocket client3(socketIDs[1]);
+    VClientSessionPtr session3(new TestReactorSession(&server, serverSocket, 65536));
+    thread->attachSession(session3, serverSocket);
+    VMessagePtr bulk(new TestWireMessage(50));
+    for (int i = 0; i < 4096; ++i) {
+        bulk->writeS32(i);
+    }
+    int numPosted = 0;
+    for (; (numPosted < 1000) && ! session3->isShuttingDown() && (thread->getNumSessions() != 0); ++numPosted) {
+        session3->postOutputMessage(bulk);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(numPosted < 1000, "reactor queue limit reached");
+    for (int i = 0; (i < 200) && (thread->getNumSessions() != 0); ++i) {
+        VThread::sleep(VDuration::MILLISECOND() * 10);
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(thread->getNumSessions(), 0, "reactor closes session over queue limit");
+    VUNIT_ASSERT_TRUE_LABELED(session3->isShuttingDown(), "reactor shuts down session over queue limit");
+    VUNIT_ASSERT_EQUAL_LABELED(serverSocket->getSockID(), VSocket::kNoSocketID, "reactor thread closed the socket");
+    session3->postOutputMessage(bulk); // ignored now; must not touch the closed socket or the deleted connection
+
+    // The thread does not delete itself; its creator joins and deletes it.
+    thread->stop();
+    VUNIT_ASSERT_TRUE_LABELED(VThread::threadJoin(thread->threadID(), NULL), "reactor thread joined");
+    VUNIT_ASSERT_FALSE_LABELED(threadEnded, "reactor thread not deleted at end");
+    delete thread;
+    VUNIT_ASSERT_TRUE_LABELED(threadEnded, "reactor thread deleted");
+#endif /* __linux__ */
+}
+
+void VMessageUnit::_testMessageReactorStandby() {
+#ifdef __linux__
+    TestWireMessageFactory  factory;
+    TestReactorServer       server;
+    volatile bool           threadEnded = false;
+    TestReactorThread*      thread = new TestReactorThread(&factory, &server, &threadEnded);
+    thread->start();
+
+    int socketIDs[2];
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor standby socketpair");
+    VSocket* serverSocket = new VSocket(socketIDs[0]); // owned by the session
+    VSocket client(socketIDs[1]);
+
+    TestStandbyReactorSession* standbySession = new TestStandbyReactorSession(&server, serverSocket);
+    VClientSessionPtr session(standbySession);
+    thread->attachSession(session, serverSocket);
+
+    // A broadcast to a session that is not yet online waits on its standby queue.
+    VMessagePtr broadcast(new TestWireMessage(40));
+    broadcast->writeS32(7);
+    session->postOutputMessage(broadcast, true);
+    VMemoryStream   received;
+    VBinaryIOStream receivedIO(received);
+    VThread::sleep(VDuration::MILLISECOND() * 50);
+    Vu8 chunk[16];
+    VUNIT_ASSERT_EQUAL_LABELED(client.readNonBlocking(chunk, sizeof(chunk)), 0, "reactor standby message held");
+
+    // Going online moves it to the reactor's output queue, which has no output thread.
+    standbySession->goOnline();
+    _readFromReactor(client, received, 12);
+    VUNIT_ASSERT_EQUAL_LABELED(received.getEOFOffset(), CONST_S64(12), "reactor standby message bytes");
+    if (received.getEOFOffset() == 12) {
+        receivedIO.seek0();
+        VUNIT_ASSERT_EQUAL_LABELED(receivedIO.readS32(), 4, "reactor standby message length");
+        VUNIT_ASSERT_EQUAL_LABELED(receivedIO.readS32(), 40, "reactor standby message ID");
+        VUNIT_ASSERT_EQUAL_LABELED(receivedIO.readS32(), 7, "reactor standby message data");
+    }
+
+    thread->stop();
+    VUNIT_ASSERT_TRUE_LABELED(VThread::threadJoin(thread->threadID(), NULL), "reactor standby thread joined");
+    delete thread;
+#endif /* __linux__ */
+}
+
+// Sends a message with no data on the socket, as a client would.
+static void _sendToReactor(VSocket& socket, int messageID) {
+    VMemoryStream   frame;
+    VBinaryIOStream frameIO(frame);
+    TestWireMessage message(messageID);
+    message.send("test", frameIO);
+    (void) socket.write(frame.getBuffer(), static_cast<int>(frame.getEOFOffset()));
+}
+
+void VMessageUnit::_testMessageReactorDispatcher() {
+#ifdef __linux__
+    TestWireMessageFactory  factory;
+    TestReactorServer       server;
+    VMessageDispatcher      dispatcher("TestReactorDispatcher", 2);
+    volatile bool           threadEnded = false;
+    TestReactorThread*      thread = new TestReactorThread(&factory, &server, &threadEnded);
+    thread->setMessageDispatcher(&dispatcher, 2);
+    thread->holdSlowHandlers(true);
+    dispatcher.start();
+    thread->start();
+
+    int socketIDs[2];
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor dispatcher socketpair 1");
+    VSocket* serverSocket = new VSocket(socketIDs[0]); // owned by the session
+    VSocket slowClient(socketIDs[1]);
+    VClientSessionPtr slowSession(new TestReactorSession(&server, serverSocket));
+    thread->attachSession(slowSession, serverSocket);
+
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor dispatcher socketpair 2");
+    serverSocket = new VSocket(socketIDs[0]);
+    VSocket otherClient(socketIDs[1]);
+    VClientSessionPtr otherSession(new TestReactorSession(&server, serverSocket));
+    thread->attachSession(otherSession, serverSocket);
+
+    // A handler that blocks holds up a dispatcher worker, not the event loop: the other session is still served.
+    _sendToReactor(slowClient, 70);
+    _waitForNumDispatched(thread, 1);
+    _sendToReactor(otherClient, 10);
+    VMemoryStream otherReplies;
+    _readFromReactor(otherClient, otherReplies, 12);
+    VUNIT_ASSERT_EQUAL_LABELED(otherReplies.getEOFOffset(), CONST_S64(12), "reactor serves other sessions while a handler blocks");
+
+    // With two in flight, the slow session is not read from; its ordered messages wait behind the slow one.
+    _sendToReactor(slowClient, 20);
+    _sendToReactor(slowClient, 30);
+    VThread::sleep(VDuration::MILLISECOND() * 50);
+    VUNIT_ASSERT_EQUAL_LABELED((int) thread->getDispatchedIDs().size(), 2, "reactor holds ordered messages behind a blocked handler");
+
+    thread->holdSlowHandlers(false);
+    VMemoryStream   slowReplies;
+    VBinaryIOStream slowRepliesIO(slowReplies);
+    _readFromReactor(slowClient, slowReplies, 36);
+    VUNIT_ASSERT_EQUAL_LABELED(slowReplies.getEOFOffset(), CONST_S64(36), "reactor resumes a paused session");
+    if (slowReplies.getEOFOffset() == 36) {
+        const int kExpectedReplyIDs[] = { 71, 21, 31 };
+        slowRepliesIO.seek0();
+        for (int i = 0; i < 3; ++i) {
+            (void) slowRepliesIO.readS32();
+            VUNIT_ASSERT_EQUAL_LABELED(slowRepliesIO.readS32(), kExpectedReplyIDs[i], VSTRING_FORMAT("reactor dispatcher reply %d in order", i));
+            (void) slowRepliesIO.readS32();
+        }
+    }
+
+    std::vector<int> ids = thread->getDispatchedIDs();
+    VUNIT_ASSERT_TRUE_LABELED((ids.size() == 4) && (ids[0] == 70) && (ids[1] == 10) && (ids[2] == 20) && (ids[3] == 30), "reactor dispatcher order");
+
+    // A session closed while its handler runs is not deleted from under the handler.
+    thread->holdSlowHandlers(true);
+    _sendToReactor(slowClient, 70);
+    _waitForNumDispatched(thread, 5);
+    thread->stop();
+    VThread::sleep(VDuration::MILLISECOND() * 50); // the event loop has closed the session and is waiting for the handler
+    thread->holdSlowHandlers(false);
+    VUNIT_ASSERT_TRUE_LABELED(VThread::threadJoin(thread->threadID(), NULL), "reactor dispatcher thread joined");
+    VUNIT_ASSERT_EQUAL_LABELED((int) dispatcher.getQueueSize(), 0, "reactor dispatcher drained");
+    delete thread;
+    dispatcher.stop();
+#endif /* __linux__ */
+}
+
+void VMessageUnit::_testMessageReactorThreadFailure() {
+#ifdef __linux__
+    TestWireMessageFactory  factory;
+    TestReactorServer       server;
+    VMessageReactor         reactor("TestReactor", 2, &server, &factory, NULL);
+    int                     pipeIDs[2];
+
+    reactor.start();
+    VUNIT_ASSERT_EQUAL_LABELED(::pipe(pipeIDs), 0, "reactor failure pipe");
+
+    // Replacing a thread's epoll descriptor with a pipe makes its next epoll_wait fail.
+    for (int threadIndex = 0; threadIndex < 2; ++threadIndex) {
+        VMessageReactorThread* thread = reactor.mThreads[threadIndex];
+        (void) ::dup2(pipeIDs[0], thread->mPollID);
+        thread->_wakeUp();
+
+        bool isDead = false;
+        for (int i = 0; (i < 300) && ! isDead; ++i) {
+            VThread::sleep(VDuration::MILLISECOND() * 10);
+            VMutexLocker locker(&reactor.mThreadsMutex, "_testMessageReactorThreadFailure");
+            isDead = thread->mIsDead;
+        }
+        VUNIT_ASSERT_TRUE_LABELED(isDead, VSTRING_FORMAT("reactor marks failed thread %d dead", threadIndex));
+
+        int socketIDs[2];
+        VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "reactor failure socketpair");
+        VSocket* serverSocket = new VSocket(socketIDs[0]); // owned by the session
+        VSocket client(socketIDs[1]);
+        VClientSessionPtr session(new TestReactorSession(&server, serverSocket));
+
+        bool threw = false;
+        try {
+            reactor.attachSession(session, serverSocket);
+        } catch (const VException& /*ex*/) {
+            threw = true;
+        }
+
+        if (threadIndex == 0) {
+            // The session goes to the thread that is still running, which still holds it.
+            VUNIT_ASSERT_FALSE_LABELED(threw, "reactor attaches to surviving thread");
+            VUNIT_ASSERT_EQUAL_LABELED(reactor.mThreads[1]->getNumSessions(), 1, "reactor skips failed thread");
+        } else {
+            VUNIT_ASSERT_TRUE_LABELED(threw, "reactor refuses sessions when all threads failed");
+            VUNIT_ASSERT_EQUAL_LABELED(reactor.getNumSessions(), 0, "reactor failed threads shut down sessions");
+        }
+    }
+
+    // The failed threads ended on their own but are still ours; stop() joins and deletes them.
+    VBentoNode info;
+    reactor.getReactorInfo(info);
+    VUNIT_ASSERT_EQUAL_LABELED((int) info.getNodes().size(), 2, "reactor keeps failed threads");
+    reactor.stop();
+    VUNIT_ASSERT_EQUAL_LABELED(reactor.getNumSessions(), 0, "reactor stopped");
+
+    (void) ::close(pipeIDs[0]);
+    (void) ::close(pipeIDs[1]);
+#endif /* __linux__ */
+}
+
+void VMessageUnit::_testOutputThreadBatching() {
+#ifdef __linux__
+    VSocketID serverID;
+    VSocketID clientID;
+    if (! _connectLoopbackPair(serverID, clientID)) {
+        VUNIT_ASSERT_FAILURE("output thread batching: unable to connect loopback sockets");
+        return;
+    }
+
+    TestCountingSocket  serverSocket(serverID);
+    VSocket             client(clientID);
+    volatile bool       threadEnded = false;
+    TestOutputThread*   thread = new TestOutputThread(&serverSocket, &threadEnded);
+
+    // Queue more than two batches before the thread starts, so it drains them in one wakeup.
+    const int kNumMessages = 2 * VMessageOutputThread::kMaxBatchMessages + 10;
+    for (int i = 0; i < kNumMessages; ++i) {
+        VMessagePtr message(new TestWireMessage(i));
+        message->writeS32(i);
+        (void) thread->postOutputMessage(message);
+    }
+
+    // Then one message too large to batch.
+    const int kLargeDataSize = VMessageOutputThread::kMaxBatchDataSize * 2;
+    VMessagePtr largeMessage(new TestWireMessage(kNumMessages));
+    for (int i = 0; i < kLargeDataSize / 4; ++i) {
+        largeMessage->writeS32(i);
+    }
+    (void) thread->postOutputMessage(largeMessage);
+
+    thread->start();
+
+    const Vs64 kExpectedNumBytes = (kNumMessages * 12) + 8 + kLargeDataSize;
+    VMemoryStream   received;
+    VBinaryIOStream receivedIO(received);
+    _readFromReactor(client, received, kExpectedNumBytes);
+    VUNIT_ASSERT_EQUAL_LABELED(received.getEOFOffset(), kExpectedNumBytes, "output thread batching bytes");
+
+    // Three batches, the large message's data on its own, and nothing written uncorked until the queue was empty.
+    VUNIT_ASSERT_EQUAL_LABELED((int) serverSocket.mNumWrites, 4, "output thread batching write count");
+    VUNIT_ASSERT_EQUAL_LABELED((int) serverSocket.mNumCorkedWrites, 4, "output thread batching corked writes");
+    VUNIT_ASSERT_EQUAL_LABELED((int) serverSocket.mLargestWrite, kLargeDataSize, "output thread large message written directly");
+
+    bool inOrder = (received.getEOFOffset() == kExpectedNumBytes);
+    receivedIO.seek0();
+    for (int i = 0; inOrder && (i < kNumMessages); ++i) {
+        inOrder = (receivedIO.readS32() == 4) && (receivedIO.readS32() == i) && (receivedIO.readS32() == i);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(inOrder, "output thread batching order");
+
+    for (int i = 0; (i < 200) && serverSocket.isCorked(); ++i) {
+        VThread::sleep(VDuration::MILLISECOND() * 10);
+    }
+    VUNIT_ASSERT_FALSE_LABELED(serverSocket.isCorked(), "output thread uncorks when drained");
+
+    // The thread deletes itself once stopped; the socket must outlive it.
+    thread->stop();
+    for (int i = 0; (i < 200) && ! threadEnded; ++i) {
+        VThread::sleep(VDuration::MILLISECOND() * 10);
+    }
+    VUNIT_ASSERT_TRUE_LABELED(threadEnded, "output thread ended");
+#endif /* __linux__ */
+}
@@ -34,6 +34,20 @@ class VMessageUnit : public VUnit {
         */
         virtual void run();
 
+    private:
+
+        void _testLockFreeMessageQueue();
+        void _testBroadcastMessage();
+        void _testMessagePool();
+        void _testMessageDispatcher();
+        void _testMessageHandlerTable();
+        void _testMessageHandlerStorage();
+        void _testClientSessionStats();
+        void _testMessageReactor();
+        void _testMessageReactorStandby();
+        void _testMessageReactorDispatcher();
+        void _testMessageReactorThreadFailure();
+        void _testOutputThreadBatching();
 };
 
 #endif /* vmessageunit_h */
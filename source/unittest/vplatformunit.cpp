@@ -23,6 +23,7 @@ void VPlatformUnit::run() {
     this->_runMinMaxAbsCheck();
     this->_runTimeCheck();
     this->_runUtilitiesTest();
+    this->_runSocketWaitTest();
     this->_runSocketTests();
 }
 
@@ -141,6 +142,12 @@ void VPlatformUnit::_reportEnvironment() {
     this->logStatus("VAULT_MUTEX_LOCK_DELAY_CHECK is not set.");
 #endif
 
+#ifdef VAULT_MUTEX_BARE_LOCKS
+    this->logStatus("VAULT_MUTEX_BARE_LOCKS is set.");
+#else
+    this->logStatus("VAULT_MUTEX_BARE_LOCKS is not set.");
+#endif
+
 #ifdef VAULT_MEMORY_ALLOCATION_TRACKING_SUPPORT
     this->logStatus("VAULT_MEMORY_ALLOCATION_TRACKING_SUPPORT is set.");
 #else
@@ -421,6 +428,12 @@ void VPlatformUnit::_runUtilitiesTest() {
 
 #include "vsocket.h"
 
+#ifdef __linux__
+    #include <sys/socket.h>
+    #include <sys/resource.h>
+    #include <unistd.h>
+#endif
+
 // These helpers let us test a couple of things at once for a proposed IP address string.
 // E.g.: A proposed IPv4 string should also be seen as an IP string, and as NOT an IPv6 string. And vice versa.
 // This way we don't have to assert all three tests separately for each proposed address.
@@ -505,6 +518,97 @@ void VPlatformUnit::_runSocketTests() {
 
 }
 
+void VPlatformUnit::_runSocketWaitTest() {
+#ifdef __linux__
+    const struct timeval    kShortTimeOut = { 0, 50000 }; // 50ms
+    const Vu8               kData[4] = { 1, 2, 3, 4 };
+    Vu8                     buffer[4];
+    int                     socketIDs[2];
+
+    // A descriptor at or above FD_SETSIZE could not be waited on with select(); poll() has no such limit.
+    // We may have to raise the file descriptor limit to get one; the original limit is restored afterward.
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "wait socketpair 1");
+    const int highSocketID = FD_SETSIZE + 10;
+    struct rlimit originalFileLimit;
+    const bool gotFileLimit = (::getrlimit(RLIMIT_NOFILE, &originalFileLimit) == 0);
+    bool raisedFileLimit = false;
+    if (gotFileLimit && (originalFileLimit.rlim_cur <= static_cast<rlim_t>(highSocketID))) {
+        struct rlimit fileLimit = originalFileLimit;
+        fileLimit.rlim_cur = V_MIN(fileLimit.rlim_max, static_cast<rlim_t>(highSocketID + 1));
+        raisedFileLimit = (::setrlimit(RLIMIT_NOFILE, &fileLimit) == 0);
+    }
+
+    if (::dup2(socketIDs[0], highSocketID) != highSocketID) {
+        this->logStatus(VSTRING_FORMAT("Skipping wait test for socket ID %d: dup2 failed (file descriptor limit).", highSocketID));
+        (void) ::close(socketIDs[0]);
+        (void) ::close(socketIDs[1]);
+    } else {
+        (void) ::close(socketIDs[0]);
+        VSocket highSocket(highSocketID);
+        VSocket peer(socketIDs[1]);
+        highSocket.setReadTimeOut(kShortTimeOut);
+        (void) peer.write(kData, 4);
+        VUNIT_ASSERT_EQUAL_LABELED(highSocket.read(buffer, 4), 4, "wait on socket ID above FD_SETSIZE");
+        VUNIT_ASSERT_TRUE_LABELED(::memcmp(buffer, kData, 4) == 0, "wait on socket ID above FD_SETSIZE data");
+    } // the sockets close here, before the limit is lowered again
+
+    if (raisedFileLimit) {
+        (void) ::setrlimit(RLIMIT_NOFILE, &originalFileLimit);
+    }
+
+    // With a read timeout and no data, the wait times out rather than blocking.
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "wait socketpair 2");
+    VSocket reader(socketIDs[0]);
+    VSocket writer(socketIDs[1]);
+    reader.setReadTimeOut(kShortTimeOut);
+
+    VInstant waitStart;
+    bool timedOut = false;
+    try {
+        (void) reader.read(buffer, 4);
+    } catch (const VSocketClosedException& /*ex*/) {
+        // not a timeout; timedOut stays false
+    } catch (const VException& /*ex*/) {
+        timedOut = true;
+    }
+    VInstant waitEnd;
+    VUNIT_ASSERT_TRUE_LABELED(timedOut, "wait read timeout");
+    VUNIT_ASSERT_TRUE_LABELED((waitEnd - waitStart) >= VDuration::MILLISECOND() * 40, "wait read timeout duration");
+
+    // Without waiting when no timeout is set, read() goes straight to recv(); a set timeout is still honored.
+    reader.setWaitWhenNoTimeOut(false);
+    reader.clearReadTimeOut();
+    (void) writer.write(kData, 4);
+    VUNIT_ASSERT_EQUAL_LABELED(reader.read(buffer, 4), 4, "no-wait read");
+    VUNIT_ASSERT_TRUE_LABELED(::memcmp(buffer, kData, 4) == 0, "no-wait read data");
+
+    reader.setReadTimeOut(kShortTimeOut);
+    timedOut = false;
+    try {
+        (void) reader.read(buffer, 4);
+    } catch (const VException& /*ex*/) {
+        timedOut = true;
+    }
+    VUNIT_ASSERT_TRUE_LABELED(timedOut, "no-wait read still honors timeout");
+
+    // A descriptor closed out from under the socket polls as POLLNVAL, which is reported as EBADF, i.e. closed.
+    VUNIT_ASSERT_EQUAL_LABELED(::socketpair(AF_UNIX, SOCK_STREAM, 0, socketIDs), 0, "wait socketpair 3");
+    VSocket closedSocket(socketIDs[0]);
+    (void) ::close(socketIDs[0]);
+    (void) ::close(socketIDs[1]);
+    bool sawClosed = false;
+    try {
+        (void) closedSocket.read(buffer, 4);
+    } catch (const VSocketClosedException& /*ex*/) {
+        sawClosed = true;
+    } catch (const VException& /*ex*/) {
+        // any other failure leaves sawClosed false
+    }
+    closedSocket.setSockID(VSocket::kNoSocketID); // already closed above
+    VUNIT_ASSERT_TRUE_LABELED(sawClosed, "wait on closed descriptor reports socket closed");
+#endif /* __linux__ */
+}
+
 void VPlatformUnit::_runResolveAndConnectHostNameTest(const VString& hostName) {
     VStringVector names = VSocket::resolveHostName(hostName);
     VUNIT_ASSERT_FALSE(names.empty());
@@ -10,6 +10,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vstreamsunit.h"
 
 #include "vwritebufferedstream.h"
+#include "vreadbufferedstream.h"
 #include "vbinaryiostream.h"
 #include "vstreamcopier.h"
 #include "vexception.h"
@@ -33,6 +34,7 @@ void VStreamsUnit::run() {
     // of two memory streams for equality.
 
     this->_testWriteBufferedStream();
+    this->_testReadBufferedStream();
     this->_testStreamCopier();
     this->_testBufferOwnership();
     this->_testReadOnlyStream();
@@ -69,6 +71,90 @@ void VStreamsUnit::_testWriteBufferedStream() {
     VUNIT_ASSERT_EQUAL_LABELED(verifier.readS32(), 3456, "write-buffered stream check 3");
     VUNIT_ASSERT_EQUAL_LABELED(verifier.readS32(), 7890, "write-buffered stream check 4");
     VUNIT_ASSERT_EQUAL_LABELED(verifier.readS32(), 2468, "write-buffered stream check 5");
+
+    // A write-through stream sends a write at least as large as its buffer straight to the
+    // raw stream, after what it has buffered, without growing the buffer.
+    VMemoryStream           directRawStream;
+    VWriteBufferedStream    directStream(directRawStream, 16, VMemoryStream::kIncrement2x, true);
+    VBinaryIOStream         directIO(directStream);
+    VMemoryStream           largeData;
+    VBinaryIOStream         largeIO(largeData);
+    for (int i = 0; i < 10; ++i) {
+        largeIO.writeS32(i);
+    }
+
+    directIO.writeS32(-1);
+    (void) directStream.write(largeData.getBuffer(), 16);
+    VUNIT_ASSERT_EQUAL_LABELED(directRawStream.getEOFOffset(), CONST_S64(20), "write-buffered direct write flushes first");
+    VUNIT_ASSERT_EQUAL_LABELED(directStream.getEOFOffset(), CONST_S64(0), "write-buffered direct write leaves buffer empty");
+
+    directIO.writeS32(-2);
+    largeIO.seek0();
+    (void) VStream::streamCopy(largeIO, directIO, 40);
+    VUNIT_ASSERT_EQUAL_LABELED(directRawStream.getEOFOffset(), CONST_S64(64), "write-buffered direct stream copy");
+    VUNIT_ASSERT_EQUAL_LABELED(directStream.getBufferSize(), CONST_S64(16), "write-buffered direct stream copy does not grow buffer");
+
+    directIO.writeS32(-3);
+    VUNIT_ASSERT_EQUAL_LABELED(directRawStream.getEOFOffset(), CONST_S64(64), "write-buffered small write still buffered");
+    directIO.flush();
+
+    VBinaryIOStream directVerifier(directRawStream);
+    directVerifier.seek0();
+    VUNIT_ASSERT_EQUAL_LABELED(directVerifier.readS32(), -1, "write-buffered direct check 1");
+    for (int i = 0; i < 4; ++i) {
+        VUNIT_ASSERT_EQUAL_LABELED(directVerifier.readS32(), i, "write-buffered direct check write");
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(directVerifier.readS32(), -2, "write-buffered direct check 2");
+    for (int i = 0; i < 10; ++i) {
+        VUNIT_ASSERT_EQUAL_LABELED(directVerifier.readS32(), i, "write-buffered direct check stream copy");
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(directVerifier.readS32(), -3, "write-buffered direct check 3");
+}
+
+void VStreamsUnit::_testReadBufferedStream() {
+    // Test VReadBufferedStream. We'll have it buffer reads from a memory
+    // stream, using a small buffer so that refills, direct reads, and
+    // buffer growth are all exercised.
+    VMemoryStream   rawStream;
+    VBinaryIOStream rawIO(rawStream);
+    for (int i = 0; i < 10; ++i) {
+        rawIO.writeS32(i);
+    }
+    rawStream.seek0();
+
+    VReadBufferedStream bufferedStream(rawStream, 16);
+    VBinaryIOStream     io(bufferedStream);
+
+    VUNIT_ASSERT_EQUAL_LABELED(io.readS32(), 0, "read-buffered stream check 0");
+    VUNIT_ASSERT_EQUAL_LABELED(bufferedStream.getIOOffset(), CONST_S64(4), "read-buffered stream offset");
+    VUNIT_ASSERT_EQUAL_LABELED(bufferedStream.getNumBufferedBytes(), 12, "read-buffered stream fills buffer");
+    VUNIT_ASSERT_EQUAL_LABELED(bufferedStream.available(), CONST_S64(36), "read-buffered stream available");
+    VUNIT_ASSERT_EQUAL_LABELED(io.readS32(), 1, "read-buffered stream check 1");
+
+    // Peek a frame larger than the buffer; it must grow and keep the data in order.
+    Vu8* frame = bufferedStream.peek(24);
+    VReadOnlyMemoryStream frameStream(frame, 24);
+    VBinaryIOStream frameIO(frameStream);
+    VUNIT_ASSERT_EQUAL_LABELED(frameIO.readS32(), 2, "read-buffered stream peek 2");
+    frameIO.skip(16);
+    VUNIT_ASSERT_EQUAL_LABELED(frameIO.readS32(), 7, "read-buffered stream peek 7");
+    bufferedStream.consume(24);
+    VUNIT_ASSERT_EQUAL_LABELED(bufferedStream.getIOOffset(), CONST_S64(32), "read-buffered stream offset after consume");
+
+    VUNIT_ASSERT_TRUE_LABELED(io.skip(4), "read-buffered stream skip");
+    VUNIT_ASSERT_EQUAL_LABELED(io.readS32(), 9, "read-buffered stream check 9");
+
+    Vu8 extra;
+    VUNIT_ASSERT_EQUAL_LABELED(bufferedStream.read(&extra, 1), CONST_S64(0), "read-buffered stream EOF");
+
+    try {
+        (void) bufferedStream.peek(1);
+        VUNIT_ASSERT_FAILURE("read-buffered stream peek past EOF");
+    } catch (const VEOFException& /*ex*/) {
+        VUNIT_ASSERT_SUCCESS("read-buffered stream peek past EOF");
+    } catch (...) {
+        VUNIT_ASSERT_FAILURE("read-buffered stream peek past EOF (unexpected exception type)");
+    }
 }
 
 void VStreamsUnit::_testStreamCopier() {
@@ -37,6 +37,7 @@ class VStreamsUnit : public VUnit {
     private:
 
         void _testWriteBufferedStream();
+        void _testReadBufferedStream();
         void _testStreamCopier();
         void _testBufferOwnership();
         void _testReadOnlyStream();
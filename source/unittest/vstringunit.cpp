@@ -808,6 +808,24 @@ void VStringUnit::run() {
     forcedToEmptyString.substringInPlace(0, 2);
     VUNIT_ASSERT_EQUAL_LABELED(forcedToEmptyString, VString::EMPTY(), "substring-in-place of a truncated to empty string");
 
+    // clearKeepingBuffer() empties a string without giving up its heap buffer.
+    VString clearedString;
+    for (int i = 0; i < 1000; ++i) {
+        clearedString += 'x';
+    }
+
+    const char* clearedBuffer = clearedString.chars();
+    clearedString.clearKeepingBuffer();
+    VUNIT_ASSERT_TRUE_LABELED(clearedString.isEmpty() && (clearedString.length() == 0) && (clearedString == VString::EMPTY()), "clear keeping buffer is empty");
+    VUNIT_ASSERT_EQUAL_LABELED(clearedString.getNumCodePoints(), 0, "clear keeping buffer has no code points");
+    clearedString += "refilled";
+    VUNIT_ASSERT_EQUAL_LABELED(clearedString, "refilled", "clear keeping buffer refilled");
+    VUNIT_ASSERT_TRUE_LABELED(clearedString.chars() == clearedBuffer, "clear keeping buffer kept the buffer");
+    clearedString.clearKeepingBuffer();
+    shouldBecomeEmpty = "123456789";
+    clearedString.getSubstring(shouldBecomeEmpty, 0, 2);
+    VUNIT_ASSERT_EQUAL_LABELED(shouldBecomeEmpty, VString::EMPTY(), "substring of a string cleared keeping its buffer");
+
     // New API: split()
 
     VStringVector splitResult;
@@ -1179,5 +1197,118 @@ void VStringUnit::run() {
     VUNIT_ASSERT_EQUAL_LABELED((*(localeExample.begin() + 1)).intValue(), 0xDF, "localeExample[1]");
     VUNIT_ASSERT_EQUAL_LABELED((*(localeExample.begin() + 2)).intValue(), 0x6C34, "localeExample[2]");
     VUNIT_ASSERT_EQUAL_LABELED((*(localeExample.begin() + 3)).intValue(), 0x0001D10B, "localeExample[3]");
+
+    this->_testScratchScope();
+}
+
+void VStringUnit::_testScratchScope() {
+    // Formatting outside a scope makes ordinary heap or internal strings.
+    VString heapFormatted(VSTRING_ARGS("scratch test %d is longer than the internal buffer", 1));
+    VUNIT_ASSERT_EQUAL_LABELED(heapFormatted, "scratch test 1 is longer than the internal buffer", "format outside scratch scope");
+    VUNIT_ASSERT_FALSE_LABELED(heapFormatted._isScratchBuffer(), "format outside scratch scope uses heap");
+    VUNIT_ASSERT_EQUAL_LABELED(VStringScratchScope::getNumBytesInUse(), 0, "no scratch bytes in use outside scope");
+
+    VString escaped;
+    VString* escapedByPointer = NULL;
+    {
+        VStringScratchScope scope;
+
+        VString shortString(VSTRING_ARGS("%d", 42));
+        VUNIT_ASSERT_EQUAL_LABELED(shortString, "42", "short format in scratch scope");
+        VUNIT_ASSERT_TRUE_LABELED(shortString.mU.mI.mUsingInternalBuffer, "short format in scratch scope uses internal buffer");
+
+        VString longString(VSTRING_ARGS("scratch test %d is longer than the internal buffer", 2));
+        VUNIT_ASSERT_EQUAL_LABELED(longString, "scratch test 2 is longer than the internal buffer", "long format in scratch scope");
+        VUNIT_ASSERT_TRUE_LABELED(longString._isScratchBuffer(), "long format in scratch scope uses arena");
+        VUNIT_ASSERT_TRUE_LABELED(VStringScratchScope::getNumBytesInUse() > longString.length(), "arena bytes in use");
+
+        // A copy must not share the arena buffer, and appending moves the text to the heap.
+        escaped = longString;
+        VUNIT_ASSERT_FALSE_LABELED(escaped._isScratchBuffer(), "copy of scratch string uses heap");
+        longString += " and then some more";
+        VUNIT_ASSERT_EQUAL_LABELED(longString, "scratch test 2 is longer than the internal buffer and then some more", "append to scratch string");
+        VUNIT_ASSERT_FALSE_LABELED(longString._isScratchBuffer(), "append to scratch string moves it to heap");
+
+        {
+            VStringScratchScope innerScope;
+            int outerBytesInUse = VStringScratchScope::getNumBytesInUse();
+            VString innerString(VSTRING_ARGS("inner scratch string number %d of many", 3));
+            VUNIT_ASSERT_TRUE_LABELED(innerString._isScratchBuffer(), "nested scope uses arena");
+            VUNIT_ASSERT_TRUE_LABELED(VStringScratchScope::getNumBytesInUse() > outerBytesInUse, "nested scope allocates above outer");
+        }
+
+        // Strings of the outer scope that go away while an inner scope is open must not hide the inner scope's own.
+        {
+            VString* outerString1 = new VString(VSTRING_ARGS("outer scratch string number %d of a pair", 1));
+            VString* outerString2 = new VString(VSTRING_ARGS("outer scratch string number %d of a pair", 2));
+            VString* innerKept = NULL;
+            {
+                VStringScratchScope innerScope;
+                delete outerString2;
+                delete outerString1;
+                innerKept = new VString(VSTRING_ARGS("inner scratch string %d outlives its scope", 6));
+                VUNIT_ASSERT_TRUE_LABELED(innerKept->_isScratchBuffer(), "inner string after outer releases uses arena");
+            }
+
+            VUNIT_ASSERT_FALSE_LABELED(innerKept->_isScratchBuffer(), "inner string after outer releases moved to heap");
+            VString reuse(VSTRING_ARGS("%s", "yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy"));
+            VUNIT_ASSERT_EQUAL_LABELED(*innerKept, "inner scratch string 6 outlives its scope", "inner string after outer releases intact");
+            delete innerKept;
+        }
+
+        // This one outlives the scope, so it must be moved to the heap when the scope ends.
+        escapedByPointer = new VString(VSTRING_ARGS("scratch test %d escapes its scope by pointer", 4));
+        VUNIT_ASSERT_TRUE_LABELED(escapedByPointer->_isScratchBuffer(), "escaping string starts in arena");
+
+        char* orphan = VString(VSTRING_ARGS("scratch test %d is orphaned to the caller", 5)).orphanDataBuffer();
+        VUNIT_ASSERT_EQUAL_LABELED(VString(orphan), "scratch test 5 is orphaned to the caller", "orphaned scratch buffer");
+        delete [] orphan;
+
+        // Fill the arena; strings beyond its capacity fall back to the heap.
+        std::vector<VString*> many;
+        for (int i = 0; i < 200; ++i) {
+            many.push_back(new VString(VSTRING_ARGS("scratch test filler string %d with some padding to use up space", i)));
+        }
+        VUNIT_ASSERT_FALSE_LABELED(many.back()->_isScratchBuffer(), "arena overflow falls back to heap");
+        for (int i = 0; i < 200; ++i) {
+            VUNIT_ASSERT_EQUAL_LABELED(*many[i], VSTRING_FORMAT("scratch test filler string %d with some padding to use up space", i), "arena filler string");
+            delete many[i];
+        }
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED(VStringScratchScope::getNumBytesInUse(), 0, "scratch bytes released at scope end");
+    VUNIT_ASSERT_EQUAL_LABELED(escaped, "scratch test 2 is longer than the internal buffer", "copy survives scope");
+    VUNIT_ASSERT_FALSE_LABELED(escapedByPointer->_isScratchBuffer(), "escaped string moved to heap");
+    VUNIT_ASSERT_EQUAL_LABELED(*escapedByPointer, "scratch test 4 escapes its scope by pointer", "escaped string survives scope");
+
+    // Reuse the arena space and make sure the escaped string was not disturbed.
+    {
+        VStringScratchScope scope;
+        VString reuse(VSTRING_ARGS("%s", "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"));
+        VUNIT_ASSERT_EQUAL_LABELED(*escapedByPointer, "scratch test 4 escapes its scope by pointer", "escaped string unaffected by arena reuse");
+    }
+
+    delete escapedByPointer;
+
+    // The arena is allocated by the first scope, not by formatting outside one. (Gather the results
+    // before asserting, since the assertions themselves log, which opens a scope.)
+    VStringScratchScope::releaseThreadArena();
+    const bool arenaAfterRelease = VStringScratchScope::hasThreadArena();
+    VString formattedWithoutArena(VSTRING_ARGS("scratch test %d formats without an arena", 7));
+    const bool arenaAfterFormat = VStringScratchScope::hasThreadArena();
+    bool arenaInScope = false;
+    bool arenaUsedInScope = false;
+    {
+        VStringScratchScope scope;
+        arenaInScope = VStringScratchScope::hasThreadArena();
+        VString formattedInScope(VSTRING_ARGS("scratch test %d formats in a new arena", 8));
+        arenaUsedInScope = formattedInScope._isScratchBuffer();
+    }
+
+    VUNIT_ASSERT_FALSE_LABELED(arenaAfterRelease, "scratch arena released");
+    VUNIT_ASSERT_FALSE_LABELED(arenaAfterFormat, "scratch arena not allocated by formatting outside scope");
+    VUNIT_ASSERT_EQUAL_LABELED(formattedWithoutArena, "scratch test 7 formats without an arena", "format without scratch arena");
+    VUNIT_ASSERT_TRUE_LABELED(arenaInScope, "scratch arena allocated by first scope");
+    VUNIT_ASSERT_TRUE_LABELED(arenaUsedInScope, "scratch arena used after lazy allocation");
 }
 
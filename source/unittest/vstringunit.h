@@ -34,6 +34,10 @@ class VStringUnit : public VUnit {
         */
         virtual void run();
 
+    private:
+
+        void _testScratchScope();
+
 };
 
 #endif /* vstringunit_h */
@@ -11,8 +11,17 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vthread.h"
 #include "vmutex.h"
 #include "vmutexlocker.h"
+#include "vreadwritelock.h"
+#include "vthreadpool.h"
+#include "vtimerwheel.h"
 #include "vsemaphore.h"
+#include "vconditionvariable.h"
+#include "vmessagequeue.h"
 #include "vexception.h"
+#include "vbento.h"
+#include "vsettings.h"
+#include "vmemorystream.h"
+#include "vtextiostream.h"
 
 class TestThreadClass : public VThread {
     public:
@@ -65,8 +74,13 @@ void TestThreadClass::run() {
         --mNumIterations;
     }
 
+#ifndef VAULT_MUTEX_BARE_LOCKS
     if (mMutexToLock != NULL)
         mOwnerUnit->test(mMutexToLock->isLockedByCurrentThread(), "TestThreadClass sees that it has the lock");
+#endif
+
+    mOwnerUnit->test(VThread::getCurrentThread() == this, "TestThreadClass is the current thread");
+    mOwnerUnit->test(VThread::getCurrentThreadName() == mName, "TestThreadClass current thread name");
 
     // Now our thread will finish, terminate, and delete this.
 
@@ -79,6 +93,79 @@ void TestThreadClass::run() {
     mOwnerUnit->logStatus(info);
 }
 
+/**
+Takes a read lock and notes that it got it, so the unit test can see whether the
+read was allowed in alongside, or held off by, what the test thread holds.
+*/
+class TestReadLockThread : public VThread {
+    public:
+
+        TestReadLockThread(VReadWriteLock* rwlock, volatile bool* gotReadLock) :
+            VThread("TestReadLockThread", "vault.threads.TestReadLockThread", kDontDeleteSelfAtEnd, kCreateThreadJoinable, NULL),
+            mLock(rwlock),
+            mGotReadLock(gotReadLock) {
+            *mGotReadLock = false;
+        }
+        ~TestReadLockThread() {}
+
+        virtual void run() {
+            VReadLocker locker(mLock, "TestReadLockThread::run");
+            *mGotReadLock = true;
+        }
+
+    private:
+
+        TestReadLockThread(const TestReadLockThread&); // not copyable
+        TestReadLockThread& operator=(const TestReadLockThread&); // not assignable
+
+        VReadWriteLock* mLock;
+        volatile bool*  mGotReadLock;
+};
+
+// Task functions for the VThreadPool tests.
+static void _incrementCounter(std::atomic<int>* counter) {
+    ++(*counter);
+}
+
+static void _countCompletion(std::atomic<int>* counter, VThreadPoolFuturePtr future) {
+    if (future->isDone()) {
+        ++(*counter);
+    }
+}
+
+static void _addIndex(std::atomic<Vs64>* sum, int index) {
+    (*sum) += index;
+}
+
+static void _throwRangeException() {
+    throw VRangeException("VThreadsUnit pool task failure");
+}
+
+static void _submitAndWait(VThreadPool* pool, std::atomic<int>* counter) {
+    // Waiting on a worker runs other tasks meanwhile, so this cannot starve the pool.
+    VThreadPoolFuturePtr future = pool->submit(std::bind(_incrementCounter, counter));
+    future->wait();
+}
+
+// Task functions for the VTimerWheel tests.
+static void _recordFiringOrder(std::atomic<int>* sequence, std::atomic<int>* position) {
+    *position = ++(*sequence);
+}
+
+static void _recordFiringDelay(VInstant scheduledTime, std::atomic<Vs64>* delayMilliseconds) {
+    const VInstant now;
+    *delayMilliseconds = (now - scheduledTime).getDurationMilliseconds();
+}
+
+// Task function and predicate for the VConditionVariable and VCountingSemaphore tests.
+static void _releasePermits(VCountingSemaphore* semaphore, int count) {
+    semaphore->release(count);
+}
+
+static bool _isFlagSet(const bool* flag) {
+    return *flag;
+}
+
 VThreadsUnit::VThreadsUnit(bool logOnSuccess, bool throwOnError) :
     VUnit("VThreadsUnit", logOnSuccess, throwOnError) {
 }
@@ -104,6 +191,121 @@ void VThreadsUnit::run() {
         VUNIT_ASSERT_FALSE_LABELED(locker.isLocked(), "mutex locker explicit unlock");
     }
 
+    // Lock timing is sampled per thread; locking must behave the same whether or not a lock is timed.
+    const int sampleInterval = VMutex::getLockTimingSampleInterval();
+    VMutex::setLockTimingSampleInterval(0);
+    {
+        VMutexLocker locker(&mutex1, "VThreadsUnit untimed locker");
+        VUNIT_ASSERT_TRUE_LABELED(locker.isLocked(), "mutex locker untimed lock");
+    }
+
+    VMutex::setLockTimingSampleInterval(3);
+    int numSampledLocks = 0;
+    for (int i = 0; i < 10; ++i) {
+        VMutexLocker locker(&mutex1, "VThreadsUnit sampled locker");
+        if (locker.isLocked()) {
+            ++numSampledLocks;
+        }
+    }
+    VUNIT_ASSERT_EQUAL_LABELED(numSampledLocks, 10, "mutex locker sampled locks");
+    VMutex::setLockTimingSampleInterval(sampleInterval);
+
+#ifndef VAULT_MUTEX_BARE_LOCKS
+    // Contention profiling counts each lock of a named mutex and reports it by name.
+    VMutex profiledMutex("VThreadsUnit profiled mutex");
+    VMutex::resetContentionInfo();
+    VMutex::setContentionProfilingEnabled(true);
+    for (int i = 0; i < 5; ++i) {
+        VMutexLocker locker(&profiledMutex, "VThreadsUnit profiled locker");
+    }
+    VMutex::setContentionProfilingEnabled(false);
+    {
+        VMutexLocker locker(&profiledMutex, "VThreadsUnit unprofiled locker");
+    }
+
+    VBentoNode mutexesInfo;
+    VMutex::getMutexesInfo(mutexesInfo);
+    const VBentoNode* profiledInfo = NULL;
+    for (VBentoNodePtrVector::const_iterator i = mutexesInfo.getNodes().begin(); i != mutexesInfo.getNodes().end(); ++i) {
+        if ((*i)->getString("name", VString::EMPTY()) == "VThreadsUnit profiled mutex") {
+            profiledInfo = *i;
+        }
+    }
+
+    VUNIT_ASSERT_TRUE_LABELED(profiledInfo != NULL, "mutex profiling info present");
+    if (profiledInfo != NULL) {
+        VUNIT_ASSERT_EQUAL_LABELED(profiledInfo->getS64("acquisitions"), CONST_S64(5), "mutex profiling acquisitions");
+        VUNIT_ASSERT_EQUAL_LABELED(profiledInfo->getS64("contended"), CONST_S64(0), "mutex profiling uncontended");
+        const Vs64Array& holdHistogram = profiledInfo->getS64Array("holdHistogram");
+        Vs64 numHolds = 0;
+        for (Vs64Array::const_iterator i = holdHistogram.begin(); i != holdHistogram.end(); ++i) {
+            numHolds += *i;
+        }
+        VUNIT_ASSERT_EQUAL_LABELED(numHolds, CONST_S64(5), "mutex profiling hold histogram");
+    }
+
+    // Mutexes named per instance but sharing a profiling key are counted together, under the key.
+    VMutex keyedMutex1("VThreadsUnit keyed mutex[1]", false, "VThreadsUnit keyed mutex");
+    VMutex keyedMutex2("VThreadsUnit keyed mutex[2]", false, "VThreadsUnit keyed mutex");
+    VMutex::setContentionProfilingEnabled(true);
+    {
+        VMutexLocker locker(&keyedMutex1, "VThreadsUnit keyed locker 1");
+    }
+    {
+        VMutexLocker locker(&keyedMutex2, "VThreadsUnit keyed locker 2");
+    }
+    VMutex::setContentionProfilingEnabled(false);
+
+    VBentoNode keyedInfo;
+    VMutex::getMutexesInfo(keyedInfo);
+    Vs64 numKeyedAcquisitions = -1;
+    bool foundInstanceName = false;
+    for (VBentoNodePtrVector::const_iterator i = keyedInfo.getNodes().begin(); i != keyedInfo.getNodes().end(); ++i) {
+        const VString name = (*i)->getString("name", VString::EMPTY());
+        if (name == "VThreadsUnit keyed mutex") {
+            numKeyedAcquisitions = (*i)->getS64("acquisitions");
+        } else if (name.startsWith("VThreadsUnit keyed mutex[")) {
+            foundInstanceName = true;
+        }
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED(numKeyedAcquisitions, CONST_S64(2), "mutex profiling by key");
+    VUNIT_ASSERT_FALSE_LABELED(foundInstanceName, "mutex profiling ignores instance names with a key");
+
+    // A mutex may be renamed while its caller holds it (it is not recursive, so this would deadlock
+    // if setName() locked it). The hold in progress counts under the old name, the next lock under the new.
+    VMutex renamedMutex("VThreadsUnit renamed mutex (old)");
+    VMutex::setContentionProfilingEnabled(true);
+    {
+        VMutexLocker locker(&renamedMutex, "VThreadsUnit renaming locker");
+        renamedMutex.setName("VThreadsUnit renamed mutex (new)");
+    }
+    {
+        VMutexLocker locker(&renamedMutex, "VThreadsUnit renamed locker");
+    }
+    VMutex::setContentionProfilingEnabled(false);
+
+    VBentoNode renamedInfo;
+    VMutex::getMutexesInfo(renamedInfo);
+    Vs64 numOldNameHolds = -1;
+    Vs64 numNewNameAcquisitions = -1;
+    for (VBentoNodePtrVector::const_iterator i = renamedInfo.getNodes().begin(); i != renamedInfo.getNodes().end(); ++i) {
+        const VString name = (*i)->getString("name", VString::EMPTY());
+        if (name == "VThreadsUnit renamed mutex (old)") {
+            const Vs64Array& holdHistogram = (*i)->getS64Array("holdHistogram");
+            numOldNameHolds = 0;
+            for (Vs64Array::const_iterator j = holdHistogram.begin(); j != holdHistogram.end(); ++j) {
+                numOldNameHolds += *j;
+            }
+        } else if (name == "VThreadsUnit renamed mutex (new)") {
+            numNewNameAcquisitions = (*i)->getS64("acquisitions");
+        }
+    }
+
+    VUNIT_ASSERT_EQUAL_LABELED(numOldNameHolds, CONST_S64(1), "mutex renamed while held records hold under old name");
+    VUNIT_ASSERT_EQUAL_LABELED(numNewNameAcquisitions, CONST_S64(1), "mutex renamed while held profiles under new name");
+#endif
+
     // Test creating a couple of threads, join to them, and verify that they ran.
     // We give each one a different sleep duration, so they behave a little differently.
     // Note that since we don't have additional machinery in place to keep track of
@@ -159,6 +361,12 @@ void VThreadsUnit::run() {
     VUNIT_ASSERT_EQUAL_LABELED((Vs64) thread3ID, (Vs64) thread3Self, "thread 3 self/id match");
     VUNIT_ASSERT_NOT_EQUAL_LABELED((Vs64) thread3ID, CONST_S64(0), "thread 3 self/id non-zero");
 
+    // The current thread name is cached per thread, so repeated calls must agree.
+    VString currentThreadName = VThread::getCurrentThreadName();
+    VUNIT_ASSERT_FALSE_LABELED(currentThreadName.isEmpty(), "current thread name");
+    VUNIT_ASSERT_EQUAL_LABELED(VThread::getCurrentThreadName(), currentThreadName, "current thread name is stable");
+
+#ifndef VAULT_MUTEX_BARE_LOCKS
     {
         // mutex and locker scope
         // Test the ability to examine a mutex and see if it is locked by the current thread.
@@ -191,6 +399,243 @@ void VThreadsUnit::run() {
         mutexX._unlock();
         VUNIT_ASSERT_FALSE_LABELED(mutexX.isLockedByCurrentThread(), "9 - local mutex not locked by current thread");
     }
+#endif /* VAULT_MUTEX_BARE_LOCKS */
+
+    {
+        // read-write lock scope
+        // A reader gets in while another reader holds the lock, but not while a writer does.
+        VReadWriteLock rwlock("VThreadsUnit rwlock", VReadWriteLock::kPreferWriters);
+        volatile bool gotReadLock = false;
+
+        /* read locker scope */ {
+            VReadLocker locker(&rwlock, "VThreadsUnit reader");
+            TestReadLockThread reader(&rwlock, &gotReadLock);
+            reader.start();
+            reader.join();
+            VUNIT_ASSERT_TRUE_LABELED(gotReadLock, "read lock shared with another reader");
+        }
+
+        /* write locker scope */ {
+            VWriteLocker locker(&rwlock, "VThreadsUnit writer");
+            TestReadLockThread reader(&rwlock, &gotReadLock);
+            reader.start();
+            VThread::sleep(100 * VDuration::MILLISECOND());
+            VUNIT_ASSERT_FALSE_LABELED(gotReadLock, "read lock held off by writer");
+
+            locker.unlock();
+            reader.join();
+            VUNIT_ASSERT_TRUE_LABELED(gotReadLock, "read lock acquired after writer");
+        }
+    }
+
+    {
+        // thread pool scope
+        VThreadPool pool("VThreadsUnit.pool", 3);
+        pool.start();
+
+        std::atomic<int> numRun(0);
+        std::atomic<int> numCompleted(0);
+        std::vector<VThreadPoolFuturePtr> futures;
+        for (int i = 0; i < 50; ++i) {
+            futures.push_back(pool.submit(std::bind(_incrementCounter, &numRun), std::bind(_countCompletion, &numCompleted, std::placeholders::_1)));
+        }
+
+        for (std::vector<VThreadPoolFuturePtr>::const_iterator i = futures.begin(); i != futures.end(); ++i) {
+            (*i)->wait();
+        }
+
+        VUNIT_ASSERT_EQUAL_LABELED(numRun.load(), 50, "thread pool tasks run");
+
+        // A task may wait on tasks it submits.
+        std::atomic<int> numNested(0);
+        futures.clear();
+        for (int i = 0; i < 10; ++i) {
+            futures.push_back(pool.submit(std::bind(_submitAndWait, &pool, &numNested)));
+        }
+
+        for (std::vector<VThreadPoolFuturePtr>::const_iterator i = futures.begin(); i != futures.end(); ++i) {
+            (*i)->wait();
+        }
+
+        VUNIT_ASSERT_EQUAL_LABELED(numNested.load(), 10, "thread pool nested tasks run");
+
+        VThreadPoolFuturePtr failed = pool.submit(_throwRangeException);
+        bool caughtFailure = false;
+        try {
+            failed->wait();
+        } catch (const VRangeException&) {
+            caughtFailure = true;
+        }
+
+        VUNIT_ASSERT_TRUE_LABELED(caughtFailure, "thread pool task exception rethrown by wait");
+        VUNIT_ASSERT_FALSE_LABELED(failed->succeeded(), "thread pool failed task not succeeded");
+
+        std::atomic<Vs64> sum(0);
+        pool.parallelFor(0, 1000, std::bind(_addIndex, &sum, std::placeholders::_1));
+        VUNIT_ASSERT_EQUAL_LABELED(sum.load(), CONST_S64(499500), "thread pool parallelFor");
+
+        int numPoolThreads = 0;
+        VBentoNode threadsInfo;
+        VThread::getThreadsInfo(threadsInfo);
+        for (VBentoNodePtrVector::const_iterator i = threadsInfo.getNodes().begin(); i != threadsInfo.getNodes().end(); ++i) {
+            if ((*i)->getString("pool", VString::EMPTY()) == "VThreadsUnit.pool") {
+                ++numPoolThreads;
+            }
+        }
+
+        VUNIT_ASSERT_EQUAL_LABELED(numPoolThreads, 3, "thread pool workers in threads info");
+
+        pool.stop();
+        VUNIT_ASSERT_EQUAL_LABELED(numCompleted.load(), 50, "thread pool completion callbacks");
+
+        // No worker is left after stop(), so a late task runs on the submitting thread instead of waiting forever.
+        VThreadPoolFuturePtr late = pool.submit(std::bind(_incrementCounter, &numRun), std::bind(_countCompletion, &numCompleted, std::placeholders::_1));
+        VUNIT_ASSERT_TRUE_LABELED(late->isDone(), "thread pool task after stop done on return");
+        late->wait();
+        VUNIT_ASSERT_EQUAL_LABELED(numRun.load(), 51, "thread pool task after stop run");
+        VUNIT_ASSERT_EQUAL_LABELED(numCompleted.load(), 51, "thread pool task after stop completion");
+    }
+
+    {
+        // unstarted thread pool scope
+        VThreadPool pool("VThreadsUnit.unstarted", 2);
+        std::atomic<int> numRun(0);
+
+        // Tasks queued on a pool that never starts still complete when it is stopped.
+        VThreadPoolFuturePtr early = pool.submit(std::bind(_incrementCounter, &numRun));
+        VUNIT_ASSERT_FALSE_LABELED(early->isDone(), "unstarted thread pool task queued");
+        pool.stop();
+        VUNIT_ASSERT_TRUE_LABELED(early->isDone(), "unstarted thread pool task done after stop");
+        early->wait();
+        VUNIT_ASSERT_EQUAL_LABELED(numRun.load(), 1, "unstarted thread pool task run");
+    }
+
+    {
+        // timer wheel scope
+        VTimerWheel wheel("VThreadsUnit.wheel", VDuration::MILLISECOND());
+        wheel.start();
+
+        std::atomic<int> sequence(0);
+        std::atomic<int> first(0);
+        std::atomic<int> second(0);
+        std::atomic<int> third(0);
+        std::atomic<int> cancelled(0);
+        std::atomic<Vs64> delayMilliseconds(-1);
+        (void) wheel.schedule(150 * VDuration::MILLISECOND(), std::bind(_recordFiringOrder, &sequence, &third)); // far enough out to be moved down a wheel
+        (void) wheel.schedule(10 * VDuration::MILLISECOND(), std::bind(_recordFiringOrder, &sequence, &first));
+        (void) wheel.schedule(50 * VDuration::MILLISECOND(), std::bind(_recordFiringOrder, &sequence, &second));
+        (void) wheel.schedule(100 * VDuration::MILLISECOND(), std::bind(_recordFiringDelay, VInstant(), &delayMilliseconds));
+        VTimerID cancelledTimer = wheel.schedule(100 * VDuration::MILLISECOND(), std::bind(_recordFiringOrder, &sequence, &cancelled));
+        VUNIT_ASSERT_TRUE_LABELED(wheel.cancel(cancelledTimer), "timer wheel cancel pending timer");
+        VUNIT_ASSERT_FALSE_LABELED(wheel.cancel(cancelledTimer), "timer wheel cancel twice");
+
+        std::atomic<int> numRepeats(0);
+        VTimerID repeatingTimer = wheel.scheduleRepeating(20 * VDuration::MILLISECOND(), std::bind(_incrementCounter, &numRepeats));
+
+        VThread::sleep(300 * VDuration::MILLISECOND());
+        VUNIT_ASSERT_EQUAL_LABELED(first.load(), 1, "timer wheel first timer");
+        VUNIT_ASSERT_EQUAL_LABELED(second.load(), 2, "timer wheel second timer");
+        VUNIT_ASSERT_EQUAL_LABELED(third.load(), 3, "timer wheel third timer");
+        VUNIT_ASSERT_EQUAL_LABELED(cancelled.load(), 0, "timer wheel cancelled timer did not fire");
+        VUNIT_ASSERT_TRUE_LABELED(delayMilliseconds.load() >= 100, "timer wheel timer not early");
+        VUNIT_ASSERT_TRUE_LABELED(numRepeats.load() >= 5, "timer wheel repeating timer");
+
+        VUNIT_ASSERT_TRUE_LABELED(wheel.cancel(repeatingTimer), "timer wheel cancel repeating timer");
+        const int numRepeatsAtCancel = numRepeats.load();
+        VThread::sleep(100 * VDuration::MILLISECOND());
+        VUNIT_ASSERT_EQUAL_LABELED(numRepeats.load(), numRepeatsAtCancel, "timer wheel repeating timer stopped");
+        VUNIT_ASSERT_EQUAL_LABELED(wheel.getNumTimers(), 0, "timer wheel empty");
+
+        wheel.stop();
+    }
+
+    {
+        // condition variable and counting semaphore scope
+        VMutex mutex("VThreadsUnit.conditionMutex");
+        VConditionVariable condition;
+        bool flag = false;
+        /* locker scope */ {
+            VMutexLocker locker(&mutex, "VThreadsUnit condition variable");
+            VUNIT_ASSERT_FALSE_LABELED(condition.waitFor(&mutex, std::bind(_isFlagSet, &flag), 20 * VDuration::MILLISECOND()), "condition variable predicate wait times out");
+            flag = true;
+            VUNIT_ASSERT_TRUE_LABELED(condition.waitFor(&mutex, std::bind(_isFlagSet, &flag), VDuration::ZERO()), "condition variable predicate already true");
+
+            // Timeouts run on the monotonic clock, so they still elapse while VInstant time is frozen.
+            flag = false;
+            VInstant::freezeTime(VInstant());
+            VUNIT_ASSERT_FALSE_LABELED(condition.waitFor(&mutex, std::bind(_isFlagSet, &flag), 20 * VDuration::MILLISECOND()), "condition variable wait times out in frozen time");
+            VInstant::unfreezeTime();
+        }
+
+        VCountingSemaphore semaphore;
+        VUNIT_ASSERT_FALSE_LABELED(semaphore.tryAcquire(), "counting semaphore empty");
+        VUNIT_ASSERT_FALSE_LABELED(semaphore.tryAcquire(20 * VDuration::MILLISECOND()), "counting semaphore timed acquire times out");
+        semaphore.release(2); // with nobody waiting; the permits must not be lost
+        VUNIT_ASSERT_EQUAL_LABELED(semaphore.getCount(), 2, "counting semaphore count");
+        VUNIT_ASSERT_TRUE_LABELED(semaphore.tryAcquire(), "counting semaphore acquire released permit");
+        semaphore.acquire();
+        VUNIT_ASSERT_EQUAL_LABELED(semaphore.getCount(), 0, "counting semaphore drained");
+
+        VTimerWheel wheel("VThreadsUnit.semaphoreWheel", VDuration::MILLISECOND());
+        wheel.start();
+        (void) wheel.schedule(20 * VDuration::MILLISECOND(), std::bind(_releasePermits, &semaphore, 1));
+        VUNIT_ASSERT_TRUE_LABELED(semaphore.tryAcquire(5 * VDuration::SECOND()), "counting semaphore woken by release");
+        wheel.stop();
+
+        // A wakeUp() that arrives before the consumer blocks must not be lost.
+        VMessageQueue queue;
+        queue.wakeUp();
+        const VInstant beforeBlocking;
+        VUNIT_ASSERT_TRUE_LABELED(queue.blockUntilNextMessage() == nullptr, "message queue wakeup returns no message");
+        VUNIT_ASSERT_TRUE_LABELED(VInstant() - beforeBlocking < VDuration::SECOND(), "message queue early wakeup not lost");
+    }
+
+    {
+        // thread placement scope
+        VThreadCPUList cpus = VThreadPlacement::parseCPUList(" 0-3, 8,10-11 ");
+        VUNIT_ASSERT_EQUAL_LABELED(static_cast<int>(cpus.size()), 7, "parse CPU list size");
+        VUNIT_ASSERT_EQUAL_LABELED(VThreadPlacement::formatCPUList(cpus), VString("0-3,8,10-11"), "format CPU list");
+        VUNIT_ASSERT_TRUE_LABELED(VThreadPlacement::parseCPUList(VString::EMPTY()).empty(), "parse empty CPU list");
+
+        bool threwOnBadList = false;
+        try {
+            (void) VThreadPlacement::parseCPUList("3-1");
+        } catch (const VRangeException&) {
+            threwOnBadList = true;
+        }
+        VUNIT_ASSERT_TRUE_LABELED(threwOnBadList, "parse reversed CPU range throws");
+
+        VString settingsText(VSTRING_COPY(
+                                 "<thread-placement>"
+                                 "<rule name-prefix=\"VThreadsUnit.placed\" cpus=\"0\" spread=\"true\" os-name=\"vunit-placed\" />"
+                                 "</thread-placement>"
+                             ));
+        VMemoryStream buf(settingsText.getDataBuffer(), VMemoryStream::kAllocatedByOperatorNew, false, settingsText.length(), settingsText.length());
+        VTextIOStream in(buf);
+        VSettings settings(in);
+        VThread::configurePlacement(*(settings.findNode("thread-placement")));
+
+        VThreadPool pool("VThreadsUnit.placed", 2);
+        pool.start();
+        VThread::sleep(100 * VDuration::MILLISECOND()); // the workers apply their placement as they start
+
+        int numPlacedInInfo = 0;
+        VBentoNode threadsInfo;
+        VThread::getThreadsInfo(threadsInfo);
+        for (VBentoNodePtrVector::const_iterator i = threadsInfo.getNodes().begin(); i != threadsInfo.getNodes().end(); ++i) {
+            if ((*i)->getString("placementRule", VString::EMPTY()) == "VThreadsUnit.placed") {
+                VUNIT_ASSERT_EQUAL_LABELED((*i)->getString("cpus", VString::EMPTY()), VString("0"), "placed thread CPUs in threads info");
+                VUNIT_ASSERT_EQUAL_LABELED((*i)->getString("osName", VString::EMPTY()), VString("vunit-placed"), "placed thread OS name in threads info");
+                ++numPlacedInInfo;
+            }
+        }
+
+        VUNIT_ASSERT_EQUAL_LABELED(numPlacedInInfo, 2, "placement rule applied to pool workers");
+        pool.stop();
+
+        VSettings noRules;
+        VThread::configurePlacement(noRules);
+    }
 
 }
 
@@ -13,7 +13,7 @@ License: MIT. See LICENSE.md in the Vault top level directory.
 #include "vunit.h"
 
 /**
-Unit test class for validating VThread, VMutex, VMutexLocker, VSemaphore.
+Unit test class for validating VThread, VMutex, VMutexLocker, VReadWriteLock, VConditionVariable, VSemaphore, VCountingSemaphore, VThreadPool, VTimerWheel.
 */
 class VThreadsUnit : public VUnit {
     public:
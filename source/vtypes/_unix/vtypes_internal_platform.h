@@ -52,6 +52,13 @@ inline off_t lseek(int fd, off_t offset, int whence) { return ::lseek(fd, offset
 inline int open(const char* path, int flags, mode_t mode) { return ::open(path, flags, mode); }
 inline FILE* fopen(const char* path, const char* mode) { return ::fopen(path, mode); }
 inline int close(int fd) { return ::close(fd); }
+inline int ftruncate(int fd, off_t length) { return ::ftruncate(fd, length); }
+#ifdef __linux__
+// FALLOC_FL_KEEP_SIZE reserves the blocks without changing the file length, so readers see only what was written.
+inline int fallocate(int fd, off_t length) { return ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, length); }
+#else
+inline int fallocate(int /*fd*/, off_t /*length*/) { errno = ENOSYS; return -1; }
+#endif
 inline int mkdir(const char* path, mode_t mode) { return ::mkdir(path, mode); }
 inline int rmdir(const char* path) { return ::rmdir(path); }
 inline int unlink(const char* path) { return ::unlink(path); }
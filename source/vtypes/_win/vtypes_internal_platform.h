@@ -184,6 +184,9 @@ inline int snprintf(char* buffer, size_t length, const char* format, ...) {
 
 #endif /* Compiler-specific inline core functions. */
 
+inline int ftruncate(int fd, off_t length) { return ::_chsize(fd, static_cast<long>(length)); }
+inline int fallocate(int /*fd*/, off_t /*length*/) { errno = ENOSYS; return -1; } // no equivalent to Linux fallocate() that keeps the file length
+
 }
 
 #endif /* vtypes_internal_platform_h */
@@ -209,7 +209,19 @@ set up for this platform build.
     #define VCOMPILER_CLANG
 #endif
 
+/*
+V_THREAD_LOCAL declares a variable that has a separate instance in each thread.
+It uses the compilers' native thread storage rather than C++11 thread_local, so
+it is limited to plain data such as pointers, integers, and char arrays.
+*/
+#ifdef _MSC_VER
+    #define V_THREAD_LOCAL __declspec(thread)
+#else
+    #define V_THREAD_LOCAL __thread
+#endif
+
 #include <memory> // C++11 shared_ptr
+#include <functional> // C++11 std::function; must precede the redefinition of new below
 #include <vector>
 #include <stdarg.h>
 #include <vector>
@@ -209,6 +209,39 @@ int VFileSystem::close(int fd) {
     return result;
 }
 
+// static
+int VFileSystem::ftruncate(int fd, off_t length) {
+    int     result = 0;
+    bool    done = false;
+
+    while (! done) {
+        result = vault::ftruncate(fd, length);
+
+        if ((result == 0) || (errno != EINTR))
+            done = true;
+    }
+
+    _debugCheck(result != -1);
+
+    return result;
+}
+
+// static
+int VFileSystem::fallocate(int fd, off_t length) {
+    int     result = 0;
+    bool    done = false;
+
+    while (! done) {
+        result = vault::fallocate(fd, length);
+
+        if ((result == 0) || (errno != EINTR))
+            done = true;
+    }
+
+    // Not supported is an expected outcome, not worth a breakpoint.
+    return result;
+}
+
 // static
 FILE* VFileSystem::fopen(const VString& nativePath, const char* mode) {
     if (nativePath.isEmpty())
@@ -40,6 +40,8 @@ class VFileSystem {
         static ssize_t  write(int fd, const void* buffer, size_t numBytes);                 ///< Calls POSIX write in a way that is safe even if a signal is caught inside the function.
         static off_t    lseek(int fd, off_t offset, int whence);                            ///< Calls POSIX lseek in a way that is safe even if a signal is caught inside the function.
         static int      close(int fd);                                                      ///< Calls POSIX close in a way that is safe even if a signal is caught inside the function.
+        static int      ftruncate(int fd, off_t length);                                    ///< Calls POSIX ftruncate in a way that is safe even if a signal is caught inside the function.
+        static int      fallocate(int fd, off_t length);                                    ///< Reserves disk space for the file without changing its length, where the platform supports it; otherwise returns -1 with errno ENOSYS.
 
         static FILE*    fopen(const VString& nativePath, const char* mode);                 ///< Calls POSIX fopen in a way that is safe even if a signal is caught inside the function.
         static int      fclose(FILE* f);                                                    ///< Calls POSIX fclose in a way that is safe even if a signal is caught inside the function.